@@ -0,0 +1,27 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/* Benchmark fixture: makes argv[1] allocations of varying sizes, keeping the
+ * last 64 live and leaking them at exit. */
+
+#include <stdlib.h>
+
+int main(int argc, char* argv[]) {
+  const long allocations = argc > 1 ? atol(argv[1]) : 1000000;
+  void* live[64] = {0};
+  for (long i = 0; i < allocations; ++i) {
+    void** const slot = &live[i % 64];
+    if (i % 16 == 15) {
+      *slot = realloc(*slot, (size_t)(i % 4096) + 1);
+      continue;
+    }
+    free(*slot);
+    *slot = i % 8 == 0 ? calloc(4, (size_t)(i % 256) + 1)
+                       : malloc((size_t)(i % 1024) + 1);
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/* Benchmark fixture: calls `hot` in a tight loop, argv[1] times. */
+
+#include <stdlib.h>
+
+volatile long sink = 0;
+
+__attribute__((noinline)) void hot(long i) { sink += i; }
+
+int main(int argc, char* argv[]) {
+  const long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+  for (long i = 0; i < iterations; ++i) {
+    hot(i);
+  }
+  return 0;
+}
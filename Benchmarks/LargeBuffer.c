@@ -0,0 +1,30 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/* Benchmark fixture: fills a buffer of argv[1] MiB and passes it to `ready`,
+ * where the benchmark stops it to read the buffer. */
+
+#include <stdlib.h>
+#include <string.h>
+
+__attribute__((noinline)) void ready(void* buffer, size_t size) {
+  __asm__ volatile("" : : "r"(buffer), "r"(size) : "memory");
+}
+
+int main(int argc, char* argv[]) {
+  const size_t size = (size_t)(argc > 1 ? atol(argv[1]) : 64) << 20;
+  unsigned char* const buffer = malloc(size);
+  if (buffer == NULL) {
+    return 1;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    buffer[i] = (unsigned char)(i * 131);
+  }
+  ready(buffer, size);
+  free(buffer);
+  return 0;
+}
@@ -0,0 +1,542 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/// \file
+/// Microbenchmarks of the debugger core against the fixture programs in this
+/// directory. Results are written to stdout as JSON, progress and errors to
+/// stderr.
+///
+/// usage: nebugger_bench [--quick]
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Breakpoint.hpp"
+#include "CallFrame.hpp"
+#include "DebugInfo.hpp"
+#include "Elf.hpp"
+#include "HeapTracker.hpp"
+#include "InstructionCache.hpp"
+#include "LineTable.hpp"
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+#include "ProcessBackend.hpp"
+#include "Registers.hpp"
+#include "Stepping.hpp"
+#include "Values.hpp"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  std::string name;
+  double value;
+  std::string unit;
+};
+
+double seconds_since(const Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Start `path` with `args` traced, it stops at its first instruction after
+/// exec.
+pid_t spawn(const std::string& path, const std::vector<std::string>& args) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    std::vector<char*> argv{const_cast<char*>(path.c_str())};
+    for (const auto& arg : args) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+    execv(path.c_str(), argv.data());
+    _exit(127);
+  }
+  return pid;
+}
+
+/// Start `path` with `args` stopped at its first instruction after exec.
+pid_t launch(const std::string& path, const std::vector<std::string>& args) {
+  const pid_t pid = spawn(path, args);
+  int status = 0;
+  if (pid == -1 or waitpid(pid, &status, 0) != pid or not WIFSTOPPED(status)) {
+    std::cerr << "Failed to launch '" << path << "'\n";
+    return -1;
+  }
+  return pid;
+}
+
+void terminate(const pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+}
+
+/// Address of `name` in the running fixture, 0 if it is unknown.
+std::intptr_t symbol_address(const nebugger::ElfFile& elf, const pid_t pid,
+                             const std::string& name) {
+  const nebugger::Symbol* const symbol = elf.find_symbol(name);
+  if (symbol == nullptr) {
+    std::cerr << "Fixture '" << elf.path() << "' has no symbol '" << name
+              << "'\n";
+    return 0;
+  }
+  const std::intptr_t load =
+      elf.is_position_independent()
+          ? nebugger::find_load_address(pid, elf.path())
+          : 0;
+  return static_cast<std::intptr_t>(symbol->address) + load;
+}
+
+/// Continue until `address` is hit, leaving the inferior stopped there.
+bool run_to(const pid_t pid, const std::intptr_t address) {
+  nebugger::Breakpoint breakpoint{pid, address};
+  breakpoint.enable();
+  int status = 0;
+  ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+  waitpid(pid, &status, 0);
+  breakpoint.disable();
+  if (not WIFSTOPPED(status) or WSTOPSIG(status) != SIGTRAP) {
+    return false;
+  }
+  user_regs_struct regs = nebugger::get_registers(pid);
+  regs.rip -= 1;
+  nebugger::set_registers(pid, regs);
+  return true;
+}
+
+void bench_breakpoint_hits(const bool quick, std::vector<Result>& results) {
+  const std::string path{NEBUGGER_FIXTURE_HOT_LOOP};
+  const long iterations = quick ? 20000 : 200000;
+  const pid_t pid = launch(path, {std::to_string(iterations)});
+  if (pid == -1) {
+    return;
+  }
+  const nebugger::ElfFile elf{path};
+  const std::intptr_t hot = symbol_address(elf, pid, "hot");
+  if (hot == 0) {
+    terminate(pid);
+    return;
+  }
+  nebugger::Breakpoint breakpoint{pid, hot};
+  breakpoint.enable();
+  long hits = 0;
+  int status = 0;
+  const auto start = Clock::now();
+  while (true) {
+    ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+    waitpid(pid, &status, 0);
+    if (not WIFSTOPPED(status)) {
+      break;
+    }
+    ++hits;
+    // Rewind over the int3 and step the original instruction.
+    user_regs_struct regs = nebugger::get_registers(pid);
+    regs.rip -= 1;
+    nebugger::set_registers(pid, regs);
+    breakpoint.disable();
+    ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
+    waitpid(pid, &status, 0);
+    breakpoint.enable();
+  }
+  const double elapsed = seconds_since(start);
+  if (hits != iterations) {
+    std::cerr << "Expected " << iterations << " breakpoint hits, got " << hits
+              << '\n';
+  }
+  results.push_back({"breakpoint_hits", hits / elapsed, "hits/s"});
+}
+
+void bench_registers(const bool quick, std::vector<Result>& results) {
+  const std::string path{NEBUGGER_FIXTURE_HOT_LOOP};
+  const pid_t pid = launch(path, {"1"});
+  if (pid == -1) {
+    return;
+  }
+  const long repetitions = quick ? 20000 : 200000;
+  auto start = Clock::now();
+  uint64_t checksum = 0;
+  for (long i = 0; i < repetitions; ++i) {
+    checksum += nebugger::get_registers(pid).rip;
+  }
+  results.push_back({"register_read_all",
+                     1.0e9 * seconds_since(start) / repetitions, "ns"});
+
+  const user_regs_struct regs = nebugger::get_registers(pid);
+  start = Clock::now();
+  for (long i = 0; i < repetitions; ++i) {
+    nebugger::set_registers(pid, regs);
+  }
+  results.push_back({"register_write_all",
+                     1.0e9 * seconds_since(start) / repetitions, "ns"});
+
+  start = Clock::now();
+  for (long i = 0; i < repetitions; ++i) {
+    checksum += nebugger::get_register_value(pid, nebugger::Register::rip);
+  }
+  results.push_back({"register_read_one",
+                     1.0e9 * seconds_since(start) / repetitions, "ns"});
+  if (checksum == 0) {
+    std::cerr << "Unexpected register values\n";
+  }
+  terminate(pid);
+}
+
+void bench_memory(const bool quick, std::vector<Result>& results) {
+  const std::string path{NEBUGGER_FIXTURE_LARGE_BUFFER};
+  const std::size_t mebibytes = quick ? 16 : 64;
+  const pid_t pid = launch(path, {std::to_string(mebibytes)});
+  if (pid == -1) {
+    return;
+  }
+  const nebugger::ElfFile elf{path};
+  const std::intptr_t ready = symbol_address(elf, pid, "ready");
+  if (ready == 0 or not run_to(pid, ready)) {
+    terminate(pid);
+    return;
+  }
+  const user_regs_struct regs = nebugger::get_registers(pid);
+  const auto buffer = static_cast<std::intptr_t>(regs.rdi);
+  const std::size_t size = regs.rsi;
+
+  nebugger::InferiorMemory memory{pid};
+  std::vector<uint8_t> chunk(1 << 20);
+  const struct {
+    const char* name;
+    nebugger::InferiorMemory::Backend backend;
+    // PTRACE_PEEKDATA is too slow to read the whole buffer.
+    std::size_t size;
+  } backends[] = {
+      {"memory_read_ptrace", nebugger::InferiorMemory::Backend::Ptrace,
+       size < (4u << 20) ? size : (4u << 20)},
+      {"memory_read_process_vm", nebugger::InferiorMemory::Backend::ProcessVm,
+       size},
+      {"memory_read_proc_mem", nebugger::InferiorMemory::Backend::ProcMem,
+       size},
+  };
+  for (const auto& backend : backends) {
+    const auto start = Clock::now();
+    bool success = true;
+    for (std::size_t offset = 0; offset < backend.size and success;
+         offset += chunk.size()) {
+      success = memory.read(buffer + static_cast<std::intptr_t>(offset),
+                            chunk.data(), chunk.size(), backend.backend);
+    }
+    const double elapsed = seconds_since(start);
+    if (not success or chunk[1] != 131) {
+      std::cerr << "Reading the buffer with " << backend.name << " failed\n";
+      continue;
+    }
+    results.push_back(
+        {backend.name, static_cast<double>(backend.size >> 20) / elapsed,
+         "MiB/s"});
+  }
+  terminate(pid);
+}
+
+void bench_breakpoint_insertion(const bool quick,
+                                std::vector<Result>& results) {
+  const std::string path{NEBUGGER_FIXTURE_HOT_LOOP};
+  const pid_t pid = launch(path, {"1"});
+  if (pid == -1) {
+    return;
+  }
+  const nebugger::ElfFile elf{path};
+  const std::intptr_t main_address = symbol_address(elf, pid, "main");
+  if (main_address == 0) {
+    terminate(pid);
+    return;
+  }
+  const long repetitions = quick ? 20000 : 200000;
+  const auto start = Clock::now();
+  for (long i = 0; i < repetitions; ++i) {
+    // Cycle through the bytes of main so the addresses differ.
+    nebugger::Breakpoint breakpoint{pid, main_address + i % 32};
+    breakpoint.enable();
+    breakpoint.disable();
+  }
+  results.push_back(
+      {"breakpoint_insert_remove", repetitions / seconds_since(start),
+       "breakpoints/s"});
+  terminate(pid);
+}
+
+void bench_startup(const bool quick, std::vector<Result>& results) {
+  const int launches = quick ? 5 : 20;
+  const std::string hot_loop{NEBUGGER_FIXTURE_HOT_LOOP};
+  double to_exec = 0.0;
+  double to_exit = 0.0;
+  for (int i = 0; i < launches; ++i) {
+    const auto start = Clock::now();
+    const pid_t pid = launch(hot_loop, {"0"});
+    if (pid == -1) {
+      return;
+    }
+    to_exec += seconds_since(start);
+    ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+    waitpid(pid, nullptr, 0);
+    to_exit += seconds_since(start);
+  }
+  results.push_back({"startup_to_exec", 1.0e6 * to_exec / launches, "us"});
+  results.push_back({"startup_to_exit", 1.0e6 * to_exit / launches, "us"});
+
+  // Starting many threads, and reading the resulting memory map
+  const std::string threads{NEBUGGER_FIXTURE_THREADS};
+  const nebugger::ElfFile elf{threads};
+  const int thread_count = 64;
+  double to_ready = 0.0;
+  double read_maps = 0.0;
+  for (int i = 0; i < launches; ++i) {
+    const auto start = Clock::now();
+    const pid_t pid = launch(threads, {std::to_string(thread_count)});
+    if (pid == -1) {
+      return;
+    }
+    const std::intptr_t ready = symbol_address(elf, pid, "ready");
+    if (ready == 0 or not run_to(pid, ready)) {
+      terminate(pid);
+      return;
+    }
+    to_ready += seconds_since(start);
+    const auto maps_start = Clock::now();
+    if (nebugger::read_memory_map(pid).empty()) {
+      std::cerr << "Failed to read the memory map\n";
+    }
+    read_maps += seconds_since(maps_start);
+    terminate(pid);
+  }
+  results.push_back({"startup_to_ready_64_threads",
+                     1.0e6 * to_ready / launches, "us"});
+  results.push_back({"read_memory_map_64_threads",
+                     1.0e6 * read_maps / launches, "us"});
+}
+
+void bench_next(const bool quick, std::vector<Result>& results) {
+  // `next` through the loop of the fixture, which steps over the call of
+  // `hot` on every other line, with each engine
+  const std::string path{NEBUGGER_FIXTURE_HOT_LOOP};
+  const std::size_t steps = quick ? 200 : 2000;
+  const nebugger::ElfFile elf{path};
+  const nebugger::LineTable lines{elf};
+  const struct {
+    const char* name;
+    nebugger::StepEngine engine;
+  } engines[] = {
+      {"next_single_step", nebugger::StepEngine::SingleStep},
+      {"next_range", nebugger::StepEngine::Range},
+  };
+  for (const auto& engine : engines) {
+    const pid_t pid = launch(path, {std::to_string(steps)});
+    if (pid == -1) {
+      return;
+    }
+    const std::intptr_t main_address = symbol_address(elf, pid, "main");
+    if (main_address == 0 or not run_to(pid, main_address)) {
+      terminate(pid);
+      return;
+    }
+    const std::intptr_t load =
+        elf.is_position_independent() ? nebugger::find_load_address(pid, path)
+                                      : 0;
+    nebugger::InferiorMemory memory{pid};
+    std::unordered_map<std::intptr_t, nebugger::Breakpoint> breakpoints{};
+    const nebugger::Stepper* stepper_pointer = nullptr;
+    nebugger::InstructionCache instructions{
+        memory, [&stepper_pointer](const std::intptr_t address,
+                                   uint8_t& byte) {
+          const auto& temporary = stepper_pointer->temporary_breakpoints();
+          const auto bp = temporary.find(address);
+          if (bp == temporary.end() or not bp->second.is_enabled()) {
+            return false;
+          }
+          byte = bp->second.saved_instruction();
+          return true;
+        }};
+    nebugger::Stepper stepper{pid, instructions, memory, breakpoints};
+    stepper_pointer = &stepper;
+    std::size_t stops = 0;
+    std::size_t done = 0;
+    const auto start = Clock::now();
+    for (; done < steps; ++done) {
+      const nebugger::StepResult result =
+          stepper.step_line(elf, lines, load, false, engine.engine);
+      if (result.status != nebugger::StepResult::Status::Done) {
+        break;
+      }
+      stops += result.stops;
+    }
+    const double elapsed = seconds_since(start);
+    terminate(pid);
+    if (done != steps) {
+      std::cerr << "Stepping with " << engine.name << " ended after " << done
+                << " of " << steps << " lines\n";
+      continue;
+    }
+    results.push_back(
+        {engine.name, 1.0e6 * elapsed / static_cast<double>(steps), "us"});
+    results.push_back({std::string{engine.name} + "_stops",
+                       static_cast<double>(stops) / static_cast<double>(steps),
+                       "stops/line"});
+  }
+}
+
+void bench_heap_tracker(const bool quick, std::vector<Result>& results) {
+  // The table of live allocations alone, keeping 64k of them live
+  const std::size_t operations = quick ? 1000000 : 10000000;
+  const std::size_t live = 65536;
+  nebugger::AllocationTable table{};
+  uint64_t size = 0;
+  uint32_t site = 0;
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < operations; ++i) {
+    const auto address = static_cast<std::intptr_t>(0x10000000 + 48 * i);
+    table.insert(address, i % 1024, static_cast<uint32_t>(i % 64));
+    if (i >= live) {
+      table.erase(address - static_cast<std::intptr_t>(48 * live), size, site);
+    }
+  }
+  results.push_back({"allocation_table_insert_erase",
+                     operations / seconds_since(start), "ops/s"});
+  results.push_back(
+      {"allocation_table_bytes_per_live_allocation",
+       static_cast<double>(table.memory_use()) / table.size(), "bytes"});
+
+  // Tracking a program that does little but allocate
+  const std::string path{NEBUGGER_FIXTURE_ALLOCATIONS};
+  const long allocations = quick ? 20000 : 200000;
+  const pid_t pid = spawn(path, {std::to_string(allocations)});
+  if (pid == -1) {
+    return;
+  }
+  nebugger::HeapTracker tracker{path, pid};
+  start = Clock::now();
+  if (tracker.run() != 0) {
+    std::cerr << "Failed to track the allocations of '" << path << "'\n";
+    return;
+  }
+  const double elapsed = seconds_since(start);
+  results.push_back({"heap_tracker_allocations",
+                     tracker.allocations() / elapsed, "allocations/s"});
+  results.push_back(
+      {"heap_tracker_traps", tracker.traps() / elapsed, "traps/s"});
+}
+
+void bench_print(const bool quick, std::vector<Result>& results) {
+  const std::string path{NEBUGGER_FIXTURE_STRUCTS};
+  const pid_t pid = launch(path, {});
+  if (pid == -1) {
+    return;
+  }
+  auto start = Clock::now();
+  const nebugger::ElfFile elf{path};
+  const nebugger::DebugInfo debug_info{elf};
+  const nebugger::CallFrameInfo call_frames{elf};
+  results.push_back(
+      {"print_index_debug_info", 1.0e3 * seconds_since(start), "ms"});
+  const std::intptr_t ready = symbol_address(elf, pid, "ready");
+  if (ready == 0 or not run_to(pid, ready)) {
+    terminate(pid);
+    return;
+  }
+  const std::intptr_t load =
+      elf.is_position_independent() ? nebugger::find_load_address(pid, path)
+                                    : 0;
+  nebugger::InferiorMemory memory{pid};
+  nebugger::LiveProcess process{pid, memory};
+  const user_regs_struct regs = nebugger::get_registers(pid);
+
+  // Printing an array of structures as far as the element limit, the first
+  // time compiling the layouts
+  nebugger::ValuePrinter printer{debug_info, call_frames};
+  std::ostringstream output{};
+  start = Clock::now();
+  if (not printer.print("particles", regs, process, load, output)) {
+    terminate(pid);
+    return;
+  }
+  results.push_back({"print_first_array_of_structs",
+                     1.0e3 * seconds_since(start), "ms"});
+  const std::size_t prints = quick ? 20 : 200;
+  start = Clock::now();
+  for (std::size_t i = 0; i < prints; ++i) {
+    output.str({});
+    printer.print("particles", regs, process, load, output);
+  }
+  results.push_back({"print_array_of_structs",
+                     1.0e3 * seconds_since(start) / prints, "ms"});
+  results.push_back({"print_output_bytes",
+                     static_cast<double>(output.str().size()), "bytes"});
+  start = Clock::now();
+  for (std::size_t i = 0; i < 100 * prints; ++i) {
+    output.str({});
+    printer.print("particles[99999].name", regs, process, load, output);
+  }
+  results.push_back({"print_member",
+                     1.0e6 * seconds_since(start) / (100 * prints), "us"});
+  terminate(pid);
+}
+
+void print_json(std::ostream& os, const std::vector<Result>& results,
+                const bool quick) {
+  utsname host{};
+  uname(&host);
+  os << "{\n  \"host\": \"" << host.nodename << "\",\n  \"kernel\": \""
+     << host.release << "\",\n  \"timestamp\": " << std::time(nullptr)
+     << ",\n  \"quick\": " << (quick ? "true" : "false")
+     << ",\n  \"benchmarks\": [\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    os << "    {\"name\": \"" << results[i].name
+       << "\", \"value\": " << results[i].value << ", \"unit\": \""
+       << results[i].unit << "\"}" << (i + 1 < results.size() ? "," : "")
+       << '\n';
+  }
+  os << "  ]\n}\n";
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool quick = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string{argv[i]} == "--quick") {
+      quick = true;
+    } else {
+      std::cerr << "usage: nebugger_bench [--quick]\n";
+      return 1;
+    }
+  }
+  std::vector<Result> results{};
+  const struct {
+    const char* name;
+    void (*run)(bool, std::vector<Result>&);
+  } benchmarks[] = {
+      {"breakpoint hits", bench_breakpoint_hits},
+      {"registers", bench_registers},
+      {"memory", bench_memory},
+      {"breakpoint insertion", bench_breakpoint_insertion},
+      {"startup", bench_startup},
+      {"next", bench_next},
+      {"heap tracker", bench_heap_tracker},
+      {"print", bench_print},
+  };
+  for (const auto& benchmark : benchmarks) {
+    std::cerr << "Running " << benchmark.name << " benchmarks\n";
+    benchmark.run(quick, results);
+  }
+  print_json(std::cout, results, quick);
+  return 0;
+}
@@ -0,0 +1,40 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/* Benchmark fixture: fills a global array of structures and stops in
+ * `ready`, where the benchmark prints it by its debugging information. */
+
+#include <stddef.h>
+
+struct particle {
+  double position[3];
+  double velocity[3];
+  const char* name;
+  unsigned species : 4;
+  unsigned charged : 1;
+  int id;
+};
+
+struct particle particles[100000];
+
+__attribute__((noinline)) void ready(struct particle* first, size_t count) {
+  __asm__ volatile("" : : "r"(first), "r"(count) : "memory");
+}
+
+int main(void) {
+  const size_t count = sizeof(particles) / sizeof(particles[0]);
+  for (size_t i = 0; i < count; ++i) {
+    particles[i].position[0] = (double)i;
+    particles[i].velocity[1] = 0.5 * (double)i;
+    particles[i].name = i % 2 == 0 ? "electron" : "proton";
+    particles[i].species = (unsigned)(i % 16);
+    particles[i].charged = 1;
+    particles[i].id = (int)i;
+  }
+  ready(particles, count);
+  return 0;
+}
@@ -0,0 +1,48 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+/* Benchmark fixture: starts argv[1] threads, each with its own stack and a
+ * touched heap block, waits until all run and then calls `ready`. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_barrier_t started;
+static pthread_barrier_t finish;
+
+__attribute__((noinline)) void ready(long threads) {
+  __asm__ volatile("" : : "r"(threads) : "memory");
+}
+
+static void* worker(void* argument) {
+  (void)argument;
+  char* const block = malloc(1 << 16);
+  memset(block, 1, 1 << 16);
+  pthread_barrier_wait(&started);
+  pthread_barrier_wait(&finish);
+  free(block);
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+  const long count = argc > 1 ? atol(argv[1]) : 64;
+  pthread_t* const threads = malloc(sizeof(pthread_t) * (size_t)count);
+  pthread_barrier_init(&started, NULL, (unsigned)count + 1);
+  pthread_barrier_init(&finish, NULL, (unsigned)count + 1);
+  for (long i = 0; i < count; ++i) {
+    pthread_create(&threads[i], NULL, worker, NULL);
+  }
+  pthread_barrier_wait(&started);
+  ready(count);
+  pthread_barrier_wait(&finish);
+  for (long i = 0; i < count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  return 0;
+}
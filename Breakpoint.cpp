@@ -10,13 +10,23 @@
 #include <iostream>
 #include <sys/ptrace.h>
 
+#include "Stats.hpp"
+
 namespace nebugger {
 Breakpoint::Breakpoint(const pid_t pid, const std::intptr_t address)
     : pid_(pid), address_(address) {}
 
+Breakpoint::Breakpoint(const pid_t pid, const std::intptr_t address,
+                       const uint8_t saved_instruction)
+    : pid_(pid),
+      address_(address),
+      enabled_(true),
+      saved_instruction_(saved_instruction) {}
+
 Breakpoint& Breakpoint::enable() {
   // Read/PEEK data at the address from the process
-  const long data_at_address = ptrace(PTRACE_PEEKDATA, pid_, address_, nullptr);
+  const long data_at_address = timed_ptrace(
+      Probe::PtracePeek, PTRACE_PEEKDATA, pid_, address_, nullptr);
   if (data_at_address == -1) {
     std::cerr << "Failed to set breakpoint at address '" << std::hex << address_
               << "' during reading of address.\n";
@@ -40,7 +50,8 @@ Breakpoint& Breakpoint::enable() {
   //    instruction.
   const uint64_t data_with_int3 = ((data_at_address & ~0xff) | int3);
   // Inject the new instruction back into the process
-  if (ptrace(PTRACE_POKEDATA, pid_, address_, data_with_int3) == -1) {
+  if (timed_ptrace(Probe::PtracePoke, PTRACE_POKEDATA, pid_, address_,
+                   data_with_int3) == -1) {
     std::cerr << "Failed to set breakpoint at address '" << std::hex << address_
               << "' during writing of breakpoint to address.\n";
     return *this;
@@ -51,7 +62,8 @@ Breakpoint& Breakpoint::enable() {
 }
 
 Breakpoint& Breakpoint::disable() {
-  const long data_at_address = ptrace(PTRACE_PEEKDATA, pid_, address_, nullptr);
+  const long data_at_address = timed_ptrace(
+      Probe::PtracePeek, PTRACE_PEEKDATA, pid_, address_, nullptr);
   if (data_at_address == -1) {
     std::cerr << "Failed to disable breakpoint at address '" << std::hex
               << address_ << "' during reading of address.\n";
@@ -60,7 +72,8 @@ Breakpoint& Breakpoint::disable() {
   const uint64_t restored_instructions =
       ((data_at_address & ~0xff) | saved_instruction_);
   // Inject the new instruction back into the process
-  if (ptrace(PTRACE_POKEDATA, pid_, address_, restored_instructions) == -1) {
+  if (timed_ptrace(Probe::PtracePoke, PTRACE_POKEDATA, pid_, address_,
+                   restored_instructions) == -1) {
     std::cerr << "Failed to disable breakpoint at address '" << std::hex
               << address_ << "' during writing of instructions to address.\n";
     return *this;
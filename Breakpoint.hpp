@@ -15,12 +15,17 @@ namespace nebugger {
 class Breakpoint {
  public:
   Breakpoint(pid_t pid, std::intptr_t address);
+  /// A breakpoint already inserted at `address`, e.g. inherited by a forked
+  /// child, over the original byte `saved_instruction`.
+  Breakpoint(pid_t pid, std::intptr_t address, uint8_t saved_instruction);
 
   Breakpoint& enable();
   Breakpoint& disable();
 
   bool is_enabled() const noexcept { return enabled_; }
   std::intptr_t address() const noexcept { return address_; }
+  /// The original byte at the address, valid while the breakpoint is enabled.
+  uint8_t saved_instruction() const noexcept { return saved_instruction_; }
 
  private:
   pid_t pid_;
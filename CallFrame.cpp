@@ -0,0 +1,348 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "CallFrame.hpp"
+
+#include <algorithm>
+#include <elf.h>
+#include <string_view>
+#include <unordered_map>
+
+#include "DwarfReader.hpp"
+#include "Elf.hpp"
+
+namespace nebugger {
+namespace {
+// Pointer encodings of `.eh_frame`, the format in the low bits and how the
+// value is applied in the high bits
+enum : uint8_t {
+  DW_EH_PE_absptr = 0x00,
+  DW_EH_PE_uleb128 = 0x01,
+  DW_EH_PE_udata2 = 0x02,
+  DW_EH_PE_udata4 = 0x03,
+  DW_EH_PE_udata8 = 0x04,
+  DW_EH_PE_sleb128 = 0x09,
+  DW_EH_PE_sdata2 = 0x0a,
+  DW_EH_PE_sdata4 = 0x0b,
+  DW_EH_PE_sdata8 = 0x0c,
+  DW_EH_PE_pcrel = 0x10,
+  DW_EH_PE_omit = 0xff
+};
+
+// Call frame instructions, the first three with the operand in the low six
+// bits
+enum : uint8_t {
+  DW_CFA_advance_loc = 0x40,
+  DW_CFA_offset = 0x80,
+  DW_CFA_restore = 0xc0,
+  DW_CFA_nop = 0x00,
+  DW_CFA_set_loc = 0x01,
+  DW_CFA_advance_loc1 = 0x02,
+  DW_CFA_advance_loc2 = 0x03,
+  DW_CFA_advance_loc4 = 0x04,
+  DW_CFA_offset_extended = 0x05,
+  DW_CFA_restore_extended = 0x06,
+  DW_CFA_undefined = 0x07,
+  DW_CFA_same_value = 0x08,
+  DW_CFA_register = 0x09,
+  DW_CFA_remember_state = 0x0a,
+  DW_CFA_restore_state = 0x0b,
+  DW_CFA_def_cfa = 0x0c,
+  DW_CFA_def_cfa_register = 0x0d,
+  DW_CFA_def_cfa_offset = 0x0e,
+  DW_CFA_def_cfa_expression = 0x0f,
+  DW_CFA_expression = 0x10,
+  DW_CFA_offset_extended_sf = 0x11,
+  DW_CFA_def_cfa_sf = 0x12,
+  DW_CFA_def_cfa_offset_sf = 0x13,
+  DW_CFA_val_offset = 0x14,
+  DW_CFA_val_offset_sf = 0x15,
+  DW_CFA_val_expression = 0x16,
+  DW_CFA_GNU_args_size = 0x2e,
+  DW_CFA_GNU_negative_offset_extended = 0x2f
+};
+
+// Read a pointer with `encoding`, where `address` is the address of the
+// field for pc-relative pointers
+uint64_t read_pointer(DwarfReader& reader, const uint8_t encoding,
+                      const uint64_t address) {
+  uint64_t value = 0;
+  switch (encoding & 0x0f) {
+    case DW_EH_PE_absptr:
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8:
+      value = reader.read<uint64_t>();
+      break;
+    case DW_EH_PE_uleb128:
+      value = reader.read_uleb128();
+      break;
+    case DW_EH_PE_udata2:
+      value = reader.read<uint16_t>();
+      break;
+    case DW_EH_PE_udata4:
+      value = reader.read<uint32_t>();
+      break;
+    case DW_EH_PE_sleb128:
+      value = static_cast<uint64_t>(reader.read_sleb128());
+      break;
+    case DW_EH_PE_sdata2:
+      value = static_cast<uint64_t>(int64_t{reader.read<int16_t>()});
+      break;
+    case DW_EH_PE_sdata4:
+      value = static_cast<uint64_t>(int64_t{reader.read<int32_t>()});
+      break;
+    default:
+      break;
+  }
+  return (encoding & 0x70) == DW_EH_PE_pcrel ? value + address : value;
+}
+}  // namespace
+
+CallFrameInfo::CallFrameInfo(const ElfFile& elf) {
+  const Elf64_Shdr* const section = elf.find_section(".eh_frame");
+  if (section == nullptr or section->sh_type == SHT_NOBITS) {
+    return;
+  }
+  data_ = elf.section_data(*section);
+  size_ = section->sh_size;
+  address_ = section->sh_addr;
+
+  std::unordered_map<uint64_t, uint32_t> cie_indices{};
+  const auto read_cie = [this, &cie_indices](const uint64_t offset) {
+    const auto known = cie_indices.find(offset);
+    if (known != cie_indices.end()) {
+      return known->second;
+    }
+    DwarfReader reader{data_ + offset, data_ + size_};
+    bool is_64bit = false;
+    const uint64_t length = reader.read_unit_length(is_64bit);
+    const uint8_t* const end =
+        reader.position() + std::min<uint64_t>(length, reader.remaining());
+    reader.read<uint32_t>();  // CIE id
+    const auto version = reader.read<uint8_t>();
+    const std::string_view augmentation = reader.read_string();
+    if (augmentation.find("eh") != std::string_view::npos) {
+      reader.skip(8);
+    }
+    Cie cie{};
+    cie.code_alignment = reader.read_uleb128();
+    cie.data_alignment = reader.read_sleb128();
+    if (version == 1) {
+      reader.read<uint8_t>();  // return address register
+    } else {
+      reader.read_uleb128();
+    }
+    cie.pointer_encoding = DW_EH_PE_absptr;
+    cie.has_augmentation_data =
+        not augmentation.empty() and augmentation[0] == 'z';
+    if (cie.has_augmentation_data) {
+      const uint64_t augmentation_length = reader.read_uleb128();
+      const uint8_t* const augmentation_end =
+          reader.position() + augmentation_length;
+      for (const char c : augmentation.substr(1)) {
+        if (c == 'R') {
+          cie.pointer_encoding = reader.read<uint8_t>();
+        } else if (c == 'P') {
+          const auto encoding = reader.read<uint8_t>();
+          read_pointer(reader, encoding, 0);
+        } else if (c == 'L') {
+          reader.read<uint8_t>();
+        } else if (c != 'S' and c != 'B') {
+          break;
+        }
+      }
+      reader.skip(static_cast<std::size_t>(
+          std::max(augmentation_end, reader.position()) - reader.position()));
+    }
+    cie.instructions = reader.position();
+    cie.instructions_end = std::max(end, cie.instructions);
+    if (reader.overflow()) {
+      cie.instructions_end = cie.instructions;
+    }
+    const auto index = static_cast<uint32_t>(cies_.size());
+    cies_.push_back(cie);
+    cie_indices.emplace(offset, index);
+    return index;
+  };
+
+  DwarfReader reader{data_, data_ + size_};
+  while (not reader.at_end()) {
+    bool is_64bit = false;
+    const uint64_t length = reader.read_unit_length(is_64bit);
+    // A zero length terminates the section.
+    if (length == 0 or reader.overflow() or length > reader.remaining()) {
+      break;
+    }
+    const uint64_t end = reader.offset() + length;
+    const uint64_t id_offset = reader.offset();
+    const auto id = reader.read<uint32_t>();
+    if (id != 0 and id <= id_offset) {
+      // A frame description entry, pointing back to its CIE
+      const uint32_t cie_index = read_cie(id_offset - id);
+      const Cie& cie = cies_[cie_index];
+      Fde fde{};
+      fde.cie = cie_index;
+      fde.begin = read_pointer(reader, cie.pointer_encoding,
+                               address_ + reader.offset());
+      fde.end = fde.begin + read_pointer(reader, cie.pointer_encoding & 0x0f,
+                                         0);
+      if (cie.has_augmentation_data) {
+        reader.skip(reader.read_uleb128());
+      }
+      fde.instructions = reader.position();
+      fde.instructions_end = data_ + end;
+      // Entries of discarded functions are left at address 0
+      if (not reader.overflow() and fde.begin != 0 and
+          fde.instructions <= fde.instructions_end and
+          cie.pointer_encoding != DW_EH_PE_omit) {
+        fdes_.push_back(fde);
+      }
+    }
+    reader.skip(static_cast<std::size_t>(end - reader.offset()));
+  }
+  std::sort(fdes_.begin(), fdes_.end(),
+            [](const Fde& a, const Fde& b) { return a.begin < b.begin; });
+}
+
+bool CallFrameInfo::find_cfa_rule(const uint64_t address,
+                                  CfaRule& rule) const {
+  auto it = std::upper_bound(
+      fdes_.begin(), fdes_.end(), address,
+      [](const uint64_t a, const Fde& fde) { return a < fde.begin; });
+  if (it == fdes_.begin() or address >= (it - 1)->end) {
+    return false;
+  }
+  const Fde& fde = *(it - 1);
+  const Cie& cie = cies_[fde.cie];
+
+  rule = CfaRule{0, 0};
+  bool is_expression = false;
+  std::vector<std::pair<CfaRule, bool>> remembered{};
+  uint64_t location = fde.begin;
+  // Run the instructions of the CIE and then those of the FDE until they
+  // advance past `address`. Returns false once they do.
+  const auto run = [&](const uint8_t* const begin, const uint8_t* const end) {
+    DwarfReader reader{begin, end};
+    const auto advance = [&location, address](const uint64_t delta) {
+      location += delta;
+      return location <= address;
+    };
+    while (not reader.at_end() and not reader.overflow()) {
+      const auto opcode = reader.read<uint8_t>();
+      const uint8_t operand = opcode & 0x3f;
+      switch (opcode & 0xc0) {
+        case DW_CFA_advance_loc:
+          if (not advance(operand * cie.code_alignment)) {
+            return false;
+          }
+          continue;
+        case DW_CFA_offset:
+          reader.read_uleb128();
+          continue;
+        case DW_CFA_restore:
+          continue;
+        default:
+          break;
+      }
+      switch (opcode) {
+        case DW_CFA_nop:
+          break;
+        case DW_CFA_set_loc: {
+          const uint64_t target = read_pointer(
+              reader, cie.pointer_encoding,
+              address_ + static_cast<uint64_t>(reader.position() - data_));
+          if (target > address) {
+            return false;
+          }
+          location = target;
+          break;
+        }
+        case DW_CFA_advance_loc1:
+          if (not advance(reader.read<uint8_t>() * cie.code_alignment)) {
+            return false;
+          }
+          break;
+        case DW_CFA_advance_loc2:
+          if (not advance(reader.read<uint16_t>() * cie.code_alignment)) {
+            return false;
+          }
+          break;
+        case DW_CFA_advance_loc4:
+          if (not advance(reader.read<uint32_t>() * cie.code_alignment)) {
+            return false;
+          }
+          break;
+        case DW_CFA_offset_extended:
+        case DW_CFA_register:
+        case DW_CFA_val_offset:
+        case DW_CFA_GNU_negative_offset_extended:
+          reader.read_uleb128();
+          reader.read_uleb128();
+          break;
+        case DW_CFA_offset_extended_sf:
+        case DW_CFA_val_offset_sf:
+          reader.read_uleb128();
+          reader.read_sleb128();
+          break;
+        case DW_CFA_restore_extended:
+        case DW_CFA_undefined:
+        case DW_CFA_same_value:
+        case DW_CFA_GNU_args_size:
+          reader.read_uleb128();
+          break;
+        case DW_CFA_remember_state:
+          remembered.emplace_back(rule, is_expression);
+          break;
+        case DW_CFA_restore_state:
+          if (not remembered.empty()) {
+            rule = remembered.back().first;
+            is_expression = remembered.back().second;
+            remembered.pop_back();
+          }
+          break;
+        case DW_CFA_def_cfa:
+          rule.register_number = reader.read_uleb128();
+          rule.offset = static_cast<int64_t>(reader.read_uleb128());
+          is_expression = false;
+          break;
+        case DW_CFA_def_cfa_sf:
+          rule.register_number = reader.read_uleb128();
+          rule.offset = reader.read_sleb128() * cie.data_alignment;
+          is_expression = false;
+          break;
+        case DW_CFA_def_cfa_register:
+          rule.register_number = reader.read_uleb128();
+          break;
+        case DW_CFA_def_cfa_offset:
+          rule.offset = static_cast<int64_t>(reader.read_uleb128());
+          break;
+        case DW_CFA_def_cfa_offset_sf:
+          rule.offset = reader.read_sleb128() * cie.data_alignment;
+          break;
+        case DW_CFA_def_cfa_expression:
+          is_expression = true;
+          reader.skip(reader.read_uleb128());
+          break;
+        case DW_CFA_expression:
+        case DW_CFA_val_expression:
+          reader.read_uleb128();
+          reader.skip(reader.read_uleb128());
+          break;
+        default:
+          // An unknown instruction, whose operands cannot be skipped
+          is_expression = true;
+          return false;
+      }
+    }
+    return true;
+  };
+  if (run(cie.instructions, cie.instructions_end)) {
+    run(fde.instructions, fde.instructions_end);
+  }
+  return not is_expression;
+}
+}  // namespace nebugger
@@ -0,0 +1,69 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nebugger {
+class ElfFile;
+
+/// How the canonical frame address (CFA), the value of the stack pointer
+/// before the call of the current function, is computed: the value of the
+/// DWARF register `register_number` plus `offset`.
+struct CfaRule {
+  uint64_t register_number;
+  int64_t offset;
+};
+
+/// The CFA rules of the functions of an ELF file, from `.eh_frame`.
+///
+/// The frame description entries are indexed by address on construction
+/// and the call frame instructions of one are run up to the address when
+/// its rule is needed. Only the rule for the CFA is tracked, the rules for
+/// the other registers are skipped.
+class CallFrameInfo {
+ public:
+  CallFrameInfo() = default;
+  explicit CallFrameInfo(const ElfFile& elf);
+
+  /// Set `rule` to the CFA rule at `address`, relative to the load address.
+  /// Returns false if no entry covers the address or the CFA is computed by
+  /// an expression.
+  bool find_cfa_rule(uint64_t address, CfaRule& rule) const;
+
+ private:
+  struct Cie {
+    uint64_t code_alignment;
+    int64_t data_alignment;
+    uint8_t pointer_encoding;
+    // Whether the entries have augmentation data, augmentation "z..."
+    bool has_augmentation_data;
+    const uint8_t* instructions;
+    const uint8_t* instructions_end;
+  };
+
+  struct Fde {
+    uint64_t begin;
+    uint64_t end;
+    // Index into `cies_`
+    uint32_t cie;
+    const uint8_t* instructions;
+    const uint8_t* instructions_end;
+  };
+
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+  // Address of the section, for pc-relative pointers
+  uint64_t address_{0};
+  std::vector<Cie> cies_{};
+  // Sorted by address
+  std::vector<Fde> fdes_{};
+};
+}  // namespace nebugger
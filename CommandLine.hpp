@@ -0,0 +1,108 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <system_error>
+
+namespace nebugger {
+/// The whitespace separated words of a command line as views into the line,
+/// which must outlive the `CommandArgs`. Splitting never allocates, words
+/// beyond `max_size` are dropped and reported by `overflow()`.
+class CommandArgs {
+ public:
+  static constexpr std::size_t max_size = 16;
+
+  explicit CommandArgs(const std::string_view line) noexcept : line_(line) {
+    std::size_t position = 0;
+    while (true) {
+      position = line.find_first_not_of(" \t", position);
+      if (position == std::string_view::npos) {
+        break;
+      }
+      const std::size_t end =
+          std::min(line.find_first_of(" \t", position), line.size());
+      if (size_ == max_size) {
+        overflow_ = true;
+        break;
+      }
+      words_[size_++] = line.substr(position, end - position);
+      position = end;
+    }
+  }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool overflow() const noexcept { return overflow_; }
+
+  /// The word at `index`, or an empty view if there are fewer words.
+  std::string_view operator[](const std::size_t index) const noexcept {
+    return index < size_ ? words_[index] : std::string_view{};
+  }
+
+  /// The line from the start of the word at `index` to its end, for commands
+  /// whose arguments may contain spaces.
+  std::string_view rest(const std::size_t index) const noexcept {
+    if (index >= size_) {
+      return {};
+    }
+    return line_.substr(
+        static_cast<std::size_t>(words_[index].data() - line_.data()));
+  }
+
+ private:
+  std::string_view line_;
+  std::array<std::string_view, max_size> words_{};
+  std::size_t size_{0};
+  bool overflow_{false};
+};
+
+/// Parse `text` as an integer, hexadecimal if it starts with `0x` and decimal
+/// otherwise, optionally preceded by a minus sign. Returns false if `text` is
+/// not entirely a number or does not fit into 64 bits or, for types narrower
+/// than that, into the range of `T`. 64-bit values wrap as two's complement.
+template <typename T>
+bool parse_integer(std::string_view text, T& value) noexcept {
+  const bool negative = not text.empty() and text.front() == '-';
+  if (negative) {
+    text.remove_prefix(1);
+  }
+  int base = 10;
+  if (text.size() > 2 and text[0] == '0' and
+      (text[1] == 'x' or text[1] == 'X')) {
+    base = 16;
+    text.remove_prefix(2);
+  }
+  uint64_t magnitude = 0;
+  const auto result = std::from_chars(text.data(), text.data() + text.size(),
+                                      magnitude, base);
+  if (text.empty() or result.ec != std::errc{} or
+      result.ptr != text.data() + text.size()) {
+    return false;
+  }
+  if constexpr (sizeof(T) < sizeof(uint64_t)) {
+    const auto lowest = static_cast<uint64_t>(
+        -static_cast<int64_t>(std::numeric_limits<T>::min()));
+    if (negative ? magnitude > lowest
+                 : magnitude > static_cast<uint64_t>(
+                                   std::numeric_limits<T>::max())) {
+      return false;
+    }
+  }
+  value = static_cast<T>(negative ? ~magnitude + 1 : magnitude);
+  return true;
+}
+}  // namespace nebugger
@@ -0,0 +1,126 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "ControlFlow.hpp"
+
+#include <algorithm>
+#include <elf.h>
+
+#include "Elf.hpp"
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+namespace {
+// Decode [start, end) whose bytes are at `text` and append its blocks.
+void add_blocks(const uint8_t* const text, const uint64_t start,
+                const uint64_t end, const int64_t function,
+                std::vector<BasicBlock>& blocks) {
+  std::vector<uint64_t> boundaries{};
+  std::vector<uint64_t> leaders{start};
+  uint64_t address = start;
+  bool previous_ends_block = false;
+  while (address < end) {
+    const Instruction insn =
+        decode_instruction(text + (address - start), end - address,
+                           static_cast<std::intptr_t>(address));
+    if (not insn.valid) {
+      // Skip undecodable bytes, they are most likely data or padding.
+      ++address;
+      previous_ends_block = true;
+      continue;
+    }
+    if (previous_ends_block) {
+      leaders.push_back(address);
+    }
+    boundaries.push_back(address);
+    if (insn.relative_branch) {
+      const auto target = static_cast<uint64_t>(insn.branch_target());
+      if (target >= start and target < end) {
+        leaders.push_back(target);
+      }
+    }
+    previous_ends_block = insn.flow == FlowKind::Jump or
+                          insn.flow == FlowKind::ConditionalJump or
+                          insn.flow == FlowKind::Return or
+                          insn.flow == FlowKind::IndirectJump or
+                          insn.flow == FlowKind::Trap;
+    address += insn.length;
+  }
+
+  // Branch targets that do not land on an instruction boundary of the linear
+  // decoding cannot be patched safely.
+  std::sort(leaders.begin(), leaders.end());
+  leaders.erase(std::unique(leaders.begin(), leaders.end()), leaders.end());
+  for (const uint64_t leader : leaders) {
+    if (std::binary_search(boundaries.begin(), boundaries.end(), leader)) {
+      blocks.push_back(BasicBlock{leader, function});
+    }
+  }
+}
+}  // namespace
+
+std::vector<BasicBlock> find_basic_blocks(const ElfFile& elf) {
+  std::vector<BasicBlock> blocks{};
+  if (not elf.is_valid()) {
+    return blocks;
+  }
+  const auto& header = elf.header();
+  const auto* const sections = reinterpret_cast<const Elf64_Shdr*>(
+      reinterpret_cast<const uint8_t*>(&header) + header.e_shoff);
+  const auto find_text = [&header, sections](const uint64_t address,
+                                             const uint64_t size)
+      -> const Elf64_Shdr* {
+    for (std::size_t i = 0; i < header.e_shnum; ++i) {
+      const Elf64_Shdr& section = sections[i];
+      if ((section.sh_flags & SHF_EXECINSTR) != 0 and
+          section.sh_type == SHT_PROGBITS and address >= section.sh_addr and
+          address + size <= section.sh_addr + section.sh_size) {
+        return &section;
+      }
+    }
+    return nullptr;
+  };
+
+  const auto& symbols = elf.symbols();
+  uint64_t previous_function = 0;
+  for (std::size_t i = 0; i < symbols.size(); ++i) {
+    const Symbol& symbol = symbols[i];
+    // Aliases share an address, only decode the first one.
+    if (not symbol.is_function or symbol.size == 0 or
+        (i > 0 and symbol.address == previous_function)) {
+      continue;
+    }
+    const Elf64_Shdr* const section = find_text(symbol.address, symbol.size);
+    if (section == nullptr) {
+      continue;
+    }
+    previous_function = symbol.address;
+    add_blocks(elf.section_data(*section) + (symbol.address - section->sh_addr),
+               symbol.address, symbol.address + symbol.size,
+               static_cast<int64_t>(i), blocks);
+  }
+
+  if (blocks.empty()) {
+    // Stripped binary, decode the text sections as a whole.
+    const Elf64_Shdr* const text = elf.find_section(".text");
+    if (text != nullptr) {
+      add_blocks(elf.section_data(*text), text->sh_addr,
+                 text->sh_addr + text->sh_size, -1, blocks);
+    }
+  }
+  std::sort(blocks.begin(), blocks.end(),
+            [](const BasicBlock& a, const BasicBlock& b) {
+              return a.address < b.address;
+            });
+  blocks.erase(std::unique(blocks.begin(), blocks.end(),
+                           [](const BasicBlock& a, const BasicBlock& b) {
+                             return a.address == b.address;
+                           }),
+               blocks.end());
+  return blocks;
+}
+}  // namespace nebugger
@@ -0,0 +1,34 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nebugger {
+class ElfFile;
+
+/// A basic block found by statically decoding the text of an ELF file.
+struct BasicBlock {
+  // Address of the first instruction, relative to the load address
+  uint64_t address;
+  // Index into `ElfFile::symbols()` of the function containing the block,
+  // or -1 if the text was decoded without symbols
+  int64_t function;
+};
+
+/// Find the basic blocks of all functions in `elf`, sorted by address.
+///
+/// Every function symbol is decoded linearly. Block leaders are the function
+/// entry, the targets of relative branches inside the function, and the
+/// instructions following a jump, conditional jump or return. Calls do not
+/// end a block. If the file has no function symbols the executable sections
+/// are decoded as a whole instead.
+std::vector<BasicBlock> find_basic_blocks(const ElfFile& elf);
+}  // namespace nebugger
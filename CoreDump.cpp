@@ -0,0 +1,423 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "CoreDump.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <signal.h>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sys/procfs.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+#include "Registers.hpp"
+
+namespace nebugger {
+namespace {
+constexpr std::size_t page_size = 4096;
+// Size of each bulk read, and number of chunks that may wait for the writer
+// before reading stalls
+constexpr std::size_t chunk_size = 8 << 20;
+constexpr std::size_t chunks_in_flight = 8;
+
+uint64_t align_up(const uint64_t value, const uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void append_note(std::vector<uint8_t>& notes, const uint32_t type,
+                 const void* const data, const std::size_t size) {
+  const char name[] = "CORE";
+  Elf64_Nhdr header{};
+  header.n_namesz = sizeof(name);
+  header.n_descsz = static_cast<Elf64_Word>(size);
+  header.n_type = type;
+  const auto* const header_bytes = reinterpret_cast<const uint8_t*>(&header);
+  notes.insert(notes.end(), header_bytes, header_bytes + sizeof(header));
+  notes.insert(notes.end(), name, name + sizeof(name));
+  notes.resize(align_up(notes.size(), 4));
+  const auto* const bytes = static_cast<const uint8_t*>(data);
+  notes.insert(notes.end(), bytes, bytes + size);
+  notes.resize(align_up(notes.size(), 4));
+}
+
+std::string read_proc_file(const pid_t pid, const char* const name) {
+  std::ifstream file{"/proc/" + std::to_string(pid) + "/" + name,
+                     std::ios::binary};
+  return std::string{std::istreambuf_iterator<char>{file},
+                     std::istreambuf_iterator<char>{}};
+}
+
+std::vector<uint8_t> build_notes(const pid_t pid,
+                                 const std::vector<MemoryRegion>& regions) {
+  std::vector<uint8_t> notes{};
+
+  elf_prstatus status{};
+  status.pr_pid = pid;
+  status.pr_ppid = getpid();
+  status.pr_pgrp = getpgid(pid);
+  status.pr_sid = getsid(pid);
+  const user_regs_struct regs = get_registers(pid);
+  static_assert(sizeof(status.pr_reg) == sizeof(regs),
+                "elf_gregset_t must match user_regs_struct");
+  std::memcpy(&status.pr_reg, &regs, sizeof(regs));
+  siginfo_t signal_info{};
+  if (ptrace(PTRACE_GETSIGINFO, pid, nullptr, &signal_info) != -1) {
+    status.pr_cursig = static_cast<short>(signal_info.si_signo);
+    status.pr_info.si_signo = signal_info.si_signo;
+    status.pr_info.si_code = signal_info.si_code;
+    status.pr_info.si_errno = signal_info.si_errno;
+  }
+  append_note(notes, NT_PRSTATUS, &status, sizeof(status));
+
+  elf_prpsinfo info{};
+  info.pr_pid = pid;
+  info.pr_ppid = getpid();
+  info.pr_state = 't' - 'a';
+  info.pr_sname = 't';
+  const std::string comm = read_proc_file(pid, "comm");
+  std::strncpy(info.pr_fname, comm.c_str(), sizeof(info.pr_fname) - 1);
+  if (const auto newline = std::strchr(info.pr_fname, '\n')) {
+    *newline = '\0';
+  }
+  std::string arguments = read_proc_file(pid, "cmdline");
+  std::replace(arguments.begin(), arguments.end(), '\0', ' ');
+  std::strncpy(info.pr_psargs, arguments.c_str(), sizeof(info.pr_psargs) - 1);
+  append_note(notes, NT_PRPSINFO, &info, sizeof(info));
+
+  user_fpregs_struct fp_regs{};
+  if (ptrace(PTRACE_GETFPREGS, pid, nullptr, &fp_regs) != -1) {
+    append_note(notes, NT_FPREGSET, &fp_regs, sizeof(fp_regs));
+  }
+
+  const std::string auxv = read_proc_file(pid, "auxv");
+  if (not auxv.empty()) {
+    append_note(notes, NT_AUXV, auxv.data(), auxv.size());
+  }
+
+  // NT_FILE: count, page size, (start, end, offset in pages) per file mapping
+  // and then the file names.
+  std::vector<uint64_t> ranges{};
+  std::string names{};
+  for (const auto& region : regions) {
+    if (not region.path.empty() and region.path[0] == '/') {
+      ranges.push_back(static_cast<uint64_t>(region.start));
+      ranges.push_back(static_cast<uint64_t>(region.end));
+      ranges.push_back(region.offset / page_size);
+      names += region.path;
+      names += '\0';
+    }
+  }
+  std::vector<uint8_t> files(2 * sizeof(uint64_t));
+  const uint64_t header[2] = {ranges.size() / 3, page_size};
+  std::memcpy(files.data(), header, sizeof(header));
+  const auto* const range_bytes = reinterpret_cast<const uint8_t*>(
+      ranges.data());
+  files.insert(files.end(), range_bytes,
+               range_bytes + ranges.size() * sizeof(uint64_t));
+  files.insert(files.end(), names.begin(), names.end());
+  append_note(notes, NT_FILE, files.data(), files.size());
+  return notes;
+}
+
+bool is_zero(const uint8_t* const data, const std::size_t size) {
+  uint64_t accumulated = 0;
+  for (std::size_t i = 0; i < size; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    std::memcpy(&word, data + i, sizeof(word));
+    accumulated |= word;
+  }
+  return accumulated == 0;
+}
+
+bool write_all(const int fd, const uint8_t* data, std::size_t size,
+               off_t offset) {
+  while (size > 0) {
+    const ssize_t written = pwrite(fd, data, size, offset);
+    if (written == -1 and errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+    offset += written;
+  }
+  return true;
+}
+
+/// Writes chunks of the core file on a background thread, leaving all-zero
+/// pages as holes.
+///
+/// The buffers are allocated as they are first needed, sized to the data,
+/// and left uninitialized, so that small processes are dumped without
+/// touching `chunks_in_flight * chunk_size` bytes while they are stopped.
+class ChunkWriter {
+ public:
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    std::size_t capacity;
+    std::size_t size;
+    off_t offset;
+  };
+
+  explicit ChunkWriter(const int fd) : fd_(fd) {
+    thread_ = std::thread([this]() { run(); });
+  }
+  ChunkWriter(const ChunkWriter&) = delete;
+  ChunkWriter& operator=(const ChunkWriter&) = delete;
+  ~ChunkWriter() { finish(); }
+
+  /// A chunk to fill with `size` bytes, blocks while all chunks are queued.
+  Chunk acquire(const std::size_t size) {
+    Chunk chunk{};
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this]() {
+        return not free_.empty() or allocated_ < chunks_in_flight;
+      });
+      if (free_.empty()) {
+        ++allocated_;
+      } else {
+        chunk = std::move(free_.front());
+        free_.pop_front();
+      }
+    }
+    if (chunk.capacity < size) {
+      // Not value-initialized, every byte is read or cleared before use
+      chunk.data.reset(new uint8_t[size]);
+      chunk.capacity = size;
+    }
+    chunk.size = size;
+    return chunk;
+  }
+
+  void submit(Chunk chunk) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_.push_back(std::move(chunk));
+    }
+    changed_.notify_all();
+  }
+
+  /// Wait for all chunks to be written, returns false if a write failed.
+  bool finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    changed_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    return not failed_;
+  }
+
+  uint64_t bytes_written() const noexcept { return bytes_written_; }
+
+ private:
+  void run() {
+    while (true) {
+      Chunk chunk{};
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock,
+                      [this]() { return done_ or not queued_.empty(); });
+        if (queued_.empty()) {
+          return;
+        }
+        chunk = std::move(queued_.front());
+        queued_.pop_front();
+      }
+      write_chunk(chunk);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(std::move(chunk));
+      }
+      changed_.notify_all();
+    }
+  }
+
+  // Write the runs of non-zero pages of `chunk`.
+  void write_chunk(const Chunk& chunk) {
+    std::size_t run_start = 0;
+    for (std::size_t page = 0; page <= chunk.size; page += page_size) {
+      const bool end = page == chunk.size;
+      const std::size_t length = std::min(page_size, chunk.size - page);
+      if (end or is_zero(chunk.data.get() + page, length)) {
+        if (page > run_start and not failed_) {
+          failed_ = not write_all(fd_, chunk.data.get() + run_start,
+                                  page - run_start,
+                                  chunk.offset + static_cast<off_t>(run_start));
+          bytes_written_ += page - run_start;
+        }
+        run_start = page + length;
+      }
+      if (end) {
+        break;
+      }
+    }
+  }
+
+  int fd_;
+  std::thread thread_{};
+  std::mutex mutex_{};
+  std::condition_variable changed_{};
+  std::deque<Chunk> free_{};
+  std::deque<Chunk> queued_{};
+  std::size_t allocated_{0};
+  bool done_{false};
+  // Only touched by the writer thread until it is joined
+  bool failed_{false};
+  uint64_t bytes_written_{0};
+};
+}  // namespace
+
+bool write_core_file(const pid_t pid, InferiorMemory& memory,
+                     const std::string& path, CoreDumpSummary& summary) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  std::vector<MemoryRegion> regions = read_memory_map(pid);
+  // The vsyscall page cannot be read through the inferior and vvar holds
+  // kernel data that is meaningless in a core file.
+  regions.erase(std::remove_if(regions.begin(), regions.end(),
+                               [](const MemoryRegion& region) {
+                                 return region.path == "[vsyscall]" or
+                                        region.path == "[vvar]";
+                               }),
+                regions.end());
+  if (regions.empty()) {
+    std::cerr << "Failed to read the memory map of process " << pid << '\n';
+    return false;
+  }
+  const std::vector<uint8_t> notes = build_notes(pid, regions);
+
+  // Layout: ELF header, program headers, an extra section header when there
+  // are too many program headers for e_phnum, notes, then the page-aligned
+  // memory of each readable region.
+  const std::size_t number_of_headers = regions.size() + 1;
+  const bool extended_numbering = number_of_headers >= PN_XNUM;
+  const uint64_t program_headers_offset = sizeof(Elf64_Ehdr);
+  const uint64_t section_header_offset =
+      program_headers_offset + number_of_headers * sizeof(Elf64_Phdr);
+  const uint64_t notes_offset =
+      section_header_offset + (extended_numbering ? sizeof(Elf64_Shdr) : 0);
+  uint64_t file_size = align_up(notes_offset + notes.size(), page_size);
+
+  std::vector<uint8_t> headers(notes_offset);
+  Elf64_Ehdr& elf_header = *reinterpret_cast<Elf64_Ehdr*>(headers.data());
+  std::memcpy(elf_header.e_ident, ELFMAG, SELFMAG);
+  elf_header.e_ident[EI_CLASS] = ELFCLASS64;
+  elf_header.e_ident[EI_DATA] = ELFDATA2LSB;
+  elf_header.e_ident[EI_VERSION] = EV_CURRENT;
+  elf_header.e_ident[EI_OSABI] = ELFOSABI_NONE;
+  elf_header.e_type = ET_CORE;
+  elf_header.e_machine = EM_X86_64;
+  elf_header.e_version = EV_CURRENT;
+  elf_header.e_phoff = program_headers_offset;
+  elf_header.e_ehsize = sizeof(Elf64_Ehdr);
+  elf_header.e_phentsize = sizeof(Elf64_Phdr);
+  elf_header.e_phnum = static_cast<Elf64_Half>(
+      extended_numbering ? PN_XNUM : number_of_headers);
+  if (extended_numbering) {
+    elf_header.e_shoff = section_header_offset;
+    elf_header.e_shentsize = sizeof(Elf64_Shdr);
+    elf_header.e_shnum = 1;
+    reinterpret_cast<Elf64_Shdr*>(headers.data() + section_header_offset)
+        ->sh_info = static_cast<Elf64_Word>(number_of_headers);
+  }
+  auto* const program_headers =
+      reinterpret_cast<Elf64_Phdr*>(headers.data() + program_headers_offset);
+  program_headers[0].p_type = PT_NOTE;
+  program_headers[0].p_offset = notes_offset;
+  program_headers[0].p_filesz = notes.size();
+  program_headers[0].p_align = 4;
+  for (std::size_t i = 0; i < regions.size(); ++i) {
+    const MemoryRegion& region = regions[i];
+    Elf64_Phdr& header = program_headers[i + 1];
+    const auto size = static_cast<uint64_t>(region.end - region.start);
+    header.p_type = PT_LOAD;
+    header.p_flags = (region.readable ? PF_R : 0u) |
+                     (region.writable ? PF_W : 0u) |
+                     (region.executable ? PF_X : 0u);
+    header.p_offset = file_size;
+    header.p_vaddr = static_cast<uint64_t>(region.start);
+    header.p_memsz = size;
+    header.p_filesz = region.readable ? size : 0;
+    header.p_align = page_size;
+    file_size += header.p_filesz;
+  }
+
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+  if (fd == -1) {
+    std::cerr << "Failed to create the core file '" << path
+              << "' with errno: " << errno << '\n';
+    return false;
+  }
+  bool success = write_all(fd, headers.data(), headers.size(), 0) and
+                 write_all(fd, notes.data(), notes.size(),
+                           static_cast<off_t>(notes_offset));
+
+  summary = CoreDumpSummary{};
+  summary.regions = regions.size();
+  {
+    ChunkWriter writer{fd};
+    for (std::size_t i = 0; i < regions.size() and success; ++i) {
+      const Elf64_Phdr& header = program_headers[i + 1];
+      for (uint64_t done = 0; done < header.p_filesz; done += chunk_size) {
+        ChunkWriter::Chunk chunk = writer.acquire(static_cast<std::size_t>(
+            std::min<uint64_t>(chunk_size, header.p_filesz - done)));
+        chunk.offset = static_cast<off_t>(header.p_offset + done);
+        const auto address = static_cast<std::intptr_t>(header.p_vaddr + done);
+        if (not memory.read(address, chunk.data.get(), chunk.size)) {
+          // Some pages, e.g. of a file mapped past its end, cannot be read.
+          // Dump what can be read and leave the rest zero.
+          for (std::size_t page = 0; page < chunk.size; page += page_size) {
+            if (not memory.read(address + static_cast<std::intptr_t>(page),
+                                chunk.data.get() + page, page_size)) {
+              std::memset(chunk.data.get() + page, 0, page_size);
+            }
+          }
+        }
+        summary.bytes_read += chunk.size;
+        writer.submit(std::move(chunk));
+      }
+    }
+    summary.read_seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    success = writer.finish() and success;
+    summary.bytes_written = writer.bytes_written();
+  }
+  // Extend the file over trailing holes.
+  success = ftruncate(fd, static_cast<off_t>(file_size)) == 0 and success;
+  success = close(fd) == 0 and success;
+  summary.total_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  if (not success) {
+    std::cerr << "Failed to write the core file '" << path
+              << "' with errno: " << errno << '\n';
+  }
+  return success;
+}
+}  // namespace nebugger
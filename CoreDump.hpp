@@ -0,0 +1,43 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace nebugger {
+class InferiorMemory;
+
+/// What went into a core file written by `write_core_file`.
+struct CoreDumpSummary {
+  std::size_t regions{0};
+  // Bytes of memory read from the inferior
+  uint64_t bytes_read{0};
+  // Bytes of memory written, the remaining pages were all zero and left as
+  // holes in the file
+  uint64_t bytes_written{0};
+  // Time spent reading the inferior's memory, and in total
+  double read_seconds{0.0};
+  double total_seconds{0.0};
+};
+
+/// Write an ELF core file of the stopped inferior `pid` to `path`, readable
+/// by GDB and other core file consumers.
+///
+/// The file holds a PT_NOTE segment with NT_PRSTATUS, NT_PRPSINFO,
+/// NT_FPREGSET, NT_AUXV and NT_FILE notes, and a PT_LOAD segment for every
+/// mapping in `/proc/PID/maps`. Memory is read in large chunks while a
+/// separate thread writes the previous chunks, skipping all-zero pages so
+/// that they become holes of a sparse file. Only the thread `pid` is dumped.
+///
+/// Returns false and prints the reason on failure.
+bool write_core_file(pid_t pid, InferiorMemory& memory,
+                     const std::string& path, CoreDumpSummary& summary);
+}  // namespace nebugger
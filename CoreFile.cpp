@@ -0,0 +1,223 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "CoreFile.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nebugger {
+namespace {
+std::size_t align4(const std::size_t value) { return (value + 3) & ~3ul; }
+}  // namespace
+
+CoreFile::CoreFile(const std::string& path) : path_(path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    std::cerr << "Failed to open core file '" << path << "'\n";
+    return;
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) == -1 or
+      static_cast<std::size_t>(file_stat.st_size) < sizeof(Elf64_Ehdr)) {
+    std::cerr << "Core file '" << path << "' is too small\n";
+    close(fd);
+    return;
+  }
+  size_ = static_cast<std::size_t>(file_stat.st_size);
+  void* const mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "Failed to map core file '" << path << "'\n";
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(mapped);
+
+  const auto& header = *reinterpret_cast<const Elf64_Ehdr*>(data_);
+  std::size_t number_of_headers = header.e_phnum;
+  if (number_of_headers == PN_XNUM and header.e_shoff != 0 and
+      header.e_shoff + sizeof(Elf64_Shdr) <= size_) {
+    number_of_headers =
+        reinterpret_cast<const Elf64_Shdr*>(data_ + header.e_shoff)->sh_info;
+  }
+  if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 or
+      header.e_ident[EI_CLASS] != ELFCLASS64 or header.e_type != ET_CORE or
+      header.e_machine != EM_X86_64 or
+      header.e_phoff + number_of_headers * sizeof(Elf64_Phdr) > size_) {
+    std::cerr << "File '" << path << "' is not an x86-64 ELF core file\n";
+    munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    return;
+  }
+
+  const auto* const program_headers =
+      reinterpret_cast<const Elf64_Phdr*>(data_ + header.e_phoff);
+  for (std::size_t i = 0; i < number_of_headers; ++i) {
+    const Elf64_Phdr& program_header = program_headers[i];
+    if (program_header.p_offset + program_header.p_filesz > size_) {
+      std::cerr << "Core file '" << path << "' is truncated, segment at 0x"
+                << std::hex << program_header.p_vaddr << std::dec
+                << " is incomplete\n";
+      continue;
+    }
+    if (program_header.p_type == PT_NOTE) {
+      read_notes(data_ + program_header.p_offset, program_header.p_filesz);
+    } else if (program_header.p_type == PT_LOAD) {
+      segments_.push_back(Segment{
+          program_header.p_vaddr,
+          std::min(program_header.p_filesz, program_header.p_memsz),
+          program_header.p_memsz, data_ + program_header.p_offset});
+    }
+  }
+  std::sort(segments_.begin(), segments_.end(),
+            [](const Segment& a, const Segment& b) {
+              return a.start < b.start;
+            });
+}
+
+CoreFile::~CoreFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+void CoreFile::read_notes(const uint8_t* notes, std::size_t size) {
+  bool have_status = false;
+  while (size >= sizeof(Elf64_Nhdr)) {
+    const auto& note_header = *reinterpret_cast<const Elf64_Nhdr*>(notes);
+    const std::size_t name_size = align4(note_header.n_namesz);
+    const std::size_t description_size = align4(note_header.n_descsz);
+    if (sizeof(Elf64_Nhdr) + name_size + note_header.n_descsz > size) {
+      break;
+    }
+    const uint8_t* const description = notes + sizeof(Elf64_Nhdr) + name_size;
+    // Later NT_PRSTATUS notes belong to the other threads.
+    if (note_header.n_type == NT_PRSTATUS and not have_status and
+        note_header.n_descsz >= sizeof(elf_prstatus)) {
+      elf_prstatus status{};
+      std::memcpy(&status, description, sizeof(status));
+      pid_ = status.pr_pid;
+      signal_ = status.pr_cursig;
+      std::memcpy(&registers_, &status.pr_reg, sizeof(registers_));
+      have_status = true;
+    } else if (note_header.n_type == NT_PRPSINFO and
+               note_header.n_descsz >= sizeof(elf_prpsinfo)) {
+      elf_prpsinfo info{};
+      std::memcpy(&info, description, sizeof(info));
+      command_.assign(info.pr_fname,
+                      strnlen(info.pr_fname, sizeof(info.pr_fname)));
+    } else if (note_header.n_type == NT_FILE and
+               note_header.n_descsz >= 2 * sizeof(uint64_t)) {
+      // Count and page size, then (start, end, offset in pages) per file and
+      // the NUL terminated file names.
+      uint64_t header[2] = {};
+      std::memcpy(header, description, sizeof(header));
+      const uint64_t count = header[0];
+      const std::size_t names_offset = (2 + 3 * count) * sizeof(uint64_t);
+      if (names_offset <= note_header.n_descsz) {
+        const char* name =
+            reinterpret_cast<const char*>(description + names_offset);
+        const char* const end =
+            reinterpret_cast<const char*>(description + note_header.n_descsz);
+        for (uint64_t i = 0; i < count and name < end; ++i) {
+          uint64_t range[3] = {};
+          std::memcpy(range, description + (2 + 3 * i) * sizeof(uint64_t),
+                      sizeof(range));
+          const std::size_t length =
+              strnlen(name, static_cast<std::size_t>(end - name));
+          files_.push_back(
+              MappedFile{range[0], range[2] * header[1], {name, length}});
+          name += length + 1;
+        }
+      }
+    }
+    const std::size_t note_size =
+        sizeof(Elf64_Nhdr) + name_size + description_size;
+    if (note_size >= size) {
+      break;
+    }
+    notes += note_size;
+    size -= note_size;
+  }
+  if (not have_status) {
+    std::cerr << "Core file '" << path_ << "' has no NT_PRSTATUS note\n";
+  }
+}
+
+const CoreFile::Segment* CoreFile::find_segment(
+    const uint64_t address) const noexcept {
+  // The last segment starting at or below the address
+  const auto it = std::upper_bound(
+      segments_.begin(), segments_.end(), address,
+      [](const uint64_t value, const Segment& segment) {
+        return value < segment.start;
+      });
+  if (it == segments_.begin() or address - (it - 1)->start >=
+                                     (it - 1)->memory_size) {
+    return nullptr;
+  }
+  return &*(it - 1);
+}
+
+const uint8_t* CoreFile::find(const std::intptr_t address,
+                              const std::size_t size) const noexcept {
+  const auto start = static_cast<uint64_t>(address);
+  const Segment* const segment = find_segment(start);
+  if (segment == nullptr or
+      start - segment->start + size > segment->file_size) {
+    return nullptr;
+  }
+  return segment->data + (start - segment->start);
+}
+
+bool CoreFile::read_memory(const std::intptr_t address, void* const buffer,
+                           const std::size_t size) {
+  auto current = static_cast<uint64_t>(address);
+  auto* out = static_cast<uint8_t*>(buffer);
+  std::size_t remaining = size;
+  // Adjacent mappings are separate segments, so a read may span several.
+  while (remaining > 0) {
+    const Segment* const segment = find_segment(current);
+    if (segment == nullptr) {
+      return false;
+    }
+    const uint64_t offset = current - segment->start;
+    if (offset >= segment->file_size) {
+      // Mapped, but its contents were not dumped
+      return false;
+    }
+    const std::size_t length = static_cast<std::size_t>(
+        std::min<uint64_t>(remaining, segment->file_size - offset));
+    std::memcpy(out, segment->data + offset, length);
+    out += length;
+    current += length;
+    remaining -= length;
+  }
+  return true;
+}
+
+std::intptr_t CoreFile::load_address(const std::string& path) {
+  char resolved[PATH_MAX];
+  const std::string canonical_path =
+      realpath(path.c_str(), resolved) == nullptr ? path : resolved;
+  for (const auto& file : files_) {
+    if (file.offset == 0 and file.path == canonical_path) {
+      return static_cast<std::intptr_t>(file.start);
+    }
+  }
+  return 0;
+}
+}  // namespace nebugger
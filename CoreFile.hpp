@@ -0,0 +1,81 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <vector>
+
+#include "ProcessBackend.hpp"
+
+namespace nebugger {
+/// An ELF core file, e.g. from the kernel or `gcore`, for post-mortem
+/// debugging.
+///
+/// The file is mapped into memory once and its PT_LOAD segments are kept in
+/// a table sorted by address, so a memory read is a binary search and a
+/// `memcpy` out of the mapping, or no copy at all with `find`. Registers come
+/// from the NT_PRSTATUS note of the first thread, which is the thread that
+/// received the fatal signal in kernel core files.
+class CoreFile final : public ProcessBackend {
+ public:
+  explicit CoreFile(const std::string& path);
+  ~CoreFile() override;
+
+  bool is_valid() const noexcept { return data_ != nullptr; }
+
+  bool is_live() const noexcept override { return false; }
+  pid_t pid() const noexcept override { return pid_; }
+  bool read_memory(std::intptr_t address, void* buffer,
+                   std::size_t size) override;
+  user_regs_struct registers() override { return registers_; }
+  std::intptr_t load_address(const std::string& path) override;
+
+  /// Pointer to the `size` bytes at `address` inside the mapped file, or
+  /// `nullptr` if they are not all stored in a single segment.
+  const uint8_t* find(std::intptr_t address, std::size_t size) const noexcept;
+
+  /// The signal that terminated the process.
+  int signal() const noexcept { return signal_; }
+
+  /// The program's name, from NT_PRPSINFO.
+  const std::string& command() const noexcept { return command_; }
+
+ private:
+  struct Segment {
+    uint64_t start;
+    // Bytes of the segment stored in the file, the rest of its memory size
+    // was not dumped
+    uint64_t file_size;
+    uint64_t memory_size;
+    const uint8_t* data;
+  };
+  struct MappedFile {
+    uint64_t start;
+    uint64_t offset;
+    std::string path;
+  };
+
+  void read_notes(const uint8_t* notes, std::size_t size);
+  const Segment* find_segment(uint64_t address) const noexcept;
+
+  std::string path_;
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+  // Sorted by start address
+  std::vector<Segment> segments_{};
+  std::vector<MappedFile> files_{};
+  user_regs_struct registers_{};
+  pid_t pid_{0};
+  int signal_{0};
+  std::string command_{};
+};
+}  // namespace nebugger
@@ -0,0 +1,296 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Coverage.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <utility>
+
+#include "Fork.hpp"
+#include "MemoryMap.hpp"
+#include "Registers.hpp"
+
+namespace nebugger {
+CoverageRecorder::CoverageRecorder(std::string program_name, const pid_t pid)
+    : program_name_(std::move(program_name)),
+      pid_(pid),
+      elf_(program_name_),
+      memory_(pid) {}
+
+int CoverageRecorder::run() {
+  int wait_status = 0;
+  if (waitpid(pid_, &wait_status, 0) != pid_ or not WIFSTOPPED(wait_status)) {
+    std::cerr << "Failed to start '" << program_name_ << "'\n";
+    return -1;
+  }
+  if (ptrace(PTRACE_SETOPTIONS, pid_, nullptr,
+             PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                 PTRACE_O_TRACEVFORKDONE | PTRACE_O_TRACEEXEC |
+                 PTRACE_O_EXITKILL) == -1) {
+    std::cerr << "Failed to set ptrace options with errno: " << errno << '\n';
+    return -1;
+  }
+  threads_.insert(pid_);
+  if (not insert_breakpoints()) {
+    return -1;
+  }
+
+  int exit_status = 0;
+  pid_t tid = pid_;
+  int signal_to_deliver = 0;
+  bool resume = true;
+  while (true) {
+    if (resume and
+        ptrace(PTRACE_CONT, tid, nullptr, signal_to_deliver) == -1 and
+        errno != ESRCH) {
+      std::cerr << "Failed to continue thread " << tid
+                << " with errno: " << errno << '\n';
+    }
+    signal_to_deliver = 0;
+    resume = true;
+    tid = waitpid(-1, &wait_status, __WALL);
+    if (tid == -1) {
+      break;
+    }
+    if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+      threads_.erase(tid);
+      if (tid == pid_) {
+        exit_status = WIFEXITED(wait_status)
+                          ? WEXITSTATUS(wait_status)
+                          : 128 + WTERMSIG(wait_status);
+        break;
+      }
+      // Another thread exited, there is nothing to resume.
+      resume = false;
+      continue;
+    }
+    const int signal = WSTOPSIG(wait_status);
+    const int event = ptrace_event(wait_status);
+    if (signal == SIGTRAP and event != 0) {
+      handle_event(tid, event);
+      continue;
+    }
+    if (threads_.count(tid) == 0) {
+      // The first stop of a new thread or forked child may be reported
+      // before the event that created it, which decides what to do with it.
+      early_stops_.insert(tid);
+      resume = false;
+      continue;
+    }
+    if (signal == SIGTRAP) {
+      if (not handle_trap(tid)) {
+        signal_to_deliver = SIGTRAP;
+      }
+    } else if (signal != SIGSTOP) {
+      // New threads start with a SIGSTOP, everything else belongs to the
+      // program.
+      signal_to_deliver = signal;
+    }
+  }
+  return exit_status;
+}
+
+void CoverageRecorder::write_report(std::ostream& os) const {
+  os << "# nebugger coverage v1\n"
+     << "binary " << program_name_ << '\n'
+     << "blocks " << blocks_.size() << " hit " << number_of_hits_ << '\n';
+  const auto& symbols = elf_.symbols();
+  std::size_t i = 0;
+  while (i < blocks_.size()) {
+    const int64_t function = blocks_[i].function;
+    std::size_t hit = 0;
+    std::size_t total = 0;
+    for (; i < blocks_.size() and blocks_[i].function == function; ++i) {
+      ++total;
+      hit += hit_[i] ? 1 : 0;
+    }
+    os << "function "
+       << (function >= 0 ? symbols[static_cast<std::size_t>(function)].name
+                         : std::string{"?"})
+       << ' ' << hit << '/' << total << '\n';
+  }
+  // Bitmap with one bit per block, least significant bit first in each byte.
+  os << "bitmap ";
+  for (std::size_t byte = 0; byte < (blocks_.size() + 7) / 8; ++byte) {
+    unsigned value = 0;
+    for (std::size_t bit = 0; bit < 8 and 8 * byte + bit < blocks_.size();
+         ++bit) {
+      value |= hit_[8 * byte + bit] ? (1U << bit) : 0;
+    }
+    os << std::hex << std::setw(2) << std::setfill('0') << value;
+  }
+  os << std::dec << '\n';
+}
+
+bool CoverageRecorder::insert_breakpoints() {
+  if (not elf_.is_valid()) {
+    return false;
+  }
+  blocks_ = find_basic_blocks(elf_);
+  if (blocks_.empty()) {
+    std::cerr << "No basic blocks found in '" << program_name_ << "'\n";
+    return false;
+  }
+  if (elf_.is_position_independent()) {
+    load_address_ = find_load_address(pid_, program_name_);
+  }
+  original_bytes_.resize(blocks_.size());
+  hit_.assign(blocks_.size(), false);
+
+  // Patch each contiguous run of blocks with one read and one write.
+  std::size_t first = 0;
+  while (first < blocks_.size()) {
+    std::size_t last = first;
+    // Blocks of a text section are close together, split runs at large gaps
+    // so we do not copy unrelated memory.
+    while (last + 1 < blocks_.size() and
+           blocks_[last + 1].address - blocks_[last].address < 4096) {
+      ++last;
+    }
+    const std::intptr_t start =
+        load_address_ + static_cast<std::intptr_t>(blocks_[first].address);
+    const std::size_t size = blocks_[last].address - blocks_[first].address + 1;
+    std::vector<uint8_t> text(size);
+    if (not memory_.read(start, text.data(), size)) {
+      std::cerr << "Failed to read text at 0x" << std::hex << start
+                << std::dec << '\n';
+      return false;
+    }
+    for (std::size_t i = first; i <= last; ++i) {
+      const std::size_t offset = blocks_[i].address - blocks_[first].address;
+      original_bytes_[i] = text[offset];
+      text[offset] = 0xcc;
+    }
+    if (not memory_.write(start, text.data(), size)) {
+      std::cerr << "Failed to write breakpoints at 0x" << std::hex << start
+                << std::dec << '\n';
+      return false;
+    }
+    first = last + 1;
+  }
+  return true;
+}
+
+bool CoverageRecorder::write_breakpoints(const pid_t pid, const bool insert) {
+  InferiorMemory memory{pid};
+  // Like the insertion, one read and one write per run of blocks
+  std::size_t first = 0;
+  while (first < blocks_.size()) {
+    std::size_t last = first;
+    while (last + 1 < blocks_.size() and
+           blocks_[last + 1].address - blocks_[last].address < 4096) {
+      ++last;
+    }
+    const std::intptr_t start =
+        load_address_ + static_cast<std::intptr_t>(blocks_[first].address);
+    const std::size_t size = blocks_[last].address - blocks_[first].address + 1;
+    std::vector<uint8_t> text(size);
+    if (not memory.read(start, text.data(), size)) {
+      return false;
+    }
+    for (std::size_t i = first; i <= last; ++i) {
+      if (not hit_[i]) {
+        text[blocks_[i].address - blocks_[first].address] =
+            insert ? uint8_t{0xcc} : original_bytes_[i];
+      }
+    }
+    if (not memory.write(start, text.data(), size)) {
+      return false;
+    }
+    first = last + 1;
+  }
+  return true;
+}
+
+void CoverageRecorder::handle_event(const pid_t tid, const int event) {
+  unsigned long message = 0;
+  switch (event) {
+    case PTRACE_EVENT_CLONE: {
+      ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+      const auto thread = static_cast<pid_t>(message);
+      threads_.insert(thread);
+      if (early_stops_.erase(thread) != 0) {
+        ptrace(PTRACE_CONT, thread, nullptr, nullptr);
+      }
+      return;
+    }
+    case PTRACE_EVENT_FORK:
+    case PTRACE_EVENT_VFORK: {
+      ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+      const auto child = static_cast<pid_t>(message);
+      if (early_stops_.erase(child) == 0 and not wait_for_forked_child(child)) {
+        return;
+      }
+      // A forked child runs on untraced without the copies of the
+      // breakpoints. A vforked child shares the memory of the parent until it
+      // executes a new program or exits, the breakpoints are lifted until then
+      // and blocks run by other threads in the meantime are missed.
+      if (not executed_ and
+          not write_breakpoints(event == PTRACE_EVENT_FORK ? child : pid_,
+                                false)) {
+        std::cerr << "Failed to remove the coverage breakpoints from process "
+                  << child << '\n';
+      }
+      if (ptrace(PTRACE_DETACH, child, nullptr, nullptr) == -1) {
+        std::cerr << "Failed to detach from forked process " << child
+                  << " with errno: " << errno << '\n';
+      }
+      return;
+    }
+    case PTRACE_EVENT_VFORK_DONE:
+      if (not executed_) {
+        write_breakpoints(pid_, true);
+      }
+      return;
+    case PTRACE_EVENT_EXEC:
+      // The program replaced itself, the breakpoints are gone and the new
+      // program is not covered.
+      executed_ = true;
+      return;
+    default:
+      return;
+  }
+}
+
+bool CoverageRecorder::handle_trap(const pid_t tid) {
+  if (executed_) {
+    return false;
+  }
+  user_regs_struct regs = get_registers(tid);
+  const uint64_t address =
+      regs.rip - 1 - static_cast<uint64_t>(load_address_);
+  const auto it = std::lower_bound(
+      blocks_.begin(), blocks_.end(), address,
+      [](const BasicBlock& block, const uint64_t a) {
+        return block.address < a;
+      });
+  if (it == blocks_.end() or it->address != address) {
+    return false;
+  }
+  const auto index = static_cast<std::size_t>(it - blocks_.begin());
+  if (hit_[index] and original_bytes_[index] == 0xcc) {
+    // The program contains an int3 itself.
+    return false;
+  }
+  // A block may already be hit if several threads trapped on it before its
+  // byte was restored. They all need to re-execute the instruction.
+  if (not hit_[index]) {
+    hit_[index] = true;
+    ++number_of_hits_;
+    memory_.write(static_cast<std::intptr_t>(regs.rip - 1),
+                  &original_bytes_[index], 1);
+  }
+  regs.rip -= 1;
+  set_registers(tid, regs);
+  return true;
+}
+}  // namespace nebugger
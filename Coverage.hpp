@@ -0,0 +1,67 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+#include <unordered_set>
+#include <vector>
+
+#include "ControlFlow.hpp"
+#include "Elf.hpp"
+#include "Memory.hpp"
+
+namespace nebugger {
+/// Records basic block coverage of an unmodified executable.
+///
+/// A one-shot `int3` is written to the start of every basic block of the
+/// executable, with one bulk write per text section. When a block is hit for
+/// the first time its original byte is restored and the inferior continues,
+/// so each block traps at most once and the overhead vanishes as coverage
+/// saturates. Shared libraries are not instrumented. Forked children run on
+/// untraced without the breakpoints, and coverage ends when the program
+/// executes a new one.
+class CoverageRecorder {
+ public:
+  /// `pid` must be stopped right after `exec`.
+  CoverageRecorder(std::string program_name, pid_t pid);
+
+  /// Run the inferior, including all of its threads, to completion. Returns
+  /// the exit status of the inferior, or 128 + signal if it was killed.
+  int run();
+
+  /// Write a compact report: a summary, per-function block counts and a hex
+  /// bitmap of hit blocks in address order.
+  void write_report(std::ostream& os) const;
+
+ private:
+  bool insert_breakpoints();
+  // Write the breakpoints of the blocks not hit yet, or their original bytes
+  // if `insert` is false, to the memory of `pid`
+  bool write_breakpoints(pid_t pid, bool insert);
+  // Handle a SIGTRAP of thread `tid`, returns true if it was a coverage trap
+  bool handle_trap(pid_t tid);
+  void handle_event(pid_t tid, int event);
+
+  std::string program_name_;
+  pid_t pid_;
+  ElfFile elf_;
+  InferiorMemory memory_;
+  std::intptr_t load_address_{0};
+  std::vector<BasicBlock> blocks_{};
+  std::vector<uint8_t> original_bytes_{};
+  std::vector<bool> hit_{};
+  std::size_t number_of_hits_{0};
+  // Set once the program executed another one, whose blocks are elsewhere
+  bool executed_{false};
+  std::unordered_set<pid_t> threads_{};
+  std::unordered_set<pid_t> early_stops_{};
+};
+}  // namespace nebugger
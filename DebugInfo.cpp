@@ -0,0 +1,1034 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "DebugInfo.hpp"
+
+#include <algorithm>
+#include <elf.h>
+
+#include "DwarfReader.hpp"
+#include "Elf.hpp"
+
+namespace nebugger {
+namespace {
+// Attributes
+enum : uint64_t {
+  DW_AT_sibling = 0x01,
+  DW_AT_location = 0x02,
+  DW_AT_name = 0x03,
+  DW_AT_byte_size = 0x0b,
+  DW_AT_bit_offset = 0x0c,
+  DW_AT_bit_size = 0x0d,
+  DW_AT_low_pc = 0x11,
+  DW_AT_high_pc = 0x12,
+  DW_AT_const_value = 0x1c,
+  DW_AT_lower_bound = 0x22,
+  DW_AT_upper_bound = 0x2f,
+  DW_AT_abstract_origin = 0x31,
+  DW_AT_artificial = 0x34,
+  DW_AT_count = 0x37,
+  DW_AT_data_member_location = 0x38,
+  DW_AT_declaration = 0x3c,
+  DW_AT_encoding = 0x3e,
+  DW_AT_frame_base = 0x40,
+  DW_AT_specification = 0x47,
+  DW_AT_type = 0x49,
+  DW_AT_ranges = 0x55,
+  DW_AT_data_bit_offset = 0x6b,
+  DW_AT_str_offsets_base = 0x72,
+  DW_AT_addr_base = 0x73,
+  DW_AT_rnglists_base = 0x74,
+  DW_AT_loclists_base = 0x8c
+};
+
+// Attribute forms
+enum : uint64_t {
+  DW_FORM_addr = 0x01,
+  DW_FORM_block2 = 0x03,
+  DW_FORM_block4 = 0x04,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_string = 0x08,
+  DW_FORM_block = 0x09,
+  DW_FORM_block1 = 0x0a,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_flag = 0x0c,
+  DW_FORM_sdata = 0x0d,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_ref_addr = 0x10,
+  DW_FORM_ref1 = 0x11,
+  DW_FORM_ref2 = 0x12,
+  DW_FORM_ref4 = 0x13,
+  DW_FORM_ref8 = 0x14,
+  DW_FORM_ref_udata = 0x15,
+  DW_FORM_indirect = 0x16,
+  DW_FORM_sec_offset = 0x17,
+  DW_FORM_exprloc = 0x18,
+  DW_FORM_flag_present = 0x19,
+  DW_FORM_strx = 0x1a,
+  DW_FORM_addrx = 0x1b,
+  DW_FORM_ref_sup4 = 0x1c,
+  DW_FORM_strp_sup = 0x1d,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_line_strp = 0x1f,
+  DW_FORM_ref_sig8 = 0x20,
+  DW_FORM_implicit_const = 0x21,
+  DW_FORM_loclistx = 0x22,
+  DW_FORM_rnglistx = 0x23,
+  DW_FORM_ref_sup8 = 0x24,
+  DW_FORM_strx1 = 0x25,
+  DW_FORM_strx2 = 0x26,
+  DW_FORM_strx3 = 0x27,
+  DW_FORM_strx4 = 0x28,
+  DW_FORM_addrx1 = 0x29,
+  DW_FORM_addrx2 = 0x2a,
+  DW_FORM_addrx3 = 0x2b,
+  DW_FORM_addrx4 = 0x2c,
+  DW_FORM_GNU_addr_index = 0x1f01,
+  DW_FORM_GNU_str_index = 0x1f02,
+  DW_FORM_GNU_ref_alt = 0x1f20,
+  DW_FORM_GNU_strp_alt = 0x1f21
+};
+
+// Unit types of DWARF 5 unit headers
+constexpr uint8_t DW_UT_compile = 0x01;
+constexpr uint8_t DW_UT_partial = 0x03;
+
+// Entries of DWARF 5 range and location lists
+enum : uint8_t {
+  DW_RLE_end_of_list,
+  DW_RLE_base_addressx,
+  DW_RLE_startx_endx,
+  DW_RLE_startx_length,
+  DW_RLE_offset_pair,
+  DW_RLE_base_address,
+  DW_RLE_start_end,
+  DW_RLE_start_length
+};
+enum : uint8_t {
+  DW_LLE_end_of_list,
+  DW_LLE_base_addressx,
+  DW_LLE_startx_endx,
+  DW_LLE_startx_length,
+  DW_LLE_offset_pair,
+  DW_LLE_default_location,
+  DW_LLE_base_address,
+  DW_LLE_start_end,
+  DW_LLE_start_length
+};
+
+constexpr uint8_t DW_OP_plus_uconst = 0x23;
+
+// Read a little endian integer of 1 to 8 bytes
+uint64_t read_unsigned(DwarfReader& reader, const std::size_t size) {
+  uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(reader.read<uint8_t>()) << (8 * i);
+  }
+  return value;
+}
+}  // namespace
+
+// The value of an attribute, decoded according to its form
+struct DebugInfo::FormValue {
+  enum class Class {
+    Constant,
+    Signed,
+    Address,
+    Reference,
+    String,
+    Block,
+    SectionOffset,
+    LocationListIndex,
+    RangeListIndex,
+    Flag
+  };
+
+  Class kind{Class::Constant};
+  uint64_t value{0};
+  const uint8_t* block{nullptr};
+  std::size_t size{0};
+  const char* string{nullptr};
+};
+
+DebugInfo::DebugInfo(const ElfFile& elf) {
+  const auto section = [&elf](const char* const name) {
+    const Elf64_Shdr* const header = elf.find_section(name);
+    if (header == nullptr or header->sh_type == SHT_NOBITS or
+        (header->sh_flags & SHF_COMPRESSED) != 0) {
+      return Section{};
+    }
+    return Section{elf.section_data(*header), header->sh_size};
+  };
+  info_ = section(".debug_info");
+  abbrev_ = section(".debug_abbrev");
+  str_ = section(".debug_str");
+  line_str_ = section(".debug_line_str");
+  str_offsets_ = section(".debug_str_offsets");
+  addr_ = section(".debug_addr");
+  ranges_ = section(".debug_ranges");
+  rnglists_ = section(".debug_rnglists");
+  loc_ = section(".debug_loc");
+  loclists_ = section(".debug_loclists");
+  if (info_.data == nullptr or abbrev_.data == nullptr) {
+    return;
+  }
+
+  DwarfReader reader{info_.data, info_.data + info_.size};
+  while (not reader.at_end()) {
+    Unit unit{};
+    unit.offset = reader.offset();
+    const uint64_t length = reader.read_unit_length(unit.is_64bit);
+    if (reader.overflow() or length > reader.remaining()) {
+      break;
+    }
+    unit.end = reader.offset() + length;
+    unit.version = reader.read<uint16_t>();
+    uint8_t unit_type = DW_UT_compile;
+    uint64_t abbreviations = 0;
+    if (unit.version >= 5) {
+      unit_type = reader.read<uint8_t>();
+      unit.address_size = reader.read<uint8_t>();
+      abbreviations = reader.read_offset(unit.is_64bit);
+    } else {
+      abbreviations = reader.read_offset(unit.is_64bit);
+      unit.address_size = reader.read<uint8_t>();
+    }
+    if (unit.version >= 2 and unit.version <= 5 and
+        (unit_type == DW_UT_compile or unit_type == DW_UT_partial) and
+        unit.address_size == 8 and not reader.overflow()) {
+      unit.entry = reader.offset();
+      unit.abbreviations = read_abbreviations(abbreviations);
+      units_.push_back(unit);
+    }
+    reader.skip(static_cast<std::size_t>(unit.end - reader.offset()));
+  }
+
+  for (uint32_t i = 0; i < units_.size(); ++i) {
+    index_unit(i);
+  }
+  std::sort(functions_.begin(), functions_.end(),
+            [](const Function& a, const Function& b) {
+              return a.begin < b.begin;
+            });
+}
+
+bool DebugInfo::read_entry(const uint64_t offset,
+                           DebugInfoEntry& entry) const {
+  const uint64_t index = unit_index(offset);
+  if (index >= units_.size() or offset < units_[index].entry) {
+    return false;
+  }
+  const Unit& unit = units_[index];
+  entry = DebugInfoEntry{};
+  entry.offset = offset;
+  entry.unit = static_cast<uint32_t>(index);
+  DwarfReader reader{info_.data + offset, info_.data + unit.end};
+  const uint64_t code = reader.read_uleb128();
+  if (code == 0) {
+    entry.next = offset + reader.offset();
+    return not reader.overflow();
+  }
+  const std::vector<Abbreviation>& table =
+      abbreviation_tables_[unit.abbreviations];
+  if (code >= table.size() or table[code].tag == 0) {
+    return false;
+  }
+  const Abbreviation& abbreviation = table[code];
+  entry.tag = abbreviation.tag;
+  entry.has_children = abbreviation.has_children;
+
+  using Class = FormValue::Class;
+  bool has_low_pc = false;
+  bool has_high_pc = false;
+  bool high_pc_is_offset = false;
+  for (uint32_t i = 0; i < abbreviation.count; ++i) {
+    const AttributeSpec& spec = attribute_specs_[abbreviation.first + i];
+    FormValue value{};
+    if (not read_form(reader, unit, spec.form, spec.implicit_const, value)) {
+      return false;
+    }
+    const bool is_constant =
+        value.kind == Class::Constant or value.kind == Class::Signed;
+    const auto constant = static_cast<int64_t>(value.value);
+    switch (spec.name) {
+      case DW_AT_sibling:
+        entry.sibling = value.kind == Class::Reference ? value.value : 0;
+        break;
+      case DW_AT_name:
+        entry.name = value.string;
+        break;
+      case DW_AT_type:
+        entry.type = value.kind == Class::Reference ? value.value : 0;
+        break;
+      case DW_AT_specification:
+        entry.specification = value.kind == Class::Reference ? value.value : 0;
+        break;
+      case DW_AT_abstract_origin:
+        entry.abstract_origin =
+            value.kind == Class::Reference ? value.value : 0;
+        break;
+      case DW_AT_byte_size:
+        entry.byte_size = is_constant ? constant : -1;
+        break;
+      case DW_AT_bit_size:
+        entry.bit_size = is_constant ? constant : -1;
+        break;
+      case DW_AT_bit_offset:
+        entry.bit_offset = is_constant ? constant : -1;
+        break;
+      case DW_AT_data_bit_offset:
+        entry.data_bit_offset = is_constant ? constant : -1;
+        break;
+      case DW_AT_data_member_location:
+        if (is_constant) {
+          entry.member_location = constant;
+        } else if (value.kind == Class::Block and value.size > 1 and
+                   value.block[0] == DW_OP_plus_uconst) {
+          // DWARF 2 and 3 store the offset as an expression
+          DwarfReader expression{value.block + 1, value.block + value.size};
+          entry.member_location =
+              static_cast<int64_t>(expression.read_uleb128());
+        }
+        break;
+      case DW_AT_lower_bound:
+        entry.lower_bound = is_constant ? constant : 0;
+        break;
+      case DW_AT_upper_bound:
+        // Bounds computed at run time, as of variable length arrays, are
+        // treated as unknown
+        entry.upper_bound = is_constant ? constant : -1;
+        break;
+      case DW_AT_count:
+        entry.count = is_constant ? constant : -1;
+        break;
+      case DW_AT_encoding:
+        entry.encoding = value.value;
+        break;
+      case DW_AT_const_value:
+        entry.has_const_value = true;
+        if (value.kind == Class::Block) {
+          entry.const_block = value.block;
+          entry.const_size = value.size;
+        } else if (value.kind == Class::String and value.string != nullptr) {
+          entry.const_block = reinterpret_cast<const uint8_t*>(value.string);
+          entry.const_size = std::char_traits<char>::length(value.string) + 1;
+        } else {
+          entry.const_value = value.value;
+        }
+        break;
+      case DW_AT_declaration:
+        entry.declaration = value.value != 0;
+        break;
+      case DW_AT_artificial:
+        entry.artificial = value.value != 0;
+        break;
+      case DW_AT_location:
+      case DW_AT_frame_base: {
+        LocationAttribute& location = spec.name == DW_AT_location
+                                          ? entry.location
+                                          : entry.frame_base;
+        if (value.kind == Class::Block) {
+          location.expression = value.block;
+          location.size = value.size;
+        } else if (value.kind == Class::SectionOffset or
+                   value.kind == Class::Constant) {
+          location.is_list = true;
+          location.list_offset = value.value;
+        } else if (value.kind == Class::LocationListIndex) {
+          location.is_list = true;
+          location.list_offset =
+              list_offset(loclists_, unit, unit.loclists_base, value.value);
+        }
+        break;
+      }
+      case DW_AT_low_pc:
+        has_low_pc = value.kind == Class::Address;
+        entry.low_pc = value.value;
+        break;
+      case DW_AT_high_pc:
+        has_high_pc = true;
+        high_pc_is_offset = value.kind != Class::Address;
+        entry.high_pc = value.value;
+        break;
+      case DW_AT_ranges:
+        entry.has_ranges = true;
+        entry.ranges =
+            value.kind == Class::RangeListIndex
+                ? list_offset(rnglists_, unit, unit.rnglists_base, value.value)
+                : value.value;
+        break;
+      default:
+        break;
+    }
+  }
+  if (reader.overflow()) {
+    return false;
+  }
+  if (has_low_pc and has_high_pc) {
+    entry.has_pc_range = true;
+    if (high_pc_is_offset) {
+      entry.high_pc += entry.low_pc;
+    }
+  }
+  entry.next = offset + reader.offset();
+  return true;
+}
+
+void DebugInfo::inherit_from_origin(DebugInfoEntry& entry) const {
+  uint64_t origin = entry.abstract_origin != 0 ? entry.abstract_origin
+                                               : entry.specification;
+  DebugInfoEntry other{};
+  // The bound only guards against cycles in corrupt files
+  for (int depth = 0; origin != 0 and depth < 8 and read_entry(origin, other);
+       ++depth) {
+    if (entry.name == nullptr) {
+      entry.name = other.name;
+    }
+    if (entry.type == 0) {
+      entry.type = other.type;
+    }
+    origin = other.abstract_origin != 0 ? other.abstract_origin
+                                        : other.specification;
+  }
+}
+
+uint64_t DebugInfo::next_sibling(const DebugInfoEntry& entry) const {
+  if (not entry.has_children) {
+    return entry.next;
+  }
+  if (entry.sibling > entry.offset) {
+    return entry.sibling;
+  }
+  // Walk over the children, skipping the subtrees of those with a sibling
+  std::size_t depth = 1;
+  uint64_t offset = entry.next;
+  DebugInfoEntry child{};
+  while (depth > 0) {
+    if (not read_entry(offset, child)) {
+      return units_[entry.unit].end;
+    }
+    if (child.tag == 0) {
+      --depth;
+      offset = child.next;
+    } else if (child.has_children and child.sibling > child.offset) {
+      offset = child.sibling;
+    } else {
+      depth += child.has_children ? 1 : 0;
+      offset = child.next;
+    }
+  }
+  return offset;
+}
+
+bool DebugInfo::contains(const DebugInfoEntry& entry,
+                         const uint64_t address) const {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges{};
+  address_ranges(entry, ranges);
+  return std::any_of(ranges.begin(), ranges.end(),
+                     [address](const std::pair<uint64_t, uint64_t>& range) {
+                       return range.first <= address and address < range.second;
+                     });
+}
+
+uint64_t DebugInfo::find_function(const uint64_t address) const noexcept {
+  auto it = std::upper_bound(
+      functions_.begin(), functions_.end(), address,
+      [](const uint64_t a, const Function& function) {
+        return a < function.begin;
+      });
+  if (it == functions_.begin()) {
+    return 0;
+  }
+  --it;
+  return address < it->end ? it->entry : 0;
+}
+
+uint64_t DebugInfo::find_global(const std::string_view name) const {
+  const auto it = globals_.find(std::string{name});
+  return it == globals_.end() ? 0 : it->second;
+}
+
+uint64_t DebugInfo::find_type(const std::string_view name) const {
+  const auto it = types_.find(std::string{name});
+  return it == types_.end() ? 0 : it->second;
+}
+
+uint64_t DebugInfo::find_local(const uint64_t function, const uint64_t address,
+                               const std::string_view name) const {
+  uint64_t found = 0;
+  uint64_t scope = function;
+  DebugInfoEntry parent{};
+  DebugInfoEntry entry{};
+  // Descend through the lexical blocks and inlined calls covering the
+  // address, so that inner declarations shadow outer ones.
+  while (scope != 0 and read_entry(scope, parent) and parent.has_children) {
+    uint64_t inner = 0;
+    for (uint64_t child = parent.next; read_entry(child, entry) and
+                                       entry.tag != 0;
+         child = next_sibling(entry)) {
+      if (entry.tag == DW_TAG_variable or
+          entry.tag == DW_TAG_formal_parameter) {
+        if (entry.name == nullptr) {
+          inherit_from_origin(entry);
+        }
+        if (entry.name != nullptr and name == entry.name) {
+          found = entry.offset;
+        }
+      } else if ((entry.tag == DW_TAG_lexical_block or
+                  entry.tag == DW_TAG_inlined_subroutine) and
+                 contains(entry, address)) {
+        inner = entry.offset;
+      }
+    }
+    scope = inner;
+  }
+  return found;
+}
+
+bool DebugInfo::find_expression(const DebugInfoEntry& entry,
+                                const LocationAttribute& location,
+                                const uint64_t address,
+                                const uint8_t*& expression,
+                                std::size_t& size) const {
+  if (not location.is_list) {
+    expression = location.expression;
+    size = location.size;
+    return expression != nullptr;
+  }
+  const Unit& unit = units_[entry.unit];
+  uint64_t base = unit.base_address;
+  if (unit.version < 5) {
+    if (location.list_offset >= loc_.size) {
+      return false;
+    }
+    DwarfReader reader{loc_.data + location.list_offset,
+                       loc_.data + loc_.size};
+    while (not reader.overflow()) {
+      const auto begin = reader.read<uint64_t>();
+      const auto end = reader.read<uint64_t>();
+      if (begin == 0 and end == 0) {
+        return false;
+      }
+      if (begin == ~uint64_t{0}) {
+        base = end;
+        continue;
+      }
+      const auto length = reader.read<uint16_t>();
+      const uint8_t* const data = reader.position();
+      reader.skip(length);
+      if (not reader.overflow() and base + begin <= address and
+          address < base + end) {
+        expression = data;
+        size = length;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  if (location.list_offset >= loclists_.size) {
+    return false;
+  }
+  DwarfReader reader{loclists_.data + location.list_offset,
+                     loclists_.data + loclists_.size};
+  while (not reader.overflow()) {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    switch (reader.read<uint8_t>()) {
+      case DW_LLE_end_of_list:
+        return false;
+      case DW_LLE_base_addressx:
+        base = indexed_address(unit, reader.read_uleb128());
+        continue;
+      case DW_LLE_startx_endx:
+        begin = indexed_address(unit, reader.read_uleb128());
+        end = indexed_address(unit, reader.read_uleb128());
+        break;
+      case DW_LLE_startx_length:
+        begin = indexed_address(unit, reader.read_uleb128());
+        end = begin + reader.read_uleb128();
+        break;
+      case DW_LLE_offset_pair:
+        begin = base + reader.read_uleb128();
+        end = base + reader.read_uleb128();
+        break;
+      case DW_LLE_default_location:
+        end = ~uint64_t{0};
+        break;
+      case DW_LLE_base_address:
+        base = reader.read<uint64_t>();
+        continue;
+      case DW_LLE_start_end:
+        begin = reader.read<uint64_t>();
+        end = reader.read<uint64_t>();
+        break;
+      case DW_LLE_start_length:
+        begin = reader.read<uint64_t>();
+        end = begin + reader.read_uleb128();
+        break;
+      default:
+        return false;
+    }
+    const uint64_t length = reader.read_uleb128();
+    const uint8_t* const data = reader.position();
+    reader.skip(length);
+    if (not reader.overflow() and begin <= address and address < end) {
+      expression = data;
+      size = length;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t DebugInfo::indexed_address(const DebugInfoEntry& entry,
+                                    const uint64_t index) const {
+  return indexed_address(units_[entry.unit], index);
+}
+
+uint64_t DebugInfo::indexed_address(const Unit& unit,
+                                    const uint64_t index) const {
+  const uint64_t offset = unit.addr_base + index * unit.address_size;
+  if (offset + 8 > addr_.size) {
+    return 0;
+  }
+  DwarfReader reader{addr_.data + offset, addr_.data + addr_.size};
+  return reader.read<uint64_t>();
+}
+
+uint64_t DebugInfo::list_offset(const Section& section, const Unit& unit,
+                                const uint64_t base,
+                                const uint64_t index) const {
+  const uint64_t offset = base + index * (unit.is_64bit ? 8 : 4);
+  if (offset >= section.size) {
+    return section.size;
+  }
+  DwarfReader reader{section.data + offset, section.data + section.size};
+  return base + reader.read_offset(unit.is_64bit);
+}
+
+bool DebugInfo::read_form(DwarfReader& reader, const Unit& unit,
+                          const uint64_t form, const int64_t implicit_const,
+                          FormValue& value) const {
+  using Class = FormValue::Class;
+  const auto string_at = [](const Section& section, const uint64_t offset) {
+    return offset < section.size
+               ? reinterpret_cast<const char*>(section.data + offset)
+               : nullptr;
+  };
+  const auto indexed_string = [this, &unit, &string_at](const uint64_t index) {
+    const uint64_t offset =
+        unit.str_offsets_base + index * (unit.is_64bit ? 8 : 4);
+    if (offset >= str_offsets_.size) {
+      return static_cast<const char*>(nullptr);
+    }
+    DwarfReader offsets{str_offsets_.data + offset,
+                        str_offsets_.data + str_offsets_.size};
+    return string_at(str_, offsets.read_offset(unit.is_64bit));
+  };
+  const auto block = [&reader, &value](const uint64_t size) {
+    value.kind = Class::Block;
+    value.block = reader.position();
+    value.size = static_cast<std::size_t>(size);
+    reader.skip(value.size);
+  };
+
+  switch (form) {
+    case DW_FORM_addr:
+      value.kind = Class::Address;
+      value.value = reader.read<uint64_t>();
+      break;
+    case DW_FORM_addrx:
+    case DW_FORM_GNU_addr_index:
+      value.kind = Class::Address;
+      value.value = indexed_address(unit, reader.read_uleb128());
+      break;
+    case DW_FORM_addrx1:
+    case DW_FORM_addrx2:
+    case DW_FORM_addrx3:
+    case DW_FORM_addrx4:
+      value.kind = Class::Address;
+      value.value = indexed_address(
+          unit, read_unsigned(reader, form - DW_FORM_addrx1 + 1));
+      break;
+    case DW_FORM_data1:
+      value.value = reader.read<uint8_t>();
+      break;
+    case DW_FORM_data2:
+      value.value = reader.read<uint16_t>();
+      break;
+    case DW_FORM_data4:
+      value.value = reader.read<uint32_t>();
+      break;
+    case DW_FORM_data8:
+      value.value = reader.read<uint64_t>();
+      break;
+    case DW_FORM_data16:
+      block(16);
+      break;
+    case DW_FORM_udata:
+      value.value = reader.read_uleb128();
+      break;
+    case DW_FORM_sdata:
+      value.kind = Class::Signed;
+      value.value = static_cast<uint64_t>(reader.read_sleb128());
+      break;
+    case DW_FORM_implicit_const:
+      value.kind = Class::Signed;
+      value.value = static_cast<uint64_t>(implicit_const);
+      break;
+    case DW_FORM_flag:
+      value.kind = Class::Flag;
+      value.value = reader.read<uint8_t>();
+      break;
+    case DW_FORM_flag_present:
+      value.kind = Class::Flag;
+      value.value = 1;
+      break;
+    case DW_FORM_string:
+      value.kind = Class::String;
+      value.string = reader.read_string();
+      break;
+    case DW_FORM_strp:
+      value.kind = Class::String;
+      value.string = string_at(str_, reader.read_offset(unit.is_64bit));
+      break;
+    case DW_FORM_line_strp:
+      value.kind = Class::String;
+      value.string = string_at(line_str_, reader.read_offset(unit.is_64bit));
+      break;
+    case DW_FORM_strx:
+    case DW_FORM_GNU_str_index:
+      value.kind = Class::String;
+      value.string = indexed_string(reader.read_uleb128());
+      break;
+    case DW_FORM_strx1:
+    case DW_FORM_strx2:
+    case DW_FORM_strx3:
+    case DW_FORM_strx4:
+      value.kind = Class::String;
+      value.string =
+          indexed_string(read_unsigned(reader, form - DW_FORM_strx1 + 1));
+      break;
+    case DW_FORM_strp_sup:
+    case DW_FORM_GNU_strp_alt:
+      // Strings of a supplementary file, which is not read
+      value.kind = Class::String;
+      reader.read_offset(unit.is_64bit);
+      break;
+    case DW_FORM_ref1:
+    case DW_FORM_ref2:
+    case DW_FORM_ref4:
+    case DW_FORM_ref8:
+      value.kind = Class::Reference;
+      value.value = unit.offset +
+                    read_unsigned(reader, std::size_t{1}
+                                              << (form - DW_FORM_ref1));
+      break;
+    case DW_FORM_ref_udata:
+      value.kind = Class::Reference;
+      value.value = unit.offset + reader.read_uleb128();
+      break;
+    case DW_FORM_ref_addr:
+      value.kind = Class::Reference;
+      value.value = unit.version == 2 ? reader.read<uint64_t>()
+                                      : reader.read_offset(unit.is_64bit);
+      break;
+    case DW_FORM_ref_sig8:
+    case DW_FORM_ref_sup8:
+      // References into type units or a supplementary file, which are not
+      // read
+      value.kind = Class::Reference;
+      reader.skip(8);
+      break;
+    case DW_FORM_ref_sup4:
+      value.kind = Class::Reference;
+      reader.skip(4);
+      break;
+    case DW_FORM_GNU_ref_alt:
+      value.kind = Class::Reference;
+      reader.read_offset(unit.is_64bit);
+      break;
+    case DW_FORM_block1:
+      block(reader.read<uint8_t>());
+      break;
+    case DW_FORM_block2:
+      block(reader.read<uint16_t>());
+      break;
+    case DW_FORM_block4:
+      block(reader.read<uint32_t>());
+      break;
+    case DW_FORM_block:
+    case DW_FORM_exprloc:
+      block(reader.read_uleb128());
+      break;
+    case DW_FORM_sec_offset:
+      value.kind = Class::SectionOffset;
+      value.value = reader.read_offset(unit.is_64bit);
+      break;
+    case DW_FORM_loclistx:
+      value.kind = Class::LocationListIndex;
+      value.value = reader.read_uleb128();
+      break;
+    case DW_FORM_rnglistx:
+      value.kind = Class::RangeListIndex;
+      value.value = reader.read_uleb128();
+      break;
+    case DW_FORM_indirect:
+      return read_form(reader, unit, reader.read_uleb128(), implicit_const,
+                       value);
+    default:
+      return false;
+  }
+  return not reader.overflow();
+}
+
+uint32_t DebugInfo::read_abbreviations(const uint64_t offset) {
+  const auto known = abbreviation_offsets_.find(offset);
+  if (known != abbreviation_offsets_.end()) {
+    return known->second;
+  }
+  const auto index = static_cast<uint32_t>(abbreviation_tables_.size());
+  abbreviation_offsets_.emplace(offset, index);
+  abbreviation_tables_.emplace_back();
+  if (offset >= abbrev_.size) {
+    return index;
+  }
+  std::vector<Abbreviation>& table = abbreviation_tables_.back();
+  DwarfReader reader{abbrev_.data + offset, abbrev_.data + abbrev_.size};
+  while (not reader.overflow()) {
+    const uint64_t code = reader.read_uleb128();
+    // Codes are assigned consecutively in practice, so the table is a vector
+    // indexed by code.
+    if (code == 0 or code > (uint64_t{1} << 20)) {
+      break;
+    }
+    Abbreviation abbreviation{};
+    abbreviation.tag = reader.read_uleb128();
+    abbreviation.has_children = reader.read<uint8_t>() != 0;
+    abbreviation.first = static_cast<uint32_t>(attribute_specs_.size());
+    while (not reader.overflow()) {
+      AttributeSpec spec{reader.read_uleb128(), reader.read_uleb128(), 0};
+      if (spec.name == 0 and spec.form == 0) {
+        break;
+      }
+      if (spec.form == DW_FORM_implicit_const) {
+        spec.implicit_const = reader.read_sleb128();
+      }
+      attribute_specs_.push_back(spec);
+    }
+    abbreviation.count =
+        static_cast<uint32_t>(attribute_specs_.size()) - abbreviation.first;
+    if (code >= table.size()) {
+      table.resize(code + 1);
+    }
+    table[code] = abbreviation;
+  }
+  return index;
+}
+
+void DebugInfo::index_unit(const uint32_t index) {
+  Unit& unit = units_[index];
+  // Strings and addresses of the unit entry itself may be indexed relative to
+  // the bases it holds, so the bases are read first.
+  DwarfReader reader{info_.data + unit.entry, info_.data + unit.end};
+  const uint64_t code = reader.read_uleb128();
+  const std::vector<Abbreviation>& table =
+      abbreviation_tables_[unit.abbreviations];
+  if (code == 0 or code >= table.size()) {
+    return;
+  }
+  for (uint32_t i = 0; i < table[code].count; ++i) {
+    const AttributeSpec& spec = attribute_specs_[table[code].first + i];
+    FormValue value{};
+    if (not read_form(reader, unit, spec.form, spec.implicit_const, value)) {
+      return;
+    }
+    if (spec.name == DW_AT_str_offsets_base) {
+      unit.str_offsets_base = value.value;
+    } else if (spec.name == DW_AT_addr_base) {
+      unit.addr_base = value.value;
+    } else if (spec.name == DW_AT_rnglists_base) {
+      unit.rnglists_base = value.value;
+    } else if (spec.name == DW_AT_loclists_base) {
+      unit.loclists_base = value.value;
+    }
+  }
+  DebugInfoEntry entry{};
+  if (not read_entry(unit.entry, entry)) {
+    return;
+  }
+  unit.base_address = entry.low_pc;
+  std::unordered_map<uint64_t, std::string> names{};
+  index_children(unit.entry, "", names);
+}
+
+void DebugInfo::index_children(
+    const uint64_t offset, const std::string& scope,
+    std::unordered_map<uint64_t, std::string>& names) {
+  DebugInfoEntry parent{};
+  if (not read_entry(offset, parent) or not parent.has_children) {
+    return;
+  }
+  DebugInfoEntry entry{};
+  std::vector<std::pair<uint64_t, uint64_t>> ranges{};
+  for (uint64_t child = parent.next;
+       read_entry(child, entry) and entry.tag != 0;
+       child = next_sibling(entry)) {
+    switch (entry.tag) {
+      case DW_TAG_subprogram:
+        ranges.clear();
+        if (not entry.declaration and address_ranges(entry, ranges)) {
+          for (const auto& range : ranges) {
+            if (range.first < range.second) {
+              functions_.push_back({range.first, range.second, entry.offset});
+            }
+          }
+        }
+        break;
+      case DW_TAG_variable: {
+        // Definitions of variables declared in a namespace refer to the
+        // declaration for their name.
+        std::string name{};
+        if (entry.name != nullptr) {
+          name = scope + entry.name;
+        } else if (entry.specification != 0) {
+          const auto declared = names.find(entry.specification);
+          DebugInfoEntry declaration{};
+          if (declared != names.end()) {
+            name = declared->second;
+          } else if (read_entry(entry.specification, declaration) and
+                     declaration.name != nullptr) {
+            name = declaration.name;
+          }
+        }
+        if (name.empty()) {
+          break;
+        }
+        if (entry.declaration) {
+          names.emplace(entry.offset, std::move(name));
+        } else if (not entry.location.empty() or entry.has_const_value) {
+          globals_.emplace(std::move(name), entry.offset);
+        }
+        break;
+      }
+      case DW_TAG_structure_type:
+      case DW_TAG_class_type:
+      case DW_TAG_union_type:
+        if (not entry.declaration and entry.name != nullptr) {
+          types_.emplace(scope + entry.name, entry.offset);
+        }
+        break;
+      case DW_TAG_namespace:
+        // Names in anonymous namespaces are found unqualified.
+        index_children(entry.offset,
+                       entry.name != nullptr ? scope + entry.name + "::"
+                                             : scope,
+                       names);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+bool DebugInfo::address_ranges(
+    const DebugInfoEntry& entry,
+    std::vector<std::pair<uint64_t, uint64_t>>& ranges) const {
+  if (entry.has_pc_range) {
+    ranges.emplace_back(entry.low_pc, entry.high_pc);
+    return true;
+  }
+  if (not entry.has_ranges) {
+    return false;
+  }
+  const Unit& unit = units_[entry.unit];
+  uint64_t base = unit.base_address;
+  if (unit.version < 5) {
+    if (entry.ranges >= ranges_.size) {
+      return false;
+    }
+    DwarfReader reader{ranges_.data + entry.ranges,
+                       ranges_.data + ranges_.size};
+    while (not reader.overflow()) {
+      const auto begin = reader.read<uint64_t>();
+      const auto end = reader.read<uint64_t>();
+      if (begin == 0 and end == 0) {
+        return true;
+      }
+      if (begin == ~uint64_t{0}) {
+        base = end;
+      } else {
+        ranges.emplace_back(base + begin, base + end);
+      }
+    }
+    return false;
+  }
+
+  if (entry.ranges >= rnglists_.size) {
+    return false;
+  }
+  DwarfReader reader{rnglists_.data + entry.ranges,
+                     rnglists_.data + rnglists_.size};
+  while (not reader.overflow()) {
+    switch (reader.read<uint8_t>()) {
+      case DW_RLE_end_of_list:
+        return true;
+      case DW_RLE_base_addressx:
+        base = indexed_address(unit, reader.read_uleb128());
+        break;
+      case DW_RLE_startx_endx: {
+        const uint64_t begin = indexed_address(unit, reader.read_uleb128());
+        ranges.emplace_back(begin,
+                            indexed_address(unit, reader.read_uleb128()));
+        break;
+      }
+      case DW_RLE_startx_length: {
+        const uint64_t begin = indexed_address(unit, reader.read_uleb128());
+        ranges.emplace_back(begin, begin + reader.read_uleb128());
+        break;
+      }
+      case DW_RLE_offset_pair: {
+        const uint64_t begin = base + reader.read_uleb128();
+        ranges.emplace_back(begin, base + reader.read_uleb128());
+        break;
+      }
+      case DW_RLE_base_address:
+        base = reader.read<uint64_t>();
+        break;
+      case DW_RLE_start_end: {
+        const auto begin = reader.read<uint64_t>();
+        ranges.emplace_back(begin, reader.read<uint64_t>());
+        break;
+      }
+      case DW_RLE_start_length: {
+        const auto begin = reader.read<uint64_t>();
+        ranges.emplace_back(begin, begin + reader.read_uleb128());
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+uint64_t DebugInfo::unit_index(const uint64_t offset) const noexcept {
+  auto it = std::upper_bound(
+      units_.begin(), units_.end(), offset,
+      [](const uint64_t a, const Unit& unit) { return a < unit.offset; });
+  if (it == units_.begin()) {
+    return units_.size();
+  }
+  --it;
+  return offset < it->end ? static_cast<uint64_t>(it - units_.begin())
+                          : units_.size();
+}
+}  // namespace nebugger
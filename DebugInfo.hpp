@@ -0,0 +1,262 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+class DwarfReader;
+class ElfFile;
+
+// Tags and base type encodings of `.debug_info` entries used by the debugger
+enum : uint64_t {
+  DW_TAG_array_type = 0x01,
+  DW_TAG_class_type = 0x02,
+  DW_TAG_enumeration_type = 0x04,
+  DW_TAG_formal_parameter = 0x05,
+  DW_TAG_lexical_block = 0x0b,
+  DW_TAG_member = 0x0d,
+  DW_TAG_pointer_type = 0x0f,
+  DW_TAG_reference_type = 0x10,
+  DW_TAG_compile_unit = 0x11,
+  DW_TAG_structure_type = 0x13,
+  DW_TAG_subroutine_type = 0x15,
+  DW_TAG_typedef = 0x16,
+  DW_TAG_union_type = 0x17,
+  DW_TAG_inheritance = 0x1c,
+  DW_TAG_inlined_subroutine = 0x1d,
+  DW_TAG_ptr_to_member_type = 0x1f,
+  DW_TAG_subrange_type = 0x21,
+  DW_TAG_base_type = 0x24,
+  DW_TAG_const_type = 0x26,
+  DW_TAG_enumerator = 0x28,
+  DW_TAG_subprogram = 0x2e,
+  DW_TAG_variable = 0x34,
+  DW_TAG_volatile_type = 0x35,
+  DW_TAG_restrict_type = 0x37,
+  DW_TAG_namespace = 0x39,
+  DW_TAG_unspecified_type = 0x3b,
+  DW_TAG_partial_unit = 0x3c,
+  DW_TAG_rvalue_reference_type = 0x42,
+  DW_TAG_atomic_type = 0x47
+};
+enum : uint64_t {
+  DW_ATE_boolean = 0x02,
+  DW_ATE_float = 0x04,
+  DW_ATE_signed = 0x05,
+  DW_ATE_signed_char = 0x06,
+  DW_ATE_unsigned = 0x07,
+  DW_ATE_unsigned_char = 0x08,
+  DW_ATE_UTF = 0x10
+};
+
+/// A location or frame base attribute: a DWARF expression, or a location
+/// list holding the expressions for ranges of addresses.
+struct LocationAttribute {
+  const uint8_t* expression{nullptr};
+  std::size_t size{0};
+  bool is_list{false};
+  // Offset of the list in `.debug_loc` or `.debug_loclists`
+  uint64_t list_offset{0};
+
+  bool empty() const noexcept { return expression == nullptr and not is_list; }
+};
+
+/// An entry of `.debug_info`, decoded to the attributes the debugger uses.
+///
+/// References to other entries are offsets into `.debug_info`, 0 if absent,
+/// and absent sizes and offsets are -1.
+struct DebugInfoEntry {
+  uint64_t offset{0};
+  // Index of the compilation unit holding the entry
+  uint32_t unit{0};
+  // 0 for the null entry ending a list of siblings
+  uint64_t tag{0};
+  bool has_children{false};
+  // Offset of the entry after the attributes, the first child if any
+  uint64_t next{0};
+  uint64_t sibling{0};
+
+  const char* name{nullptr};
+  uint64_t type{0};
+  uint64_t specification{0};
+  uint64_t abstract_origin{0};
+
+  int64_t byte_size{-1};
+  int64_t bit_size{-1};
+  int64_t bit_offset{-1};
+  int64_t data_bit_offset{-1};
+  int64_t member_location{-1};
+  int64_t lower_bound{0};
+  int64_t upper_bound{-1};
+  int64_t count{-1};
+  uint64_t encoding{0};
+
+  // DW_AT_const_value, a block or a constant stored in `const_value`
+  bool has_const_value{false};
+  const uint8_t* const_block{nullptr};
+  std::size_t const_size{0};
+  uint64_t const_value{0};
+
+  bool declaration{false};
+  bool artificial{false};
+
+  LocationAttribute location{};
+  LocationAttribute frame_base{};
+
+  uint64_t low_pc{0};
+  uint64_t high_pc{0};
+  bool has_pc_range{false};
+  bool has_ranges{false};
+  // Offset of the range list in `.debug_ranges` or `.debug_rnglists`
+  uint64_t ranges{0};
+};
+
+/// Index of the debugging information entries in `.debug_info`.
+///
+/// Only the compilation units and the functions and global variables at
+/// their top level or in namespaces are indexed on construction. Everything
+/// else, in particular types and the local variables of functions, is
+/// decoded from the mapped file when it is needed. DWARF versions 2 to 5 are
+/// understood, type units and split DWARF are not.
+class DebugInfo {
+ public:
+  DebugInfo() = default;
+  explicit DebugInfo(const ElfFile& elf);
+
+  bool empty() const noexcept { return units_.empty(); }
+
+  /// Decode the entry at `offset`, returns false if it is outside of the
+  /// section or malformed.
+  bool read_entry(uint64_t offset, DebugInfoEntry& entry) const;
+
+  /// Fill in the name and type of `entry` from the declaration it completes
+  /// or the abstract instance it is a concrete instance of.
+  void inherit_from_origin(DebugInfoEntry& entry) const;
+
+  /// Offset of the first entry after `entry` and all of its children.
+  uint64_t next_sibling(const DebugInfoEntry& entry) const;
+
+  /// Whether `entry` covers `address`, relative to the load address.
+  bool contains(const DebugInfoEntry& entry, uint64_t address) const;
+
+  /// The function covering `address`, 0 if there is none.
+  uint64_t find_function(uint64_t address) const noexcept;
+
+  /// The global or namespace scope variable `name`, qualified with its
+  /// namespaces, 0 if there is none.
+  uint64_t find_global(std::string_view name) const;
+
+  /// The complete structure, class or union type `name`, for types only
+  /// declared where they are used. Returns 0 if there is none.
+  uint64_t find_type(std::string_view name) const;
+
+  /// The variable or parameter `name` visible at `address` in `function`,
+  /// from the innermost enclosing scope. Returns 0 if there is none.
+  uint64_t find_local(uint64_t function, uint64_t address,
+                      std::string_view name) const;
+
+  /// Set `expression` and `size` to the expression of `location` that is
+  /// valid at `address`. Returns false if there is none, e.g. because the
+  /// variable is optimized out at that address.
+  bool find_expression(const DebugInfoEntry& entry,
+                       const LocationAttribute& location, uint64_t address,
+                       const uint8_t*& expression, std::size_t& size) const;
+
+  /// The address at `index` of `.debug_addr` for the unit of `entry`.
+  uint64_t indexed_address(const DebugInfoEntry& entry, uint64_t index) const;
+
+ private:
+  struct AttributeSpec {
+    uint64_t name;
+    uint64_t form;
+    int64_t implicit_const;
+  };
+
+  struct Abbreviation {
+    uint64_t tag{0};
+    bool has_children{false};
+    // Range of `attribute_specs_`
+    uint32_t first{0};
+    uint32_t count{0};
+  };
+
+  struct Unit {
+    uint64_t offset;
+    uint64_t end;
+    // Offset of the unit entry
+    uint64_t entry;
+    uint16_t version;
+    uint8_t address_size;
+    bool is_64bit;
+    // Index into `abbreviation_tables_`
+    uint32_t abbreviations;
+    uint64_t base_address;
+    uint64_t str_offsets_base;
+    uint64_t addr_base;
+    uint64_t rnglists_base;
+    uint64_t loclists_base;
+  };
+
+  struct Function {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t entry;
+  };
+
+  struct Section {
+    const uint8_t* data{nullptr};
+    std::size_t size{0};
+  };
+
+  struct FormValue;
+
+  bool read_form(DwarfReader& reader, const Unit& unit, uint64_t form,
+                 int64_t implicit_const, FormValue& value) const;
+  uint64_t indexed_address(const Unit& unit, uint64_t index) const;
+  // The offset of entry `index` of the offset table at `base` of a DWARF 5
+  // range or location list section
+  uint64_t list_offset(const Section& section, const Unit& unit,
+                       uint64_t base, uint64_t index) const;
+  uint32_t read_abbreviations(uint64_t offset);
+  void index_unit(uint32_t unit);
+  // Index the children of the entry at `offset`, qualifying names with
+  // `scope`
+  void index_children(uint64_t offset, const std::string& scope,
+                      std::unordered_map<uint64_t, std::string>& names);
+  bool address_ranges(const DebugInfoEntry& entry,
+                      std::vector<std::pair<uint64_t, uint64_t>>& ranges) const;
+  uint64_t unit_index(uint64_t offset) const noexcept;
+
+  Section info_{};
+  Section abbrev_{};
+  Section str_{};
+  Section line_str_{};
+  Section str_offsets_{};
+  Section addr_{};
+  Section ranges_{};
+  Section rnglists_{};
+  Section loc_{};
+  Section loclists_{};
+
+  std::vector<Unit> units_{};
+  std::vector<std::vector<Abbreviation>> abbreviation_tables_{};
+  std::unordered_map<uint64_t, uint32_t> abbreviation_offsets_{};
+  std::vector<AttributeSpec> attribute_specs_{};
+  // Sorted by address
+  std::vector<Function> functions_{};
+  std::unordered_map<std::string, uint64_t> globals_{};
+  std::unordered_map<std::string, uint64_t> types_{};
+};
+}  // namespace nebugger
@@ -7,43 +7,180 @@
 
 #include "Debugger.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <istream>
 #include <string>
+#include <string_view>
+#include <signal.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
+#include "CoreDump.hpp"
+#include "Emulator.hpp"
 #include "Linenoise/linenoise.h"
+#include "MemoryMap.hpp"
 #include "Registers.hpp"
+#include "Search.hpp"
+#include "Stats.hpp"
 
 namespace nebugger {
 namespace detail {
-std::vector<std::string> split(const std::string& s, char delimiter) {
-  std::vector<std::string> out{};
-  std::stringstream ss{s};
-  std::string item;
-
-  while (std::getline(ss, item, delimiter)) {
-    out.push_back(item);
+std::string_view trim(const std::string_view s) {
+  const auto first = s.find_first_not_of(" \t");
+  if (first == std::string_view::npos) {
+    return {};
   }
-
-  return out;
-}
-
-bool is_prefix(const std::string& s, const std::string& of) {
-  if (s.size() > of.size()) {
-    return false;
-  }
-  return std::equal(s.begin(), s.end(), of.begin());
+  return s.substr(first, s.find_last_not_of(" \t") - first + 1);
 }
 }  // namespace detail
 
+constexpr std::array<Debugger::Command, Debugger::number_of_commands>
+    Debugger::commands_{{
+        {"backtrace", "bt", 0, 0, &Debugger::handle_backtrace_command, "",
+         "backtrace usage:\n  - backtrace\n", "", false},
+        {"break", "b", 1, 1, &Debugger::handle_break_command, " LOCATION",
+         "break usage:\n"
+         "  - break LOCATION (address format 0x... or a symbol name)\n",
+         "", true},
+        {"call", "", 1, CommandArgs::max_size, &Debugger::handle_call_command,
+         " SYMBOL(ARGS...)", "call usage:\n  - call SYMBOL(ARGS...)\n", "",
+         true},
+        {"continue", "c", 0, 0, &Debugger::handle_continue_command, "",
+         "continue usage:\n  - continue\n", "", true},
+        {"disassemble", "", 0, 2, &Debugger::handle_disassemble_command,
+         " [LOCATION [COUNT]]|syntax [att|intel]",
+         "disassemble usage:\n"
+         "  - disassemble (10 instructions from the program counter)\n"
+         "  - disassemble FUNCTION (the whole function)\n"
+         "  - disassemble LOCATION COUNT\n"
+         "  - disassemble syntax [att|intel]\n",
+         "syntax", true},
+        {"find", "", 1, 2, &Debugger::handle_find_command, " PATTERN [MASK]",
+         "find usage:\n"
+         "  - find PATTERN [MASK] (search all readable memory for PATTERN,\n"
+         "    either 0xVALUE stored little endian in 1, 2, 4 or 8 bytes by\n"
+         "    its number of digits or hexadecimal bytes in memory order, e.g.\n"
+         "    7f454c46, comparing only the bits set in MASK)\n",
+         "", true},
+        {"follow-fork", "", 0, 1, &Debugger::handle_follow_fork_command,
+         " [parent|child|detach]",
+         "follow-fork usage:\n"
+         "  - follow-fork (show what happens when the process forks)\n"
+         "  - follow-fork parent|child|detach\n",
+         "parent child detach", false},
+        {"gcore", "", 1, 1, &Debugger::handle_gcore_command, " FILE",
+         "gcore usage:\n  - gcore FILE (write an ELF core file)\n", "", true},
+        {"help", "", 0, 0, &Debugger::handle_help_command, "",
+         "help usage:\n  - help\n", "", false},
+        {"inferior", "", 0, 1, &Debugger::handle_inferior_command, " [PID]",
+         "inferior usage:\n"
+         "  - inferior (list the debugged and the held processes)\n"
+         "  - inferior PID (debug the held process PID)\n",
+         "", true},
+        {"latency", "", 0, 2, &Debugger::handle_latency_command,
+         " [FUNCTION|show [FUNCTION]|delete FUNCTION|clear|interval SECONDS]",
+         "latency usage:\n"
+         "  - latency FUNCTION (time the calls of FUNCTION while the process\n"
+         "    runs, until it starts a second thread)\n"
+         "  - latency [show] (count, mean, percentiles and maximum of the\n"
+         "    durations of the timed functions)\n"
+         "  - show FUNCTION (also the distribution of its durations)\n"
+         "  - delete FUNCTION\n"
+         "  - clear (forget the durations recorded so far)\n"
+         "  - interval SECONDS (print the durations every SECONDS while the\n"
+         "    process runs, 0 to stop)\n",
+         "clear delete interval show", true},
+        {"libraries", "", 0, 0, &Debugger::handle_libraries_command, "",
+         "libraries usage:\n"
+         "  - libraries (list the loaded shared libraries)\n",
+         "", false},
+        {"memory", "", 2, 3, &Debugger::handle_memory_command,
+         " info|read|write ADDRESS [VALUE]",
+         "memory usage:\n"
+         "  - info ADDRESS (what the mapping holding ADDRESS is)\n"
+         "  - read ADDRESS (address format 0x...)\n"
+         "  - write ADDRESS VALUE (address format 0x..., value format "
+         "0x...)\n",
+         "info read write", false},
+        {"next", "n", 0, 0, &Debugger::handle_next_command, "",
+         "next usage:\n  - next\n", "", true},
+        {"print", "p", 1, CommandArgs::max_size,
+         &Debugger::handle_print_command, " EXPRESSION",
+         "print usage:\n"
+         "  - print EXPRESSION (the value of a variable of the current\n"
+         "    function or a global, followed by .MEMBER, ->MEMBER or [INDEX]\n"
+         "    and prefixed by * or &)\n",
+         "", false},
+        {"register", "", 1, 3, &Debugger::handle_register_command,
+         " dump|read|write [REGISTER [VALUE]]",
+         "register usage:\n"
+         "  - dump\n"
+         "  - read REGISTER\n"
+         "  - write REGISTER VALUE (value format 0x...)\n",
+         "dump read write", false},
+        {"snapshot", "", 1, 2, &Debugger::handle_snapshot_command,
+         " save [MAPPING]|diff [COUNT]",
+         "snapshot usage:\n"
+         "  - save [MAPPING] (copy the writable memory, or only the mappings\n"
+         "    whose path contains MAPPING, e.g. [heap])\n"
+         "  - diff [COUNT] (list the first COUNT, by default 20, ranges of\n"
+         "    bytes changed since the save)\n",
+         "diff save", true},
+        {"step", "s", 0, 0, &Debugger::handle_step_command, "",
+         "step usage:\n  - step\n", "", true},
+        {"step-engine", "", 0, 1, &Debugger::handle_step_engine_command,
+         " [single|range]",
+         "step-engine usage:\n  - step-engine [single|range]\n",
+         "single range", false},
+        {"stepi", "si", 0, 0, &Debugger::handle_stepi_command, "",
+         "stepi usage:\n  - stepi\n", "", true},
+        {"stats", "", 0, 1, &Debugger::handle_stats_command, " [reset]",
+         "stats usage:\n"
+         "  - stats (latency of commands, waits and ptrace calls)\n"
+         "  - stats reset\n",
+         "reset", false},
+        {"tracepoint", "", 1, 5, &Debugger::handle_tracepoint_command,
+         " add|delete|list|show ...",
+         "tracepoint usage:\n"
+         "  - add LOCATION [REGISTER OFFSET LENGTH] (collects LENGTH bytes at\n"
+         "    REGISTER + OFFSET on every hit)\n"
+         "  - delete ID\n"
+         "  - list\n"
+         "  - show [COUNT]\n"
+         "The memory is read by the inferior itself without any check: if\n"
+         "REGISTER + OFFSET is not mapped at a hit, e.g. a null pointer, the\n"
+         "inferior crashes with a SIGSEGV. Offsets from rsp within the stack\n"
+         "are safe.\n",
+         "add delete list show", true},
+        {"watch-region", "", 1, 2, &Debugger::handle_watch_region_command,
+         " ADDRESS LENGTH|delete ID|list",
+         "watch-region usage:\n"
+         "  - watch-region ADDRESS LENGTH (stop when the LENGTH bytes at\n"
+         "    ADDRESS, an address 0x... or a symbol name, change)\n"
+         "  - watch-region delete ID\n"
+         "  - watch-region list\n"
+         "System calls writing into watched pages, e.g. a read into a watched\n"
+         "buffer, run with the pages unprotected and their writes are not\n"
+         "reported. Stepping over a system call instruction writing into\n"
+         "them fails with EFAULT.\n",
+         "delete list", true},
+    }};
+
 void Debugger::run() {
-  wait_for_signal();
+  if (process_->is_live()) {
+    wait_for_start();
+  } else {
+    report_core();
+  }
+  linenoiseSetCompletionCallback(&Debugger::complete_command);
+  linenoiseSetHintsCallback(&Debugger::hint_command);
   char* line = nullptr;
   while ((line = linenoise("dbg> ")) != nullptr) {
     handle_command(line);
@@ -52,16 +189,168 @@ void Debugger::run() {
   }
 }
 
+int Debugger::run_script(std::istream& script, const std::string& name) {
+  if (process_->is_live()) {
+    wait_for_start();
+  } else {
+    report_core();
+  }
+  std::string line{};
+  size_t line_number = 0;
+  int status = 0;
+  while (std::getline(script, line)) {
+    ++line_number;
+    if (not line.empty() and line.back() == '\r') {
+      line.pop_back();
+    }
+    const auto first = line.find_first_not_of(" \t");
+    if (first == std::string::npos or line[first] == '#') {
+      continue;
+    }
+    bool succeeded = false;
+    try {
+      succeeded = handle_command(line);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+    }
+    if (not succeeded) {
+      out_.flush();
+      std::cerr << name << ':' << line_number << ": command failed: " << line
+                << '\n';
+      status = 1;
+      break;
+    }
+  }
+  if (exit_code_ == -1) {
+    // Never leave the inferior behind, a script that ends with it stopped is
+    // as successful as one that ran it to completion.
+    kill_inferior();
+  } else if (status == 0) {
+    status = exit_code_;
+  }
+  out_.flush();
+  return status;
+}
+
+void Debugger::wait_for_start() {
+  wait_for_signal();
+  if (exit_code_ == -1 and process_->is_live()) {
+    trace_forks(pid_);
+    track_libraries();
+  }
+}
+
+void Debugger::print_state(std::ostream& os) {
+  if (exit_code_ != -1) {
+    os << "exited with code " << exit_code_ << '\n';
+    return;
+  }
+  const uint64_t pc = get_program_counter();
+  const uint64_t relative_pc = pc - static_cast<uint64_t>(load_address());
+  const Symbol* const function =
+      program_->elf.find_function_containing(relative_pc);
+  const LineRow* const row = program_->line_table.find(relative_pc);
+  os << "stopped";
+  if (function != nullptr) {
+    os << " in " << function->name;
+  } else {
+    print_library_function(os, pc);
+  }
+  if (row != nullptr) {
+    os << " at " << program_->line_table.file_name(*row) << ':' << row->line;
+  }
+  if (function == nullptr and row == nullptr) {
+    os << " at 0x" << std::hex << pc << std::dec;
+  }
+  os << '\n';
+}
+
+void Debugger::kill_inferior() {
+  if (exit_code_ != -1 or not process_->is_live()) {
+    return;
+  }
+  kill(pid_, SIGKILL);
+  waitpid(pid_, nullptr, 0);
+  for (const HeldProcess& held : held_) {
+    kill(held.pid, SIGKILL);
+    waitpid(held.pid, nullptr, __WALL);
+  }
+  held_.clear();
+}
+
 void Debugger::dump_registers() {
+  const user_regs_struct regs = process_->registers();
   for (const auto& t : register_descriptors) {
-    std::cout << t.name << " 0x" << std::setfill('0') << std::setw(16)
-              << std::hex << get_register_value(pid_, t.reg) << "\n";
+    out_ << t.name << " 0x" << std::setfill('0') << std::setw(16)
+         << std::hex << get_register_value(regs, t.reg) << "\n";
   }
 }
 
+bool Debugger::call_function(const std::string_view expression) {
+  // Expressions look like `name(arg0, arg1, ...)`, the parentheses may be
+  // omitted for functions without arguments.
+  const auto open_paren = expression.find('(');
+  const auto close_paren = expression.rfind(')');
+  if (open_paren != std::string_view::npos and
+      (close_paren == std::string_view::npos or close_paren < open_paren)) {
+    std::cerr << "Missing closing parenthesis in '" << expression << "'\n";
+    return false;
+  }
+  const std::string_view name = detail::trim(expression.substr(0, open_paren));
+  std::vector<uint64_t> args{};
+  if (open_paren != std::string_view::npos) {
+    std::string_view list =
+        expression.substr(open_paren + 1, close_paren - open_paren - 1);
+    while (not list.empty()) {
+      const auto comma = list.find(',');
+      const std::string_view arg = detail::trim(list.substr(0, comma));
+      list = comma == std::string_view::npos ? std::string_view{}
+                                             : list.substr(comma + 1);
+      if (arg.empty()) {
+        continue;
+      }
+      uint64_t value = 0;
+      if (not parse_integer(arg, value)) {
+        std::cerr << "Invalid integer argument '" << arg << "'\n";
+        return false;
+      }
+      args.push_back(value);
+    }
+  }
+
+  const std::intptr_t address = resolve_symbol(name);
+  if (address == 0) {
+    return false;
+  }
+  uint64_t return_value = 0;
+  // The call stops at any int3 it does not know of.
+  tracee_->latency.lift();
+  const bool called =
+      tracee_->function_caller.call(address, args, return_value);
+  tracee_->latency.restore();
+  if (not called) {
+    return false;
+  }
+  out_ << name << " returned 0x" << std::hex << return_value << std::dec
+       << " (" << static_cast<int64_t>(return_value) << ")\n";
+  if (mi_.enabled()) {
+    mi_.emit(mi_.record("call-result")
+                 .string("function", name)
+                 .integer("value", static_cast<int64_t>(return_value)));
+  }
+  return true;
+}
+
 void Debugger::continue_execution() {
+  watch_stop_ = false;
   step_over_breakpoint();
-  if (ptrace(PTRACE_CONT, pid_, nullptr, nullptr) == -1) {
+  if (exit_code_ != -1 or pending_child_ != 0 or pending_exec_ or
+      watch_stop_) {
+    return;
+  }
+  if (timed_ptrace(Probe::PtraceCont,
+                   static_cast<__ptrace_request>(continue_request()), pid_,
+                   nullptr, nullptr) == -1) {
     std::cerr << "Failed to continue of tracing on child process with errno: "
               << errno << '\n';
     return;
@@ -70,113 +359,1474 @@ void Debugger::continue_execution() {
 }
 
 uint64_t Debugger::get_program_counter() {
-  return get_register_value(pid_, Register::rip);
+  return process_->registers().rip;
+}
+
+const Debugger::Command& Debugger::find_command(const std::string_view name) {
+  return *std::find_if(
+      commands_.begin(), commands_.end(),
+      [name](const Command& command) { return command.name == name; });
+}
+
+bool Debugger::handle_command(const std::string_view line) {
+  const CommandArgs args{line};
+  if (args.empty()) {
+    return true;
+  }
+  if (args.overflow()) {
+    std::cerr << "Too many arguments, at most " << CommandArgs::max_size - 1
+              << " are supported.\n";
+    return false;
+  }
+  bool succeeded = false;
+  {
+    const LatencyTimer timer{Probe::Command};
+    succeeded = dispatch_command(args);
+  }
+  follow_pending();
+  if (mi_.enabled()) {
+    mi_.emit(mi_.record("result")
+                 .string("command", args[0])
+                 .string("status", succeeded ? "done" : "error"));
+  }
+  return succeeded;
+}
+
+bool Debugger::dispatch_command(const CommandArgs& args) {
+  for (const Command& command : commands_) {
+    if (args[0] != command.name and args[0] != command.alias) {
+      continue;
+    }
+    const size_t number_of_args = args.size() - 1;
+    if (number_of_args < command.min_args or
+        number_of_args > command.max_args) {
+      std::cerr << command.usage;
+      return false;
+    }
+    if (command.live_only and not process_->is_live()) {
+      std::cerr << "The '" << command.name
+                << "' command needs a running process, not a core file.\n";
+      return false;
+    }
+    // Running or modifying the process may have changed its mappings, also
+    // when the command fails part way through with an exception.
+    struct InvalidateMemoryMap {
+      const Debugger& debugger;
+      const bool live_only;
+      ~InvalidateMemoryMap() {
+        if (live_only) {
+          debugger.tracee_->memory_map.invalidate();
+        }
+      }
+    };
+    try {
+      const InvalidateMemoryMap invalidate{*this, command.live_only};
+      return (this->*command.handler)(args);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << '\n';
+      return false;
+    }
+  }
+  std::cerr << "Unknown command '" << args[0] << "'.\n";
+  return false;
+}
+
+void Debugger::complete_command(const char* const buffer,
+                                linenoiseCompletions* const completions) {
+  const std::string_view line{buffer};
+  const auto space = line.find(' ');
+  std::string completion{};
+  for (const Command& command : commands_) {
+    if (space == std::string_view::npos) {
+      if (command.name.substr(0, line.size()) == line) {
+        completion = command.name;
+        linenoiseAddCompletion(completions, completion.c_str());
+      }
+      continue;
+    }
+    // Complete the first argument of commands that have subcommands
+    const std::string_view name = line.substr(0, space);
+    const std::string_view partial = line.substr(space + 1);
+    if ((name != command.name and name != command.alias) or
+        partial.find(' ') != std::string_view::npos) {
+      continue;
+    }
+    const CommandArgs subcommands{command.subcommands};
+    for (size_t i = 0; i < subcommands.size(); ++i) {
+      if (subcommands[i].substr(0, partial.size()) == partial) {
+        completion = name;
+        completion += ' ';
+        completion += subcommands[i];
+        linenoiseAddCompletion(completions, completion.c_str());
+      }
+    }
+  }
+}
+
+char* Debugger::hint_command(const char* const buffer, int* const color,
+                             int* const bold) {
+  const std::string_view line{buffer};
+  for (const Command& command : commands_) {
+    if ((line == command.name or line == command.alias) and
+        not command.hint.empty()) {
+      *color = 35;
+      *bold = 0;
+      // The hints are string literals, linenoise does not free them since no
+      // free callback is set.
+      return const_cast<char*>(command.hint.data());
+    }
+  }
+  return nullptr;
+}
+
+bool Debugger::handle_backtrace_command(const CommandArgs& /*args*/) {
+  print_backtrace();
+  return true;
+}
+
+bool Debugger::handle_break_command(const CommandArgs& args) {
+  if (args[1].substr(0, 2) != "0x" and find_symbol(args[1]) == 0 and
+      tracee_->libraries.loader_breakpoint() != 0) {
+    // The symbol may be defined by a library that is not loaded yet.
+    pending_breakpoints_.emplace_back(args[1]);
+    out_ << "Breakpoint on '" << args[1]
+         << "' pending until a shared library defining it is loaded\n";
+    return true;
+  }
+  const std::intptr_t address = resolve_symbol(args[1]);
+  if (address == 0) {
+    return false;
+  }
+  return set_breakpoint_at_address(address);
+}
+
+bool Debugger::handle_call_command(const CommandArgs& args) {
+  return call_function(args.rest(1));
+}
+
+bool Debugger::handle_continue_command(const CommandArgs& /*args*/) {
+  continue_execution();
+  return true;
+}
+
+bool Debugger::handle_disassemble_command(const CommandArgs& args) {
+  if (args.size() >= 2 and args[1] == "syntax") {
+    if (args.size() == 3) {
+      if (args[2] != "att" and args[2] != "intel") {
+        std::cerr << find_command("disassemble").usage;
+        return false;
+      }
+      syntax_ = args[2] == "att" ? Syntax::Att : Syntax::Intel;
+    }
+    out_ << "Disassembly syntax: "
+         << (syntax_ == Syntax::Att ? "att" : "intel") << '\n';
+    return true;
+  }
+  if (exit_code_ != -1) {
+    std::cerr << "The process has exited\n";
+    return false;
+  }
+  auto pc = static_cast<std::intptr_t>(get_program_counter());
+  // Show the instruction of a breakpoint that was just hit.
+  const auto hit = tracee_->breakpoints.find(pc - 1);
+  if (hit != tracee_->breakpoints.end() and hit->second.is_enabled()) {
+    pc -= 1;
+  }
+  std::intptr_t address = pc;
+  std::intptr_t end = 0;
+  std::size_t count = 10;
+  if (args.size() >= 2) {
+    address = resolve_symbol(args[1]);
+    if (address == 0) {
+      return false;
+    }
+    const Symbol* const function =
+        program_->elf.find_symbol(std::string{args[1]});
+    if (args.size() == 2 and function != nullptr and function->size > 0) {
+      end = address + static_cast<std::intptr_t>(function->size);
+    }
+  }
+  if (args.size() == 3 and not parse_integer(args[2], count)) {
+    std::cerr << find_command("disassemble").usage;
+    return false;
+  }
+  for (std::size_t i = 0; end != 0 ? address < end : i < count; ++i) {
+    const Instruction* const insn = tracee_->instructions.find(address);
+    if (insn == nullptr) {
+      std::cerr << "Cannot read the text at 0x" << std::hex << address
+                << std::dec << '\n';
+      return i > 0;
+    }
+    const uint8_t* const bytes = tracee_->instructions.bytes(*insn);
+    // Undecodable bytes are shown one at a time.
+    const std::size_t length = insn->valid ? insn->length : 1;
+    out_ << (address == pc ? "=> " : "   ") << "0x" << std::hex << address;
+    print_function_offset(out_, static_cast<uint64_t>(address));
+    out_ << ": " << std::hex << std::setfill('0');
+    for (std::size_t j = 0; j < std::max<std::size_t>(length, 8); ++j) {
+      if (j < length) {
+        out_ << std::setw(2) << static_cast<unsigned>(bytes[j]) << ' ';
+      } else {
+        out_ << "   ";
+      }
+    }
+    out_ << std::setfill(' ') << std::dec << ' '
+         << format_instruction(*insn, bytes, syntax_);
+    if (insn->valid and insn->relative_branch) {
+      print_function_offset(out_, static_cast<uint64_t>(insn->branch_target()));
+    } else if (insn->valid and insn->rip_relative) {
+      const std::intptr_t target =
+          address + insn->length + insn->displacement;
+      out_ << "  # 0x" << std::hex << target << std::dec;
+      print_function_offset(out_, static_cast<uint64_t>(target));
+    }
+    out_ << '\n';
+    address += static_cast<std::intptr_t>(length);
+  }
+  return true;
+}
+
+bool Debugger::handle_find_command(const CommandArgs& args) {
+  constexpr std::size_t max_matches = 100;
+  SearchPattern pattern{};
+  if (not parse_search_pattern(args[1], args[2], pattern)) {
+    std::cerr << find_command("find").usage;
+    return false;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  MemorySearch search{pid_, std::move(pattern)};
+  SearchMatch match{};
+  std::size_t count = 0;
+  while (count < max_matches and search.next(match)) {
+    const MemoryRegion& region = search.regions()[match.region];
+    out_ << "0x" << std::hex << match.address;
+    if (not region.path.empty()) {
+      out_ << ' ' << region.path << "+0x" << match.address - region.start;
+    }
+    out_ << std::dec << '\n';
+    ++count;
+  }
+  if (count == max_matches and search.next(match)) {
+    out_ << "Stopped after " << count << " matches";
+  } else {
+    out_ << count << " matches";
+  }
+  out_ << ", scanned " << search.bytes_scanned() / (1024 * 1024)
+       << " MiB in " << std::fixed << std::setprecision(1)
+       << std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count()
+       << " ms\n"
+       << std::defaultfloat;
+  return true;
+}
+
+bool Debugger::handle_follow_fork_command(const CommandArgs& args) {
+  constexpr std::array<std::string_view, 3> names{"parent", "child",
+                                                  "detach"};
+  if (args.size() == 1) {
+    out_ << "Following the " << names[static_cast<std::size_t>(follow_fork_)]
+         << " on fork\n";
+    return true;
+  }
+  const auto name = std::find(names.begin(), names.end(), args[1]);
+  if (name == names.end()) {
+    std::cerr << find_command("follow-fork").usage;
+    return false;
+  }
+  follow_fork_ = static_cast<FollowFork>(name - names.begin());
+  return true;
 }
 
-void Debugger::handle_command(const std::string& line) {
-  const auto args = detail::split(line, ' ');
+bool Debugger::handle_gcore_command(const CommandArgs& args) {
+  // The core file should hold the program's code, not our int3s and
+  // tracepoint jumps, the original protection of watched pages, and when
+  // stopped at a breakpoint the program counter of the breakpoint's
+  // instruction.
+  const uint64_t pc = get_program_counter();
+  const bool at_breakpoint = tracee_->stepper.at_breakpoint();
+  if (at_breakpoint) {
+    set_program_counter(pc - 1);
+  }
+  InsertedCode code = *inserted_code();
+  for (const auto& [address, bp] : tracee_->stepper.temporary_breakpoints()) {
+    if (bp.is_enabled()) {
+      code.breakpoints.emplace_back(address, bp.saved_instruction());
+    }
+  }
+  // The jumps to the trampolines, to write back afterwards
+  std::vector<std::pair<std::intptr_t, std::vector<uint8_t>>> jumps{};
+  for (const auto& [address, original] : code.tracepoints) {
+    std::vector<uint8_t> jump(original.size());
+    if (not tracee_->memory.read(address, jump.data(), jump.size())) {
+      std::cerr << "Failed to read the tracepoint at 0x" << std::hex
+                << address << std::dec << '\n';
+      if (at_breakpoint) {
+        set_program_counter(pc);
+      }
+      return false;
+    }
+    jumps.emplace_back(address, std::move(jump));
+  }
+  remove_inserted_code(pid_, code);
+  CoreDumpSummary summary{};
+  const bool success =
+      write_core_file(pid_, tracee_->memory, std::string{args[1]}, summary);
+  reinsert_breakpoints(pid_, code);
+  for (const auto& [address, jump] : jumps) {
+    if (not tracee_->memory.write(address, jump.data(), jump.size())) {
+      std::cerr << "Failed to restore the tracepoint at 0x" << std::hex
+                << address << std::dec << '\n';
+    }
+  }
+  if (not tracee_->watch_regions.protect_all(true)) {
+    std::cerr << "Failed to protect the watched pages again\n";
+  }
+  if (at_breakpoint) {
+    set_program_counter(pc);
+  }
+  if (not success) {
+    return false;
+  }
+  out_ << "Saved core file " << args[1] << ": " << summary.regions
+       << " regions, " << summary.bytes_read / 1024 << " KiB read, "
+       << summary.bytes_written / 1024 << " KiB written, "
+       << std::fixed << std::setprecision(1)
+       << summary.read_seconds * 1000.0 << " ms reading of "
+       << summary.total_seconds * 1000.0 << " ms\n"
+       << std::defaultfloat;
+  return true;
+}
+
+bool Debugger::handle_help_command(const CommandArgs& /*args*/) {
+  for (const Command& command : commands_) {
+    out_ << command.name;
+    if (not command.alias.empty()) {
+      out_ << ", " << command.alias;
+    }
+    out_ << command.hint << '\n';
+  }
+  return true;
+}
+
+bool Debugger::handle_inferior_command(const CommandArgs& args) {
+  if (args.size() == 1) {
+    out_ << "* " << pid_ << (exit_code_ == -1 ? "" : " (exited)") << '\n';
+    for (const HeldProcess& held : held_) {
+      out_ << "  " << held.pid << '\n';
+    }
+    return true;
+  }
+  pid_t pid = 0;
+  if (not parse_integer(args[1], pid)) {
+    std::cerr << find_command("inferior").usage;
+    return false;
+  }
+  const auto held = std::find_if(
+      held_.begin(), held_.end(),
+      [pid](const HeldProcess& process) { return process.pid == pid; });
+  if (held == held_.end()) {
+    std::cerr << "Process " << pid << " is not held by the debugger\n";
+    return false;
+  }
+  const HeldProcess next = *held;
+  held_.erase(held);
+  if (exit_code_ == -1) {
+    held_.push_back({pid_, inserted_code()});
+  }
+  replace_tracee(next.pid, *next.code);
+  out_ << "Switched to process " << pid_ << '\n';
+  print_location();
+  return true;
+}
+
+bool Debugger::handle_latency_command(const CommandArgs& args) {
+  LatencyTracer& latency = tracee_->latency;
+  const std::size_t number_of_args = args.size();
+  std::size_t seconds = 0;
+  if (number_of_args == 1 or (number_of_args == 2 and args[1] == "show")) {
+    return latency.print(out_);
+  } else if (number_of_args == 3 and args[1] == "show") {
+    return latency.print(out_, args[2]);
+  } else if (number_of_args == 3 and args[1] == "delete") {
+    if (not latency.remove(args[2])) {
+      return false;
+    }
+    inserted_code_.reset();
+    return true;
+  } else if (number_of_args == 2 and args[1] == "clear") {
+    latency.clear();
+    return true;
+  } else if (number_of_args == 3 and args[1] == "interval" and
+             parse_integer(args[2], seconds)) {
+    latency.set_report_interval(static_cast<double>(seconds));
+    return true;
+  } else if (number_of_args != 2) {
+    std::cerr << find_command("latency").usage;
+    return false;
+  }
+  if (count_threads(pid_) > 1) {
+    std::cerr << "Cannot time calls in a process with several threads, only "
+                 "the first one is traced\n";
+    return false;
+  }
+  const std::intptr_t address = resolve_symbol(args[1]);
+  if (address == 0) {
+    return false;
+  }
+  const auto bp = tracee_->breakpoints.find(address);
+  if (bp != tracee_->breakpoints.end() and bp->second.is_enabled()) {
+    std::cerr << "Breakpoint at 0x" << std::hex << address << std::dec
+              << " is in the way of timing the calls, remove it first\n";
+    return false;
+  }
+  for (const auto& range : tracee_->fast_tracepoints.patched_ranges()) {
+    if (address >= range.first and address < range.second) {
+      std::cerr << "Cannot time calls of a function patched by a tracepoint\n";
+      return false;
+    }
+  }
+  if (not latency.add(std::string{args[1]}, address)) {
+    return false;
+  }
+  inserted_code_.reset();
+  out_ << "Timing calls of " << args[1] << " at 0x" << std::hex << address
+       << std::dec << '\n';
+  return true;
+}
+
+bool Debugger::handle_libraries_command(const CommandArgs& /*args*/) {
+  const auto& libraries = tracee_->libraries.libraries();
+  if (libraries.empty()) {
+    out_ << "No shared libraries loaded\n";
+  }
+  for (const SharedLibrary& library : libraries) {
+    out_ << "0x" << std::hex << std::setfill('0') << std::setw(16)
+         << library.start << "-0x" << std::setw(16) << library.end
+         << std::dec << ' ' << library.path << '\n';
+  }
+  for (const std::string& name : pending_breakpoints_) {
+    out_ << "Pending breakpoint on '" << name << "'\n";
+  }
+  return true;
+}
+
+bool Debugger::handle_memory_command(const CommandArgs& args) {
+  uint64_t address = 0;
+  uint64_t value = 0;
+  if (args.size() == 3 and args[1] == "info" and process_->is_live() and
+      parse_integer(args[2], address)) {
+    print_mapping(static_cast<std::intptr_t>(address));
+  } else if (args.size() == 3 and args[1] == "read" and
+             parse_integer(args[2], address)) {
+    if (not read_memory(address, value)) {
+      return false;
+    }
+    out_ << std::hex << value << std::dec << "\n";
+  } else if (args.size() == 4 and args[1] == "write" and
+             process_->is_live() and parse_integer(args[2], address) and
+             parse_integer(args[3], value)) {
+    return write_memory(address, value);
+  } else {
+    std::cerr << find_command("memory").usage;
+    return false;
+  }
+  return true;
+}
+
+bool Debugger::handle_next_command(const CommandArgs& /*args*/) {
+  step_line(false);
+  return true;
+}
+
+bool Debugger::handle_print_command(const CommandArgs& args) {
+  user_regs_struct regs = process_->registers();
+  // The program is stopped in the instruction under a breakpoint it hit.
+  if (process_->is_live() and tracee_->stepper.at_breakpoint()) {
+    --regs.rip;
+  }
+  if (printer_ == nullptr) {
+    printer_ = std::make_unique<ValuePrinter>(program_->debug_info,
+                                              program_->call_frames);
+  }
+  return printer_->print(args.rest(1), regs, *process_, load_address(), out_);
+}
+
+bool Debugger::handle_register_command(const CommandArgs& args) {
+  uint64_t value = 0;
+  if (args.size() == 2 and args[1] == "dump") {
+    dump_registers();
+  } else if (args.size() == 3 and args[1] == "read") {
+    out_ << get_register_value(process_->registers(),
+                               get_register_from_name(args[2]))
+         << '\n';
+  } else if (args.size() == 4 and args[1] == "write" and
+             process_->is_live() and parse_integer(args[3], value)) {
+    const Register reg = get_register_from_name(args[2]);
+    set_register_value(pid_, reg, value);
+    if (reg == Register::rip) {
+      // Wherever rip was set to, it is not past a breakpoint to rewind.
+      tracee_->stepper.set_at_breakpoint(false);
+    }
+  } else {
+    std::cerr << find_command("register").usage;
+    return false;
+  }
+  return true;
+}
+
+bool Debugger::handle_snapshot_command(const CommandArgs& args) {
+  MemorySnapshot& snapshot = tracee_->snapshot;
+  SnapshotSummary summary{};
+  std::size_t count = 20;
+  if (args[1] == "save") {
+    if (not snapshot.save(args.size() == 3 ? args[2] : std::string_view{},
+                          summary)) {
+      return false;
+    }
+    out_ << "Saved snapshot: " << summary.mappings << " mappings, "
+         << summary.bytes / 1024 << " KiB in " << std::fixed
+         << std::setprecision(1) << summary.seconds * 1000.0 << " ms"
+         << std::defaultfloat
+         << (summary.soft_dirty ? ", tracking soft-dirty pages" : "")
+         << '\n';
+  } else if (args[1] == "diff" and
+             (args.size() == 2 or parse_integer(args[2], count))) {
+    std::vector<ChangedRange> ranges{};
+    if (not snapshot.diff(ranges, summary)) {
+      return false;
+    }
+    uint64_t changed = 0;
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+      const ChangedRange& range = ranges[i];
+      changed += static_cast<uint64_t>(range.end - range.start);
+      if (i < count) {
+        out_ << "0x" << std::hex << range.start << "-0x" << range.end
+             << std::dec << ' ' << range.end - range.start << " bytes";
+        const std::string& name = snapshot.mapping_name(range.mapping);
+        out_ << (name.empty() ? "" : " ") << name << '\n';
+      }
+    }
+    if (ranges.size() > count) {
+      out_ << "... " << ranges.size() - count << " more ranges\n";
+    }
+    out_ << ranges.size() << " changed ranges, " << changed
+         << " bytes; compared " << summary.bytes_compared / 1024 << " of "
+         << summary.bytes / 1024 << " KiB in " << std::fixed
+         << std::setprecision(1) << summary.seconds * 1000.0 << " ms"
+         << std::defaultfloat << '\n';
+    if (summary.bytes_unreadable != 0) {
+      out_ << summary.bytes_unreadable / 1024
+           << " KiB of the snapshot are no longer mapped\n";
+    }
+  } else {
+    std::cerr << find_command("snapshot").usage;
+    return false;
+  }
+  return true;
+}
+
+bool Debugger::handle_step_command(const CommandArgs& /*args*/) {
+  step_line(true);
+  return true;
+}
+
+bool Debugger::handle_step_engine_command(const CommandArgs& args) {
+  if (args.size() == 2) {
+    if (args[1] != "single" and args[1] != "range") {
+      std::cerr << find_command("step-engine").usage;
+      return false;
+    }
+    step_engine_ =
+        args[1] == "single" ? StepEngine::SingleStep : StepEngine::Range;
+  }
+  out_ << "Step engine: "
+       << (step_engine_ == StepEngine::SingleStep ? "single" : "range")
+       << ", last step took " << last_step_stops_ << " stops\n";
+  return true;
+}
+
+bool Debugger::handle_stepi_command(const CommandArgs& /*args*/) {
+  tracee_->latency.lift();
+  const StepResult result = tracee_->stepper.step_instruction();
+  tracee_->latency.restore();
+  report_step(result);
+  return true;
+}
+
+bool Debugger::handle_stats_command(const CommandArgs& args) {
+  if (args.size() == 2) {
+    if (args[1] != "reset") {
+      std::cerr << find_command("stats").usage;
+      return false;
+    }
+    reset_stats();
+    return true;
+  }
+  print_stats(out_);
+  return true;
+}
+
+bool Debugger::handle_tracepoint_command(const CommandArgs& args) {
+  const std::string_view usage = find_command("tracepoint").usage;
   const size_t number_of_args = args.size();
-  const auto command = args[0];
-
-  // Help strings
-  const std::string help_text_memory{
-      "memory usage:\n"
-      "  - read ADDRESS (address format 0x...)\n"
-      "  - write ADDRESS VALUE (address format 0x..., value format 0x...)\n"};
-  const std::string help_text_register{
-      "register usage:\n"
-      "  - dump\n"
-      "  - read ADDRESS (address format 0x...)\n"
-      "  - write ADDRESS VALUE (address format 0x..., value format 0x...)\n"};
-
-  // We not just check that command == "continue" or 'c'?
-  if (command == "continue" or command == "c") {
-    continue_execution();
-  } else if (command == "b" or command == "break") {
-    // requires the address by written as
-    std::string address{args[1], 2};
-    set_breakpoint_at_address(std::stol(address, 0, 16));
-  } else if (command == "register") {
-    if (number_of_args == 2 and args[1] == "dump") {
-      dump_registers();
-    } else if (number_of_args == 3 and args[1] == "read") {
-      std::cout << get_register_value(pid_, get_register_from_name(args[2]))
-                << '\n';
-    } else if (number_of_args == 4 and args[1] == "write") {
-      const std::string val{args[3], 2};
-      set_register_value(pid_, get_register_from_name(args[2]),
-                         std::stol(val, 0, 16));
-    } else {
-      std::cerr << help_text_register;
+  if (number_of_args >= 3 and args[1] == "add" and
+      (number_of_args == 3 or number_of_args == 6)) {
+    const std::intptr_t address = resolve_symbol(args[2]);
+    if (address == 0) {
+      return false;
+    }
+    for (std::intptr_t i = 0; i < 16; ++i) {
+      const auto it = tracee_->breakpoints.find(address + i);
+      if (it != tracee_->breakpoints.end() and it->second.is_enabled()) {
+        std::cerr << "Breakpoint at 0x" << std::hex << address + i << std::dec
+                  << " is too close to the tracepoint, remove it first\n";
+        return false;
+      }
     }
-  } else if (command == "memory") {
-    if (number_of_args == 3 and args[1] == "read") {
-      const std::string addr{args[2], 2};
-      std::cout << std::hex << read_memory(std::stol(addr, 0, 16)) << "\n";
+    MemoryCollection collection{};
+    if (number_of_args == 6) {
+      collection.base = get_register_from_name(args[3]);
+      if (not parse_integer(args[4], collection.offset) or
+          not parse_integer(args[5], collection.length)) {
+        std::cerr << usage;
+        return false;
+      }
     }
-    if (number_of_args == 4 and args[1] == "write") {
-      const std::string addr{args[2], 2};
-      const std::string val{args[3], 2};
-      write_memory(std::stol(addr, 0, 16), std::stol(val, 0, 16));
-    } else {
-      std::cerr << help_text_memory;
+    const int id = tracee_->fast_tracepoints.insert(address, collection);
+    if (id == -1) {
+      return false;
+    }
+    inserted_code_.reset();
+    out_ << "Set tracepoint " << id << " at address 0x" << std::hex
+         << address << std::dec << "\n";
+    if (mi_.enabled()) {
+      mi_.emit(mi_.record("tracepoint-created")
+                   .integer("id", id)
+                   .address("address", static_cast<uint64_t>(address)));
+    }
+    return true;
+  }
+  int id = 0;
+  size_t count = 10;
+  if (number_of_args == 3 and args[1] == "delete" and
+      parse_integer(args[2], id)) {
+    inserted_code_.reset();
+    return tracee_->fast_tracepoints.remove(id);
+  } else if (number_of_args == 2 and args[1] == "list") {
+    tracee_->fast_tracepoints.print_list(out_);
+  } else if ((number_of_args == 2 or number_of_args == 3) and
+             args[1] == "show" and
+             (number_of_args == 2 or parse_integer(args[2], count))) {
+    tracee_->fast_tracepoints.print_records(out_, count);
+  } else {
+    std::cerr << usage;
+    return false;
+  }
+  return true;
+}
+
+bool Debugger::handle_watch_region_command(const CommandArgs& args) {
+  RegionWatchpoints& watches = tracee_->watch_regions;
+  std::size_t id = 0;
+  std::size_t length = 0;
+  if (args.size() == 2 and args[1] == "list") {
+    if (watches.regions().empty()) {
+      out_ << "No watch regions\n";
+    }
+    for (const WatchRegion& region : watches.regions()) {
+      out_ << region.id << ": 0x" << std::hex << region.start << "-0x"
+           << region.end << std::dec << ", " << region.end - region.start
+           << " bytes, " << region.hits << " hits\n";
+    }
+  } else if (args.size() == 3 and args[1] == "delete" and
+             parse_integer(args[2], id)) {
+    inserted_code_.reset();
+    return watches.remove(id);
+  } else if (args.size() == 3 and parse_integer(args[2], length)) {
+    const std::intptr_t address = resolve_symbol(args[1]);
+    id = address != 0 ? watches.add(address, length) : 0;
+    if (id == 0) {
+      return false;
     }
+    inserted_code_.reset();
+    out_ << "Watch region " << id << " at 0x" << std::hex << address
+         << std::dec << ", " << length << " bytes\n";
   } else {
-    std::cerr << "Unknown command '" << command << "'.\n";
+    std::cerr << find_command("watch-region").usage;
+    return false;
+  }
+  return true;
+}
+
+std::intptr_t Debugger::load_address() {
+  if (program_->elf.is_position_independent() and load_address_ == 0) {
+    load_address_ = process_->load_address(program_->elf.path());
+  }
+  return load_address_;
+}
+
+int Debugger::continue_request() const {
+  // Watched pages are unprotected around the system calls writing into them.
+  return tracee_->watch_regions.watching() ? PTRACE_SYSCALL : PTRACE_CONT;
+}
+
+void Debugger::handle_watched_syscall() {
+  if (not tracee_->watch_regions.handle_syscall()) {
+    std::cerr << "Failed to lift the protection of the watched pages around "
+                 "a system call\n";
+  }
+}
+
+WatchFault Debugger::handle_watch_fault() {
+  WatchHit hit{};
+  const WatchFault fault = tracee_->watch_regions.handle_fault(hit);
+  if (fault == WatchFault::Failed) {
+    std::cerr << "Failed to carry out the write into watched memory at 0x"
+              << std::hex << hit.pc << std::dec << '\n';
+  }
+  if (fault != WatchFault::Hit) {
+    return fault;
+  }
+  out_ << "Watch region " << hit.id << " changed by 0x" << std::hex << hit.pc
+       << std::dec;
+  print_function_offset(out_, static_cast<uint64_t>(hit.pc));
+  out_ << ": " << hit.length << " bytes at 0x" << std::hex << hit.address
+       << std::setfill('0');
+  for (const auto* bytes : {&hit.old_bytes, &hit.new_bytes}) {
+    out_ << (bytes == &hit.old_bytes ? "\n  old:" : "\n  new:");
+    for (std::size_t i = 0; i < hit.length; ++i) {
+      out_ << ' ' << std::setw(2) << static_cast<int>((*bytes)[i]);
+    }
+  }
+  out_ << std::dec << std::setfill(' ') << '\n';
+  return fault;
+}
+
+bool Debugger::handle_ptrace_event(const int wait_status) {
+  const int event = ptrace_event(wait_status);
+  if (event == PTRACE_EVENT_VFORK_DONE) {
+    if (vfork_lifted_ != nullptr) {
+      reinsert_breakpoints(pid_, *vfork_lifted_);
+      vfork_lifted_.reset();
+    }
+    return true;
+  }
+  if (event == PTRACE_EVENT_EXEC) {
+    pending_exec_ = true;
+    return false;
+  }
+  unsigned long message = 0;
+  if (event == PTRACE_EVENT_CLONE) {
+    // Only the thread the process started with is debugged. Calls are no
+    // longer timed, the new thread would hit the int3s untraced.
+    ptrace(PTRACE_GETEVENTMSG, pid_, nullptr, &message);
+    const auto thread = static_cast<pid_t>(message);
+    if (tracee_->latency.remove_probes()) {
+      inserted_code_.reset();
+      out_ << "Stopped timing calls, process " << pid_ << " started thread "
+           << thread << '\n';
+    }
+    if (wait_for_forked_child(thread) and
+        ptrace(PTRACE_DETACH, thread, nullptr, nullptr) == -1) {
+      std::cerr << "Failed to detach from thread " << thread
+                << " with errno: " << errno << '\n';
+    }
+    return true;
+  }
+  if (event != PTRACE_EVENT_FORK and event != PTRACE_EVENT_VFORK) {
+    return true;
+  }
+  ptrace(PTRACE_GETEVENTMSG, pid_, nullptr, &message);
+  const auto child = static_cast<pid_t>(message);
+  if (not wait_for_forked_child(child)) {
+    return true;
+  }
+  // A step in progress also left its temporary breakpoints in the child.
+  std::shared_ptr<const InsertedCode> code = inserted_code();
+  InsertedCode temporaries{};
+  for (const auto& [address, bp] : tracee_->stepper.temporary_breakpoints()) {
+    if (bp.is_enabled()) {
+      temporaries.breakpoints.emplace_back(address, bp.saved_instruction());
+    }
+  }
+  const bool vfork = event == PTRACE_EVENT_VFORK;
+  FollowFork policy = follow_fork_;
+  if (vfork and policy == FollowFork::Parent) {
+    // The parent cannot run until the child executes a new program or exits,
+    // so holding the child would hang it.
+    policy = FollowFork::Detach;
+  }
+  if (vfork and policy == FollowFork::Detach) {
+    // The child shares the memory of the parent, the breakpoints are lifted
+    // until it is done with it.
+    auto lifted = std::make_unique<InsertedCode>(temporaries);
+    lifted->breakpoints.insert(lifted->breakpoints.end(),
+                               code->breakpoints.begin(),
+                               code->breakpoints.end());
+    lifted->probes = code->probes;
+    remove_inserted_code(pid_, *lifted, false);
+    vfork_lifted_ = std::move(lifted);
+  } else if (not vfork) {
+    remove_inserted_code(child, temporaries);
+    if (policy == FollowFork::Detach) {
+      remove_inserted_code(child, *code);
+    }
+  }
+  switch (policy) {
+    case FollowFork::Detach:
+      if (ptrace(PTRACE_DETACH, child, nullptr, nullptr) == -1) {
+        std::cerr << "Failed to detach from forked process " << child
+                  << " with errno: " << errno << '\n';
+      }
+      out_ << "Detached from forked process " << child << '\n';
+      return true;
+    case FollowFork::Parent:
+      held_.push_back({child, std::move(code)});
+      out_ << "Holding forked process " << child << '\n';
+      return true;
+    case FollowFork::Child:
+      pending_child_ = child;
+      return false;
+  }
+  return true;
+}
+
+void Debugger::follow_pending() {
+  if (pending_exec_) {
+    pending_exec_ = false;
+    const std::string link = "/proc/" + std::to_string(pid_) + "/exe";
+    std::string path(4096, '\0');
+    const ssize_t length = readlink(link.c_str(), path.data(), path.size());
+    path.resize(length > 0 ? static_cast<std::size_t>(length) : 0);
+    program_ = std::make_shared<const ProgramIndex>(path);
+    printer_.reset();
+    load_address_ = 0;
+    replace_tracee(pid_, InsertedCode{});
+    out_ << "Process " << pid_ << " is executing new program " << path << '\n';
+  }
+  if (pending_child_ != 0) {
+    const pid_t child = pending_child_;
+    pending_child_ = 0;
+    const std::shared_ptr<const InsertedCode> code = inserted_code();
+    if (exit_code_ == -1) {
+      held_.push_back({pid_, code});
+    }
+    replace_tracee(child, *code);
+    out_ << "Switched to forked process " << pid_ << '\n';
+    print_location();
+  }
+}
+
+std::shared_ptr<const InsertedCode> Debugger::inserted_code() {
+  if (inserted_code_ == nullptr) {
+    auto code = std::make_shared<InsertedCode>();
+    for (const auto& [address, bp] : tracee_->breakpoints) {
+      if (bp.is_enabled()) {
+        code->breakpoints.emplace_back(address, bp.saved_instruction());
+      }
+    }
+    code->tracepoints = tracee_->fast_tracepoints.original_code();
+    code->watched_pages = tracee_->watch_regions.protected_pages();
+    code->probes = tracee_->latency.inserted_probes();
+    inserted_code_ = std::move(code);
+  }
+  return inserted_code_;
+}
+
+void Debugger::replace_tracee(const pid_t pid, const InsertedCode& code) {
+  // The tracepoints jump to code allocated in the old process, which the
+  // new one has no record of, so they are removed, as are the watch regions.
+  // Breakpoints carry over.
+  InsertedCode tracepoints{};
+  tracepoints.tracepoints = code.tracepoints;
+  tracepoints.watched_pages = code.watched_pages;
+  tracepoints.probes = code.probes;
+  remove_inserted_code(pid, tracepoints);
+  process_.reset();
+  tracee_ = std::make_unique<Tracee>(pid, library_symbols_);
+  process_ = std::make_unique<LiveProcess>(pid, tracee_->memory);
+  for (const auto& [address, saved] : code.breakpoints) {
+    tracee_->breakpoints.insert({address, Breakpoint{pid, address, saved}});
+  }
+  pid_ = pid;
+  exit_code_ = -1;
+  inserted_code_.reset();
+  connect_tracee();
+  track_libraries();
+}
+
+void Debugger::track_libraries() {
+  const std::intptr_t address =
+      tracee_->libraries.find_loader(program_->elf);
+  if (address == 0) {
+    return;
+  }
+  // A forked child inherits the breakpoint.
+  if (tracee_->breakpoints.count(address) == 0) {
+    Breakpoint bp{pid_, address};
+    tracee_->breakpoints.insert({address, std::move(bp.enable())});
+    inserted_code_.reset();
+  }
+  tracee_->stepper.set_internal_breakpoint(address,
+                                           [this]() { update_libraries(); });
+  // Pick up the libraries loaded before, e.g. by the parent of a fork.
+  update_libraries();
+}
+
+void Debugger::update_libraries() {
+  std::vector<SharedLibrary> added{};
+  const std::size_t known = tracee_->libraries.libraries().size();
+  if (not tracee_->libraries.update(added)) {
     return;
   }
+  // The loader maps and unmaps in the middle of a command.
+  tracee_->memory_map.invalidate();
+  if (tracee_->libraries.libraries().size() < known + added.size()) {
+    // The text of unloaded libraries may be reused by later mappings.
+    tracee_->instructions.clear();
+  }
+  if (added.empty()) {
+    return;
+  }
+  auto name = pending_breakpoints_.begin();
+  while (name != pending_breakpoints_.end()) {
+    const auto library = std::find_if(
+        added.begin(), added.end(), [&name](const SharedLibrary& candidate) {
+          return candidate.find_symbol(*name) != 0;
+        });
+    if (library == added.end()) {
+      ++name;
+      continue;
+    }
+    out_ << "Resolved pending breakpoint on '" << *name << "' in "
+         << library->path << '\n';
+    set_breakpoint_at_address(library->find_symbol(*name));
+    name = pending_breakpoints_.erase(name);
+  }
+}
+
+void Debugger::print_library_function(std::ostream& os,
+                                      const uint64_t address) {
+  const SharedLibrary* const library =
+      tracee_->libraries.find_library_containing(
+          static_cast<std::intptr_t>(address));
+  if (library == nullptr) {
+    return;
+  }
+  const Symbol* const function = library->elf->find_function_containing(
+      address - static_cast<uint64_t>(library->load_address));
+  if (function != nullptr) {
+    os << " in " << function->name;
+  }
+  os << " from " << library->path;
 }
 
-uint64_t Debugger::read_memory(const uint64_t address) {
-  const auto value = ptrace(PTRACE_PEEKDATA, pid_, address, nullptr);
-  if (value == -1) {
-    std::cerr << "Failed to read value at address " << std::hex << address
-              << '\n';
+uint64_t Debugger::library_function_start(const uint64_t address) const {
+  const SharedLibrary* const library =
+      tracee_->libraries.find_library_containing(
+          static_cast<std::intptr_t>(address));
+  if (library == nullptr) {
+    return 0;
   }
-  return static_cast<uint64_t>(value);
+  const auto load = static_cast<uint64_t>(library->load_address);
+  const Symbol* const function =
+      library->elf->find_function_containing(address - load);
+  return function == nullptr ? 0 : function->address + load;
 }
 
-void Debugger::set_breakpoint_at_address(const std::intptr_t address) {
+void Debugger::print_function_offset(std::ostream& os,
+                                     const uint64_t address) {
+  const auto base = static_cast<uint64_t>(load_address());
+  const Symbol* function = program_->elf.find_function_containing(address -
+                                                                  base);
+  uint64_t start = base;
+  if (function == nullptr) {
+    const SharedLibrary* const library =
+        tracee_->libraries.find_library_containing(
+            static_cast<std::intptr_t>(address));
+    if (library == nullptr) {
+      return;
+    }
+    start = static_cast<uint64_t>(library->load_address);
+    function = library->elf->find_function_containing(address - start);
+    if (function == nullptr) {
+      return;
+    }
+  }
+  os << " <" << function->name << '+' << std::dec
+     << address - start - function->address << '>';
+}
+
+void Debugger::print_backtrace() {
+  // Walk the frame pointer chain, each frame holds the caller's rbp followed
+  // by the return address. This needs code built with frame pointers, the
+  // walk goes on through library frames until the chain ends with a null
+  // rbp, points outside of the stack or stops going up.
+  constexpr std::size_t max_frames = 64;
+  const user_regs_struct regs = process_->registers();
+  const auto base = static_cast<uint64_t>(load_address());
+  uint64_t pc = regs.rip;
+  uint64_t frame = regs.rbp;
+  for (std::size_t i = 0; i < max_frames and pc != 0; ++i) {
+    // Return addresses point after the call, which may be on the next line.
+    const uint64_t lookup = i == 0 ? pc : pc - 1;
+    const Symbol* const function =
+        program_->elf.find_function_containing(lookup - base);
+    out_ << '#' << i << "  0x" << std::hex << pc << std::dec;
+    if (function != nullptr) {
+      out_ << " in " << function->name;
+    } else {
+      print_library_function(out_, pc);
+    }
+    const LineRow* const row = program_->line_table.find(lookup - base);
+    if (row != nullptr) {
+      out_ << " at " << program_->line_table.file_name(*row) << ':'
+           << row->line;
+    }
+    out_ << '\n';
+    uint64_t saved[2] = {frame, 0};
+    // Stopped at the entry of the function (possibly just past the int3 of a
+    // breakpoint there) before it pushed rbp, the return address is on top
+    // of the stack.
+    uint64_t start = 0;
+    if (i == 0) {
+      start = function != nullptr ? function->address + base
+                                  : library_function_start(pc);
+    }
+    const bool at_entry =
+        start != 0 and
+        (pc == start or
+         (pc - 1 == start and process_->is_live() and
+          tracee_->stepper.at_breakpoint()));
+    if (not at_entry and frame == 0) {
+      break;
+    }
+    // Without frame pointers rbp may hold anything.
+    const auto stack = static_cast<std::intptr_t>(at_entry ? regs.rsp : frame);
+    if (process_->is_live() and
+        not tracee_->memory_map.contains(stack, at_entry ? 8 : 16)) {
+      break;
+    }
+    if (at_entry ? not process_->read_memory(
+                       static_cast<std::intptr_t>(regs.rsp), &saved[1],
+                       sizeof(saved[1]))
+                 : not process_->read_memory(
+                       static_cast<std::intptr_t>(frame), saved,
+                       sizeof(saved))) {
+      break;
+    }
+    // The stack grows down, so the frames of the callers lie above. A saved
+    // rbp below the frame ends the chain after its return address.
+    frame = at_entry or saved[0] > frame ? saved[0] : 0;
+    pc = saved[1];
+  }
+}
+
+void Debugger::print_mapping(const std::intptr_t address) {
+  MemoryMapIndex& map = tracee_->memory_map;
+  const MemoryKind kind = map.classify(address);
+  out_ << "0x" << std::hex << address << std::dec << " is "
+       << memory_kind_name(kind);
+  const MemoryRegion* const region = map.find(address);
+  if (region == nullptr) {
+    out_ << '\n';
+    return;
+  }
+  out_ << " in 0x" << std::hex << region->start << "-0x" << region->end << ' '
+       << (region->readable ? 'r' : '-') << (region->writable ? 'w' : '-')
+       << (region->executable ? 'x' : '-') << (region->shared ? 's' : 'p');
+  if (not region->path.empty()) {
+    out_ << ' ' << region->path;
+    if (region->path.front() != '[') {
+      out_ << " at offset 0x"
+           << region->offset +
+                  static_cast<uint64_t>(address - region->start);
+    }
+  }
+  out_ << std::dec << '\n';
+}
+
+void Debugger::print_location() {
+  const auto pc = static_cast<std::intptr_t>(get_program_counter());
+  const auto relative_pc = static_cast<uint64_t>(pc - load_address());
+  out_ << "0x" << std::hex << pc << std::dec;
+  const Symbol* const function =
+      program_->elf.find_function_containing(relative_pc);
+  if (function != nullptr) {
+    out_ << " in " << function->name;
+  } else {
+    print_library_function(out_, static_cast<uint64_t>(pc));
+  }
+  const LineRow* const row = program_->line_table.find(relative_pc);
+  if (row != nullptr) {
+    out_ << " at " << program_->line_table.file_name(*row) << ':' << row->line;
+  }
+  out_ << '\n';
+}
+
+bool Debugger::read_memory(const uint64_t address, uint64_t& value) {
+  if (process_->is_live()) {
+    if (not tracee_->memory_map.contains(static_cast<std::intptr_t>(address),
+                                         sizeof(value))) {
+      std::cerr << "Address 0x" << std::hex << address << std::dec
+                << " is not mapped\n";
+      return false;
+    }
+    // -1 is also a valid word, only errno tells a failure apart.
+    errno = 0;
+    const auto word = timed_ptrace(Probe::PtracePeek, PTRACE_PEEKDATA, pid_,
+                                   address, nullptr);
+    if (word == -1 and errno != 0) {
+      std::cerr << "Failed to read value at address 0x" << std::hex << address
+                << std::dec << '\n';
+      return false;
+    }
+    value = static_cast<uint64_t>(word);
+    return true;
+  }
+  if (not process_->read_memory(static_cast<std::intptr_t>(address), &value,
+                                sizeof(value))) {
+    std::cerr << "Address 0x" << std::hex << address << std::dec
+              << " is not in the core file\n";
+    return false;
+  }
+  return true;
+}
+
+std::intptr_t Debugger::resolve_symbol(const std::string_view name) {
+  if (name.size() > 2 and name[0] == '0' and name[1] == 'x') {
+    std::intptr_t address = 0;
+    if (not parse_integer(name, address)) {
+      std::cerr << "Invalid address '" << name << "'\n";
+    }
+    return address;
+  }
+  const std::intptr_t address = find_symbol(name);
+  if (address == 0) {
+    std::cerr << "Unknown symbol '" << name << "'\n";
+  }
+  return address;
+}
+
+std::intptr_t Debugger::find_symbol(const std::string_view name) {
+  const std::string symbol_name{name};
+  const Symbol* const symbol = program_->elf.find_symbol(symbol_name);
+  if (symbol != nullptr) {
+    return static_cast<std::intptr_t>(symbol->address) + load_address();
+  }
+  return tracee_->libraries.find_symbol(symbol_name);
+}
+
+bool Debugger::set_breakpoint_at_address(const std::intptr_t address) {
+  if (not tracee_->memory_map.contains(address, 1)) {
+    std::cerr << "Cannot set a breakpoint at unmapped address 0x" << std::hex
+              << address << std::dec << '\n';
+    return false;
+  }
+  for (const auto& range : tracee_->fast_tracepoints.patched_ranges()) {
+    if (address >= range.first and address < range.second) {
+      std::cerr << "Cannot set a breakpoint inside the instructions patched by "
+                   "a tracepoint\n";
+      return false;
+    }
+  }
+  if (tracee_->latency.has_probe(address)) {
+    std::cerr << "Cannot set a breakpoint on the int3 timing calls at 0x"
+              << std::hex << address << std::dec << '\n';
+    return false;
+  }
   Breakpoint bp{pid_, address};
-  breakpoints_.insert({address, std::move(bp.enable())});
-  std::cout << "Set breakpoint at address 0x" << std::hex << address << "\n";
+  tracee_->breakpoints.insert({address, std::move(bp.enable())});
+  inserted_code_.reset();
+  out_ << "Set breakpoint at address 0x" << std::hex << address
+       << std::dec << "\n";
+  if (mi_.enabled()) {
+    mi_.emit(mi_.record("breakpoint-created")
+                 .address("address", static_cast<uint64_t>(address)));
+  }
+  return true;
 }
 
 void Debugger::set_program_counter(const uint64_t program_counter) {
   set_register_value(pid_, Register::rip, program_counter);
 }
 
+void Debugger::report_step(const StepResult& result) {
+  last_step_stops_ = result.stops;
+  switch (result.status) {
+    case StepResult::Status::Exited:
+      report_exit(result.code);
+      return;
+    case StepResult::Status::Signal:
+      out_ << "Process stopped by signal " << result.code << " at ";
+      emit_stopped("signal", result.code, get_program_counter());
+      break;
+    case StepResult::Status::Breakpoint:
+      out_ << "Hit breakpoint at ";
+      emit_stopped("breakpoint-hit", SIGTRAP, get_program_counter());
+      break;
+    case StepResult::Status::NoLineInfo:
+      std::cerr << "No line information for the current location\n";
+      return;
+    case StepResult::Status::Done:
+      emit_stopped("end-stepping-range", SIGTRAP, get_program_counter());
+      break;
+    case StepResult::Status::Event:
+      // Reported by follow_pending
+      return;
+    case StepResult::Status::Watch:
+      // The change was reported by handle_watch_fault
+      out_ << "Stopped at ";
+      emit_stopped("watch-region-hit", result.code, get_program_counter());
+      break;
+  }
+  print_location();
+}
+
+void Debugger::report_core() {
+  auto& core = static_cast<CoreFile&>(*process_);
+  out_ << "Core was generated by '" << core.command() << "', process "
+       << core.pid() << ".\nProgram terminated with signal "
+       << core.signal() << " at ";
+  print_location();
+  emit_stopped("signal", core.signal(), get_program_counter());
+}
+
+void Debugger::report_exit(const int exit_code) {
+  exit_code_ = exit_code;
+  out_ << "Process exited with code " << exit_code << '\n';
+  if (mi_.enabled()) {
+    mi_.emit(mi_.record("exited").integer("code", exit_code));
+  }
+}
+
+void Debugger::emit_stopped(const std::string_view reason, const int signal,
+                            const uint64_t address) {
+  if (not mi_.enabled()) {
+    return;
+  }
+  MiRecord& record = mi_.record("stopped")
+                         .string("reason", reason)
+                         .integer("signal", signal)
+                         .address("address", address);
+  const uint64_t relative_address =
+      address - static_cast<uint64_t>(load_address());
+  const Symbol* const function =
+      program_->elf.find_function_containing(relative_address);
+  if (function != nullptr) {
+    record.string("function", function->name);
+  }
+  const LineRow* const row = program_->line_table.find(relative_address);
+  if (row != nullptr) {
+    record.string("file", program_->line_table.file_name(*row))
+        .integer("line", row->line);
+  }
+  mi_.emit(record);
+}
+
+void Debugger::step_line(const bool into) {
+  // A step stops at any int3 it does not know of, so the calls made during
+  // the step are not timed.
+  tracee_->latency.lift();
+  const StepResult result =
+      tracee_->stepper.step_line(program_->elf, program_->line_table,
+                                 load_address(), into, step_engine_);
+  tracee_->latency.restore();
+  report_step(result);
+}
+
 void Debugger::step_over_breakpoint() {
-  const auto possible_breakpoint_location = get_program_counter() - 1;
-  if (breakpoints_.count(possible_breakpoint_location) > 0) {
-    auto& bp = breakpoints_.at(possible_breakpoint_location);
+  // Only a trap on a breakpoint leaves rip one past it, an instruction
+  // ending right after one is not to be run again.
+  if (not tracee_->stepper.at_breakpoint()) {
+    return;
+  }
+  tracee_->stepper.set_at_breakpoint(false);
+  user_regs_struct regs = process_->registers();
+  const auto possible_breakpoint_location = regs.rip - 1;
+  const auto hit = tracee_->breakpoints.find(
+      static_cast<std::intptr_t>(possible_breakpoint_location));
+  if (hit == tracee_->breakpoints.end() or not hit->second.is_enabled()) {
+    // The breakpoint went away since, its original instruction is back.
+    set_program_counter(possible_breakpoint_location);
+    return;
+  }
+  Breakpoint& bp = hit->second;
+  // The instruction under the breakpoint is usually simple enough to execute
+  // here, which leaves the int3 in place.
+  regs.rip = possible_breakpoint_location;
+  if (const Instruction* const insn = tracee_->instructions.find(
+          static_cast<std::intptr_t>(regs.rip))) {
+    const LatencyTimer timer{Probe::Emulate};
+    if (emulate_instruction(*insn, tracee_->instructions.bytes(*insn), regs,
+                            tracee_->memory)) {
+      set_registers(pid_, regs);
+      return;
+    }
+  }
+  set_program_counter(possible_breakpoint_location);
+  bp.disable();
+  if (timed_ptrace(Probe::PtraceStep, PTRACE_SINGLESTEP, pid_, nullptr,
+                   nullptr) == -1) {
+    std::cerr << "";
+    return;
+  }
+  wait_for_signal(PTRACE_SINGLESTEP);
+  bp.enable();
+}
 
-    if (bp.is_enabled()) {
-      set_program_counter(possible_breakpoint_location);
-      bp.disable();
-      if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) == -1) {
-        std::cerr << "";
-        return;
-      }
-      wait_for_signal();
-      bp.enable();
+void Debugger::connect_tracee() {
+  tracee_->stepper.set_event_handler([this](const int wait_status) {
+    return handle_ptrace_event(wait_status);
+  });
+  tracee_->stepper.set_syscall_handler(
+      [this]() { return tracee_->watch_regions.watching(); },
+      [this]() { handle_watched_syscall(); });
+  tracee_->stepper.set_fault_handler([this](const int /*wait_status*/) {
+    switch (handle_watch_fault()) {
+      case WatchFault::NotWatched:
+        return StepResult::Status::Signal;
+      case WatchFault::Resume:
+        return StepResult::Status::Done;
+      default:
+        return StepResult::Status::Watch;
     }
+  });
+  if (not mi_.enabled()) {
+    return;
   }
+  // Called on the drain thread, which therefore gets its own record.
+  tracee_->fast_tracepoints.set_record_callback(
+      [this, record = MiRecord{}](const TraceRecord& hit) mutable {
+        mi_.emit(record.begin("tracepoint-hit")
+                     .integer("id", static_cast<int64_t>(hit.tracepoint_id))
+                     .integer("sequence", static_cast<int64_t>(hit.sequence))
+                     .integer("timestamp", static_cast<int64_t>(hit.timestamp))
+                     .address("rip", hit.rip));
+      });
 }
 
-void Debugger::wait_for_signal() {
+void Debugger::wait_for_signal(const int request) {
+  watch_stop_ = false;
+  tracee_->stepper.set_at_breakpoint(false);
   int wait_status = 0;
   const int options = 0;
-  if (waitpid(pid_, &wait_status, options) != pid_) {
-    std::cerr << "Failed to continue process with name '" << program_name_
-              << "' correctly.\n";
+  while (true) {
+    pid_t waited = 0;
+    {
+      const LatencyTimer timer{Probe::WaitForSignal};
+      waited = waitpid(pid_, &wait_status, options);
+    }
+    if (waited != pid_) {
+      std::cerr << "Failed to continue process with name '"
+                << program_->elf.path() << "' correctly.\n";
+      return;
+    }
+    const uint64_t loader_breakpoint =
+        static_cast<uint64_t>(tracee_->libraries.loader_breakpoint());
+    if (WIFSTOPPED(wait_status) and ptrace_event(wait_status) != 0) {
+      if (not handle_ptrace_event(wait_status)) {
+        break;
+      }
+    } else if (WIFSTOPPED(wait_status) and
+               WSTOPSIG(wait_status) == syscall_trap) {
+      handle_watched_syscall();
+    } else if (request == PTRACE_CONT and loader_breakpoint != 0 and
+               WIFSTOPPED(wait_status) and
+               WSTOPSIG(wait_status) == SIGTRAP and
+               get_program_counter() - 1 == loader_breakpoint) {
+      update_libraries();
+      tracee_->stepper.set_at_breakpoint(true);
+      step_over_breakpoint();
+      if (exit_code_ != -1 or pending_child_ != 0 or pending_exec_ or
+          watch_stop_) {
+        return;
+      }
+    } else if (request == PTRACE_CONT and WIFSTOPPED(wait_status) and
+               WSTOPSIG(wait_status) == SIGTRAP and
+               tracee_->latency.handle_trap(pid_)) {
+      // Return addresses get their int3 on the first call from there.
+      inserted_code_.reset();
+      if (tracee_->latency.report_due()) {
+        tracee_->latency.print(out_);
+      }
+    } else if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGSEGV) {
+      const WatchFault fault = handle_watch_fault();
+      if (fault != WatchFault::Resume) {
+        watch_stop_ = fault != WatchFault::NotWatched;
+        break;
+      }
+      if (request == PTRACE_SINGLESTEP) {
+        // The faulting instruction was the one to step.
+        return;
+      }
+    } else {
+      break;
+    }
+    if (timed_ptrace(
+            request == PTRACE_CONT ? Probe::PtraceCont : Probe::PtraceStep,
+            static_cast<__ptrace_request>(
+                request == PTRACE_CONT ? continue_request() : request),
+            pid_, nullptr, nullptr) == -1) {
+      std::cerr << "Failed to resume process " << pid_
+                << " with errno: " << errno << '\n';
+      return;
+    }
+  }
+  // A single step stops before an int3 it runs into, and a trap one past a
+  // breakpoint only comes from the int3 when continuing.
+  if (request == PTRACE_CONT and WIFSTOPPED(wait_status) and
+      WSTOPSIG(wait_status) == SIGTRAP and ptrace_event(wait_status) == 0) {
+    const auto hit = tracee_->breakpoints.find(
+        static_cast<std::intptr_t>(get_program_counter() - 1));
+    tracee_->stepper.set_at_breakpoint(hit != tracee_->breakpoints.end() and
+                                       hit->second.is_enabled());
+  }
+  if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+    report_exit(WIFEXITED(wait_status) ? WEXITSTATUS(wait_status)
+                                       : 128 + WTERMSIG(wait_status));
+  } else if (mi_.enabled() and WIFSTOPPED(wait_status)) {
+    const int signal = WSTOPSIG(wait_status);
+    const uint64_t pc = get_program_counter();
+    if (watch_stop_) {
+      emit_stopped("watch-region-hit", signal, pc);
+    } else if (signal == SIGTRAP and tracee_->breakpoints.count(pc - 1) > 0) {
+      emit_stopped("breakpoint-hit", signal, pc - 1);
+    } else {
+      emit_stopped("signal", signal, pc);
+    }
+  }
+}
+
+bool Debugger::write_memory(const uint64_t address, const uint64_t value) {
+  if (not tracee_->memory_map.contains(static_cast<std::intptr_t>(address),
+                                       sizeof(value))) {
+    std::cerr << "Address 0x" << std::hex << address << std::dec
+              << " is not mapped\n";
+    return false;
   }
+  if (timed_ptrace(Probe::PtracePoke, PTRACE_POKEDATA, pid_, address,
+                   value) == -1) {
+    std::cerr << "Failed to write value 0x" << std::hex << value
+              << " to address 0x" << address << std::dec << '\n';
+    return false;
+  }
+  // The write may have patched code.
+  tracee_->instructions.invalidate(static_cast<std::intptr_t>(address),
+                                   sizeof(value));
+  return true;
 }
 
-void Debugger::write_memory(const uint64_t address, const uint64_t value) {
-  if (ptrace(PTRACE_POKEDATA, pid_, address, value) == -1) {
-    std::cerr << "Failed to write value " << value << " to address " << std::hex
-              << address << '\n';
+bool Debugger::Tracee::original_byte(const std::intptr_t address,
+                                     uint8_t& byte) const {
+  for (const auto* table : {&breakpoints, &stepper.temporary_breakpoints()}) {
+    const auto bp = table->find(address);
+    if (bp != table->end() and bp->second.is_enabled()) {
+      byte = bp->second.saved_instruction();
+      return true;
+    }
   }
+  return latency.original_byte(address, byte);
 }
 }  // namespace nebugger
@@ -7,40 +7,307 @@
 
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <sys/ptrace.h>
 #include <sys/types.h>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "Breakpoint.hpp"
+#include "CallFrame.hpp"
+#include "CommandLine.hpp"
+#include "CoreFile.hpp"
+#include "DebugInfo.hpp"
+#include "Disassembler.hpp"
+#include "Elf.hpp"
+#include "Fork.hpp"
+#include "InferiorCall.hpp"
+#include "InstructionCache.hpp"
+#include "Latency.hpp"
+#include "LineTable.hpp"
+#include "MachineInterface.hpp"
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+#include "ProcessBackend.hpp"
+#include "RemoteAllocator.hpp"
+#include "SharedLibraries.hpp"
+#include "Snapshot.hpp"
+#include "Stepping.hpp"
+#include "Tracepoint.hpp"
+#include "Values.hpp"
+#include "Watchpoint.hpp"
+
+struct linenoiseCompletions;
 
 /// Nils debugger (nebugger) namespace
 namespace nebugger {}
 
 namespace nebugger {
+/// The symbols and line table of a program, built once and shared by the
+/// debuggers of all processes running it.
+struct ProgramIndex {
+  explicit ProgramIndex(const std::string& path)
+      : elf(path), line_table(elf), debug_info(elf), call_frames(elf) {}
+
+  ElfFile elf;
+  LineTable line_table;
+  DebugInfo debug_info;
+  CallFrameInfo call_frames;
+};
+
 class Debugger {
  public:
   Debugger() = delete;
-  Debugger(std::string program_name, pid_t pid)
-      : program_name_(std::move(program_name)), pid_(pid) {}
+  /// Machine interface records are written to `mi_fd` unless it is -1.
+  Debugger(std::string program_name, pid_t pid, int mi_fd = -1)
+      : Debugger(std::make_shared<const ProgramIndex>(program_name), pid,
+                 nullptr, mi_fd, std::cout) {}
+  /// Inspect the process saved in `core` post-mortem. Only the commands that
+  /// do not need a live process are available.
+  Debugger(std::string program_name, std::unique_ptr<CoreFile> core,
+           int mi_fd = -1)
+      : Debugger(std::make_shared<const ProgramIndex>(program_name), 0,
+                 std::move(core), mi_fd, std::cout) {}
+  /// Debug one of several processes running `program`, writing the output of
+  /// commands to `out` instead of stdout.
+  Debugger(std::shared_ptr<const ProgramIndex> program, pid_t pid,
+           std::ostream& out)
+      : Debugger(std::move(program), pid, nullptr, -1, out) {}
 
   /// Run the debugger waiting on user input.
   void run();
 
+  /// Run the commands read from `script` without any terminal handling,
+  /// stopping at the first one that fails. Blank lines and lines starting
+  /// with `#` are skipped, `name` is used in error messages. The inferior is
+  /// killed if it is still alive at the end.
+  ///
+  /// Returns 1 if a command failed, otherwise the exit code of the inferior
+  /// (128 plus the signal number if it was killed by a signal) or 0 if it did
+  /// not exit during the script.
+  int run_script(std::istream& script, const std::string& name);
+
+  /// Wait for the first stop of the inferior, for callers that drive the
+  /// debugger with `handle_command` instead of `run` or `run_script`.
+  void wait_for_start();
+
+  /// Carry out one command, returns false if it could not be carried out.
+  bool handle_command(std::string_view line);
+
+  /// Write a line saying where the inferior is stopped or that it exited,
+  /// without addresses when the location is known so that the states of
+  /// processes running the same program compare equal.
+  void print_state(std::ostream& os);
+
+  /// Kill the inferior if it is still alive.
+  void kill_inferior();
+
+  /// Exit code of the inferior, -1 while it is alive.
+  int exit_code() const noexcept { return exit_code_; }
+
  private:
+  /// An entry of the table of commands understood by `handle_command`, which
+  /// also drives tab completion and hints at the prompt.
+  struct Command {
+    std::string_view name;
+    // Optional short form, empty if there is none
+    std::string_view alias;
+    // Allowed number of arguments following the command name
+    std::size_t min_args;
+    std::size_t max_args;
+    bool (Debugger::*handler)(const CommandArgs& args);
+    // Shown after the command name while typing
+    std::string_view hint;
+    std::string_view usage;
+    // Space separated completions for the first argument
+    std::string_view subcommands;
+    // Whether the command runs or modifies the process, which is impossible
+    // for core files
+    bool live_only;
+  };
+  static constexpr std::size_t number_of_commands = 23;
+  static const std::array<Command, number_of_commands> commands_;
+
+  static const Command& find_command(std::string_view name);
+  static void complete_command(const char* buffer,
+                               linenoiseCompletions* completions);
+  static char* hint_command(const char* buffer, int* color, int* bold);
+
+  /// The state tied to the traced process, replaced when another process is
+  /// debugged or the process executes a new program.
+  struct Tracee {
+    Tracee(const pid_t pid, ElfCache& library_symbols)
+        : remote_allocator(pid),
+          function_caller(pid, remote_allocator),
+          memory(pid),
+          instructions(memory,
+                       [this](const std::intptr_t address, uint8_t& byte) {
+                         return original_byte(address, byte);
+                       }),
+          fast_tracepoints(pid, remote_allocator, memory, instructions),
+          stepper(pid, instructions, memory, breakpoints),
+          libraries(pid, memory, library_symbols),
+          watch_regions(pid, memory, instructions),
+          snapshot(pid, memory),
+          memory_map(pid),
+          latency(memory, instructions) {}
+
+    // The byte replaced by a breakpoint of the user, of a step or of latency
+    // tracing at `address`
+    bool original_byte(std::intptr_t address, uint8_t& byte) const;
+
+    std::unordered_map<std::intptr_t, Breakpoint> breakpoints{};
+    RemoteAllocator remote_allocator;
+    FunctionCaller function_caller;
+    InferiorMemory memory;
+    InstructionCache instructions;
+    FastTracepoints fast_tracepoints;
+    Stepper stepper;
+    SharedLibraries libraries;
+    RegionWatchpoints watch_regions;
+    MemorySnapshot snapshot;
+    MemoryMapIndex memory_map;
+    LatencyTracer latency;
+  };
+
+  Debugger(std::shared_ptr<const ProgramIndex> program, pid_t pid,
+           std::unique_ptr<CoreFile> core, int mi_fd, std::ostream& out)
+      : program_(std::move(program)),
+        out_(out),
+        pid_(core != nullptr ? core->pid() : pid),
+        mi_(mi_fd),
+        tracee_(std::make_unique<Tracee>(pid_, library_symbols_)),
+        process_(core != nullptr
+                     ? std::unique_ptr<ProcessBackend>{std::move(core)}
+                     : std::make_unique<LiveProcess>(pid_, tracee_->memory)) {
+    connect_tracee();
+  }
+
+  bool handle_backtrace_command(const CommandArgs& args);
+  bool handle_break_command(const CommandArgs& args);
+  bool handle_call_command(const CommandArgs& args);
+  bool handle_continue_command(const CommandArgs& args);
+  bool handle_disassemble_command(const CommandArgs& args);
+  bool handle_find_command(const CommandArgs& args);
+  bool handle_follow_fork_command(const CommandArgs& args);
+  bool handle_gcore_command(const CommandArgs& args);
+  bool handle_help_command(const CommandArgs& args);
+  bool handle_inferior_command(const CommandArgs& args);
+  bool handle_latency_command(const CommandArgs& args);
+  bool handle_libraries_command(const CommandArgs& args);
+  bool handle_memory_command(const CommandArgs& args);
+  bool handle_next_command(const CommandArgs& args);
+  bool handle_print_command(const CommandArgs& args);
+  bool handle_register_command(const CommandArgs& args);
+  bool handle_snapshot_command(const CommandArgs& args);
+  bool handle_step_command(const CommandArgs& args);
+  bool handle_step_engine_command(const CommandArgs& args);
+  bool handle_stepi_command(const CommandArgs& args);
+  bool handle_stats_command(const CommandArgs& args);
+  bool handle_tracepoint_command(const CommandArgs& args);
+  bool handle_watch_region_command(const CommandArgs& args);
+
+  bool dispatch_command(const CommandArgs& args);
+  void emit_stopped(std::string_view reason, int signal, uint64_t address);
+  void connect_tracee();
+
+  // Returns true if the process should be resumed as if the event had not
+  // happened, see `Stepper::set_event_handler`
+  bool handle_ptrace_event(int wait_status);
+  // Carry out the write into a watch region the process is stopped at with
+  // a SIGSEGV, reporting the change of the region if any
+  WatchFault handle_watch_fault();
+  // PTRACE_SYSCALL while regions are watched, PTRACE_CONT otherwise
+  int continue_request() const;
+  // Lift or put back the protection of watched pages at a system call stop
+  void handle_watched_syscall();
+  // Switch to a forked child or reload the program after an exec that ended
+  // the last command
+  void follow_pending();
+  std::shared_ptr<const InsertedCode> inserted_code();
+  // Debug `pid` from now on, which holds `breakpoints` of the current program
+  void replace_tracee(pid_t pid, const InsertedCode& breakpoints);
+  // Break on the changes of the shared libraries of the current process
+  void track_libraries();
+  // Read the changes after the dynamic loader hit its breakpoint and set the
+  // pending breakpoints found in new libraries
+  void update_libraries();
+
+  bool call_function(std::string_view expression);
   void continue_execution();
   void dump_registers();
   uint64_t get_program_counter();
-  void handle_command(const std::string& line);
-  uint64_t read_memory(const uint64_t address);
-  void set_breakpoint_at_address(std::intptr_t address);
+  std::intptr_t load_address();
+  // Address of `name` in the executable or a shared library, 0 if unknown
+  std::intptr_t find_symbol(std::string_view name);
+  void print_backtrace();
+  // Write ` in FUNCTION from LIBRARY` if `address` is in a shared library
+  void print_library_function(std::ostream& os, uint64_t address);
+  // Start of the library function containing `address`, 0 if unknown
+  uint64_t library_function_start(uint64_t address) const;
+  // Write ` <FUNCTION+OFFSET>` if `address` is in a known function
+  void print_function_offset(std::ostream& os, uint64_t address);
+  void print_location();
+  // Write what the mapping holding `address` of the live process is
+  void print_mapping(std::intptr_t address);
+  void report_core();
+  // Read the word at `address`, reporting why it cannot be read if so
+  bool read_memory(const uint64_t address, uint64_t& value);
+  std::intptr_t resolve_symbol(std::string_view name);
+  bool set_breakpoint_at_address(std::intptr_t address);
   void set_program_counter(const uint64_t program_counter);
+  void report_exit(int exit_code);
+  void report_step(const StepResult& result);
+  void step_line(bool into);
   void step_over_breakpoint();
-  void wait_for_signal();
-  void write_memory(const uint64_t address, const uint64_t value);
+  // `request` resumes the process after ptrace events that are handled
+  // transparently
+  void wait_for_signal(int request = PTRACE_CONT);
+  bool write_memory(const uint64_t address, const uint64_t value);
 
-  std::string program_name_;
+  std::shared_ptr<const ProgramIndex> program_;
+  // Where command output goes, stdout unless debugging a process group
+  std::ostream& out_;
   pid_t pid_;
-  std::unordered_map<std::intptr_t, Breakpoint> breakpoints_;
+  MiStream mi_;
+  // Address the executable is loaded at, 0 until first needed
+  std::intptr_t load_address_{0};
+  // Symbols of the shared libraries loaded by any of the debugged processes
+  ElfCache library_symbols_{};
+  std::unique_ptr<Tracee> tracee_;
+  // Memory and registers for inspection, of the live process or a core file
+  std::unique_ptr<ProcessBackend> process_;
+  // Compiled type layouts of the program, created by the first `print`
+  std::unique_ptr<ValuePrinter> printer_{};
+  FollowFork follow_fork_{FollowFork::Detach};
+  // Other processes forked from or by the debugged one, held stopped
+  std::vector<HeldProcess> held_{};
+  // Snapshot of `inserted_code`, shared with the children forked since the
+  // breakpoints or tracepoints last changed; empty when out of date
+  std::shared_ptr<const InsertedCode> inserted_code_{};
+  // Breakpoints removed from memory shared with a vforked child until it
+  // executes a new program or exits
+  std::unique_ptr<InsertedCode> vfork_lifted_{};
+  // Set by events that end a command and are handled by `follow_pending`
+  pid_t pending_child_{0};
+  bool pending_exec_{false};
+  // Set when a watch region stopped the process while it was resumed
+  bool watch_stop_{false};
+  // Breakpoints on symbols of shared libraries that are not loaded yet
+  std::vector<std::string> pending_breakpoints_{};
+  StepEngine step_engine_{StepEngine::Range};
+  Syntax syntax_{Syntax::Att};
+  // Number of stops taken by the last step, for comparing engines
+  std::size_t last_step_stops_{0};
+  // Exit code of the inferior, -1 while it is alive
+  int exit_code_{-1};
 };
 }  // namespace nebugger
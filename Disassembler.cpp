@@ -0,0 +1,949 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Disassembler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+namespace nebugger {
+namespace {
+struct Operand {
+  // String: the implicit memory operand of a string instruction, at rsi or
+  // rdi
+  enum class Kind { Register, Xmm, Memory, Immediate, Target, String };
+  Kind kind;
+  // Register number, 0 to 15
+  uint8_t reg{0};
+  // Size in bytes of the register, memory or immediate
+  uint8_t size{0};
+  int64_t value{0};
+};
+
+// A decoded instruction before it is written in either syntax. The operands
+// are in Intel order, destination first.
+struct Parsed {
+  // Written before the mnemonic, e.g. `lock ` or `rep `
+  std::string prefix{};
+  std::string mnemonic{};
+  // The AT&T and Intel spellings differ, e.g. movzbl and movzx
+  std::string intel_mnemonic{};
+  std::vector<Operand> operands{};
+  // `call *%rax` in AT&T syntax
+  bool indirect{false};
+  // Whether the operand size is implied by the mnemonic, e.g. for push, so
+  // AT&T needs no suffix
+  bool implied_size{false};
+  // Shifts by one, which Intel syntax writes with a count of 1 and AT&T
+  // without a count
+  bool shift_by_one{false};
+  bool valid{true};
+};
+
+constexpr std::array<const char*, 16> condition_codes{
+    "o", "no", "b", "ae", "e", "ne", "be", "a",
+    "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+std::string hex(const uint64_t value) {
+  char buffer[24];
+  std::snprintf(buffer, sizeof(buffer), "0x%llx",
+                static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+std::string signed_hex(const int64_t value) {
+  return value < 0 ? "-" + hex(-static_cast<uint64_t>(value)) : hex(value);
+}
+
+uint64_t truncate(const int64_t value, const uint8_t size) {
+  return size >= 8 ? static_cast<uint64_t>(value)
+                   : static_cast<uint64_t>(value) & ((1ull << (size * 8)) - 1);
+}
+
+std::string register_name(const uint8_t reg, const uint8_t size,
+                          const bool has_rex) {
+  static constexpr std::array<const char*, 16> names64{
+      "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+      "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15"};
+  static constexpr std::array<const char*, 8> names32{
+      "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+  static constexpr std::array<const char*, 8> names16{
+      "ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+  static constexpr std::array<const char*, 8> names8{
+      "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+  static constexpr std::array<const char*, 4> high8{"ah", "ch", "dh", "bh"};
+  if (reg >= 8) {
+    const std::string name = names64[reg];
+    return size == 8 ? name
+                     : name + (size == 4 ? "d" : (size == 2 ? "w" : "b"));
+  }
+  switch (size) {
+    case 8:
+      return names64[reg];
+    case 4:
+      return names32[reg];
+    case 2:
+      return names16[reg];
+    default:
+      return reg >= 4 and not has_rex ? high8[reg - 4] : names8[reg];
+  }
+}
+
+const char* size_suffix(const uint8_t size) {
+  switch (size) {
+    case 1:
+      return "b";
+    case 2:
+      return "w";
+    case 4:
+      return "l";
+    default:
+      return "q";
+  }
+}
+
+const char* size_name(const uint8_t size) {
+  switch (size) {
+    case 1:
+      return "BYTE PTR ";
+    case 2:
+      return "WORD PTR ";
+    case 4:
+      return "DWORD PTR ";
+    case 8:
+      return "QWORD PTR ";
+    case 16:
+      return "XMMWORD PTR ";
+    default:
+      return "";
+  }
+}
+
+uint8_t operand_size(const Instruction& insn) {
+  return insn.rex_w() ? 8 : (insn.operand_size_prefix ? 2 : 4);
+}
+
+uint8_t reg_field(const Instruction& insn) {
+  return static_cast<uint8_t>(insn.modrm_reg() | ((insn.rex & 0x4) << 1));
+}
+
+uint8_t rm_field(const Instruction& insn) {
+  return static_cast<uint8_t>(insn.modrm_rm() | ((insn.rex & 0x1) << 3));
+}
+
+Operand reg(const uint8_t number, const uint8_t size) {
+  return {Operand::Kind::Register, number, size, 0};
+}
+
+Operand xmm(const uint8_t number) {
+  return {Operand::Kind::Xmm, number, 16, 0};
+}
+
+Operand reg_operand(const Instruction& insn, const uint8_t size) {
+  return reg(reg_field(insn), size);
+}
+
+// The ModRM r/m operand, a register of the given class or memory
+Operand rm_operand(const Instruction& insn, const uint8_t size,
+                   const bool is_xmm = false) {
+  if (insn.modrm_mod() == 3) {
+    return is_xmm ? xmm(rm_field(insn)) : reg(rm_field(insn), size);
+  }
+  return {Operand::Kind::Memory, 0, size, 0};
+}
+
+Operand immediate(const Instruction& insn, const uint8_t size) {
+  return {Operand::Kind::Immediate, 0, size, insn.immediate};
+}
+
+// Names of the scalar and packed SSE instructions without, with 66, F3 and
+// F2 prefix, followed by the memory operand sizes
+struct SseEntry {
+  uint8_t opcode;
+  std::array<const char*, 4> names;
+  std::array<uint8_t, 4> sizes;
+};
+
+constexpr SseEntry sse_table[] = {
+    {0x10, {"movups", "movupd", "movss", "movsd"}, {16, 16, 4, 8}},
+    {0x11, {"movups", "movupd", "movss", "movsd"}, {16, 16, 4, 8}},
+    {0x12, {"movlps", "movlpd", nullptr, nullptr}, {8, 8, 0, 0}},
+    {0x13, {"movlps", "movlpd", nullptr, nullptr}, {8, 8, 0, 0}},
+    {0x14, {"unpcklps", "unpcklpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x16, {"movhps", "movhpd", nullptr, nullptr}, {8, 8, 0, 0}},
+    {0x17, {"movhps", "movhpd", nullptr, nullptr}, {8, 8, 0, 0}},
+    {0x28, {"movaps", "movapd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x29, {"movaps", "movapd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x2b, {"movntps", "movntpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x2e, {"ucomiss", "ucomisd", nullptr, nullptr}, {4, 8, 0, 0}},
+    {0x2f, {"comiss", "comisd", nullptr, nullptr}, {4, 8, 0, 0}},
+    {0x51, {"sqrtps", "sqrtpd", "sqrtss", "sqrtsd"}, {16, 16, 4, 8}},
+    {0x54, {"andps", "andpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x55, {"andnps", "andnpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x56, {"orps", "orpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x57, {"xorps", "xorpd", nullptr, nullptr}, {16, 16, 0, 0}},
+    {0x58, {"addps", "addpd", "addss", "addsd"}, {16, 16, 4, 8}},
+    {0x59, {"mulps", "mulpd", "mulss", "mulsd"}, {16, 16, 4, 8}},
+    {0x5a, {"cvtps2pd", "cvtpd2ps", "cvtss2sd", "cvtsd2ss"}, {8, 16, 4, 8}},
+    {0x5c, {"subps", "subpd", "subss", "subsd"}, {16, 16, 4, 8}},
+    {0x5d, {"minps", "minpd", "minss", "minsd"}, {16, 16, 4, 8}},
+    {0x5e, {"divps", "divpd", "divss", "divsd"}, {16, 16, 4, 8}},
+    {0x5f, {"maxps", "maxpd", "maxss", "maxsd"}, {16, 16, 4, 8}},
+    {0x60, {nullptr, "punpcklbw", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x61, {nullptr, "punpcklwd", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x62, {nullptr, "punpckldq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x64, {nullptr, "pcmpgtb", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x65, {nullptr, "pcmpgtw", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x66, {nullptr, "pcmpgtd", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x68, {nullptr, "punpckhbw", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x6c, {nullptr, "punpcklqdq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x6d, {nullptr, "punpckhqdq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x6f, {nullptr, "movdqa", "movdqu", nullptr}, {0, 16, 16, 0}},
+    {0x74, {nullptr, "pcmpeqb", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x75, {nullptr, "pcmpeqw", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x76, {nullptr, "pcmpeqd", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0x7e, {nullptr, nullptr, "movq", nullptr}, {0, 0, 8, 0}},
+    {0x7f, {nullptr, "movdqa", "movdqu", nullptr}, {0, 16, 16, 0}},
+    {0xd4, {nullptr, "paddq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xd6, {nullptr, "movq", nullptr, nullptr}, {0, 8, 0, 0}},
+    {0xda, {nullptr, "pminub", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xdb, {nullptr, "pand", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xde, {nullptr, "pmaxub", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xdf, {nullptr, "pandn", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xe7, {nullptr, "movntdq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xeb, {nullptr, "por", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xef, {nullptr, "pxor", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xf8, {nullptr, "psubb", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xfa, {nullptr, "psubd", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xfb, {nullptr, "psubq", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xfc, {nullptr, "paddb", nullptr, nullptr}, {0, 16, 0, 0}},
+    {0xfe, {nullptr, "paddd", nullptr, nullptr}, {0, 16, 0, 0}},
+};
+
+void parse_sse(const Instruction& insn, Parsed& parsed) {
+  const std::size_t prefix = insn.repne_prefix         ? 3
+                             : insn.rep_prefix          ? 2
+                             : insn.operand_size_prefix ? 1
+                                                        : 0;
+  const uint8_t op = insn.opcode;
+  switch (op) {
+    case 0x2a:
+      if (prefix >= 2) {
+        parsed.mnemonic = prefix == 2 ? "cvtsi2ss" : "cvtsi2sd";
+        parsed.intel_mnemonic = parsed.mnemonic;
+        if (insn.modrm_mod() != 3) {
+          // The size of the integer is not implied by a register.
+          parsed.mnemonic += size_suffix(insn.rex_w() ? 8 : 4);
+        }
+        parsed.operands = {xmm(reg_field(insn)),
+                           rm_operand(insn, insn.rex_w() ? 8 : 4)};
+        return;
+      }
+      break;
+    case 0x2c:
+    case 0x2d:
+      if (prefix >= 2) {
+        parsed.mnemonic = std::string{op == 0x2c ? "cvtt" : "cvt"} +
+                          (prefix == 2 ? "ss2si" : "sd2si");
+        parsed.operands = {reg_operand(insn, insn.rex_w() ? 8 : 4),
+                           rm_operand(insn, prefix == 2 ? 4 : 8, true)};
+        return;
+      }
+      break;
+    case 0x6e:
+    case 0x7e:
+      if (prefix == 1) {
+        parsed.mnemonic = insn.rex_w() ? "movq" : "movd";
+        const Operand gpr = rm_operand(insn, insn.rex_w() ? 8 : 4);
+        parsed.operands = op == 0x6e
+                              ? std::vector<Operand>{xmm(reg_field(insn)), gpr}
+                              : std::vector<Operand>{gpr, xmm(reg_field(insn))};
+        return;
+      }
+      break;
+    case 0xd7:
+      if (prefix == 1) {
+        parsed.mnemonic = "pmovmskb";
+        parsed.operands = {reg_operand(insn, 4), xmm(rm_field(insn))};
+        return;
+      }
+      break;
+    case 0xc6:
+      if (prefix <= 1) {
+        parsed.mnemonic = prefix == 0 ? "shufps" : "shufpd";
+        parsed.operands = {xmm(reg_field(insn)), rm_operand(insn, 16, true),
+                           immediate(insn, 1)};
+        return;
+      }
+      break;
+    case 0x70:
+      if (prefix != 0) {
+        parsed.mnemonic = prefix == 1   ? "pshufd"
+                          : prefix == 2 ? "pshufhw"
+                                        : "pshuflw";
+        parsed.operands = {xmm(reg_field(insn)), rm_operand(insn, 16, true),
+                           immediate(insn, 1)};
+        return;
+      }
+      break;
+    case 0x72:
+    case 0x73: {
+      // Shifts of the r/m register by an immediate, by ModRM reg
+      static constexpr std::array<const char*, 8> dwords{
+          nullptr, nullptr, "psrld", nullptr, "psrad", nullptr, "pslld",
+          nullptr};
+      static constexpr std::array<const char*, 8> qwords{
+          nullptr, nullptr, "psrlq", "psrldq", nullptr, nullptr, "psllq",
+          "pslldq"};
+      const char* const name =
+          (op == 0x72 ? dwords : qwords)[insn.modrm_reg()];
+      if (prefix == 1 and name != nullptr and insn.modrm_mod() == 3) {
+        parsed.mnemonic = name;
+        parsed.operands = {xmm(rm_field(insn)), immediate(insn, 1)};
+        return;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  if ((op == 0x12 or op == 0x16) and prefix == 0 and insn.modrm_mod() == 3) {
+    parsed.mnemonic = op == 0x12 ? "movhlps" : "movlhps";
+    parsed.operands = {xmm(reg_field(insn)), xmm(rm_field(insn))};
+    return;
+  }
+  for (const SseEntry& entry : sse_table) {
+    if (entry.opcode != op or entry.names[prefix] == nullptr) {
+      continue;
+    }
+    parsed.mnemonic = entry.names[prefix];
+    const Operand reg_xmm = xmm(reg_field(insn));
+    const Operand rm_xmm = rm_operand(insn, entry.sizes[prefix], true);
+    // The stores have the r/m operand as destination.
+    const bool store = op == 0x11 or op == 0x13 or op == 0x17 or op == 0x29 or
+                       op == 0x2b or op == 0x7f or op == 0xd6 or op == 0xe7;
+    parsed.operands = store ? std::vector<Operand>{rm_xmm, reg_xmm}
+                            : std::vector<Operand>{reg_xmm, rm_xmm};
+    return;
+  }
+  parsed.valid = false;
+}
+
+void parse_two_byte(const Instruction& insn, Parsed& parsed) {
+  const uint8_t op = insn.opcode;
+  const uint8_t size = operand_size(insn);
+  if (op >= 0x40 and op <= 0x4f) {
+    parsed.mnemonic = std::string{"cmov"} + condition_codes[op - 0x40];
+    parsed.operands = {reg_operand(insn, size), rm_operand(insn, size)};
+  } else if (op >= 0x80 and op <= 0x8f) {
+    parsed.mnemonic = std::string{"j"} + condition_codes[op - 0x80];
+    parsed.operands = {{Operand::Kind::Target, 0, 8, insn.branch_target()}};
+  } else if (op >= 0x90 and op <= 0x9f) {
+    parsed.mnemonic = std::string{"set"} + condition_codes[op - 0x90];
+    parsed.operands = {rm_operand(insn, 1)};
+    parsed.implied_size = true;
+  } else if (op >= 0xc8 and op <= 0xcf) {
+    parsed.mnemonic = "bswap";
+    parsed.operands = {reg(static_cast<uint8_t>((op - 0xc8) |
+                                                ((insn.rex & 0x1) << 3)),
+                           insn.rex_w() ? 8 : 4)};
+  } else {
+    switch (op) {
+      case 0x05:
+        parsed.mnemonic = "syscall";
+        break;
+      case 0x0b:
+        parsed.mnemonic = "ud2";
+        break;
+      case 0x31:
+        parsed.mnemonic = "rdtsc";
+        break;
+      case 0xa2:
+        parsed.mnemonic = "cpuid";
+        break;
+      case 0x1e:
+        if (insn.rep_prefix and insn.modrm == 0xfa) {
+          parsed.mnemonic = "endbr64";
+        } else if (insn.rep_prefix and insn.modrm == 0xfb) {
+          parsed.mnemonic = "endbr32";
+        } else {
+          parsed.valid = false;
+        }
+        break;
+      case 0x1f:
+        parsed.mnemonic = "nop";
+        parsed.operands = {rm_operand(insn, size)};
+        break;
+      case 0x18:
+        if (insn.modrm_reg() < 4 and insn.modrm_mod() != 3) {
+          static constexpr std::array<const char*, 4> names{
+              "prefetchnta", "prefetcht0", "prefetcht1", "prefetcht2"};
+          parsed.mnemonic = names[insn.modrm_reg()];
+          parsed.operands = {rm_operand(insn, 1)};
+          parsed.implied_size = true;
+        } else {
+          parsed.valid = false;
+        }
+        break;
+      case 0xaf:
+        parsed.mnemonic = "imul";
+        parsed.operands = {reg_operand(insn, size), rm_operand(insn, size)};
+        break;
+      case 0xa3:
+      case 0xab:
+      case 0xb3:
+      case 0xbb: {
+        static constexpr std::array<const char*, 4> names{"bt", "bts", "btr",
+                                                          "btc"};
+        parsed.mnemonic = names[(op >> 3) & 0x3];
+        parsed.operands = {rm_operand(insn, size), reg_operand(insn, size)};
+        break;
+      }
+      case 0xba:
+        if (insn.modrm_reg() >= 4) {
+          static constexpr std::array<const char*, 4> names{"bt", "bts",
+                                                            "btr", "btc"};
+          parsed.mnemonic = names[insn.modrm_reg() - 4];
+          parsed.operands = {rm_operand(insn, size), immediate(insn, 1)};
+        } else {
+          parsed.valid = false;
+        }
+        break;
+      case 0xa4:
+      case 0xa5:
+      case 0xac:
+      case 0xad:
+        parsed.mnemonic = op < 0xa8 ? "shld" : "shrd";
+        parsed.operands = {rm_operand(insn, size), reg_operand(insn, size)};
+        parsed.operands.push_back((op & 1) != 0 ? reg(1, 1)
+                                                : immediate(insn, 1));
+        break;
+      case 0xb0:
+      case 0xb1:
+      case 0xc0:
+      case 0xc1: {
+        const uint8_t operand = (op & 1) != 0 ? size : 1;
+        parsed.mnemonic = op < 0xc0 ? "cmpxchg" : "xadd";
+        parsed.operands = {rm_operand(insn, operand),
+                           reg_operand(insn, operand)};
+        break;
+      }
+      case 0xb6:
+      case 0xb7:
+      case 0xbe:
+      case 0xbf: {
+        const uint8_t source = (op & 1) != 0 ? 2 : 1;
+        const bool sign = op >= 0xbe;
+        parsed.mnemonic = std::string{sign ? "movs" : "movz"} +
+                          size_suffix(source) + size_suffix(size);
+        parsed.intel_mnemonic = sign ? "movsx" : "movzx";
+        parsed.operands = {reg_operand(insn, size), rm_operand(insn, source)};
+        break;
+      }
+      case 0xb8:
+      case 0xbc:
+      case 0xbd:
+        if (op == 0xb8 and not insn.rep_prefix) {
+          parsed.valid = false;
+          break;
+        }
+        parsed.mnemonic = op == 0xb8   ? "popcnt"
+                          : op == 0xbc ? (insn.rep_prefix ? "tzcnt" : "bsf")
+                                       : (insn.rep_prefix ? "lzcnt" : "bsr");
+        parsed.operands = {reg_operand(insn, size), rm_operand(insn, size)};
+        break;
+      default:
+        parse_sse(insn, parsed);
+        break;
+    }
+  }
+}
+
+void parse_one_byte(const Instruction& insn, Parsed& parsed) {
+  static constexpr std::array<const char*, 8> alu{"add", "or",  "adc", "sbb",
+                                                  "and", "sub", "xor", "cmp"};
+  static constexpr std::array<const char*, 8> shifts{
+      "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"};
+  const uint8_t op = insn.opcode;
+  const uint8_t size = operand_size(insn);
+  // Byte sized forms have the lowest opcode bit clear
+  const uint8_t sized = (op & 1) != 0 ? size : 1;
+  const uint8_t number = static_cast<uint8_t>((op & 0x7) |
+                                              ((insn.rex & 0x1) << 3));
+  if (op < 0x40 and (op & 0x7) < 6) {
+    parsed.mnemonic = alu[op >> 3];
+    switch (op & 0x7) {
+      case 0:
+      case 1:
+        parsed.operands = {rm_operand(insn, sized), reg_operand(insn, sized)};
+        break;
+      case 2:
+      case 3:
+        parsed.operands = {reg_operand(insn, sized), rm_operand(insn, sized)};
+        break;
+      default:
+        parsed.operands = {reg(0, sized), immediate(insn, sized)};
+        break;
+    }
+    return;
+  }
+  if (op >= 0x50 and op <= 0x5f) {
+    parsed.mnemonic = op < 0x58 ? "push" : "pop";
+    parsed.operands = {reg(number, 8)};
+    return;
+  }
+  if (op >= 0x70 and op <= 0x7f) {
+    parsed.mnemonic = std::string{"j"} + condition_codes[op - 0x70];
+    parsed.operands = {{Operand::Kind::Target, 0, 8, insn.branch_target()}};
+    return;
+  }
+  if (op >= 0x91 and op <= 0x97) {
+    parsed.mnemonic = "xchg";
+    parsed.operands = {reg(number, size), reg(0, size)};
+    return;
+  }
+  if (op >= 0xb0 and op <= 0xbf) {
+    const uint8_t operand = op < 0xb8 ? 1 : size;
+    parsed.mnemonic = operand == 8 ? "movabs" : "mov";
+    parsed.intel_mnemonic = operand == 8 ? "movabs" : "mov";
+    parsed.operands = {reg(number, operand), immediate(insn, operand)};
+    return;
+  }
+  switch (op) {
+    case 0x63:
+      parsed.mnemonic = std::string{"movs"} + "l" + size_suffix(size);
+      parsed.intel_mnemonic = "movsxd";
+      parsed.operands = {reg_operand(insn, size), rm_operand(insn, 4)};
+      return;
+    case 0x68:
+    case 0x6a:
+      parsed.mnemonic = "push";
+      parsed.operands = {immediate(insn, 8)};
+      return;
+    case 0x69:
+    case 0x6b:
+      parsed.mnemonic = "imul";
+      parsed.operands = {reg_operand(insn, size), rm_operand(insn, size),
+                         immediate(insn, size)};
+      return;
+    case 0x80:
+    case 0x81:
+    case 0x83:
+      parsed.mnemonic = alu[insn.modrm_reg()];
+      parsed.operands = {rm_operand(insn, sized), immediate(insn, sized)};
+      return;
+    case 0x84:
+    case 0x85:
+    case 0x86:
+    case 0x87:
+    case 0x88:
+    case 0x89:
+      parsed.mnemonic = op < 0x86 ? "test" : (op < 0x88 ? "xchg" : "mov");
+      parsed.operands = {rm_operand(insn, sized), reg_operand(insn, sized)};
+      return;
+    case 0x8a:
+    case 0x8b:
+      parsed.mnemonic = "mov";
+      parsed.operands = {reg_operand(insn, sized), rm_operand(insn, sized)};
+      return;
+    case 0x8d:
+      parsed.mnemonic = "lea";
+      parsed.operands = {reg_operand(insn, size), rm_operand(insn, 0)};
+      return;
+    case 0x8f:
+      parsed.mnemonic = "pop";
+      parsed.operands = {rm_operand(insn, 8)};
+      parsed.implied_size = true;
+      return;
+    case 0x90:
+      parsed.mnemonic = insn.rep_prefix ? "pause" : "nop";
+      if ((insn.rex & 0x1) != 0 or insn.operand_size_prefix) {
+        parsed.mnemonic = "xchg";
+        parsed.operands = {reg(number, size), reg(0, size)};
+      }
+      return;
+    case 0x98:
+      parsed.mnemonic = size == 8 ? "cltq" : (size == 4 ? "cwtl" : "cbtw");
+      parsed.intel_mnemonic =
+          size == 8 ? "cdqe" : (size == 4 ? "cwde" : "cbw");
+      return;
+    case 0x99:
+      parsed.mnemonic = size == 8 ? "cqto" : (size == 4 ? "cltd" : "cwtd");
+      parsed.intel_mnemonic = size == 8 ? "cqo" : (size == 4 ? "cdq" : "cwd");
+      return;
+    case 0x9c:
+    case 0x9d:
+      parsed.mnemonic = op == 0x9c ? "pushf" : "popf";
+      return;
+    case 0xa4:
+    case 0xa5:
+    case 0xa6:
+    case 0xa7:
+    case 0xaa:
+    case 0xab:
+    case 0xac:
+    case 0xad:
+    case 0xae:
+    case 0xaf: {
+      static constexpr std::array<const char*, 6> names{"movs", "cmps", "",
+                                                        "stos", "lods", "scas"};
+      const bool compares = op == 0xa6 or op == 0xa7 or op >= 0xae;
+      if (insn.rep_prefix) {
+        parsed.prefix = compares ? "repz " : "rep ";
+      } else if (insn.repne_prefix) {
+        parsed.prefix = "repnz ";
+      }
+      parsed.mnemonic = names[(op - 0xa4) >> 1];
+      const Operand source{Operand::Kind::String, 6, sized, 0};
+      const Operand destination{Operand::Kind::String, 7, sized, 0};
+      switch (op & 0xfe) {
+        case 0xa4:
+          parsed.operands = {destination, source};
+          break;
+        case 0xa6:
+          parsed.operands = {source, destination};
+          break;
+        case 0xaa:
+          parsed.operands = {destination, reg(0, sized)};
+          break;
+        case 0xac:
+          parsed.operands = {reg(0, sized), source};
+          break;
+        default:
+          parsed.operands = {reg(0, sized), destination};
+          break;
+      }
+      return;
+    }
+    case 0xa8:
+    case 0xa9:
+      parsed.mnemonic = "test";
+      parsed.operands = {reg(0, sized), immediate(insn, sized)};
+      return;
+    case 0xc0:
+    case 0xc1:
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+      parsed.mnemonic = shifts[insn.modrm_reg()];
+      parsed.operands = {rm_operand(insn, sized)};
+      if (op <= 0xc1) {
+        parsed.operands.push_back(immediate(insn, 1));
+      } else if (op >= 0xd2) {
+        parsed.operands.push_back(reg(1, 1));
+      } else {
+        parsed.shift_by_one = true;
+      }
+      return;
+    case 0xc2:
+      parsed.mnemonic = "ret";
+      parsed.operands = {immediate(insn, 2)};
+      return;
+    case 0xc3:
+      parsed.prefix = insn.rep_prefix ? "repz " : "";
+      parsed.mnemonic = "ret";
+      return;
+    case 0xc6:
+    case 0xc7:
+      if (insn.modrm_reg() != 0) {
+        break;
+      }
+      parsed.mnemonic = "mov";
+      parsed.operands = {rm_operand(insn, sized), immediate(insn, sized)};
+      return;
+    case 0xc8:
+      parsed.mnemonic = "enter";
+      parsed.operands = {immediate(insn, 2)};
+      return;
+    case 0xc9:
+      parsed.mnemonic = "leave";
+      return;
+    case 0xcc:
+      parsed.mnemonic = "int3";
+      return;
+    case 0xcd:
+      parsed.mnemonic = "int";
+      parsed.operands = {immediate(insn, 1)};
+      return;
+    case 0xe0:
+    case 0xe1:
+    case 0xe2:
+    case 0xe3: {
+      static constexpr std::array<const char*, 4> names{"loopne", "loope",
+                                                        "loop", "jrcxz"};
+      parsed.mnemonic = names[op - 0xe0];
+      parsed.operands = {{Operand::Kind::Target, 0, 8, insn.branch_target()}};
+      return;
+    }
+    case 0xe8:
+    case 0xe9:
+    case 0xeb:
+      parsed.mnemonic = op == 0xe8 ? "call" : "jmp";
+      parsed.operands = {{Operand::Kind::Target, 0, 8, insn.branch_target()}};
+      return;
+    case 0xf4:
+      parsed.mnemonic = "hlt";
+      return;
+    case 0xf5:
+    case 0xf8:
+    case 0xf9:
+    case 0xfc:
+    case 0xfd:
+      parsed.mnemonic = op == 0xf5   ? "cmc"
+                        : op == 0xf8 ? "clc"
+                        : op == 0xf9 ? "stc"
+                        : op == 0xfc ? "cld"
+                                     : "std";
+      return;
+    case 0xf6:
+    case 0xf7: {
+      static constexpr std::array<const char*, 8> names{
+          "test", "test", "not", "neg", "mul", "imul", "div", "idiv"};
+      parsed.mnemonic = names[insn.modrm_reg()];
+      parsed.operands = {rm_operand(insn, sized)};
+      if (insn.modrm_reg() < 2) {
+        parsed.operands.push_back(immediate(insn, sized));
+      }
+      return;
+    }
+    case 0xfe:
+    case 0xff:
+      switch (insn.modrm_reg()) {
+        case 0:
+        case 1:
+          parsed.mnemonic = insn.modrm_reg() == 0 ? "inc" : "dec";
+          parsed.operands = {rm_operand(insn, sized)};
+          return;
+        case 2:
+        case 4:
+          if (op == 0xff) {
+            parsed.mnemonic = insn.modrm_reg() == 2 ? "call" : "jmp";
+            parsed.operands = {rm_operand(insn, 8)};
+            parsed.indirect = true;
+            parsed.implied_size = true;
+            return;
+          }
+          break;
+        case 6:
+          if (op == 0xff) {
+            parsed.mnemonic = "push";
+            parsed.operands = {rm_operand(insn, 8)};
+            parsed.implied_size = true;
+            return;
+          }
+          break;
+        default:
+          break;
+      }
+      break;
+    default:
+      break;
+  }
+  parsed.valid = false;
+}
+
+// The segment override of a memory operand, empty if there is none
+std::string segment(const Instruction& insn, const uint8_t* bytes) {
+  for (std::size_t i = 0; i < insn.opcode_offset; ++i) {
+    if (bytes[i] == 0x64) {
+      return "fs";
+    }
+    if (bytes[i] == 0x65) {
+      return "gs";
+    }
+  }
+  return {};
+}
+
+std::string format_memory(const Instruction& insn, const uint8_t* bytes,
+                          const Operand& operand, const Syntax syntax) {
+  const uint8_t address_size = insn.address_size_prefix ? 4 : 8;
+  const bool att = syntax == Syntax::Att;
+  const auto name = [att, address_size](const uint8_t number) {
+    return (att ? "%" : "") + register_name(number, address_size, true);
+  };
+  std::string base{};
+  std::string index{};
+  unsigned scale = 1;
+  if (insn.rip_relative) {
+    base = att ? "%rip" : "rip";
+  } else if (insn.has_sib) {
+    const auto base_number =
+        static_cast<uint8_t>((insn.sib & 0x7) | ((insn.rex & 0x1) << 3));
+    const auto index_number = static_cast<uint8_t>(((insn.sib >> 3) & 0x7) |
+                                                   ((insn.rex & 0x2) << 2));
+    if (not(insn.modrm_mod() == 0 and (insn.sib & 0x7) == 5)) {
+      base = name(base_number);
+    }
+    if (index_number != 4) {
+      index = name(index_number);
+      scale = 1u << (insn.sib >> 6);
+    }
+  } else {
+    base = name(rm_field(insn));
+  }
+  std::string segment_name = segment(insn, bytes);
+  const bool has_displacement = insn.displacement_size != 0;
+  // Absolute addresses are sign-extended to 64 bits.
+  const auto absolute = static_cast<int64_t>(insn.displacement);
+  std::string result{};
+  if (att) {
+    if (not segment_name.empty()) {
+      result += "%" + segment_name + ":";
+    }
+    if (has_displacement) {
+      result += base.empty() and index.empty()
+                    ? hex(static_cast<uint64_t>(absolute))
+                    : signed_hex(insn.displacement);
+    }
+    if (not base.empty() or not index.empty()) {
+      result += "(" + base;
+      if (not index.empty()) {
+        result += "," + index + "," + std::to_string(scale);
+      }
+      result += ")";
+    }
+    return result;
+  }
+  result = size_name(operand.size);
+  if (base.empty() and index.empty()) {
+    return result + (segment_name.empty() ? "ds" : segment_name) + ":" +
+           hex(static_cast<uint64_t>(absolute));
+  }
+  if (not segment_name.empty()) {
+    result += segment_name + ":";
+  }
+  result += "[" + base;
+  if (not index.empty()) {
+    result += (base.empty() ? "" : "+") + index + "*" + std::to_string(scale);
+  }
+  if (insn.rip_relative) {
+    // objdump writes negative offsets from rip as unsigned
+    result += "+" + hex(static_cast<uint64_t>(
+                        static_cast<int64_t>(insn.displacement)));
+  } else if (has_displacement) {
+    result += (insn.displacement < 0 ? "" : "+") +
+              signed_hex(insn.displacement);
+  }
+  return result + "]";
+}
+}  // namespace
+
+std::string format_instruction(const Instruction& insn,
+                               const uint8_t* const bytes,
+                               const Syntax syntax) {
+  Parsed parsed{};
+  if (not insn.valid or insn.vex or insn.opcode_map > 1) {
+    parsed.valid = false;
+  } else if (insn.opcode_map == 1) {
+    parse_two_byte(insn, parsed);
+  } else {
+    parse_one_byte(insn, parsed);
+  }
+  if (not parsed.valid) {
+    return "(bad)";
+  }
+
+  const bool att = syntax == Syntax::Att;
+  std::string mnemonic = att or parsed.intel_mnemonic.empty()
+                             ? parsed.mnemonic
+                             : parsed.intel_mnemonic;
+  if (insn.lock_prefix) {
+    parsed.prefix = "lock " + parsed.prefix;
+  }
+  if (parsed.indirect and
+      std::find(bytes, bytes + insn.opcode_offset, 0x3e) !=
+          bytes + insn.opcode_offset) {
+    // Exempt from indirect branch tracking
+    parsed.prefix += "notrack ";
+  }
+  if (insn.opcode_map == 1 and insn.opcode == 0x1f) {
+    // Padding carries redundant prefixes, shown the way objdump does.
+    bool operand_size = false;
+    for (std::size_t i = 0; i < insn.opcode_offset; ++i) {
+      if (bytes[i] == 0x66 and operand_size) {
+        parsed.prefix += "data16 ";
+      }
+      operand_size = operand_size or bytes[i] == 0x66;
+      if (bytes[i] == 0x2e) {
+        parsed.prefix += "cs ";
+      }
+    }
+  }
+  std::vector<std::string> operands{};
+  bool has_register = false;
+  uint8_t memory_size = 0;
+  for (const Operand& operand : parsed.operands) {
+    switch (operand.kind) {
+      case Operand::Kind::Register:
+        has_register = true;
+        operands.push_back((att ? "%" : "") +
+                           register_name(operand.reg, operand.size,
+                                         insn.rex != 0));
+        break;
+      case Operand::Kind::Xmm:
+        has_register = true;
+        operands.push_back((att ? "%xmm" : "xmm") +
+                           std::to_string(operand.reg));
+        break;
+      case Operand::Kind::Memory:
+        memory_size = operand.size;
+        operands.push_back(format_memory(insn, bytes, operand, syntax));
+        break;
+      case Operand::Kind::String: {
+        memory_size = operand.size;
+        const char* const segment_name = operand.reg == 7 ? "es" : "ds";
+        const std::string base = register_name(operand.reg, 8, true);
+        operands.push_back(att ? std::string{"%"} + segment_name + ":(%" +
+                                     base + ")"
+                               : size_name(operand.size) +
+                                     std::string{segment_name} + ":[" + base +
+                                     "]");
+        break;
+      }
+      case Operand::Kind::Immediate:
+        operands.push_back((att ? "$" : "") +
+                           hex(truncate(operand.value, operand.size)));
+        break;
+      case Operand::Kind::Target:
+        operands.push_back(hex(static_cast<uint64_t>(operand.value)));
+        break;
+    }
+  }
+  // AT&T needs a size suffix where no register implies the operand size.
+  if (att and memory_size != 0 and memory_size <= 8 and not has_register and
+      not parsed.implied_size) {
+    mnemonic += size_suffix(memory_size);
+  }
+  if (parsed.shift_by_one and not att) {
+    operands.emplace_back("1");
+  }
+  std::string result = parsed.prefix + mnemonic;
+  if (operands.empty()) {
+    return result;
+  }
+  result += ' ';
+  if (att) {
+    if (parsed.indirect) {
+      result += '*';
+    }
+    for (auto operand = operands.rbegin(); operand != operands.rend();
+         ++operand) {
+      result += (operand == operands.rbegin() ? "" : ",") + *operand;
+    }
+  } else {
+    for (auto operand = operands.begin(); operand != operands.end();
+         ++operand) {
+      result += (operand == operands.begin() ? "" : ",") + *operand;
+    }
+  }
+  return result;
+}
+}  // namespace nebugger
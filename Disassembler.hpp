@@ -0,0 +1,27 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+/// Assembly syntax of `format_instruction`.
+enum class Syntax { Att, Intel };
+
+/// Write the decoded instruction `insn`, whose bytes start at `bytes`, as
+/// assembly in the style of objdump, e.g. `mov %rsp,%rbp` or `mov rbp,rsp`.
+///
+/// The general purpose instructions emitted by compilers and the common
+/// scalar and packed SSE moves and arithmetic are known. Anything else,
+/// including VEX encoded instructions, is written as `(bad)`.
+std::string format_instruction(const Instruction& insn, const uint8_t* bytes,
+                               Syntax syntax);
+}  // namespace nebugger
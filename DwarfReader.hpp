@@ -0,0 +1,119 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace nebugger {
+/// Sequential reader for the encodings used in DWARF sections.
+///
+/// Reads past the end return zero and set `overflow`, so callers can parse a
+/// whole structure and check for truncation once.
+class DwarfReader {
+ public:
+  DwarfReader(const uint8_t* begin, const uint8_t* end)
+      : begin_(begin), position_(begin), end_(end) {}
+
+  bool at_end() const noexcept { return position_ >= end_; }
+  bool overflow() const noexcept { return overflow_; }
+  const uint8_t* position() const noexcept { return position_; }
+  std::size_t offset() const noexcept {
+    return static_cast<std::size_t>(position_ - begin_);
+  }
+  std::size_t remaining() const noexcept {
+    return position_ < end_ ? static_cast<std::size_t>(end_ - position_) : 0;
+  }
+
+  void skip(const std::size_t bytes) noexcept {
+    if (bytes > remaining()) {
+      overflow_ = true;
+      position_ = end_;
+    } else {
+      position_ += bytes;
+    }
+  }
+
+  template <class T>
+  T read() noexcept {
+    T value{};
+    if (sizeof(T) > remaining()) {
+      overflow_ = true;
+      position_ = end_;
+      return value;
+    }
+    std::memcpy(&value, position_, sizeof(T));
+    position_ += sizeof(T);
+    return value;
+  }
+
+  uint64_t read_uleb128() noexcept {
+    uint64_t result = 0;
+    unsigned shift = 0;
+    while (true) {
+      const auto byte = read<uint8_t>();
+      if (shift < 64) {
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      }
+      shift += 7;
+      if ((byte & 0x80) == 0 or overflow_) {
+        return result;
+      }
+    }
+  }
+
+  int64_t read_sleb128() noexcept {
+    int64_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte = 0;
+    do {
+      byte = read<uint8_t>();
+      if (shift < 64) {
+        result |= static_cast<int64_t>(byte & 0x7f) << shift;
+      }
+      shift += 7;
+    } while ((byte & 0x80) != 0 and not overflow_);
+    if (shift < 64 and (byte & 0x40) != 0) {
+      result |= -(int64_t{1} << shift);
+    }
+    return result;
+  }
+
+  /// Read an offset, 4 bytes in 32-bit DWARF and 8 bytes in 64-bit DWARF.
+  uint64_t read_offset(const bool is_64bit) noexcept {
+    return is_64bit ? read<uint64_t>() : read<uint32_t>();
+  }
+
+  /// Read a unit length, setting `is_64bit` for the 64-bit DWARF format.
+  uint64_t read_unit_length(bool& is_64bit) noexcept {
+    const auto length = read<uint32_t>();
+    is_64bit = length == 0xffffffff;
+    return is_64bit ? read<uint64_t>() : length;
+  }
+
+  /// Read a null terminated string.
+  const char* read_string() noexcept {
+    const auto* const start = reinterpret_cast<const char*>(position_);
+    const void* const terminator = std::memchr(position_, 0, remaining());
+    if (terminator == nullptr) {
+      overflow_ = true;
+      position_ = end_;
+      return "";
+    }
+    position_ = static_cast<const uint8_t*>(terminator) + 1;
+    return start;
+  }
+
+ private:
+  const uint8_t* begin_;
+  const uint8_t* position_;
+  const uint8_t* end_;
+  bool overflow_{false};
+};
+}  // namespace nebugger
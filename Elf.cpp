@@ -0,0 +1,200 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Elf.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace nebugger {
+ElfFile::ElfFile(const std::string& path) : path_(path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    std::cerr << "Failed to open ELF file '" << path << "'\n";
+    return;
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) == -1 or
+      static_cast<std::size_t>(file_stat.st_size) < sizeof(Elf64_Ehdr)) {
+    std::cerr << "ELF file '" << path << "' is too small\n";
+    close(fd);
+    return;
+  }
+  size_ = static_cast<std::size_t>(file_stat.st_size);
+  void* const mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "Failed to map ELF file '" << path << "'\n";
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(mapped);
+
+  const auto& ehdr = header();
+  if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 or
+      ehdr.e_ident[EI_CLASS] != ELFCLASS64 or
+      ehdr.e_shoff + ehdr.e_shnum * sizeof(Elf64_Shdr) > size_) {
+    std::cerr << "File '" << path << "' is not a 64-bit ELF file\n";
+    munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    return;
+  }
+
+  const auto* const sections =
+      reinterpret_cast<const Elf64_Shdr*>(data_ + ehdr.e_shoff);
+  for (std::size_t i = 0; i < ehdr.e_shnum; ++i) {
+    if (sections[i].sh_type == SHT_SYMTAB or
+        sections[i].sh_type == SHT_DYNSYM) {
+      read_symbol_table(sections[i]);
+    }
+  }
+  std::sort(symbols_.begin(), symbols_.end(),
+            [](const Symbol& a, const Symbol& b) {
+              return a.address < b.address;
+            });
+  for (std::size_t i = 0; i < symbols_.size(); ++i) {
+    // Prefer the first (i.e. lowest address) symbol of a given name.
+    symbol_indices_.insert({symbols_[i].name, i});
+  }
+}
+
+ElfFile::ElfFile(ElfFile&& other) noexcept
+    : path_(std::move(other.path_)),
+      data_(other.data_),
+      size_(other.size_),
+      symbols_(std::move(other.symbols_)),
+      symbol_indices_(std::move(other.symbol_indices_)) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+ElfFile& ElfFile::operator=(ElfFile&& other) noexcept {
+  if (this != &other) {
+    if (data_ != nullptr) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    path_ = std::move(other.path_);
+    data_ = other.data_;
+    size_ = other.size_;
+    symbols_ = std::move(other.symbols_);
+    symbol_indices_ = std::move(other.symbol_indices_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+ElfFile::~ElfFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+bool ElfFile::is_position_independent() const noexcept {
+  return is_valid() and header().e_type == ET_DYN;
+}
+
+const Elf64_Shdr* ElfFile::find_section(const std::string& name) const
+    noexcept {
+  if (not is_valid()) {
+    return nullptr;
+  }
+  const auto& ehdr = header();
+  const auto* const sections =
+      reinterpret_cast<const Elf64_Shdr*>(data_ + ehdr.e_shoff);
+  if (ehdr.e_shstrndx == SHN_UNDEF or ehdr.e_shstrndx >= ehdr.e_shnum) {
+    return nullptr;
+  }
+  const char* const names =
+      reinterpret_cast<const char*>(data_ + sections[ehdr.e_shstrndx].sh_offset);
+  for (std::size_t i = 0; i < ehdr.e_shnum; ++i) {
+    if (name == names + sections[i].sh_name) {
+      return &sections[i];
+    }
+  }
+  return nullptr;
+}
+
+std::pair<uint64_t, uint64_t> ElfFile::address_range() const noexcept {
+  if (not is_valid() or header().e_phoff + header().e_phnum *
+                                              sizeof(Elf64_Phdr) > size_) {
+    return {0, 0};
+  }
+  std::pair<uint64_t, uint64_t> range{UINT64_MAX, 0};
+  const auto& ehdr = header();
+  const auto* const segments =
+      reinterpret_cast<const Elf64_Phdr*>(data_ + ehdr.e_phoff);
+  for (std::size_t i = 0; i < ehdr.e_phnum; ++i) {
+    if (segments[i].p_type == PT_LOAD) {
+      range.first = std::min(range.first, segments[i].p_vaddr);
+      range.second =
+          std::max(range.second, segments[i].p_vaddr + segments[i].p_memsz);
+    }
+  }
+  return range.first < range.second ? range : std::pair<uint64_t, uint64_t>{};
+}
+
+const Symbol* ElfFile::find_symbol(const std::string& name) const noexcept {
+  const auto it = symbol_indices_.find(name);
+  return it == symbol_indices_.end() ? nullptr : &symbols_[it->second];
+}
+
+const Symbol* ElfFile::find_function_containing(const uint64_t address) const
+    noexcept {
+  // Find the last symbol starting at or before the address.
+  auto it = std::upper_bound(
+      symbols_.begin(), symbols_.end(), address,
+      [](const uint64_t a, const Symbol& s) { return a < s.address; });
+  while (it != symbols_.begin()) {
+    --it;
+    if (it->is_function and address < it->address + std::max<uint64_t>(
+                                                         it->size, 1)) {
+      return &*it;
+    }
+    if (it->is_function and it->size != 0) {
+      // Functions do not overlap, so no earlier function can contain the
+      // address either.
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+void ElfFile::read_symbol_table(const Elf64_Shdr& symbol_table) {
+  const auto& ehdr = header();
+  const auto* const sections =
+      reinterpret_cast<const Elf64_Shdr*>(data_ + ehdr.e_shoff);
+  if (symbol_table.sh_link >= ehdr.e_shnum or
+      symbol_table.sh_offset + symbol_table.sh_size > size_) {
+    return;
+  }
+  const char* const names = reinterpret_cast<const char*>(
+      data_ + sections[symbol_table.sh_link].sh_offset);
+  const auto* const entries =
+      reinterpret_cast<const Elf64_Sym*>(data_ + symbol_table.sh_offset);
+  const std::size_t number_of_entries =
+      symbol_table.sh_size / sizeof(Elf64_Sym);
+  symbols_.reserve(symbols_.size() + number_of_entries);
+  for (std::size_t i = 0; i < number_of_entries; ++i) {
+    const Elf64_Sym& entry = entries[i];
+    const unsigned type = ELF64_ST_TYPE(entry.st_info);
+    if (entry.st_name == 0 or entry.st_shndx == SHN_UNDEF or
+        (type != STT_FUNC and type != STT_OBJECT and
+         type != STT_GNU_IFUNC and type != STT_NOTYPE)) {
+      continue;
+    }
+    symbols_.push_back(Symbol{names + entry.st_name, entry.st_value,
+                              entry.st_size,
+                              type == STT_FUNC or type == STT_GNU_IFUNC});
+  }
+}
+}  // namespace nebugger
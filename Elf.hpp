@@ -0,0 +1,84 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <elf.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+/// A symbol from the `.symtab` or `.dynsym` section of an ELF file.
+struct Symbol {
+  std::string name;
+  // Address relative to the load address of the ELF file
+  uint64_t address;
+  uint64_t size;
+  bool is_function;
+};
+
+/// Read-only view of a 64-bit ELF file.
+///
+/// The file is mapped into memory once and the symbol tables are indexed on
+/// construction, so symbol lookups do not touch the file again.
+class ElfFile {
+ public:
+  ElfFile() = default;
+  explicit ElfFile(const std::string& path);
+  ElfFile(const ElfFile&) = delete;
+  ElfFile& operator=(const ElfFile&) = delete;
+  ElfFile(ElfFile&& other) noexcept;
+  ElfFile& operator=(ElfFile&& other) noexcept;
+  ~ElfFile();
+
+  bool is_valid() const noexcept { return data_ != nullptr; }
+  const std::string& path() const noexcept { return path_; }
+
+  /// True for position independent executables and shared libraries, whose
+  /// addresses must be offset by the load address.
+  bool is_position_independent() const noexcept;
+
+  const Elf64_Ehdr& header() const noexcept {
+    return *reinterpret_cast<const Elf64_Ehdr*>(data_);
+  }
+
+  /// Find a section by name, returns `nullptr` if there is none.
+  const Elf64_Shdr* find_section(const std::string& name) const noexcept;
+
+  /// Pointer to the contents of `section` in the mapped file.
+  const uint8_t* section_data(const Elf64_Shdr& section) const noexcept {
+    return data_ + section.sh_offset;
+  }
+
+  /// The addresses [first, second), relative to the load address, covered by
+  /// the loadable segments.
+  std::pair<uint64_t, uint64_t> address_range() const noexcept;
+
+  /// Find a symbol by name, returns `nullptr` if there is none.
+  const Symbol* find_symbol(const std::string& name) const noexcept;
+
+  /// Find the function symbol whose range contains `address`, returns
+  /// `nullptr` if there is none.
+  const Symbol* find_function_containing(uint64_t address) const noexcept;
+
+  /// All symbols, sorted by address.
+  const std::vector<Symbol>& symbols() const noexcept { return symbols_; }
+
+ private:
+  void read_symbol_table(const Elf64_Shdr& symbol_table);
+
+  std::string path_{};
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+  std::vector<Symbol> symbols_{};
+  std::unordered_map<std::string, std::size_t> symbol_indices_{};
+};
+}  // namespace nebugger
@@ -0,0 +1,539 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Emulator.hpp"
+
+#include <array>
+#include <cstddef>
+
+#include "Memory.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint64_t carry_flag = 0x1;
+constexpr uint64_t parity_flag = 0x4;
+constexpr uint64_t adjust_flag = 0x10;
+constexpr uint64_t zero_flag = 0x40;
+constexpr uint64_t sign_flag = 0x80;
+constexpr uint64_t trap_flag = 0x100;
+constexpr uint64_t overflow_flag = 0x800;
+constexpr uint64_t status_flags = carry_flag | parity_flag | adjust_flag |
+                                  zero_flag | sign_flag | overflow_flag;
+
+// The general purpose registers in hardware encoding order
+constexpr std::array<unsigned long long user_regs_struct::*, 16> registers{
+    &user_regs_struct::rax, &user_regs_struct::rcx, &user_regs_struct::rdx,
+    &user_regs_struct::rbx, &user_regs_struct::rsp, &user_regs_struct::rbp,
+    &user_regs_struct::rsi, &user_regs_struct::rdi, &user_regs_struct::r8,
+    &user_regs_struct::r9,  &user_regs_struct::r10, &user_regs_struct::r11,
+    &user_regs_struct::r12, &user_regs_struct::r13, &user_regs_struct::r14,
+    &user_regs_struct::r15};
+
+uint64_t mask(const uint8_t size) {
+  return size >= 8 ? ~uint64_t{0} : (uint64_t{1} << (size * 8)) - 1;
+}
+
+uint64_t sign_extend(const uint64_t value, const uint8_t size) {
+  const unsigned shift = 64 - 8 * static_cast<unsigned>(size);
+  return static_cast<uint64_t>(static_cast<int64_t>(value << shift) >> shift);
+}
+
+// The group 1 operations in ModRM reg order, adc and sbb are not supported
+enum class AluOperation { Add, Or, Adc, Sbb, And, Sub, Xor, Cmp };
+
+// Result of `a op b` on `size` bytes, setting the status flags in `flags`
+uint64_t alu(const AluOperation operation, uint64_t a, uint64_t b,
+             const uint8_t size, unsigned long long& flags) {
+  const uint64_t bits = mask(size);
+  const uint64_t sign = uint64_t{1} << (8 * size - 1);
+  a &= bits;
+  b &= bits;
+  uint64_t result = 0;
+  uint64_t set = 0;
+  switch (operation) {
+    case AluOperation::Add:
+      result = (a + b) & bits;
+      set |= result < a ? carry_flag : 0;
+      set |= ((a ^ result) & (b ^ result) & sign) != 0 ? overflow_flag : 0;
+      set |= ((a ^ b ^ result) & 0x10) != 0 ? adjust_flag : 0;
+      break;
+    case AluOperation::Sub:
+    case AluOperation::Cmp:
+      result = (a - b) & bits;
+      set |= a < b ? carry_flag : 0;
+      set |= ((a ^ b) & (a ^ result) & sign) != 0 ? overflow_flag : 0;
+      set |= ((a ^ b ^ result) & 0x10) != 0 ? adjust_flag : 0;
+      break;
+    case AluOperation::Or:
+      result = a | b;
+      break;
+    case AluOperation::And:
+      result = a & b;
+      break;
+    default:
+      result = a ^ b;
+      break;
+  }
+  set |= result == 0 ? zero_flag : 0;
+  set |= (result & sign) != 0 ? sign_flag : 0;
+  set |= __builtin_parity(static_cast<unsigned>(result & 0xff)) == 0
+             ? parity_flag
+             : 0;
+  flags = (flags & ~status_flags) | set;
+  return result;
+}
+
+// Whether the condition `code` of jcc, setcc and cmovcc holds
+bool condition(const uint8_t code, const uint64_t flags) {
+  const bool carry = (flags & carry_flag) != 0;
+  const bool zero = (flags & zero_flag) != 0;
+  const bool less =
+      ((flags & sign_flag) != 0) != ((flags & overflow_flag) != 0);
+  bool result = false;
+  switch (code >> 1) {
+    case 0:
+      result = (flags & overflow_flag) != 0;
+      break;
+    case 1:
+      result = carry;
+      break;
+    case 2:
+      result = zero;
+      break;
+    case 3:
+      result = carry or zero;
+      break;
+    case 4:
+      result = (flags & sign_flag) != 0;
+      break;
+    case 5:
+      result = (flags & parity_flag) != 0;
+      break;
+    case 6:
+      result = less;
+      break;
+    default:
+      result = less or zero;
+      break;
+  }
+  return result != ((code & 1) != 0);
+}
+
+// The registers and memory an instruction executes on. Registers are
+// changed in a copy, and the single memory write an instruction may do is
+// deferred, so that nothing changes unless the instruction completes.
+class Machine {
+ public:
+  Machine(const Instruction& insn, const uint8_t* const bytes,
+          const user_regs_struct& initial, InferiorMemory& memory,
+          const std::pair<std::intptr_t, std::intptr_t> unprotected)
+      : regs(initial),
+        insn_(insn),
+        bytes_(bytes),
+        memory_(memory),
+        unprotected_(unprotected),
+        original_(initial) {}
+
+  user_regs_struct regs;
+
+  uint8_t operand_size() const {
+    return insn_.rex_w() ? 8 : (insn_.operand_size_prefix ? 2 : 4);
+  }
+  uint8_t reg_number() const {
+    return static_cast<uint8_t>(insn_.modrm_reg() | ((insn_.rex & 0x4) << 1));
+  }
+  bool rm_is_register() const { return insn_.modrm_mod() == 3; }
+
+  uint64_t get(const uint8_t number, const uint8_t size) const {
+    if (size == 1 and insn_.rex == 0 and number >= 4 and number < 8) {
+      // ah, ch, dh and bh
+      return (regs.*registers[number - 4] >> 8) & 0xff;
+    }
+    return regs.*registers[number] & mask(size);
+  }
+
+  void set(const uint8_t number, const uint8_t size, const uint64_t value) {
+    if (size == 1 and insn_.rex == 0 and number >= 4 and number < 8) {
+      auto& reg = regs.*registers[number - 4];
+      reg = (reg & ~uint64_t{0xff00}) | ((value & 0xff) << 8);
+      return;
+    }
+    auto& reg = regs.*registers[number];
+    // 32-bit writes clear the upper half, narrower ones merge.
+    reg = size >= 4 ? value & mask(size)
+                    : (reg & ~mask(size)) | (value & mask(size));
+  }
+
+  // Effective address of the ModRM memory operand, from the registers
+  // before the instruction changed any of them
+  std::intptr_t address() const {
+    uint64_t address = static_cast<uint64_t>(insn_.displacement);
+    if (insn_.rip_relative) {
+      address += static_cast<uint64_t>(insn_.address + insn_.length);
+    } else if (insn_.has_sib) {
+      const auto base =
+          static_cast<uint8_t>((insn_.sib & 0x7) | ((insn_.rex & 0x1) << 3));
+      const auto index = static_cast<uint8_t>(((insn_.sib >> 3) & 0x7) |
+                                              ((insn_.rex & 0x2) << 2));
+      if (not(insn_.modrm_mod() == 0 and (insn_.sib & 0x7) == 5)) {
+        address += original_.*registers[base];
+      }
+      if (index != 4) {
+        address += original_.*registers[index] << (insn_.sib >> 6);
+      }
+    } else {
+      address += original_.*registers[insn_.modrm_rm() |
+                                      ((insn_.rex & 0x1) << 3)];
+    }
+    if (insn_.address_size_prefix) {
+      address &= 0xffffffff;
+    }
+    for (std::size_t i = 0; i < insn_.opcode_offset; ++i) {
+      if (bytes_[i] == 0x64) {
+        address += original_.fs_base;
+      } else if (bytes_[i] == 0x65) {
+        address += original_.gs_base;
+      }
+    }
+    return static_cast<std::intptr_t>(address);
+  }
+
+  bool read(const std::intptr_t address, const uint8_t size,
+            uint64_t& value) {
+    value = 0;
+    return memory_.read_as_inferior(address, &value, size);
+  }
+
+  void write(const std::intptr_t address, const uint8_t size,
+             const uint64_t value) {
+    pending_address_ = address;
+    pending_size_ = size;
+    pending_value_ = value;
+  }
+
+  bool read_rm(const uint8_t size, uint64_t& value) {
+    if (rm_is_register()) {
+      value = get(rm_number(), size);
+      return true;
+    }
+    return read(address(), size, value);
+  }
+
+  void write_rm(const uint8_t size, const uint64_t value) {
+    if (rm_is_register()) {
+      set(rm_number(), size, value);
+    } else {
+      write(address(), size, value);
+    }
+  }
+
+  void push(const uint64_t value) {
+    regs.rsp -= 8;
+    write(static_cast<std::intptr_t>(regs.rsp), 8, value);
+  }
+
+  bool pop(uint64_t& value) {
+    if (not read(static_cast<std::intptr_t>(regs.rsp), 8, value)) {
+      return false;
+    }
+    regs.rsp += 8;
+    return true;
+  }
+
+  // Do the memory write, if any, and hand out the registers
+  bool commit(user_regs_struct& result) {
+    if (pending_size_ != 0) {
+      const bool forced =
+          pending_address_ >= unprotected_.first and
+          pending_address_ + pending_size_ <= unprotected_.second;
+      if (not(forced ? memory_.write(pending_address_, &pending_value_,
+                                     pending_size_)
+                     : memory_.write_as_inferior(
+                           pending_address_, &pending_value_,
+                           pending_size_))) {
+        return false;
+      }
+    }
+    result = regs;
+    return true;
+  }
+
+ private:
+  uint8_t rm_number() const {
+    return static_cast<uint8_t>(insn_.modrm_rm() | ((insn_.rex & 0x1) << 3));
+  }
+
+  const Instruction& insn_;
+  const uint8_t* bytes_;
+  InferiorMemory& memory_;
+  std::pair<std::intptr_t, std::intptr_t> unprotected_;
+  const user_regs_struct original_;
+  std::intptr_t pending_address_{0};
+  uint8_t pending_size_{0};
+  uint64_t pending_value_{0};
+};
+
+bool alu_operation(const uint8_t kind, AluOperation& operation) {
+  operation = static_cast<AluOperation>(kind);
+  return operation != AluOperation::Adc and operation != AluOperation::Sbb;
+}
+
+bool emulate_one_byte(const Instruction& insn, Machine& machine) {
+  const uint8_t op = insn.opcode;
+  const uint8_t size = machine.operand_size();
+  // Byte sized forms have the lowest opcode bit clear
+  const uint8_t sized = (op & 1) != 0 ? size : 1;
+  const auto number =
+      static_cast<uint8_t>((op & 0x7) | ((insn.rex & 0x1) << 3));
+  const auto immediate = static_cast<uint64_t>(insn.immediate);
+  user_regs_struct& regs = machine.regs;
+  uint64_t a = 0;
+  uint64_t b = 0;
+  AluOperation operation{};
+
+  if (op < 0x40 and (op & 0x7) < 6) {
+    if (not alu_operation(op >> 3, operation)) {
+      return false;
+    }
+    switch (op & 0x7) {
+      case 0:
+      case 1:
+        b = machine.get(machine.reg_number(), sized);
+        if (not machine.read_rm(sized, a)) {
+          return false;
+        }
+        a = alu(operation, a, b, sized, regs.eflags);
+        if (operation != AluOperation::Cmp) {
+          machine.write_rm(sized, a);
+        }
+        return true;
+      case 2:
+      case 3:
+        a = machine.get(machine.reg_number(), sized);
+        if (not machine.read_rm(sized, b)) {
+          return false;
+        }
+        a = alu(operation, a, b, sized, regs.eflags);
+        if (operation != AluOperation::Cmp) {
+          machine.set(machine.reg_number(), sized, a);
+        }
+        return true;
+      default:
+        a = alu(operation, machine.get(0, sized), immediate, sized,
+                regs.eflags);
+        if (operation != AluOperation::Cmp) {
+          machine.set(0, sized, a);
+        }
+        return true;
+    }
+  }
+  if (op >= 0x50 and op <= 0x5f) {
+    if (insn.operand_size_prefix) {
+      return false;
+    }
+    if (op < 0x58) {
+      machine.push(machine.get(number, 8));
+      return true;
+    }
+    if (not machine.pop(a)) {
+      return false;
+    }
+    machine.set(number, 8, a);
+    return true;
+  }
+  if ((op >= 0x70 and op <= 0x7f) or op == 0xe9 or op == 0xeb) {
+    if (op > 0x7f or condition(op & 0xf, regs.eflags)) {
+      regs.rip = static_cast<uint64_t>(insn.branch_target());
+    }
+    return true;
+  }
+  if (op >= 0xb0 and op <= 0xbf) {
+    machine.set(number, op < 0xb8 ? 1 : size, immediate);
+    return true;
+  }
+  switch (op) {
+    case 0x63:
+      if (not machine.read_rm(4, a)) {
+        return false;
+      }
+      machine.set(machine.reg_number(), size, sign_extend(a, 4));
+      return true;
+    case 0x68:
+    case 0x6a:
+      if (insn.operand_size_prefix) {
+        return false;
+      }
+      machine.push(immediate);
+      return true;
+    case 0x80:
+    case 0x81:
+    case 0x83:
+      if (not alu_operation(insn.modrm_reg(), operation) or
+          not machine.read_rm(sized, a)) {
+        return false;
+      }
+      a = alu(operation, a, immediate, sized, regs.eflags);
+      if (operation != AluOperation::Cmp) {
+        machine.write_rm(sized, a);
+      }
+      return true;
+    case 0x84:
+    case 0x85:
+      if (not machine.read_rm(sized, a)) {
+        return false;
+      }
+      alu(AluOperation::And, a, machine.get(machine.reg_number(), sized),
+          sized, regs.eflags);
+      return true;
+    case 0x88:
+    case 0x89:
+      machine.write_rm(sized, machine.get(machine.reg_number(), sized));
+      return true;
+    case 0x8a:
+    case 0x8b:
+      if (not machine.read_rm(sized, a)) {
+        return false;
+      }
+      machine.set(machine.reg_number(), sized, a);
+      return true;
+    case 0x8d:
+      if (machine.rm_is_register()) {
+        return false;
+      }
+      machine.set(machine.reg_number(), size,
+                  static_cast<uint64_t>(machine.address()));
+      return true;
+    case 0x90:
+      // Without REX.B, which makes it xchg r8, rax
+      return (insn.rex & 0x1) == 0;
+    case 0xa8:
+    case 0xa9:
+      alu(AluOperation::And, machine.get(0, sized), immediate, sized,
+          regs.eflags);
+      return true;
+    case 0xc2:
+    case 0xc3:
+      if (insn.operand_size_prefix or not machine.pop(a)) {
+        return false;
+      }
+      regs.rip = a;
+      regs.rsp += op == 0xc2 ? immediate & 0xffff : 0;
+      return true;
+    case 0xc6:
+    case 0xc7:
+      if (insn.modrm_reg() != 0) {
+        return false;
+      }
+      machine.write_rm(sized, immediate);
+      return true;
+    case 0xc9:
+      if (insn.operand_size_prefix) {
+        return false;
+      }
+      regs.rsp = regs.rbp;
+      if (not machine.pop(a)) {
+        return false;
+      }
+      regs.rbp = a;
+      return true;
+    case 0xe8:
+      machine.push(regs.rip);
+      regs.rip = static_cast<uint64_t>(insn.branch_target());
+      return true;
+    case 0xf6:
+    case 0xf7:
+      if (insn.modrm_reg() > 1 or not machine.read_rm(sized, a)) {
+        return false;
+      }
+      alu(AluOperation::And, a, immediate, sized, regs.eflags);
+      return true;
+    case 0xff:
+      if (insn.modrm_reg() != 2 and insn.modrm_reg() != 4) {
+        return false;
+      }
+      if (not machine.read_rm(8, a)) {
+        return false;
+      }
+      if (insn.modrm_reg() == 2) {
+        machine.push(regs.rip);
+      }
+      regs.rip = a;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool emulate_two_byte(const Instruction& insn, Machine& machine) {
+  const uint8_t op = insn.opcode;
+  const uint8_t size = machine.operand_size();
+  user_regs_struct& regs = machine.regs;
+  uint64_t value = 0;
+  if (op >= 0x80 and op <= 0x8f) {
+    if (condition(op & 0xf, regs.eflags)) {
+      regs.rip = static_cast<uint64_t>(insn.branch_target());
+    }
+    return true;
+  }
+  if (op >= 0x40 and op <= 0x4f) {
+    // The source is read even if the condition is false.
+    if (not machine.read_rm(size, value)) {
+      return false;
+    }
+    machine.set(machine.reg_number(), size,
+                condition(op & 0xf, regs.eflags)
+                    ? value
+                    : machine.get(machine.reg_number(), size));
+    return true;
+  }
+  if (op >= 0x90 and op <= 0x9f) {
+    machine.write_rm(1, condition(op & 0xf, regs.eflags) ? 1 : 0);
+    return true;
+  }
+  switch (op) {
+    case 0x1e:
+      // endbr64 and endbr32, nops unless indirect branch tracking is on
+      return insn.rep_prefix and (insn.modrm == 0xfa or insn.modrm == 0xfb);
+    case 0x1f:
+      return true;
+    case 0xb6:
+    case 0xb7:
+    case 0xbe:
+    case 0xbf: {
+      const uint8_t source = (op & 1) != 0 ? 2 : 1;
+      if (not machine.read_rm(source, value)) {
+        return false;
+      }
+      machine.set(machine.reg_number(), size,
+                  op >= 0xbe ? sign_extend(value, source) : value);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+bool emulate_instruction(
+    const Instruction& insn, const uint8_t* const bytes, user_regs_struct& regs,
+    InferiorMemory& memory,
+    const std::pair<std::intptr_t, std::intptr_t> unprotected) {
+  if (not insn.valid or insn.vex or insn.lock_prefix or
+      (regs.eflags & trap_flag) != 0) {
+    return false;
+  }
+  Machine machine{insn, bytes, regs, memory, unprotected};
+  machine.regs.rip = static_cast<uint64_t>(insn.address + insn.length);
+  // The debug exception of a single-step leaves no system call to restart.
+  machine.regs.orig_rax = ~0ull;
+  const bool supported = insn.opcode_map == 0
+                             ? emulate_one_byte(insn, machine)
+                             : insn.opcode_map == 1 and
+                                   emulate_two_byte(insn, machine);
+  return supported and machine.commit(regs);
+}
+}  // namespace nebugger
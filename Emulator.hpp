@@ -0,0 +1,41 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sys/user.h>
+#include <utility>
+
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+class InferiorMemory;
+
+/// Apply the effect of the instruction `insn`, whose original bytes start at
+/// `bytes`, to `regs` and the memory of the stopped inferior, as if it had
+/// been single-stepped.
+///
+/// Stepping over a breakpoint otherwise takes a `PTRACE_SINGLESTEP`, a
+/// `waitpid` and two writes of the int3, while most breakpoints sit on
+/// instructions that are trivial to execute in the debugger: the `push rbp`
+/// or `endbr64` at function entries, moves, arithmetic and branches.
+///
+/// Supported are mov, movzx, movsx, movsxd, lea, add, sub, and, or, xor,
+/// cmp and test including their effect on the flags, push, pop, leave,
+/// call, ret, jmp, jcc and the nops. Returns false without changing `regs`
+/// or memory for anything else, e.g. locked or string instructions, a
+/// memory operand that cannot be accessed, or when the trap flag is set, so
+/// the caller can fall back to a real single-step.
+///
+/// Writes that lie within `unprotected` are carried out even if the process
+/// could not do them itself, for pages the debugger write-protected.
+bool emulate_instruction(
+    const Instruction& insn, const uint8_t* bytes, user_regs_struct& regs,
+    InferiorMemory& memory,
+    std::pair<std::intptr_t, std::intptr_t> unprotected = {0, 0});
+}  // namespace nebugger
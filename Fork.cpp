@@ -0,0 +1,102 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Fork.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "Memory.hpp"
+#include "Syscall.hpp"
+
+namespace nebugger {
+bool trace_forks(const pid_t pid) {
+  if (ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+             PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                 PTRACE_O_TRACEVFORKDONE | PTRACE_O_TRACEEXEC |
+                 PTRACE_O_TRACESYSGOOD) == -1) {
+    std::cerr << "Failed to trace forks of process " << pid
+              << " with errno: " << errno << '\n';
+    return false;
+  }
+  return true;
+}
+
+std::size_t count_threads(const pid_t pid) {
+  std::ifstream status{"/proc/" + std::to_string(pid) + "/status"};
+  std::string line{};
+  while (std::getline(status, line)) {
+    if (line.compare(0, 8, "Threads:") == 0) {
+      return static_cast<std::size_t>(std::stoul(line.substr(8)));
+    }
+  }
+  return 0;
+}
+
+bool wait_for_forked_child(const pid_t pid) {
+  // The child starts with a SIGSTOP, which may be reported before or after
+  // the fork event of the parent.
+  int wait_status = 0;
+  while (waitpid(pid, &wait_status, __WALL) == -1) {
+    if (errno != EINTR) {
+      std::cerr << "Failed to wait for forked process " << pid
+                << " with errno: " << errno << '\n';
+      return false;
+    }
+  }
+  return WIFSTOPPED(wait_status);
+}
+
+bool remove_inserted_code(const pid_t pid, const InsertedCode& code,
+                          const bool tracepoints) {
+  InferiorMemory memory{pid};
+  bool success = true;
+  for (const auto* table : {&code.breakpoints, &code.probes}) {
+    for (const auto& [address, original] : *table) {
+      success = memory.write(address, &original, 1) and success;
+    }
+  }
+  if (tracepoints) {
+    for (const auto& [address, original] : code.tracepoints) {
+      success = memory.write(address, original.data(), original.size()) and
+                success;
+    }
+    for (const ProtectedPages& pages : code.watched_pages) {
+      success = inject_syscall(pid, SYS_mprotect,
+                               {{static_cast<uint64_t>(pages.start),
+                                 pages.length,
+                                 static_cast<uint64_t>(pages.protection), 0,
+                                 0, 0}}) == 0 and
+                success;
+    }
+  }
+  if (not success) {
+    std::cerr << "Failed to remove breakpoints from process " << pid << '\n';
+  }
+  return success;
+}
+
+bool reinsert_breakpoints(const pid_t pid, const InsertedCode& code) {
+  InferiorMemory memory{pid};
+  const uint8_t int3 = 0xcc;
+  bool success = true;
+  for (const auto* table : {&code.breakpoints, &code.probes}) {
+    for (const auto& breakpoint : *table) {
+      success = memory.write(breakpoint.first, &int3, 1) and success;
+    }
+  }
+  if (not success) {
+    std::cerr << "Failed to insert breakpoints into process " << pid << '\n';
+  }
+  return success;
+}
+}  // namespace nebugger
@@ -0,0 +1,87 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+/// What happens when the debugged process forks.
+enum class FollowFork {
+  // Keep debugging the parent, the child is held stopped
+  Parent,
+  // Debug the child, the parent is held stopped
+  Child,
+  // Keep debugging the parent, the child's breakpoints are removed and it is
+  // detached
+  Detach
+};
+
+/// Pages the debugger write-protected to watch them, see
+/// `RegionWatchpoints`.
+struct ProtectedPages {
+  std::intptr_t start;
+  std::size_t length;
+  // Protection to restore, a combination of PROT_*
+  int protection;
+};
+
+/// The breakpoints and tracepoint jumps the debugger inserted into the code
+/// of a process, with the original bytes, and the pages it protected.
+///
+/// A forked child inherits them with the parent's memory. Rather than copying
+/// the breakpoint table for every child, the parent keeps one immutable
+/// snapshot, shared by all the children forked until its breakpoints change.
+struct InsertedCode {
+  std::vector<std::pair<std::intptr_t, uint8_t>> breakpoints{};
+  std::vector<std::pair<std::intptr_t, std::vector<uint8_t>>> tracepoints{};
+  std::vector<ProtectedPages> watched_pages{};
+  // The int3s timing function calls, see `LatencyTracer`, which are removed
+  // and inserted together with the breakpoints
+  std::vector<std::pair<std::intptr_t, uint8_t>> probes{};
+};
+
+/// A process stopped by the debugger other than the one being debugged.
+struct HeldProcess {
+  pid_t pid;
+  // What was inserted into its code when it was forked or left
+  std::shared_ptr<const InsertedCode> code;
+};
+
+/// Have forks, vforks, execs and new threads of `pid` reported as ptrace
+/// events. The children of forks and the new threads are traced from their
+/// start. System call stops, when resumed with PTRACE_SYSCALL, are reported
+/// with the signal `syscall_trap`.
+bool trace_forks(pid_t pid);
+
+/// Number of threads of the process `pid`, 0 if it is unknown.
+std::size_t count_threads(pid_t pid);
+
+/// The stop signal of system call stops, see PTRACE_O_TRACESYSGOOD.
+constexpr int syscall_trap = 0x80 | 5;
+
+/// The PTRACE_EVENT_* that stopped the process, 0 for other stops.
+inline int ptrace_event(const int wait_status) { return wait_status >> 16; }
+
+/// Wait for the first stop of the traced child `pid` of a fork, or of a new
+/// thread.
+bool wait_for_forked_child(pid_t pid);
+
+/// Restore the original bytes of the breakpoints and probes and, if
+/// `tracepoints` is true, of the tracepoints and the protection of the
+/// watched pages in `code` in the memory of `pid`.
+bool remove_inserted_code(pid_t pid, const InsertedCode& code,
+                          bool tracepoints = true);
+
+/// Insert the breakpoints and probes of `code` into `pid` again.
+bool reinsert_breakpoints(pid_t pid, const InsertedCode& code);
+}  // namespace nebugger
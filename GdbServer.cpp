@@ -0,0 +1,1020 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "GdbServer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "Registers.hpp"
+
+namespace nebugger {
+namespace {
+// Largest packet we accept and advertise, large enough for the `g` packet
+// and for reading 8 KiB of memory per `m` packet.
+constexpr std::size_t packet_size = 0x4000;
+
+constexpr char hex_digits[] = "0123456789abcdef";
+
+enum class Source {
+  // A member of user_regs_struct
+  General,
+  // Bytes of user_fpregs_struct
+  Float,
+  // The abridged x87 tag word of user_fpregs_struct, which is expanded to
+  // the full tag word GDB expects
+  FloatTag
+};
+
+/// A register in the order and size of GDB's amd64 register numbering.
+struct RegisterSlot {
+  std::string name;
+  std::string type;
+  std::string feature;
+  // Size in bytes in the `g` packet
+  std::size_t size;
+  Source source;
+  Register reg;
+  // Location in user_fpregs_struct for the floating point registers
+  std::size_t offset;
+  std::size_t source_size;
+};
+
+const std::vector<RegisterSlot>& register_slots() {
+  static const std::vector<RegisterSlot> slots = []() {
+    const std::string core{"org.gnu.gdb.i386.core"};
+    std::vector<RegisterSlot> result{};
+    const auto general = [&result](const std::string& name,
+                                   const std::string& type,
+                                   const std::string& feature,
+                                   const std::size_t size, const Register reg) {
+      result.push_back({name, type, feature, size, Source::General, reg, 0, 0});
+    };
+    const auto floating = [&result](const std::string& name,
+                                    const std::string& type,
+                                    const std::string& feature,
+                                    const std::size_t size,
+                                    const std::size_t offset,
+                                    const std::size_t source_size) {
+      result.push_back({name, type, feature, size, Source::Float, Register::rax,
+                        offset, source_size});
+    };
+    general("rax", "int64", core, 8, Register::rax);
+    general("rbx", "int64", core, 8, Register::rbx);
+    general("rcx", "int64", core, 8, Register::rcx);
+    general("rdx", "int64", core, 8, Register::rdx);
+    general("rsi", "int64", core, 8, Register::rsi);
+    general("rdi", "int64", core, 8, Register::rdi);
+    general("rbp", "data_ptr", core, 8, Register::rbp);
+    general("rsp", "data_ptr", core, 8, Register::rsp);
+    const Register numbered[] = {Register::r8,  Register::r9,  Register::r10,
+                                 Register::r11, Register::r12, Register::r13,
+                                 Register::r14, Register::r15};
+    for (std::size_t i = 0; i < 8; ++i) {
+      general("r" + std::to_string(i + 8), "int64", core, 8, numbered[i]);
+    }
+    general("rip", "code_ptr", core, 8, Register::rip);
+    general("eflags", "int32", core, 4, Register::rflags);
+    general("cs", "int32", core, 4, Register::cs);
+    general("ss", "int32", core, 4, Register::ss);
+    general("ds", "int32", core, 4, Register::ds);
+    general("es", "int32", core, 4, Register::es);
+    general("fs", "int32", core, 4, Register::fs);
+    general("gs", "int32", core, 4, Register::gs);
+    for (std::size_t i = 0; i < 8; ++i) {
+      floating("st" + std::to_string(i), "i387_ext", core, 10,
+               offsetof(user_fpregs_struct, st_space) + 16 * i, 10);
+    }
+    floating("fctrl", "int", core, 4, offsetof(user_fpregs_struct, cwd), 2);
+    floating("fstat", "int", core, 4, offsetof(user_fpregs_struct, swd), 2);
+    floating("ftag", "int", core, 4, offsetof(user_fpregs_struct, ftw), 1);
+    result.back().source = Source::FloatTag;
+    floating("fiseg", "int", core, 4, offsetof(user_fpregs_struct, rip) + 4,
+             4);
+    floating("fioff", "int", core, 4, offsetof(user_fpregs_struct, rip), 4);
+    floating("foseg", "int", core, 4, offsetof(user_fpregs_struct, rdp) + 4,
+             4);
+    floating("fooff", "int", core, 4, offsetof(user_fpregs_struct, rdp), 4);
+    floating("fop", "int", core, 4, offsetof(user_fpregs_struct, fop), 2);
+    for (std::size_t i = 0; i < 16; ++i) {
+      floating("xmm" + std::to_string(i), "uint128", "org.gnu.gdb.i386.sse",
+               16, offsetof(user_fpregs_struct, xmm_space) + 16 * i, 16);
+    }
+    floating("mxcsr", "int", "org.gnu.gdb.i386.sse", 4,
+             offsetof(user_fpregs_struct, mxcsr), 4);
+    general("orig_rax", "int", "org.gnu.gdb.i386.linux", 8,
+            Register::orig_rax);
+    general("fs_base", "int", "org.gnu.gdb.i386.segments", 8,
+            Register::fs_base);
+    general("gs_base", "int", "org.gnu.gdb.i386.segments", 8,
+            Register::gs_base);
+    return result;
+  }();
+  return slots;
+}
+
+const std::string& target_description() {
+  static const std::string xml = []() {
+    std::string result{
+        "<?xml version=\"1.0\"?>\n"
+        "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+        "<target>\n"
+        "<architecture>i386:x86-64</architecture>\n"
+        "<osabi>GNU/Linux</osabi>\n"};
+    std::string feature{};
+    for (const RegisterSlot& slot : register_slots()) {
+      if (slot.feature != feature) {
+        if (not feature.empty()) {
+          result += "</feature>\n";
+        }
+        feature = slot.feature;
+        result += "<feature name=\"" + feature + "\">\n";
+      }
+      result += "<reg name=\"" + slot.name + "\" bitsize=\"" +
+                std::to_string(8 * slot.size) + "\" type=\"" + slot.type +
+                "\"/>\n";
+    }
+    result += "</feature>\n</target>\n";
+    return result;
+  }();
+  return xml;
+}
+
+void append_hex(std::string& out, const uint8_t* const bytes,
+                const std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    out += hex_digits[bytes[i] >> 4];
+    out += hex_digits[bytes[i] & 0xf];
+  }
+}
+
+void append_hex_number(std::string& out, const uint64_t value) {
+  char digits[16];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), value, 16);
+  out.append(digits, result.ptr);
+}
+
+int hex_value(const char c) {
+  if (c >= '0' and c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' and c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' and c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool parse_hex_bytes(const std::string_view hex, uint8_t* const bytes) {
+  for (std::size_t i = 0; i < hex.size() / 2; ++i) {
+    const int high = hex_value(hex[2 * i]);
+    const int low = hex_value(hex[2 * i + 1]);
+    if (high == -1 or low == -1) {
+      return false;
+    }
+    bytes[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return true;
+}
+
+bool parse_hex_number(const std::string_view text, uint64_t& value) {
+  const auto result =
+      std::from_chars(text.data(), text.data() + text.size(), value, 16);
+  return not text.empty() and result.ec == std::errc{} and
+         result.ptr == text.data() + text.size();
+}
+
+// Split `text` at the first `separator` into `first` and the remainder.
+bool split_at(std::string_view text, const char separator,
+              std::string_view& first, std::string_view& rest) {
+  const auto position = text.find(separator);
+  if (position == std::string_view::npos) {
+    return false;
+  }
+  first = text.substr(0, position);
+  rest = text.substr(position + 1);
+  return true;
+}
+
+// Parse "ADDRESS,LENGTH" as used by the memory and qXfer packets.
+bool parse_address_length(const std::string_view text, uint64_t& address,
+                          uint64_t& length) {
+  std::string_view first{};
+  std::string_view second{};
+  return split_at(text, ',', first, second) and
+         parse_hex_number(first, address) and parse_hex_number(second, length);
+}
+
+// Escape the characters that cannot appear in binary packet data.
+void append_binary(std::string& out, const std::string_view data) {
+  for (const char c : data) {
+    if (c == '#' or c == '$' or c == '}' or c == '*') {
+      out += '}';
+      out += static_cast<char>(c ^ 0x20);
+    } else {
+      out += c;
+    }
+  }
+}
+
+bool read_file(const std::string& path, std::string& contents) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  char buffer[4096];
+  ssize_t count = 0;
+  while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, static_cast<std::size_t>(count));
+  }
+  close(fd);
+  return count == 0;
+}
+
+// The remote protocol numbers signals the way GDB does, not as Linux does.
+constexpr int gdb_signal_unknown = 143;
+constexpr std::pair<int, int> linux_to_gdb_signals[] = {
+    {SIGHUP, 1},     {SIGINT, 2},    {SIGQUIT, 3},   {SIGILL, 4},
+    {SIGTRAP, 5},    {SIGABRT, 6},   {SIGFPE, 8},    {SIGKILL, 9},
+    {SIGBUS, 10},    {SIGSEGV, 11},  {SIGSYS, 12},   {SIGPIPE, 13},
+    {SIGALRM, 14},   {SIGTERM, 15},  {SIGURG, 16},   {SIGSTOP, 17},
+    {SIGTSTP, 18},   {SIGCONT, 19},  {SIGCHLD, 20},  {SIGTTIN, 21},
+    {SIGTTOU, 22},   {SIGIO, 23},    {SIGXCPU, 24},  {SIGXFSZ, 25},
+    {SIGVTALRM, 26}, {SIGPROF, 27},  {SIGWINCH, 28}, {SIGUSR1, 30},
+    {SIGUSR2, 31},   {SIGPWR, 32}};
+
+// Real-time signals: GDB numbers 33 to 63 from 45, 32 is 77 and 64 is 78.
+int to_gdb_signal(const int signal) {
+  for (const auto& pair : linux_to_gdb_signals) {
+    if (pair.first == signal) {
+      return pair.second;
+    }
+  }
+  if (signal == 32) {
+    return 77;
+  }
+  if (signal > 32 and signal < 64) {
+    return signal - 33 + 45;
+  }
+  if (signal == 64) {
+    return 78;
+  }
+  return gdb_signal_unknown;
+}
+
+// The Linux signal numbered `signal` by GDB, -1 if Linux has none.
+int from_gdb_signal(const int signal) {
+  if (signal == 0) {
+    return 0;
+  }
+  for (const auto& pair : linux_to_gdb_signals) {
+    if (pair.second == signal) {
+      return pair.first;
+    }
+  }
+  if (signal == 77) {
+    return 32;
+  }
+  if (signal >= 45 and signal <= 75) {
+    return signal - 45 + 33;
+  }
+  if (signal == 78) {
+    return 64;
+  }
+  return -1;
+}
+}  // namespace
+
+GdbServer::~GdbServer() {
+  for (const int fd : {client_fd_, listen_fd_, child_signal_fd_}) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+  if (not unix_path_.empty()) {
+    unlink(unix_path_.c_str());
+  }
+}
+
+int GdbServer::run(const std::string& address) {
+  if (waitpid(pid_, &wait_status_, __WALL) != pid_) {
+    std::cerr << "Failed to wait for the inferior to start\n";
+    return -1;
+  }
+  // SIGCHLD is blocked and read from a signalfd so that waiting for the
+  // inferior can be combined with watching the client for Ctrl-C.
+  sigset_t child_signal{};
+  sigemptyset(&child_signal);
+  sigaddset(&child_signal, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &child_signal, nullptr);
+  child_signal_fd_ = signalfd(-1, &child_signal, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (child_signal_fd_ == -1 or not accept_client(address)) {
+    kill(pid_, SIGKILL);
+    waitpid(pid_, nullptr, __WALL);
+    return -1;
+  }
+
+  std::string packet{};
+  while (read_packet(packet)) {
+    if (not handle_packet(packet)) {
+      break;
+    }
+  }
+  if (WIFEXITED(wait_status_)) {
+    return WEXITSTATUS(wait_status_);
+  }
+  if (WIFSIGNALED(wait_status_)) {
+    return 128 + WTERMSIG(wait_status_);
+  }
+  if (pid_ != -1) {
+    kill(pid_, SIGKILL);
+    waitpid(pid_, nullptr, __WALL);
+  }
+  return 0;
+}
+
+bool GdbServer::accept_client(const std::string& address) {
+  if (address.compare(0, 5, "unix:") == 0) {
+    sockaddr_un local{};
+    local.sun_family = AF_UNIX;
+    unix_path_ = address.substr(5);
+    if (unix_path_.size() >= sizeof(local.sun_path)) {
+      std::cerr << "Socket path '" << unix_path_ << "' is too long\n";
+      unix_path_.clear();
+      return false;
+    }
+    std::memcpy(local.sun_path, unix_path_.c_str(), unix_path_.size() + 1);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ == -1 or
+        bind(listen_fd_, reinterpret_cast<const sockaddr*>(&local),
+             sizeof(local)) == -1) {
+      std::cerr << "Failed to bind to '" << unix_path_
+                << "' with errno: " << errno << '\n';
+      unix_path_.clear();
+      return false;
+    }
+  } else {
+    const auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      std::cerr << "Expected an address of the form [HOST]:PORT or "
+                   "unix:PATH, got '"
+                << address << "'\n";
+      return false;
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                    &hints, &addresses) != 0 or
+        addresses == nullptr) {
+      std::cerr << "Failed to resolve '" << address << "'\n";
+      return false;
+    }
+    listen_fd_ = socket(addresses->ai_family,
+                        addresses->ai_socktype | SOCK_CLOEXEC, 0);
+    const int reuse = 1;
+    if (listen_fd_ != -1) {
+      setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    const bool bound =
+        listen_fd_ != -1 and
+        bind(listen_fd_, addresses->ai_addr, addresses->ai_addrlen) == 0;
+    freeaddrinfo(addresses);
+    if (not bound) {
+      std::cerr << "Failed to bind to '" << address << "' with errno: " << errno
+                << '\n';
+      return false;
+    }
+  }
+  if (listen(listen_fd_, 1) == -1) {
+    std::cerr << "Failed to listen with errno: " << errno << '\n';
+    return false;
+  }
+  std::cerr << "Process " << pid_ << " waiting for a GDB connection on "
+            << address << std::endl;
+  client_fd_ = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+  if (client_fd_ == -1) {
+    std::cerr << "Failed to accept a connection with errno: " << errno << '\n';
+    return false;
+  }
+  if (unix_path_.empty()) {
+    // Packets are small and latency bound.
+    const int no_delay = 1;
+    setsockopt(client_fd_, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+               sizeof(no_delay));
+  }
+  return true;
+}
+
+bool GdbServer::fill_input() {
+  if (input_position_ == input_.size()) {
+    input_.clear();
+    input_position_ = 0;
+  }
+  char buffer[packet_size];
+  while (true) {
+    const ssize_t count = recv(client_fd_, buffer, sizeof(buffer), 0);
+    if (count > 0) {
+      input_.append(buffer, static_cast<std::size_t>(count));
+      return true;
+    }
+    if (count == -1 and errno == EINTR) {
+      continue;
+    }
+    return false;
+  }
+}
+
+bool GdbServer::read_packet(std::string& packet) {
+  packet.clear();
+  while (true) {
+    if (input_position_ == input_.size() and not fill_input()) {
+      return false;
+    }
+    const char c = input_[input_position_++];
+    if (c == '-' and not no_ack_ and not output_.empty()) {
+      send(client_fd_, output_.data(), output_.size(), MSG_NOSIGNAL);
+    }
+    if (c == '$') {
+      break;
+    }
+    // Acks and Ctrl-C while already stopped are ignored.
+  }
+  uint8_t checksum = 0;
+  while (true) {
+    if (input_position_ == input_.size() and not fill_input()) {
+      return false;
+    }
+    const char c = input_[input_position_++];
+    if (c == '#') {
+      break;
+    }
+    checksum = static_cast<uint8_t>(checksum + static_cast<uint8_t>(c));
+    packet += c;
+  }
+  char expected[2];
+  for (char& digit : expected) {
+    if (input_position_ == input_.size() and not fill_input()) {
+      return false;
+    }
+    digit = input_[input_position_++];
+  }
+  if (not no_ack_) {
+    const bool valid =
+        hex_value(expected[0]) * 16 + hex_value(expected[1]) == checksum;
+    send(client_fd_, valid ? "+" : "-", 1, MSG_NOSIGNAL);
+    if (not valid) {
+      return read_packet(packet);
+    }
+  }
+  // Undo the escaping of binary data, `}` does not occur otherwise.
+  std::size_t out = 0;
+  for (std::size_t i = 0; i < packet.size(); ++i, ++out) {
+    packet[out] = packet[i] == '}' and i + 1 < packet.size()
+                      ? static_cast<char>(packet[++i] ^ 0x20)
+                      : packet[i];
+  }
+  packet.resize(out);
+  return true;
+}
+
+void GdbServer::send_packet(const std::string_view payload) {
+  output_.clear();
+  output_ += '$';
+  uint8_t checksum = 0;
+  for (const char c : payload) {
+    checksum = static_cast<uint8_t>(checksum + static_cast<uint8_t>(c));
+  }
+  output_.append(payload.data(), payload.size());
+  output_ += '#';
+  output_ += hex_digits[checksum >> 4];
+  output_ += hex_digits[checksum & 0xf];
+  std::size_t sent = 0;
+  while (sent < output_.size()) {
+    const ssize_t count = send(client_fd_, output_.data() + sent,
+                               output_.size() - sent, MSG_NOSIGNAL);
+    if (count == -1 and errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return;
+    }
+    sent += static_cast<std::size_t>(count);
+  }
+}
+
+bool GdbServer::handle_packet(const std::string_view packet) {
+  const bool exited = WIFEXITED(wait_status_) or WIFSIGNALED(wait_status_);
+  const char kind = packet.empty() ? '\0' : packet[0];
+  const std::string_view body = packet.substr(packet.empty() ? 0 : 1);
+  uint64_t address = 0;
+  uint64_t length = 0;
+  std::string_view first{};
+  std::string_view rest{};
+
+  if (packet == "?") {
+    send_packet(stop_reply());
+  } else if (packet.compare(0, 10, "qSupported") == 0) {
+    std::string reply{"PacketSize="};
+    append_hex_number(reply, packet_size);
+    reply +=
+        ";QStartNoAckMode+;qXfer:features:read+;qXfer:auxv:read+;"
+        "qXfer:exec-file:read+;swbreak+;vContSupported+";
+    send_packet(reply);
+  } else if (packet == "QStartNoAckMode") {
+    send_packet("OK");
+    no_ack_ = true;
+  } else if (packet.compare(0, 6, "qXfer:") == 0) {
+    // qXfer:OBJECT:read:ANNEX:OFFSET,LENGTH
+    std::string_view object{};
+    std::string_view operation{};
+    std::string_view annex{};
+    std::string_view range{};
+    if (split_at(packet.substr(6), ':', object, rest) and
+        split_at(rest, ':', operation, rest) and
+        split_at(rest, ':', annex, range) and operation == "read" and
+        parse_address_length(range, address, length)) {
+      send_packet(transfer(object, annex, address, length));
+    } else {
+      send_packet("");
+    }
+  } else if (exited and kind != 'k' and kind != 'D' and
+             packet.compare(0, 5, "vKill") != 0 and kind != 'q') {
+    send_packet("E01");
+  } else if (kind == 'g') {
+    send_packet(read_registers());
+  } else if (kind == 'G') {
+    send_packet(write_registers(body) ? "OK" : "E01");
+  } else if (kind == 'p') {
+    send_packet(parse_hex_number(body, address) ? read_register(address)
+                                                : "E01");
+  } else if (kind == 'P') {
+    send_packet(split_at(body, '=', first, rest) and
+                        parse_hex_number(first, address) and
+                        write_register(address, rest)
+                    ? "OK"
+                    : "E01");
+  } else if (kind == 'm') {
+    // Longer reads are truncated, the client asks for the rest.
+    send_packet(
+        parse_address_length(body, address, length)
+            ? read_memory(static_cast<std::intptr_t>(address),
+                          std::min<std::size_t>(length, packet_size / 2))
+            : "E01");
+  } else if (kind == 'M' or kind == 'X') {
+    bool success = split_at(body, ':', first, rest) and
+                   parse_address_length(first, address, length);
+    std::string bytes{};
+    if (success and kind == 'M') {
+      bytes.resize(rest.size() / 2);
+      success = rest.size() == 2 * length and
+                parse_hex_bytes(rest, reinterpret_cast<uint8_t*>(&bytes[0]));
+    } else if (success) {
+      bytes = rest;
+      success = bytes.size() == length;
+    }
+    send_packet(success and write_memory(static_cast<std::intptr_t>(address),
+                                         bytes)
+                    ? "OK"
+                    : "E01");
+  } else if (kind == 'Z' or kind == 'z') {
+    // Z0,ADDRESS,KIND: only software breakpoints are supported.
+    std::string_view type{};
+    if (not split_at(body, ',', type, rest) or type != "0" or
+        not split_at(rest, ',', first, rest) or
+        not parse_hex_number(first, address)) {
+      send_packet("");
+      return true;
+    }
+    const auto location = static_cast<std::intptr_t>(address);
+    auto it = breakpoints_.find(location);
+    if (kind == 'Z') {
+      if (it == breakpoints_.end()) {
+        it = breakpoints_.emplace(location, Breakpoint{pid_, location}).first;
+      }
+      if (not it->second.is_enabled()) {
+        it->second.enable();
+      }
+      send_packet(it->second.is_enabled() ? "OK" : "E01");
+    } else {
+      if (it != breakpoints_.end()) {
+        it->second.disable();
+        breakpoints_.erase(it);
+      }
+      send_packet("OK");
+    }
+  } else if (packet == "vCont?") {
+    send_packet("vCont;c;C;s;S");
+  } else if (packet.compare(0, 6, "vCont;") == 0) {
+    send_packet(resume(packet.substr(6)));
+  } else if (kind == 'c' or kind == 's') {
+    send_packet(resume(kind == 's', 0));
+  } else if (kind == 'C' or kind == 'S') {
+    // C SIGNAL[;ADDRESS], resuming at another address is not supported.
+    const int signal =
+        parse_hex_number(body.substr(0, body.find(';')), address) and
+                address <= INT_MAX
+            ? from_gdb_signal(static_cast<int>(address))
+            : -1;
+    send_packet(signal != -1 ? resume(kind == 'S', signal) : "E01");
+  } else if (kind == 'k' or packet.compare(0, 5, "vKill") == 0) {
+    if (not exited) {
+      kill(pid_, SIGKILL);
+      waitpid(pid_, &wait_status_, __WALL);
+    }
+    if (kind != 'k') {
+      send_packet("OK");
+    }
+    return false;
+  } else if (kind == 'D') {
+    for (auto& breakpoint : breakpoints_) {
+      if (breakpoint.second.is_enabled()) {
+        breakpoint.second.disable();
+      }
+    }
+    breakpoints_.clear();
+    if (not exited) {
+      ptrace(PTRACE_DETACH, pid_, nullptr, nullptr);
+      pid_ = -1;
+    }
+    send_packet("OK");
+    return false;
+  } else if (packet == "qAttached") {
+    send_packet("0");
+  } else if (packet == "qC") {
+    std::string reply{"QC"};
+    append_hex_number(reply, static_cast<uint64_t>(pid_));
+    send_packet(reply);
+  } else if (packet == "qfThreadInfo") {
+    std::string reply{"m"};
+    append_hex_number(reply, static_cast<uint64_t>(pid_));
+    send_packet(reply);
+  } else if (packet == "qsThreadInfo") {
+    send_packet("l");
+  } else if (packet == "qSymbol::") {
+    send_packet("OK");
+  } else if (kind == 'H' or kind == 'T') {
+    // There is only one thread.
+    send_packet("OK");
+  } else {
+    send_packet("");
+  }
+  return true;
+}
+
+void GdbServer::read_register_file() {
+  if (registers_valid_) {
+    return;
+  }
+  registers_ = get_registers(pid_);
+  if (ptrace(PTRACE_GETFPREGS, pid_, nullptr, &fp_registers_) == -1) {
+    fp_registers_ = user_fpregs_struct{};
+  }
+  registers_valid_ = true;
+}
+
+bool GdbServer::write_register_file() {
+  set_registers(pid_, registers_);
+  return ptrace(PTRACE_SETFPREGS, pid_, nullptr, &fp_registers_) != -1;
+}
+
+std::string GdbServer::read_registers() {
+  std::string reply{};
+  for (std::size_t i = 0; i < register_slots().size(); ++i) {
+    reply += read_register(i);
+  }
+  return reply;
+}
+
+bool GdbServer::write_registers(const std::string_view hex) {
+  // Decode every register before writing them all with one SETREGS and one
+  // SETFPREGS.
+  std::size_t position = 0;
+  for (std::size_t i = 0;
+       i < register_slots().size() and position < hex.size(); ++i) {
+    const std::size_t digits = 2 * register_slots()[i].size;
+    if (not decode_register(i, hex.substr(position, digits))) {
+      // Drop the registers decoded so far.
+      registers_valid_ = false;
+      return false;
+    }
+    position += digits;
+  }
+  return write_register_file();
+}
+
+std::string GdbServer::read_register(const std::size_t number) {
+  if (number >= register_slots().size()) {
+    return "E01";
+  }
+  read_register_file();
+  const RegisterSlot& slot = register_slots()[number];
+  uint8_t bytes[16] = {};
+  if (slot.source == Source::General) {
+    const uint64_t value = get_register_value(registers_, slot.reg);
+    std::memcpy(bytes, &value, slot.size);
+  } else if (slot.source == Source::Float) {
+    std::memcpy(bytes,
+                reinterpret_cast<const uint8_t*>(&fp_registers_) + slot.offset,
+                slot.source_size);
+  } else {
+    // Each set bit of the abridged tag marks a register as valid (00), the
+    // others are empty (11).
+    uint16_t tag = 0;
+    for (int i = 0; i < 8; ++i) {
+      if ((fp_registers_.ftw & (1u << i)) == 0) {
+        tag = static_cast<uint16_t>(tag | 3u << (2 * i));
+      }
+    }
+    std::memcpy(bytes, &tag, sizeof(tag));
+  }
+  std::string reply{};
+  append_hex(reply, bytes, slot.size);
+  return reply;
+}
+
+bool GdbServer::write_register(const std::size_t number,
+                               const std::string_view hex) {
+  return decode_register(number, hex) and write_register_file();
+}
+
+bool GdbServer::decode_register(const std::size_t number,
+                                const std::string_view hex) {
+  if (number >= register_slots().size()) {
+    return false;
+  }
+  const RegisterSlot& slot = register_slots()[number];
+  uint8_t bytes[16] = {};
+  if (hex.size() != 2 * slot.size or not parse_hex_bytes(hex, bytes)) {
+    return false;
+  }
+  read_register_file();
+  if (slot.source == Source::General) {
+    uint64_t value = 0;
+    std::memcpy(&value, bytes, slot.size);
+    set_register_value(registers_, slot.reg, value);
+  } else if (slot.source == Source::Float) {
+    std::memcpy(reinterpret_cast<uint8_t*>(&fp_registers_) + slot.offset,
+                bytes, slot.source_size);
+  } else {
+    uint16_t tag = 0;
+    std::memcpy(&tag, bytes, sizeof(tag));
+    uint16_t abridged = 0;
+    for (int i = 0; i < 8; ++i) {
+      if (((tag >> (2 * i)) & 3u) != 3u) {
+        abridged = static_cast<uint16_t>(abridged | 1u << i);
+      }
+    }
+    fp_registers_.ftw = abridged;
+  }
+  return true;
+}
+
+std::string GdbServer::read_memory(const std::intptr_t address,
+                                   const std::size_t length) {
+  std::vector<uint8_t> bytes(length);
+  if (not memory_.read(address, bytes.data(), length)) {
+    return "E01";
+  }
+  // Show the original instructions instead of the breakpoints.
+  for (const auto& breakpoint : breakpoints_) {
+    const std::intptr_t offset = breakpoint.first - address;
+    if (breakpoint.second.is_enabled() and offset >= 0 and
+        offset < static_cast<std::intptr_t>(length)) {
+      bytes[static_cast<std::size_t>(offset)] =
+          breakpoint.second.saved_instruction();
+    }
+  }
+  std::string reply{};
+  reply.reserve(2 * length);
+  append_hex(reply, bytes.data(), length);
+  return reply;
+}
+
+bool GdbServer::write_memory(const std::intptr_t address,
+                             const std::string_view data) {
+  if (data.empty()) {
+    return true;
+  }
+  // Lift the breakpoints in the range so they save the new contents.
+  std::vector<Breakpoint*> lifted{};
+  for (auto& breakpoint : breakpoints_) {
+    const std::intptr_t offset = breakpoint.first - address;
+    if (breakpoint.second.is_enabled() and offset >= 0 and
+        offset < static_cast<std::intptr_t>(data.size())) {
+      breakpoint.second.disable();
+      lifted.push_back(&breakpoint.second);
+    }
+  }
+  const bool success = memory_.write(address, data.data(), data.size());
+  for (Breakpoint* const breakpoint : lifted) {
+    breakpoint->enable();
+  }
+  return success;
+}
+
+std::string GdbServer::transfer(const std::string_view object,
+                                const std::string_view annex,
+                                const std::size_t offset,
+                                const std::size_t length) {
+  std::string contents{};
+  if (object == "features" and annex == "target.xml") {
+    contents = target_description();
+  } else if (object == "auxv" and annex.empty()) {
+    if (not read_file("/proc/" + std::to_string(pid_) + "/auxv", contents)) {
+      return "E01";
+    }
+  } else if (object == "exec-file") {
+    char path[PATH_MAX];
+    const std::string link = "/proc/" + std::to_string(pid_) + "/exe";
+    const ssize_t size = readlink(link.c_str(), path, sizeof(path));
+    if (size <= 0) {
+      return "E01";
+    }
+    contents.assign(path, static_cast<std::size_t>(size));
+  } else {
+    return "";
+  }
+  if (offset >= contents.size()) {
+    return "l";
+  }
+  const std::size_t count =
+      std::min({length, contents.size() - offset, packet_size / 2});
+  std::string reply{offset + count == contents.size() ? "l" : "m"};
+  append_binary(reply, std::string_view{contents}.substr(offset, count));
+  return reply;
+}
+
+std::string GdbServer::resume(const std::string_view actions) {
+  // ACTION[:THREAD];ACTION[:THREAD]... where the first action that applies
+  // to our only thread wins.
+  std::string_view remaining = actions;
+  while (not remaining.empty()) {
+    std::string_view action = remaining;
+    if (not split_at(remaining, ';', action, remaining)) {
+      remaining = {};
+    }
+    std::string_view thread{};
+    std::string_view command = action;
+    uint64_t thread_id = 0;
+    if (split_at(action, ':', command, thread) and thread != "-1" and
+        (not parse_hex_number(thread, thread_id) or
+         thread_id != static_cast<uint64_t>(pid_))) {
+      continue;
+    }
+    if (command.empty()) {
+      continue;
+    }
+    uint64_t gdb_signal = 0;
+    if ((command[0] == 'C' or command[0] == 'S') and
+        (not parse_hex_number(command.substr(1), gdb_signal) or
+         gdb_signal > INT_MAX)) {
+      return "E01";
+    }
+    const int signal = from_gdb_signal(static_cast<int>(gdb_signal));
+    if (signal == -1) {
+      return "E01";
+    }
+    switch (command[0]) {
+      case 'c':
+      case 'C':
+        return resume(false, signal);
+      case 's':
+      case 'S':
+        return resume(true, signal);
+      default:
+        return "E01";
+    }
+  }
+  return "E01";
+}
+
+std::string GdbServer::resume(const bool step, const int signal) {
+  // Step off a breakpoint at the program counter before resuming.
+  const auto pc =
+      static_cast<std::intptr_t>(get_register_value(pid_, Register::rip));
+  const auto at_breakpoint = breakpoints_.find(pc);
+  int deliver = signal;
+  if (at_breakpoint != breakpoints_.end() and
+      at_breakpoint->second.is_enabled()) {
+    at_breakpoint->second.disable();
+    ptrace(PTRACE_SINGLESTEP, pid_, nullptr, deliver);
+    deliver = 0;
+    waitpid(pid_, &wait_status_, __WALL);
+    if (WIFSTOPPED(wait_status_)) {
+      at_breakpoint->second.enable();
+    }
+    if (step or not WIFSTOPPED(wait_status_) or
+        WSTOPSIG(wait_status_) != SIGTRAP) {
+      registers_valid_ = false;
+      stopped_at_breakpoint_ = false;
+      return stop_reply();
+    }
+  }
+  registers_valid_ = false;
+  stopped_at_breakpoint_ = false;
+  if (ptrace(step ? PTRACE_SINGLESTEP : PTRACE_CONT, pid_, nullptr, deliver) ==
+      -1) {
+    return "E01";
+  }
+  while (true) {
+    const pid_t waited = waitpid(pid_, &wait_status_, __WALL | WNOHANG);
+    if (waited == pid_) {
+      break;
+    }
+    pollfd fds[2] = {{child_signal_fd_, POLLIN, 0}, {client_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) == -1 and errno != EINTR) {
+      return "E01";
+    }
+    if ((fds[0].revents & POLLIN) != 0) {
+      signalfd_siginfo info{};
+      while (read(child_signal_fd_, &info, sizeof(info)) > 0) {
+      }
+    }
+    if ((fds[1].revents & (POLLIN | POLLHUP)) != 0) {
+      // Ctrl-C from the client interrupts the inferior.
+      if (not fill_input()) {
+        kill(pid_, SIGKILL);
+        continue;
+      }
+      if (input_.find('\x03', input_position_) != std::string::npos) {
+        input_.erase(input_.find('\x03', input_position_), 1);
+        kill(pid_, SIGINT);
+      }
+    }
+  }
+  if (not step and WIFSTOPPED(wait_status_) and
+      WSTOPSIG(wait_status_) == SIGTRAP) {
+    // Report the breakpoint address rather than the address after the int3.
+    user_regs_struct regs = get_registers(pid_);
+    const auto it = breakpoints_.find(static_cast<std::intptr_t>(regs.rip) - 1);
+    if (it != breakpoints_.end() and it->second.is_enabled()) {
+      regs.rip -= 1;
+      set_registers(pid_, regs);
+      stopped_at_breakpoint_ = true;
+    }
+  }
+  return stop_reply();
+}
+
+std::string GdbServer::stop_reply() {
+  std::string reply{};
+  if (WIFEXITED(wait_status_) or WIFSIGNALED(wait_status_)) {
+    const bool exited = WIFEXITED(wait_status_);
+    const auto code = static_cast<uint8_t>(
+        exited ? WEXITSTATUS(wait_status_)
+               : to_gdb_signal(WTERMSIG(wait_status_)));
+    reply += exited ? 'W' : 'X';
+    append_hex(reply, &code, 1);
+    return reply;
+  }
+  const auto signal =
+      static_cast<uint8_t>(to_gdb_signal(WSTOPSIG(wait_status_)));
+  reply += 'T';
+  append_hex(reply, &signal, 1);
+  reply += "thread:";
+  append_hex_number(reply, static_cast<uint64_t>(pid_));
+  reply += ';';
+  if (stopped_at_breakpoint_) {
+    reply += "swbreak:;";
+  }
+  // Send the frame registers along to save the usual round trips.
+  for (const std::size_t number : {6, 7, 16}) {
+    const uint8_t number_byte = static_cast<uint8_t>(number);
+    append_hex(reply, &number_byte, 1);
+    reply += ':';
+    reply += read_register(number);
+    reply += ';';
+  }
+  return reply;
+}
+}  // namespace nebugger
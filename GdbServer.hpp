@@ -0,0 +1,100 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <unordered_map>
+
+#include "Breakpoint.hpp"
+#include "Memory.hpp"
+
+namespace nebugger {
+/// A GDB remote serial protocol stub, letting GDB and other RSP frontends
+/// drive a stopped, single-threaded inferior over a socket.
+///
+/// Supported are the register (`g`, `G`, `p`, `P`), memory (`m`, `M`, `X`),
+/// software breakpoint (`Z0`, `z0`) and execution control (`vCont`, `c`,
+/// `s`, `C`, `S`, Ctrl-C) packets, `qXfer` reads of the target description,
+/// the auxiliary vector and the executable name, and `QStartNoAckMode`.
+/// Memory reads never show the `int3` of inserted breakpoints.
+class GdbServer {
+ public:
+  /// Serve the inferior `pid`, which must be traced by us and stopped.
+  explicit GdbServer(pid_t pid) : pid_(pid), memory_(pid) {}
+  GdbServer(const GdbServer&) = delete;
+  GdbServer& operator=(const GdbServer&) = delete;
+  ~GdbServer();
+
+  /// Listen on `address`, either `[HOST]:PORT` or `unix:PATH`, and serve the
+  /// first client until it detaches, kills the inferior or disconnects.
+  ///
+  /// Returns the exit code of the inferior, 0 if it was detached from or is
+  /// still alive (it is then killed), and -1 if the socket could not be set
+  /// up.
+  int run(const std::string& address);
+
+ private:
+  bool accept_client(const std::string& address);
+  // Read the next packet into `packet`, acknowledging it unless in no-ack
+  // mode. Returns false once the client disconnected.
+  bool read_packet(std::string& packet);
+  // Make sure at least one more byte is buffered, false on disconnect.
+  bool fill_input();
+  void send_packet(std::string_view payload);
+  // Handle `packet`, returns false when the session is over.
+  bool handle_packet(std::string_view packet);
+
+  void read_register_file();
+  bool write_register_file();
+  std::string read_registers();
+  bool write_registers(std::string_view hex);
+  std::string read_register(std::size_t number);
+  bool write_register(std::size_t number, std::string_view hex);
+  // Store `hex` in the cached register file without writing it to the
+  // process
+  bool decode_register(std::size_t number, std::string_view hex);
+
+  std::string read_memory(std::intptr_t address, std::size_t length);
+  bool write_memory(std::intptr_t address, std::string_view data);
+  std::string transfer(std::string_view object, std::string_view annex,
+                       std::size_t offset, std::size_t length);
+  std::string resume(std::string_view actions);
+  std::string resume(bool step, int signal);
+  std::string stop_reply();
+
+  pid_t pid_;
+  InferiorMemory memory_;
+  std::unordered_map<std::intptr_t, Breakpoint> breakpoints_{};
+
+  int listen_fd_{-1};
+  int client_fd_{-1};
+  // Signalled when the inferior changes state, to wait for it and the
+  // client at the same time
+  int child_signal_fd_{-1};
+  std::string unix_path_{};
+  bool no_ack_{false};
+  std::string input_{};
+  std::size_t input_position_{0};
+  // Last packet sent including framing, resent when the client nacks it
+  std::string output_{};
+
+  // Registers of the stopped inferior, read on first use after each stop
+  bool registers_valid_{false};
+  user_regs_struct registers_{};
+  user_fpregs_struct fp_registers_{};
+
+  // Status of the last stop as returned by waitpid
+  int wait_status_{0};
+  bool stopped_at_breakpoint_{false};
+};
+}  // namespace nebugger
@@ -0,0 +1,679 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "HeapTracker.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Emulator.hpp"
+#include "Fork.hpp"
+#include "Registers.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint8_t int3 = 0xcc;
+
+// Names code addresses with the symbols of the ELF files mapped there.
+class Symbolizer {
+ public:
+  explicit Symbolizer(const std::vector<MemoryRegion>& mappings)
+      : mappings_(mappings) {}
+
+  void print(std::ostream& os, const std::intptr_t address) {
+    os << "0x" << std::hex << address << std::dec;
+    const auto region = std::upper_bound(
+        mappings_.begin(), mappings_.end(), address,
+        [](const std::intptr_t a, const MemoryRegion& r) {
+          return a < r.start;
+        });
+    if (region == mappings_.begin() or std::prev(region)->end <= address or
+        std::prev(region)->path.empty() or
+        std::prev(region)->path.front() != '/') {
+      return;
+    }
+    const std::string& path = std::prev(region)->path;
+    std::unique_ptr<ElfFile>& file = files_[path];
+    if (file == nullptr and access(path.c_str(), R_OK) == 0) {
+      file = std::make_unique<ElfFile>(path);
+    }
+    if (file != nullptr and file->is_valid()) {
+      std::intptr_t load = 0;
+      if (file->is_position_independent()) {
+        for (const MemoryRegion& mapping : mappings_) {
+          if (mapping.offset == 0 and mapping.path == path) {
+            load = mapping.start;
+            break;
+          }
+        }
+      }
+      const auto offset = static_cast<uint64_t>(address - load);
+      if (const Symbol* const function =
+              file->find_function_containing(offset)) {
+        os << ' ' << function->name << "+0x" << std::hex
+           << offset - function->address << std::dec;
+      }
+    }
+    os << " (" << path << ')';
+  }
+
+ private:
+  const std::vector<MemoryRegion>& mappings_;
+  std::unordered_map<std::string, std::unique_ptr<ElfFile>> files_{};
+};
+}  // namespace
+
+void AllocationTable::insert(const std::intptr_t address, const uint64_t size,
+                             const uint32_t site) {
+  if ((count_ + 1) * 4 > slots_.size() * 3) {
+    resize(slots_.size() * 2);
+  }
+  const auto key = static_cast<uint64_t>(address);
+  const uint64_t value =
+      std::min(size, max_size) | uint64_t{std::min(site, max_site)} << 40;
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = home(key);; i = (i + 1) & mask) {
+    if (slots_[i].address == key) {
+      slots_[i].value = value;
+      return;
+    }
+    if (slots_[i].address == 0) {
+      slots_[i] = {key, value};
+      ++count_;
+      return;
+    }
+  }
+}
+
+bool AllocationTable::erase(const std::intptr_t address, uint64_t& size,
+                            uint32_t& site) {
+  const auto key = static_cast<uint64_t>(address);
+  const std::size_t mask = slots_.size() - 1;
+  std::size_t hole = home(key);
+  while (slots_[hole].address != key) {
+    if (slots_[hole].address == 0) {
+      return false;
+    }
+    hole = (hole + 1) & mask;
+  }
+  size = slots_[hole].value & max_size;
+  site = static_cast<uint32_t>(slots_[hole].value >> 40);
+  // Move back the following entries of the run that could no longer be found
+  // past the hole, i.e. those whose home is not between the hole and them.
+  for (std::size_t i = (hole + 1) & mask; slots_[i].address != 0;
+       i = (i + 1) & mask) {
+    if (((i - home(slots_[i].address)) & mask) >= ((i - hole) & mask)) {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole].address = 0;
+  --count_;
+  if (slots_.size() > min_capacity and count_ * 8 < slots_.size()) {
+    resize(slots_.size() / 2);
+  }
+  return true;
+}
+
+void AllocationTable::resize(const std::size_t capacity) {
+  std::vector<Slot> old(capacity);
+  old.swap(slots_);
+  shift_ = 64 - static_cast<unsigned>(__builtin_ctzll(capacity));
+  const std::size_t mask = capacity - 1;
+  for (const Slot& slot : old) {
+    if (slot.address != 0) {
+      std::size_t i = home(slot.address);
+      while (slots_[i].address != 0) {
+        i = (i + 1) & mask;
+      }
+      slots_[i] = slot;
+    }
+  }
+}
+
+HeapTracker::HeapTracker(std::string program_name, const pid_t pid)
+    : program_name_(std::move(program_name)),
+      pid_(pid),
+      elf_(program_name_),
+      memory_(pid),
+      instructions_(memory_,
+                    [this](const std::intptr_t address, uint8_t& byte) {
+                      return original_byte(address, byte);
+                    }) {}
+
+int HeapTracker::run() {
+  int wait_status = 0;
+  if (waitpid(pid_, &wait_status, 0) != pid_ or not WIFSTOPPED(wait_status)) {
+    std::cerr << "Failed to start '" << program_name_ << "'\n";
+    return -1;
+  }
+  if (ptrace(PTRACE_SETOPTIONS, pid_, nullptr,
+             PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                 PTRACE_O_TRACEVFORKDONE | PTRACE_O_TRACEEXEC |
+                 PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL) == -1) {
+    std::cerr << "Failed to set ptrace options with errno: " << errno << '\n';
+    return -1;
+  }
+  threads_.insert(pid_);
+  if (not run_to_entry_point() or not insert_probes()) {
+    return -1;
+  }
+
+  int exit_status = 0;
+  pid_t tid = pid_;
+  int signal_to_deliver = 0;
+  bool resume = true;
+  while (true) {
+    if (resume and
+        ptrace(PTRACE_CONT, tid, nullptr, signal_to_deliver) == -1 and
+        errno != ESRCH) {
+      std::cerr << "Failed to continue thread " << tid
+                << " with errno: " << errno << '\n';
+    }
+    signal_to_deliver = 0;
+    resume = true;
+    tid = waitpid(-1, &wait_status, __WALL);
+    if (tid == -1) {
+      break;
+    }
+    if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+      threads_.erase(tid);
+      frames_.erase(tid);
+      if (tid == pid_) {
+        exit_status = WIFEXITED(wait_status)
+                          ? WEXITSTATUS(wait_status)
+                          : 128 + WTERMSIG(wait_status);
+        break;
+      }
+      // Another thread exited, there is nothing to resume.
+      resume = false;
+      continue;
+    }
+    const int signal = WSTOPSIG(wait_status);
+    const int event = ptrace_event(wait_status);
+    if (signal == SIGTRAP and event != 0) {
+      handle_event(tid, event);
+      continue;
+    }
+    if (threads_.count(tid) == 0) {
+      // The first stop of a new thread or forked child may be reported
+      // before the event that created it, which decides what to do with it.
+      early_stops_.insert(tid);
+      resume = false;
+      continue;
+    }
+    if (signal == SIGTRAP) {
+      if (not handle_trap(tid)) {
+        signal_to_deliver = SIGTRAP;
+      }
+    } else if (signal != SIGSTOP) {
+      // New threads start with a SIGSTOP, everything else belongs to the
+      // program.
+      signal_to_deliver = signal;
+    }
+  }
+  return exit_status;
+}
+
+void HeapTracker::write_report(std::ostream& os, const std::size_t top) const {
+  os << "# nebugger heap profile v1\n"
+     << "binary " << program_name_ << '\n'
+     << "allocations " << allocations_ << " bytes " << bytes_ << " frees "
+     << frees_ << " reallocs " << reallocs_ << " failed " << failed_
+     << " unknown-frees " << unknown_frees_ << '\n'
+     << "peak-live-bytes " << peak_live_bytes_ << '\n'
+     << "live " << live_.size() << " bytes " << live_bytes_ << '\n';
+
+  Symbolizer symbolizer{mappings_};
+  const auto print_sites = [this, &os, &symbolizer](
+                               const std::string_view title,
+                               std::vector<const AllocationSite*> sites,
+                               const bool live, const std::size_t limit) {
+    os << title << ' ' << sites.size() << '\n';
+    for (std::size_t i = 0; i < std::min(limit, sites.size()); ++i) {
+      const AllocationSite& site = *sites[i];
+      os << "  " << (live ? site.live_bytes : site.bytes) << " bytes in "
+         << (live ? site.live_allocations : site.allocations)
+         << " allocations at ";
+      symbolizer.print(os, site.address);
+      os << '\n';
+    }
+  };
+
+  std::vector<const AllocationSite*> sites{};
+  for (const AllocationSite& site : sites_) {
+    if (site.live_allocations != 0) {
+      sites.push_back(&site);
+    }
+  }
+  std::sort(sites.begin(), sites.end(),
+            [](const AllocationSite* a, const AllocationSite* b) {
+              return a->live_bytes > b->live_bytes;
+            });
+  print_sites("leak-sites", sites, true, sites.size());
+
+  sites.clear();
+  for (const AllocationSite& site : sites_) {
+    sites.push_back(&site);
+  }
+  std::sort(sites.begin(), sites.end(),
+            [](const AllocationSite* a, const AllocationSite* b) {
+              return a->bytes > b->bytes;
+            });
+  print_sites("top-sites-by-bytes", sites, false, top);
+  std::sort(sites.begin(), sites.end(),
+            [](const AllocationSite* a, const AllocationSite* b) {
+              return a->allocations > b->allocations;
+            });
+  print_sites("top-sites-by-allocations", sites, false, top);
+}
+
+bool HeapTracker::run_to_entry_point() {
+  // Until the entry point only the dynamic linker runs, once it is reached
+  // the libraries holding the allocator are mapped.
+  if (not elf_.is_valid()) {
+    return false;
+  }
+  auto entry = static_cast<std::intptr_t>(elf_.header().e_entry);
+  if (elf_.is_position_independent()) {
+    entry += find_load_address(pid_, program_name_);
+  }
+  uint8_t original = 0;
+  if (not memory_.read(entry, &original, 1) or
+      not memory_.write(entry, &int3, 1)) {
+    std::cerr << "Failed to insert a breakpoint at the entry point of '"
+              << program_name_ << "'\n";
+    return false;
+  }
+  int wait_status = 0;
+  int signal_to_deliver = 0;
+  while (true) {
+    ptrace(PTRACE_CONT, pid_, nullptr, signal_to_deliver);
+    signal_to_deliver = 0;
+    if (waitpid(pid_, &wait_status, __WALL) != pid_ or
+        not WIFSTOPPED(wait_status)) {
+      std::cerr << "'" << program_name_
+                << "' exited before reaching its entry point\n";
+      return false;
+    }
+    const int signal = WSTOPSIG(wait_status);
+    if (signal == SIGTRAP and ptrace_event(wait_status) == 0 and
+        static_cast<std::intptr_t>(get_registers(pid_).rip) - 1 == entry) {
+      break;
+    }
+    if (signal != SIGTRAP or ptrace_event(wait_status) == 0) {
+      signal_to_deliver = signal;
+    }
+  }
+  memory_.write(entry, &original, 1);
+  user_regs_struct regs = get_registers(pid_);
+  regs.rip -= 1;
+  set_registers(pid_, regs);
+  return true;
+}
+
+bool HeapTracker::insert_probes() {
+  static const std::unordered_map<std::string_view, Function> functions{
+      {"malloc", Function::Malloc},
+      {"calloc", Function::Calloc},
+      {"realloc", Function::Realloc},
+      {"aligned_alloc", Function::AlignedAlloc},
+      {"memalign", Function::AlignedAlloc},
+      {"posix_memalign", Function::PosixMemalign},
+      {"free", Function::Free}};
+
+  mappings_ = read_memory_map(pid_);
+  std::unordered_set<std::string> seen{};
+  for (const MemoryRegion& region : mappings_) {
+    if (region.offset != 0 or region.path.empty() or
+        region.path.front() != '/' or not seen.insert(region.path).second or
+        access(region.path.c_str(), R_OK) != 0) {
+      continue;
+    }
+    const ElfFile elf{region.path};
+    if (not elf.is_valid()) {
+      continue;
+    }
+    const std::intptr_t load = elf.is_position_independent() ? region.start : 0;
+    for (const Symbol& symbol : elf.symbols()) {
+      if (not symbol.is_function or symbol.size == 0) {
+        continue;
+      }
+      Function function = Function::OperatorNew;
+      if (const auto it = functions.find(symbol.name); it != functions.end()) {
+        function = it->second;
+      } else if (symbol.name.compare(0, 4, "_Znw") != 0 and
+                 symbol.name.compare(0, 4, "_Zna") != 0) {
+        continue;
+      }
+      const std::intptr_t address =
+          load + static_cast<std::intptr_t>(symbol.address);
+      (function == Function::OperatorNew ? wrapper_code_ : allocator_code_)
+          .emplace_back(address,
+                        address + static_cast<std::intptr_t>(symbol.size));
+      uint8_t byte = 0;
+      if (probes_.count(address) == 0 and memory_.read(address, &byte, 1)) {
+        probes_.emplace(address, Probe{function, byte});
+      }
+    }
+  }
+  std::sort(allocator_code_.begin(), allocator_code_.end());
+  std::sort(wrapper_code_.begin(), wrapper_code_.end());
+  if (std::none_of(probes_.begin(), probes_.end(), [](const auto& probe) {
+        return probe.second.function == Function::Malloc;
+      })) {
+    std::cerr << "Found no malloc in '" << program_name_
+              << "' or its libraries\n";
+    return false;
+  }
+  return write_probes(pid_, true);
+}
+
+bool HeapTracker::handle_trap(const pid_t tid) {
+  user_regs_struct regs = get_registers(tid);
+  const auto address = static_cast<std::intptr_t>(regs.rip - 1);
+  if (const auto probe = probes_.find(address); probe != probes_.end()) {
+    ++traps_;
+    enter(tid, probe->second.function, regs);
+    return step_over(tid, regs, address);
+  }
+  if (return_probes_.count(address) != 0) {
+    ++traps_;
+    leave(tid, regs);
+    return step_over(tid, regs, address);
+  }
+  return false;
+}
+
+void HeapTracker::enter(const pid_t tid, const Function function,
+                        const user_regs_struct& regs) {
+  uint64_t return_address = 0;
+  if (not memory_.read(static_cast<std::intptr_t>(regs.rsp), &return_address,
+                       sizeof(return_address))) {
+    return;
+  }
+  // Calls that returned or were left by a longjmp are at or below the stack
+  // pointer now.
+  std::vector<Frame>& frames = frames_[tid];
+  while (not frames.empty() and frames.back().rsp <= regs.rsp) {
+    frames.pop_back();
+  }
+  const auto caller = static_cast<std::intptr_t>(return_address);
+  if (in_ranges(allocator_code_, caller)) {
+    // E.g. `realloc` calling `malloc`, the outer call is recorded.
+    return;
+  }
+  if (function == Function::Free) {
+    ++frees_;
+    if (regs.rdi != 0 and not record_free(regs.rdi)) {
+      ++unknown_frees_;
+    }
+    return;
+  }
+  // Allocations by `operator new` belong to the caller of `new`.
+  const uint32_t site =
+      in_ranges(wrapper_code_, caller) and not frames.empty() and
+              frames.back().function == Function::OperatorNew
+          ? frames.back().site
+          : site_index(caller);
+  Frame frame{function, regs.rsp, site, regs.rdi, 0};
+  switch (function) {
+    case Function::Calloc:
+      if (__builtin_mul_overflow(regs.rdi, regs.rsi, &frame.size)) {
+        frame.size = AllocationTable::max_size;
+      }
+      break;
+    case Function::Realloc:
+      frame.size = regs.rsi;
+      frame.pointer = regs.rdi;
+      break;
+    case Function::AlignedAlloc:
+      frame.size = regs.rsi;
+      break;
+    case Function::PosixMemalign:
+      frame.size = regs.rdx;
+      frame.pointer = regs.rdi;
+      break;
+    default:
+      break;
+  }
+  frames.push_back(frame);
+  if (function == Function::OperatorNew or
+      return_probes_.count(caller) != 0 or probes_.count(caller) != 0) {
+    return;
+  }
+  // The return address keeps its breakpoint, it is usually reached again.
+  uint8_t original = 0;
+  if (memory_.read(caller, &original, 1) and
+      memory_.write(caller, &int3, 1)) {
+    return_probes_.emplace(caller, original);
+  }
+}
+
+void HeapTracker::leave(const pid_t tid, const user_regs_struct& regs) {
+  const auto it = frames_.find(tid);
+  if (it == frames_.end()) {
+    return;
+  }
+  // The `ret` popped the return address the frame points to.
+  std::vector<Frame>& frames = it->second;
+  const uint64_t rsp = regs.rsp - 8;
+  while (not frames.empty() and frames.back().rsp < rsp) {
+    frames.pop_back();
+  }
+  if (frames.empty() or frames.back().rsp != rsp or
+      frames.back().function == Function::OperatorNew) {
+    return;
+  }
+  const Frame frame = frames.back();
+  frames.pop_back();
+  const uint64_t result = regs.rax;
+  if (frame.function == Function::PosixMemalign) {
+    uint64_t pointer = 0;
+    if (result != 0 or
+        not memory_.read(static_cast<std::intptr_t>(frame.pointer), &pointer,
+                         sizeof(pointer))) {
+      ++failed_;
+      return;
+    }
+    record_allocation(pointer, frame.size, frame.site);
+    return;
+  }
+  if (frame.function == Function::Realloc) {
+    ++reallocs_;
+    if (result == 0 and frame.size != 0) {
+      // The old block is left alone.
+      ++failed_;
+      return;
+    }
+    if (frame.pointer != 0 and not record_free(frame.pointer)) {
+      ++unknown_frees_;
+    }
+    if (result == 0) {
+      return;
+    }
+  } else if (result == 0) {
+    ++failed_;
+    return;
+  }
+  record_allocation(result, frame.size, frame.site);
+}
+
+bool HeapTracker::step_over(const pid_t tid, user_regs_struct& regs,
+                            const std::intptr_t address) {
+  regs.rip = static_cast<uint64_t>(address);
+  if (const Instruction* const insn = instructions_.find(address)) {
+    if (emulate_instruction(*insn, instructions_.bytes(*insn), regs,
+                            memory_)) {
+      set_registers(tid, regs);
+      return true;
+    }
+  }
+  // Other threads can run past the breakpoint unseen while it is lifted for
+  // the single-step.
+  set_registers(tid, regs);
+  uint8_t original = 0;
+  original_byte(address, original);
+  memory_.write(address, &original, 1);
+  int wait_status = 0;
+  const bool stepped =
+      ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) != -1 and
+      waitpid(tid, &wait_status, __WALL) == tid;
+  memory_.write(address, &int3, 1);
+  if (stepped and WIFSTOPPED(wait_status) and
+      WSTOPSIG(wait_status) != SIGTRAP) {
+    // A signal arrived before the instruction ran, queue it again.
+    syscall(SYS_tgkill, pid_, tid, WSTOPSIG(wait_status));
+  }
+  return true;
+}
+
+bool HeapTracker::original_byte(const std::intptr_t address,
+                                uint8_t& byte) const {
+  if (const auto probe = probes_.find(address); probe != probes_.end()) {
+    byte = probe->second.original_byte;
+    return true;
+  }
+  if (const auto probe = return_probes_.find(address);
+      probe != return_probes_.end()) {
+    byte = probe->second;
+    return true;
+  }
+  return false;
+}
+
+bool HeapTracker::in_ranges(
+    const std::vector<std::pair<std::intptr_t, std::intptr_t>>& ranges,
+    const std::intptr_t address) {
+  const auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), address,
+      [](const std::intptr_t a, const std::pair<std::intptr_t, std::intptr_t>&
+                                    range) { return a < range.first; });
+  return it != ranges.begin() and address < std::prev(it)->second;
+}
+
+uint32_t HeapTracker::site_index(const std::intptr_t address) {
+  const auto [it, inserted] = site_indices_.try_emplace(
+      address, static_cast<uint32_t>(sites_.size()));
+  if (inserted) {
+    sites_.push_back({address});
+  }
+  return it->second;
+}
+
+void HeapTracker::record_allocation(const uint64_t pointer, uint64_t size,
+                                    const uint32_t site) {
+  // A pointer that is still live was freed in a way we did not see.
+  record_free(pointer);
+  size = std::min(size, AllocationTable::max_size);
+  live_.insert(static_cast<std::intptr_t>(pointer), size, site);
+  AllocationSite& stats = sites_[site];
+  ++stats.allocations;
+  stats.bytes += size;
+  ++stats.live_allocations;
+  stats.live_bytes += size;
+  ++allocations_;
+  bytes_ += size;
+  live_bytes_ += size;
+  peak_live_bytes_ = std::max(peak_live_bytes_, live_bytes_);
+}
+
+bool HeapTracker::record_free(const uint64_t pointer) {
+  uint64_t size = 0;
+  uint32_t site = 0;
+  if (not live_.erase(static_cast<std::intptr_t>(pointer), size, site)) {
+    return false;
+  }
+  AllocationSite& stats = sites_[site];
+  --stats.live_allocations;
+  stats.live_bytes -= size;
+  live_bytes_ -= size;
+  return true;
+}
+
+void HeapTracker::handle_event(const pid_t tid, const int event) {
+  unsigned long message = 0;
+  switch (event) {
+    case PTRACE_EVENT_CLONE: {
+      ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+      const auto thread = static_cast<pid_t>(message);
+      threads_.insert(thread);
+      if (early_stops_.erase(thread) != 0) {
+        ptrace(PTRACE_CONT, thread, nullptr, nullptr);
+      }
+      return;
+    }
+    case PTRACE_EVENT_FORK:
+    case PTRACE_EVENT_VFORK: {
+      ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+      const auto child = static_cast<pid_t>(message);
+      if (early_stops_.erase(child) == 0 and not wait_for_forked_child(child)) {
+        return;
+      }
+      // A forked child runs on untraced without the copies of the
+      // breakpoints. A vforked child shares the memory of the parent until it
+      // executes a new program or exits, the breakpoints are lifted until then
+      // and allocations of other threads in the meantime are missed.
+      write_probes(event == PTRACE_EVENT_FORK ? child : pid_, false);
+      if (ptrace(PTRACE_DETACH, child, nullptr, nullptr) == -1) {
+        std::cerr << "Failed to detach from forked process " << child
+                  << " with errno: " << errno << '\n';
+      }
+      return;
+    }
+    case PTRACE_EVENT_VFORK_DONE:
+      write_probes(pid_, true);
+      return;
+    case PTRACE_EVENT_EXEC:
+      // The program replaced itself, the breakpoints are gone and the new
+      // program is not profiled.
+      probes_.clear();
+      return_probes_.clear();
+      frames_.clear();
+      instructions_.clear();
+      return;
+    case PTRACE_EVENT_EXIT:
+      if (tid == pid_) {
+        // Libraries loaded since the start are needed to name the sites.
+        if (std::vector<MemoryRegion> mappings = read_memory_map(pid_);
+            not mappings.empty()) {
+          mappings_ = std::move(mappings);
+        }
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+bool HeapTracker::write_probes(const pid_t pid, const bool insert) {
+  InferiorMemory memory{pid};
+  bool success = true;
+  for (const auto& [address, probe] : probes_) {
+    success =
+        memory.write(address, insert ? &int3 : &probe.original_byte, 1) and
+        success;
+  }
+  for (const auto& [address, original] : return_probes_) {
+    success =
+        memory.write(address, insert ? &int3 : &original, 1) and success;
+  }
+  if (not success) {
+    std::cerr << "Failed to " << (insert ? "insert" : "remove")
+              << " allocation breakpoints in process " << pid << '\n';
+  }
+  return success;
+}
+}  // namespace nebugger
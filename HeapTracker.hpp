@@ -0,0 +1,222 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Elf.hpp"
+#include "InstructionCache.hpp"
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+
+namespace nebugger {
+/// The live allocations of a process by address.
+///
+/// An open addressing table with linear probing that stores the address and
+/// one word packing the size and the allocation site, 16 bytes per
+/// allocation. Deletion shifts the following entries back instead of leaving
+/// tombstones, so the table can grow at 3/4 and shrink below 1/8 load and its
+/// size stays proportional to the number of live allocations.
+class AllocationTable {
+ public:
+  /// Sizes are stored in 40 bits, larger ones are clamped.
+  static constexpr uint64_t max_size = (uint64_t{1} << 40) - 1;
+  /// Sites are stored in 24 bits.
+  static constexpr uint32_t max_site = (uint32_t{1} << 24) - 1;
+
+  AllocationTable() : slots_(min_capacity) {}
+
+  /// Record `size` bytes allocated at `address`, which must not be 0, by the
+  /// site `site`, replacing a previous allocation at the same address.
+  void insert(std::intptr_t address, uint64_t size, uint32_t site);
+
+  /// Remove the allocation at `address` and set `size` and `site` to its
+  /// size and site. Returns false if there is none.
+  bool erase(std::intptr_t address, uint64_t& size, uint32_t& site);
+
+  /// Number of live allocations.
+  std::size_t size() const noexcept { return count_; }
+
+  /// Bytes used by the table itself.
+  std::size_t memory_use() const noexcept {
+    return slots_.capacity() * sizeof(Slot);
+  }
+
+  /// Call `f(address, size, site)` for each live allocation.
+  template <typename F>
+  void for_each(F&& f) const {
+    for (const Slot& slot : slots_) {
+      if (slot.address != 0) {
+        f(static_cast<std::intptr_t>(slot.address), slot.value & max_size,
+          static_cast<uint32_t>(slot.value >> 40));
+      }
+    }
+  }
+
+ private:
+  static constexpr std::size_t min_capacity = 1024;
+
+  struct Slot {
+    // 0 if the slot is empty
+    uint64_t address;
+    // The size in the low 40 bits, the site above
+    uint64_t value;
+  };
+
+  // The slot at which the search for `address` starts, by Fibonacci hashing
+  // since allocations are aligned
+  std::size_t home(const uint64_t address) const noexcept {
+    return static_cast<std::size_t>((address * 0x9e3779b97f4a7c15ULL) >>
+                                    shift_);
+  }
+  void resize(std::size_t capacity);
+
+  std::vector<Slot> slots_;
+  std::size_t count_{0};
+  // 64 minus the log2 of the capacity
+  unsigned shift_{54};
+};
+
+/// The allocations made from one call site.
+struct AllocationSite {
+  // The return address of the call to the allocation function, or to
+  // `operator new`
+  std::intptr_t address;
+  uint64_t allocations{0};
+  uint64_t bytes{0};
+  uint64_t live_allocations{0};
+  uint64_t live_bytes{0};
+};
+
+/// Profiles the heap of an unmodified program.
+///
+/// Breakpoints at the entries of `malloc`, `calloc`, `realloc`,
+/// `aligned_alloc`, `memalign`, `posix_memalign` and `free` in the program
+/// and its libraries record the arguments of each call, and a breakpoint at
+/// its return address the pointer it returned. `operator new` is followed
+/// through to the `malloc` it calls so its allocations are attributed to the
+/// caller of `new`, and `operator delete` ends in `free`. The breakpoints
+/// stay in place: they are stepped over by emulating the instruction under
+/// them, so the other threads never run past them unseen.
+///
+/// Allocations made before the program's entry point, e.g. by constructors
+/// of shared libraries, are not seen, and their frees are counted as frees
+/// of unknown pointers.
+class HeapTracker {
+ public:
+  /// `pid` must be stopped right after `exec`.
+  HeapTracker(std::string program_name, pid_t pid);
+  HeapTracker(const HeapTracker&) = delete;
+  HeapTracker& operator=(const HeapTracker&) = delete;
+
+  /// Run the inferior, including all of its threads, to completion. Returns
+  /// the exit status of the inferior, or 128 + signal if it was killed.
+  int run();
+
+  /// Write the totals, the allocations still live when the program exited
+  /// grouped by site, and the `top` sites by bytes and by allocations.
+  void write_report(std::ostream& os, std::size_t top = 20) const;
+
+  /// Number of allocations and of stops of the inferior, for benchmarks.
+  uint64_t allocations() const noexcept { return allocations_; }
+  uint64_t traps() const noexcept { return traps_; }
+
+ private:
+  enum class Function {
+    Malloc,
+    Calloc,
+    Realloc,
+    AlignedAlloc,
+    PosixMemalign,
+    Free,
+    OperatorNew
+  };
+
+  struct Probe {
+    Function function;
+    uint8_t original_byte;
+  };
+
+  // A call of an allocation function or `operator new` in progress
+  struct Frame {
+    Function function;
+    // The stack pointer at the entry, pointing to the return address
+    uint64_t rsp;
+    uint32_t site;
+    uint64_t size;
+    // The pointer passed to `realloc`, or where `posix_memalign` stores the
+    // result
+    uint64_t pointer;
+  };
+
+  bool run_to_entry_point();
+  bool insert_probes();
+  // Handle a SIGTRAP of thread `tid`, returns true if it was one of ours
+  bool handle_trap(pid_t tid);
+  void enter(pid_t tid, Function function, const user_regs_struct& regs);
+  void leave(pid_t tid, const user_regs_struct& regs);
+  // Set the program counter of `tid` to `address` and execute the original
+  // instruction at it
+  bool step_over(pid_t tid, user_regs_struct& regs, std::intptr_t address);
+  bool original_byte(std::intptr_t address, uint8_t& byte) const;
+  // Whether `address` lies in one of the sorted ranges
+  static bool in_ranges(
+      const std::vector<std::pair<std::intptr_t, std::intptr_t>>& ranges,
+      std::intptr_t address);
+  uint32_t site_index(std::intptr_t address);
+  void record_allocation(uint64_t pointer, uint64_t size, uint32_t site);
+  // Returns false if `pointer` is not live
+  bool record_free(uint64_t pointer);
+  // Handle a ptrace event of `tid`
+  void handle_event(pid_t tid, int event);
+  // Lift or restore all breakpoints in the memory of `pid`
+  bool write_probes(pid_t pid, bool insert);
+
+  std::string program_name_;
+  pid_t pid_;
+  ElfFile elf_;
+  InferiorMemory memory_;
+  InstructionCache instructions_;
+  std::unordered_map<std::intptr_t, Probe> probes_{};
+  // The original bytes under the breakpoints at return addresses
+  std::unordered_map<std::intptr_t, uint8_t> return_probes_{};
+  // Code of the allocation functions and of `operator new`
+  std::vector<std::pair<std::intptr_t, std::intptr_t>> allocator_code_{};
+  std::vector<std::pair<std::intptr_t, std::intptr_t>> wrapper_code_{};
+  // The calls in progress on each thread, innermost last
+  std::unordered_map<pid_t, std::vector<Frame>> frames_{};
+  // Threads seen, and stopped threads whose clone or fork event is not yet
+  // reported
+  std::unordered_set<pid_t> threads_{};
+  std::unordered_set<pid_t> early_stops_{};
+  // The mappings for symbolizing sites, read again when the program exits
+  std::vector<MemoryRegion> mappings_{};
+
+  AllocationTable live_{};
+  std::vector<AllocationSite> sites_{};
+  std::unordered_map<std::intptr_t, uint32_t> site_indices_{};
+  uint64_t allocations_{0};
+  uint64_t bytes_{0};
+  uint64_t frees_{0};
+  uint64_t reallocs_{0};
+  uint64_t failed_{0};
+  uint64_t unknown_frees_{0};
+  uint64_t live_bytes_{0};
+  uint64_t peak_live_bytes_{0};
+  uint64_t traps_{0};
+};
+}  // namespace nebugger
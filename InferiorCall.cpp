@@ -0,0 +1,102 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "InferiorCall.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#include "Registers.hpp"
+#include "RemoteAllocator.hpp"
+
+namespace nebugger {
+namespace {
+// Size of the scratch region, the callee's stack grows down from its end.
+constexpr uint64_t scratch_size = 1 << 20;
+}  // namespace
+
+bool FunctionCaller::call(const std::intptr_t function_address,
+                          const std::vector<uint64_t>& args,
+                          uint64_t& return_value) {
+  if (args.size() > 6) {
+    std::cerr << "At most 6 integer arguments are supported, got "
+              << args.size() << '\n';
+    return false;
+  }
+  if (scratch_ == 0 and not map_scratch()) {
+    return false;
+  }
+
+  const user_regs_struct saved_regs = get_registers(pid_);
+  user_regs_struct regs = saved_regs;
+  const std::array<unsigned long long user_regs_struct::*, 6> argument_regs{
+      {&user_regs_struct::rdi, &user_regs_struct::rsi, &user_regs_struct::rdx,
+       &user_regs_struct::rcx, &user_regs_struct::r8, &user_regs_struct::r9}};
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    regs.*argument_regs[i] = args[i];
+  }
+  // Number of vector registers used by a variadic callee.
+  regs.rax = 0;
+  // On entry (rsp + 8) must be 16-byte aligned, as after a call from an
+  // aligned stack, i.e. the return address sits 8 bytes below a 16-byte
+  // boundary.
+  const std::intptr_t return_address_slot = static_cast<std::intptr_t>(
+      ((scratch_ + scratch_size) & ~0xfULL) - 8);
+  regs.rsp = static_cast<uint64_t>(return_address_slot);
+  regs.rip = static_cast<uint64_t>(function_address);
+  regs.orig_rax = static_cast<uint64_t>(-1);
+
+  // The int3 at the start of the scratch region is the return address.
+  if (ptrace(PTRACE_POKEDATA, pid_, return_address_slot, scratch_) == -1) {
+    std::cerr << "Failed to write the return address for the call\n";
+    return false;
+  }
+  set_registers(pid_, regs);
+
+  bool success = false;
+  int wait_status = 0;
+  if (ptrace(PTRACE_CONT, pid_, nullptr, nullptr) == -1 or
+      waitpid(pid_, &wait_status, 0) != pid_) {
+    std::cerr << "Failed to run the called function\n";
+  } else if (not WIFSTOPPED(wait_status)) {
+    std::cerr << "Process exited during the called function\n";
+    return false;
+  } else {
+    const user_regs_struct result_regs = get_registers(pid_);
+    if (WSTOPSIG(wait_status) == SIGTRAP and
+        result_regs.rip == static_cast<uint64_t>(scratch_) + 1) {
+      return_value = result_regs.rax;
+      success = true;
+    } else {
+      std::cerr << "The called function stopped with signal "
+                << WSTOPSIG(wait_status) << " at 0x" << std::hex
+                << result_regs.rip << std::dec
+                << ", discarding the call and restoring the registers\n";
+    }
+  }
+  set_registers(pid_, saved_regs);
+  return success;
+}
+
+bool FunctionCaller::map_scratch() {
+  scratch_ = allocator_.allocate(scratch_size, RemoteAllocator::Kind::Code);
+  if (scratch_ == 0) {
+    return false;
+  }
+  // Place the int3 used as return address at the start of the region.
+  if (ptrace(PTRACE_POKEDATA, pid_, scratch_, 0xcc) == -1) {
+    std::cerr << "Failed to write the return trap into the scratch region\n";
+    allocator_.deallocate(scratch_);
+    scratch_ = 0;
+    return false;
+  }
+  return true;
+}
+}  // namespace nebugger
@@ -0,0 +1,44 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+namespace nebugger {
+class RemoteAllocator;
+
+/// Calls functions inside the stopped inferior following the System V AMD64
+/// calling convention.
+///
+/// The callee runs on a scratch stack that is allocated in the inferior on the
+/// first call and reused by all subsequent calls, so the live stack of the
+/// inferior is never touched. The first byte of the scratch region holds an
+/// `int3` that serves as the return address, so the callee traps straight back
+/// into the debugger when it returns.
+class FunctionCaller {
+ public:
+  FunctionCaller(pid_t pid, RemoteAllocator& allocator)
+      : pid_(pid), allocator_(allocator) {}
+
+  /// Call the function at `function_address` with up to six integer
+  /// arguments. On success the value of `rax` is stored in `return_value`.
+  /// The registers of the inferior are restored afterwards in either case.
+  bool call(std::intptr_t function_address, const std::vector<uint64_t>& args,
+            uint64_t& return_value);
+
+ private:
+  bool map_scratch();
+
+  pid_t pid_;
+  RemoteAllocator& allocator_;
+  // Start of the scratch region in the inferior, 0 if not yet mapped
+  std::intptr_t scratch_{0};
+};
+}  // namespace nebugger
@@ -0,0 +1,70 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "InstructionCache.hpp"
+
+#include <algorithm>
+
+#include "Memory.hpp"
+
+namespace nebugger {
+const Instruction* InstructionCache::find(const std::intptr_t address) {
+  const std::intptr_t page_address = address & ~(page_size - 1);
+  const auto cached = pages_.find(page_address);
+  Page* const page =
+      cached != pages_.end() ? cached->second.get() : load(page_address);
+  const auto offset = static_cast<std::size_t>(address - page_address);
+  if (page == nullptr or offset >= page->size) {
+    return nullptr;
+  }
+  if (page->index[offset] == 0) {
+    page->instructions.push_back(decode_instruction(
+        page->text.data() + offset, page->size - offset, address));
+    page->index[offset] = static_cast<uint16_t>(page->instructions.size());
+  }
+  return &page->instructions[page->index[offset] - 1u];
+}
+
+const uint8_t* InstructionCache::bytes(const Instruction& insn) const {
+  const std::intptr_t page_address = insn.address & ~(page_size - 1);
+  return pages_.at(page_address)->text.data() + (insn.address - page_address);
+}
+
+void InstructionCache::invalidate(const std::intptr_t address,
+                                  const std::size_t size) {
+  // The copy of a page includes the start of the next one.
+  const std::intptr_t first =
+      (address - static_cast<std::intptr_t>(max_instruction_length)) &
+      ~(page_size - 1);
+  const std::intptr_t last = address + static_cast<std::intptr_t>(size);
+  for (std::intptr_t page = first; page < last; page += page_size) {
+    pages_.erase(page);
+  }
+}
+
+InstructionCache::Page* InstructionCache::load(
+    const std::intptr_t page_address) {
+  auto page = std::make_unique<Page>();
+  page->size = page->text.size();
+  if (not memory_.read(page_address, page->text.data(), page->size)) {
+    // The next page may not be mapped.
+    page->size = page_size;
+    if (not memory_.read(page_address, page->text.data(), page->size)) {
+      return nullptr;
+    }
+  }
+  uint8_t* const text = page->text.data();
+  for (uint8_t* int3 = std::find(text, text + page->size, 0xcc);
+       int3 != text + page->size;
+       int3 = std::find(int3 + 1, text + page->size, 0xcc)) {
+    original_byte_(page_address + (int3 - text), *int3);
+  }
+  Page* const result = page.get();
+  pages_.emplace(page_address, std::move(page));
+  return result;
+}
+}  // namespace nebugger
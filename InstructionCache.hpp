@@ -0,0 +1,79 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+class InferiorMemory;
+
+/// Decoded instructions of the inferior by address.
+///
+/// The text of a page is read with one access the first time an instruction
+/// on it is needed, together with the bytes an instruction starting at its
+/// end may extend into. The int3s inserted by the debugger are replaced by
+/// the original bytes, so the cache holds the program's own code and stays
+/// valid when breakpoints are inserted or removed. Each page has a table
+/// from byte offset to the instruction decoded there, so repeated lookups
+/// while stepping cost neither a read nor a decode.
+///
+/// Writes to the text other than breakpoints, e.g. tracepoint patches, must
+/// be followed by `invalidate`.
+class InstructionCache {
+ public:
+  /// Sets `byte` to the original byte under a breakpoint of the debugger at
+  /// `address`, returns false if there is none.
+  using OriginalByte =
+      std::function<bool(std::intptr_t address, uint8_t& byte)>;
+
+  InstructionCache(InferiorMemory& memory, OriginalByte original_byte)
+      : memory_(memory), original_byte_(std::move(original_byte)) {}
+
+  /// The instruction at `address`, which is not `valid` if the bytes there
+  /// do not decode. Returns `nullptr` if the text cannot be read. The
+  /// pointer stays valid until the page is invalidated.
+  const Instruction* find(std::intptr_t address);
+
+  /// The original bytes of the instruction `insn` returned by `find`.
+  const uint8_t* bytes(const Instruction& insn) const;
+
+  /// Forget the instructions overlapping [address, address + size).
+  void invalidate(std::intptr_t address, std::size_t size);
+
+  /// Forget everything, e.g. after a library was unloaded.
+  void clear() { pages_.clear(); }
+
+ private:
+  static constexpr std::intptr_t page_size = 4096;
+  static constexpr std::size_t max_instruction_length = 15;
+
+  struct Page {
+    std::array<uint8_t, page_size + max_instruction_length> text{};
+    // Number of bytes of `text` that could be read
+    std::size_t size{0};
+    // One plus the index into `instructions` of the instruction decoded at
+    // each offset, 0 if none was decoded there yet
+    std::array<uint16_t, page_size> index{};
+    std::deque<Instruction> instructions{};
+  };
+
+  Page* load(std::intptr_t page_address);
+
+  InferiorMemory& memory_;
+  OriginalByte original_byte_;
+  std::unordered_map<std::intptr_t, std::unique_ptr<Page>> pages_{};
+};
+}  // namespace nebugger
@@ -0,0 +1,387 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Latency.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#include "Emulator.hpp"
+#include "InstructionCache.hpp"
+#include "Memory.hpp"
+#include "Registers.hpp"
+#include "Stats.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint8_t int3 = 0xcc;
+
+uint64_t now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+// Print `nanoseconds` in microseconds with a fixed width.
+void print_microseconds(std::ostream& os, const double nanoseconds) {
+  os << std::setw(12) << std::fixed << std::setprecision(2)
+     << nanoseconds / 1000.0;
+}
+
+// `nanoseconds` with three significant digits in a fitting unit.
+std::string duration_label(const uint64_t nanoseconds) {
+  std::ostringstream label{};
+  label << std::setprecision(3);
+  if (nanoseconds < 1000) {
+    label << nanoseconds << "ns";
+  } else if (nanoseconds < 1000000) {
+    label << nanoseconds / 1.0e3 << "us";
+  } else if (nanoseconds < 1000000000) {
+    label << nanoseconds / 1.0e6 << "ms";
+  } else {
+    label << nanoseconds / 1.0e9 << "s";
+  }
+  return label.str();
+}
+}  // namespace
+
+void LogHistogram::record(const uint64_t nanoseconds) noexcept {
+  ++counts_[index(nanoseconds)];
+  ++count_;
+  total_ += nanoseconds;
+  min_ = std::min(min_, nanoseconds);
+  max_ = std::max(max_, nanoseconds);
+}
+
+uint64_t LogHistogram::quantile(const double fraction) const noexcept {
+  const auto target = std::max(
+      uint64_t{1},
+      static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_))));
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < number_of_buckets; ++i) {
+    seen += counts_[i];
+    if (seen >= target) {
+      return std::min(highest_value(i), max_);
+    }
+  }
+  return max_;
+}
+
+void LogHistogram::print_distribution(std::ostream& os) const {
+  // The sub-buckets of a power of two are summed up, group `g` holds the
+  // values of bit length `g`.
+  std::array<uint64_t, 65> groups{};
+  for (std::size_t i = 0; i < number_of_buckets; ++i) {
+    const uint64_t value = highest_value(i);
+    const std::size_t group =
+        value == 0 ? 0
+                   : static_cast<std::size_t>(64 - __builtin_clzll(value));
+    groups[group] += counts_[i];
+  }
+  const auto first = static_cast<std::size_t>(
+      std::find_if(groups.begin(), groups.end(),
+                   [](const uint64_t count) { return count != 0; }) -
+      groups.begin());
+  const auto last = static_cast<std::size_t>(
+      groups.rend() -
+      std::find_if(groups.rbegin(), groups.rend(),
+                   [](const uint64_t count) { return count != 0; }));
+  const uint64_t most = *std::max_element(groups.begin(), groups.end());
+  constexpr uint64_t width = 40;
+  for (std::size_t group = first; group < last; ++group) {
+    const uint64_t low = group == 0 ? 0 : uint64_t{1} << (group - 1);
+    const std::string range =
+        group == 0 ? std::string{"0"}
+                   : '[' + duration_label(low) + ", " +
+                         duration_label(group == 64 ? max_ : 2 * low) + ')';
+    const uint64_t bar = (groups[group] * width + most - 1) / most;
+    os << "  " << std::left << std::setw(20) << range << std::right
+       << std::setw(10) << groups[group] << " |"
+       << std::string(static_cast<std::size_t>(bar), '@')
+       << std::string(static_cast<std::size_t>(width - bar), ' ') << "|\n";
+  }
+}
+
+std::size_t LogHistogram::index(const uint64_t value) noexcept {
+  if (value < sub_buckets) {
+    return static_cast<std::size_t>(value);
+  }
+  // The four bits below the highest set bit select the sub-bucket.
+  const auto top = static_cast<std::size_t>(63 - __builtin_clzll(value));
+  return (top - 3) * sub_buckets +
+         static_cast<std::size_t>((value >> (top - 4)) - sub_buckets);
+}
+
+uint64_t LogHistogram::highest_value(const std::size_t index) noexcept {
+  if (index < sub_buckets) {
+    return index;
+  }
+  const std::size_t top = index / sub_buckets + 3;
+  const uint64_t mantissa = sub_buckets + index % sub_buckets;
+  return ((mantissa + 1) << (top - 4)) - 1;
+}
+
+bool LatencyTracer::add(std::string name, const std::intptr_t address) {
+  for (const auto& function : functions_) {
+    if (function->name == name or function->address == address) {
+      std::cerr << "Function '" << function->name << "' is traced already\n";
+      return false;
+    }
+  }
+  auto function = std::make_unique<Function>(
+      Function{std::move(name), address, LogHistogram{}});
+  if (has_probe(address) or not insert(address, function.get())) {
+    std::cerr << "Failed to insert a breakpoint at 0x" << std::hex << address
+              << std::dec << '\n';
+    return false;
+  }
+  functions_.push_back(std::move(function));
+  return true;
+}
+
+bool LatencyTracer::remove(const std::string_view name) {
+  const auto it =
+      std::find_if(functions_.begin(), functions_.end(),
+                   [name](const auto& function) {
+                     return function->name == name;
+                   });
+  if (it == functions_.end()) {
+    std::cerr << "Function '" << name << "' is not traced\n";
+    return false;
+  }
+  Function* const function = it->get();
+  for (auto& [tid, frames] : frames_) {
+    frames.erase(std::remove_if(frames.begin(), frames.end(),
+                                [function](const Frame& frame) {
+                                  return frame.function == function;
+                                }),
+                 frames.end());
+  }
+  // Return addresses are shared between functions, they are removed with
+  // the last one.
+  for (auto probe = probes_.begin(); probe != probes_.end();) {
+    if (probe->second.function == function or
+        (functions_.size() == 1 and probe->second.function == nullptr)) {
+      if (not lifted_) {
+        memory_.write(probe->first, &probe->second.original_byte, 1);
+      }
+      probe = probes_.erase(probe);
+    } else {
+      ++probe;
+    }
+  }
+  functions_.erase(it);
+  return true;
+}
+
+void LatencyTracer::clear() {
+  for (const auto& function : functions_) {
+    function->histogram = LogHistogram{};
+  }
+  recorded_since_report_ = 0;
+}
+
+bool LatencyTracer::original_byte(const std::intptr_t address,
+                                  uint8_t& byte) const {
+  const auto probe = probes_.find(address);
+  if (lifted_ or probe == probes_.end()) {
+    return false;
+  }
+  byte = probe->second.original_byte;
+  return true;
+}
+
+std::vector<std::pair<std::intptr_t, uint8_t>>
+LatencyTracer::inserted_probes() const {
+  std::vector<std::pair<std::intptr_t, uint8_t>> inserted{};
+  if (not lifted_) {
+    for (const auto& [address, probe] : probes_) {
+      inserted.emplace_back(address, probe.original_byte);
+    }
+  }
+  return inserted;
+}
+
+bool LatencyTracer::handle_trap(const pid_t tid) {
+  if (lifted_ or probes_.empty()) {
+    return false;
+  }
+  user_regs_struct regs = get_registers(tid);
+  const auto address = static_cast<std::intptr_t>(regs.rip - 1);
+  const auto probe = probes_.find(address);
+  if (probe == probes_.end()) {
+    return false;
+  }
+  std::vector<Frame>& frames = frames_[tid];
+  if (Function* const function = probe->second.function) {
+    // Calls at or below this stack pointer are over, even if their return
+    // was not seen, e.g. because of a longjmp.
+    const uint64_t rsp = regs.rsp;
+    while (not frames.empty() and frames.back().rsp <= rsp) {
+      frames.pop_back();
+    }
+    uint64_t return_address = 0;
+    const bool timed =
+        memory_.read(static_cast<std::intptr_t>(rsp), &return_address,
+                     sizeof(return_address)) and
+        insert(static_cast<std::intptr_t>(return_address), nullptr);
+    step_over(tid, regs, address);
+    if (timed) {
+      frames.push_back({function, rsp, now()});
+    }
+    return true;
+  }
+  // The return popped the address the frame of the returning call points
+  // to.
+  const uint64_t end = now();
+  const uint64_t rsp = regs.rsp - 8;
+  while (not frames.empty() and frames.back().rsp < rsp) {
+    frames.pop_back();
+  }
+  if (not frames.empty() and frames.back().rsp == rsp) {
+    frames.back().function->histogram.record(end - frames.back().start);
+    frames.pop_back();
+    ++recorded_since_report_;
+  }
+  step_over(tid, regs, address);
+  return true;
+}
+
+bool LatencyTracer::remove_probes() {
+  if (probes_.empty()) {
+    return false;
+  }
+  lift();
+  probes_.clear();
+  lifted_ = false;
+  return true;
+}
+
+void LatencyTracer::lift() {
+  if (lifted_) {
+    return;
+  }
+  for (const auto& [address, probe] : probes_) {
+    memory_.write(address, &probe.original_byte, 1);
+  }
+  frames_.clear();
+  lifted_ = true;
+}
+
+void LatencyTracer::restore() {
+  if (not lifted_) {
+    return;
+  }
+  for (const auto& [address, probe] : probes_) {
+    memory_.write(address, &int3, 1);
+  }
+  lifted_ = false;
+}
+
+bool LatencyTracer::print(std::ostream& os, const std::string_view name) const {
+  const Function* selected = nullptr;
+  if (not name.empty()) {
+    const auto it =
+        std::find_if(functions_.begin(), functions_.end(),
+                     [name](const auto& function) {
+                       return function->name == name;
+                     });
+    if (it == functions_.end()) {
+      std::cerr << "Function '" << name << "' is not traced\n";
+      return false;
+    }
+    selected = it->get();
+  } else if (functions_.empty()) {
+    os << "No functions are traced\n";
+    return true;
+  }
+  const auto flags = os.flags();
+  os << std::left << std::setw(24) << "function" << std::right
+     << std::setw(10) << "calls" << std::setw(12) << "mean us"
+     << std::setw(12) << "p50 us" << std::setw(12) << "p90 us"
+     << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us"
+     << std::setw(12) << "max us" << '\n';
+  for (const auto& function : functions_) {
+    if (selected != nullptr and function.get() != selected) {
+      continue;
+    }
+    const LogHistogram& h = function->histogram;
+    os << std::left << std::setw(24) << function->name << std::right
+       << std::setw(10) << h.count();
+    print_microseconds(os, h.count() == 0
+                               ? 0.0
+                               : static_cast<double>(h.total()) /
+                                     static_cast<double>(h.count()));
+    for (const double fraction : {0.5, 0.9, 0.99, 0.999}) {
+      print_microseconds(os, static_cast<double>(h.quantile(fraction)));
+    }
+    print_microseconds(os, static_cast<double>(h.max()));
+    os << '\n';
+  }
+  os.flags(flags);
+  if (selected != nullptr and selected->histogram.count() != 0) {
+    selected->histogram.print_distribution(os);
+  }
+  return true;
+}
+
+bool LatencyTracer::report_due() noexcept {
+  if (report_interval_ == 0 or recorded_since_report_ == 0) {
+    return false;
+  }
+  const uint64_t time = now();
+  if (time - last_report_ < report_interval_) {
+    return false;
+  }
+  last_report_ = time;
+  recorded_since_report_ = 0;
+  return true;
+}
+
+void LatencyTracer::step_over(const pid_t tid, user_regs_struct& regs,
+                              const std::intptr_t address) {
+  regs.rip = static_cast<uint64_t>(address);
+  if (const Instruction* const insn = instructions_.find(address)) {
+    const LatencyTimer timer{Probe::Emulate};
+    if (emulate_instruction(*insn, instructions_.bytes(*insn), regs,
+                            memory_)) {
+      set_registers(tid, regs);
+      return;
+    }
+  }
+  set_registers(tid, regs);
+  const auto probe = probes_.find(address);
+  memory_.write(address, &probe->second.original_byte, 1);
+  int wait_status = 0;
+  if (timed_ptrace(Probe::PtraceStep, PTRACE_SINGLESTEP, tid, nullptr,
+                   nullptr) != -1) {
+    waitpid(tid, &wait_status, __WALL);
+  }
+  memory_.write(address, &int3, 1);
+}
+
+bool LatencyTracer::insert(const std::intptr_t address, Function* function) {
+  if (has_probe(address)) {
+    return probes_.at(address).function == function;
+  }
+  uint8_t original = 0;
+  if (not memory_.read(address, &original, 1) or original == int3 or
+      not memory_.write(address, &int3, 1)) {
+    return false;
+  }
+  probes_.emplace(address, Trap{original, function});
+  return true;
+}
+}  // namespace nebugger
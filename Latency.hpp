@@ -0,0 +1,171 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+class InferiorMemory;
+class InstructionCache;
+
+/// Histogram of durations in nanoseconds in the manner of HdrHistogram.
+///
+/// Each power of two is split into 16 linear sub-buckets, so any value is
+/// counted with a relative error below 1/16 in a fixed array of 976
+/// counters, and recording is a count of leading zeros and an increment.
+class LogHistogram {
+ public:
+  static constexpr std::size_t sub_buckets = 16;
+  static constexpr std::size_t number_of_buckets = 61 * sub_buckets;
+
+  void record(uint64_t nanoseconds) noexcept;
+
+  uint64_t count() const noexcept { return count_; }
+  uint64_t total() const noexcept { return total_; }
+  uint64_t min() const noexcept { return count_ == 0 ? 0 : min_; }
+  uint64_t max() const noexcept { return max_; }
+
+  /// The largest value counted in the bucket holding the `fraction`
+  /// quantile, e.g. 0.99.
+  uint64_t quantile(double fraction) const noexcept;
+
+  /// Print the distribution with one line per power of two.
+  void print_distribution(std::ostream& os) const;
+
+ private:
+  static std::size_t index(uint64_t value) noexcept;
+  static uint64_t highest_value(std::size_t index) noexcept;
+
+  std::array<uint64_t, number_of_buckets> counts_{};
+  uint64_t count_{0};
+  uint64_t total_{0};
+  uint64_t min_{~uint64_t{0}};
+  uint64_t max_{0};
+};
+
+/// Measures the latency of the calls of functions of a running process.
+///
+/// An int3 at the entry of a traced function pushes the time onto a shadow
+/// stack of the thread, together with the stack pointer, which points to
+/// the return address. An int3 planted at that return address pops the
+/// frame again and records the duration. Frames are matched by stack
+/// pointer, so recursive calls nest and the frames of calls left by a
+/// longjmp are dropped by the next probe hit at or above them on the stack.
+/// A traced function that tail-calls another one is not timed, its frame is
+/// replaced by that of the callee. Both int3s stay in place and are stepped
+/// over by emulating the instruction under them, so a call costs two stops
+/// of the process and the durations include about one of them.
+///
+/// Only the thread the process started with is traced, so calls can only be
+/// timed while the process has no other threads, which would hit the int3s.
+class LatencyTracer {
+ public:
+  LatencyTracer(InferiorMemory& memory, InstructionCache& instructions)
+      : memory_(memory), instructions_(instructions) {}
+  LatencyTracer(const LatencyTracer&) = delete;
+  LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+  /// Trace the calls of the function `name` at `address`.
+  bool add(std::string name, std::intptr_t address);
+
+  /// Stop tracing the function `name`, returns false if it is not traced.
+  bool remove(std::string_view name);
+
+  /// Forget the durations recorded so far.
+  void clear();
+
+  /// Remove all int3s for good, keeping the durations recorded so far, e.g.
+  /// because the process starts another thread. Returns false if there were
+  /// none.
+  bool remove_probes();
+
+  bool empty() const noexcept { return functions_.empty(); }
+
+  /// Whether the tracer has an int3 at `address`.
+  bool has_probe(const std::intptr_t address) const {
+    return probes_.count(address) != 0;
+  }
+
+  /// Sets `byte` to the original byte under an int3 of the tracer at
+  /// `address`, returns false if there is none.
+  bool original_byte(std::intptr_t address, uint8_t& byte) const;
+
+  /// The inserted int3s with their original bytes, empty while lifted.
+  std::vector<std::pair<std::intptr_t, uint8_t>> inserted_probes() const;
+
+  /// Handle the SIGTRAP thread `tid` is stopped with. Returns false if the
+  /// tracer did not cause it, otherwise the thread can be resumed.
+  bool handle_trap(pid_t tid);
+
+  /// Remove the int3s while the debugger steps or calls functions, the calls
+  /// made in the meantime are not timed, and insert them again.
+  void lift();
+  void restore();
+
+  /// Print the count, mean, percentiles and maximum of each traced function,
+  /// or only of `name` followed by its distribution.
+  bool print(std::ostream& os, std::string_view name = {}) const;
+
+  /// Print the table of all functions every `seconds` while the process
+  /// runs, see `report_due`. Zero turns this off.
+  void set_report_interval(const double seconds) noexcept {
+    report_interval_ = static_cast<uint64_t>(seconds * 1.0e9);
+  }
+
+  /// Whether calls were recorded since the last report and the report
+  /// interval has passed.
+  bool report_due() noexcept;
+
+ private:
+  struct Function {
+    std::string name;
+    std::intptr_t address;
+    LogHistogram histogram;
+  };
+
+  struct Trap {
+    uint8_t original_byte;
+    // The function whose entry this is, nullptr at return addresses
+    Function* function;
+  };
+
+  struct Frame {
+    Function* function;
+    // The stack pointer at the entry
+    uint64_t rsp;
+    uint64_t start;
+  };
+
+  // Set the program counter of `tid` to `address` and execute the original
+  // instruction at it
+  void step_over(pid_t tid, user_regs_struct& regs, std::intptr_t address);
+  bool insert(std::intptr_t address, Function* function);
+
+  InferiorMemory& memory_;
+  InstructionCache& instructions_;
+  std::vector<std::unique_ptr<Function>> functions_{};
+  std::unordered_map<std::intptr_t, Trap> probes_{};
+  // The calls in progress on each thread, innermost last
+  std::unordered_map<pid_t, std::vector<Frame>> frames_{};
+  bool lifted_{false};
+  uint64_t report_interval_{0};
+  uint64_t last_report_{0};
+  uint64_t recorded_since_report_{0};
+};
+}  // namespace nebugger
@@ -0,0 +1,364 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "LineTable.hpp"
+
+#include <algorithm>
+#include <elf.h>
+
+#include "DwarfReader.hpp"
+#include "Elf.hpp"
+
+namespace nebugger {
+namespace {
+// DWARF 5 line number header entry formats
+constexpr uint64_t DW_LNCT_path = 0x1;
+constexpr uint64_t DW_LNCT_directory_index = 0x2;
+
+constexpr uint64_t DW_FORM_block = 0x09;
+constexpr uint64_t DW_FORM_block1 = 0x0a;
+constexpr uint64_t DW_FORM_data1 = 0x0b;
+constexpr uint64_t DW_FORM_data2 = 0x05;
+constexpr uint64_t DW_FORM_data4 = 0x06;
+constexpr uint64_t DW_FORM_data8 = 0x07;
+constexpr uint64_t DW_FORM_data16 = 0x1e;
+constexpr uint64_t DW_FORM_string = 0x08;
+constexpr uint64_t DW_FORM_strp = 0x0e;
+constexpr uint64_t DW_FORM_line_strp = 0x1f;
+constexpr uint64_t DW_FORM_udata = 0x0f;
+
+// Standard and extended opcodes of the line number program
+enum : uint8_t {
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc,
+  DW_LNS_advance_line,
+  DW_LNS_set_file,
+  DW_LNS_set_column,
+  DW_LNS_negate_stmt,
+  DW_LNS_set_basic_block,
+  DW_LNS_const_add_pc,
+  DW_LNS_fixed_advance_pc,
+  DW_LNS_set_prologue_end,
+  DW_LNS_set_epilogue_begin,
+  DW_LNS_set_isa
+};
+enum : uint8_t {
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address,
+  DW_LNE_define_file,
+  DW_LNE_set_discriminator
+};
+
+const char* section_string(const ElfFile& elf, const char* const section_name,
+                           const uint64_t offset) {
+  const Elf64_Shdr* const section = elf.find_section(section_name);
+  if (section == nullptr or offset >= section->sh_size) {
+    return "";
+  }
+  return reinterpret_cast<const char*>(elf.section_data(*section)) + offset;
+}
+
+// Read a DWARF 5 directory or file name entry attribute. Strings are stored in
+// `string`, constants in `value`.
+void read_form(DwarfReader& reader, const uint64_t form, const bool is_64bit,
+               const ElfFile& elf, const char*& string, uint64_t& value) {
+  switch (form) {
+    case DW_FORM_string:
+      string = reader.read_string();
+      break;
+    case DW_FORM_line_strp:
+      string =
+          section_string(elf, ".debug_line_str", reader.read_offset(is_64bit));
+      break;
+    case DW_FORM_strp:
+      string = section_string(elf, ".debug_str", reader.read_offset(is_64bit));
+      break;
+    case DW_FORM_udata:
+      value = reader.read_uleb128();
+      break;
+    case DW_FORM_data1:
+      value = reader.read<uint8_t>();
+      break;
+    case DW_FORM_data2:
+      value = reader.read<uint16_t>();
+      break;
+    case DW_FORM_data4:
+      value = reader.read<uint32_t>();
+      break;
+    case DW_FORM_data8:
+      value = reader.read<uint64_t>();
+      break;
+    case DW_FORM_data16:
+      reader.skip(16);
+      break;
+    case DW_FORM_block:
+      reader.skip(reader.read_uleb128());
+      break;
+    case DW_FORM_block1:
+      reader.skip(reader.read<uint8_t>());
+      break;
+    default:
+      // Unknown form, give up on the rest of the header.
+      reader.skip(reader.remaining() + 1);
+  }
+}
+
+std::string join_path(const std::string& directory, const std::string& file) {
+  if (directory.empty() or (not file.empty() and file[0] == '/')) {
+    return file;
+  }
+  return directory + "/" + file;
+}
+}  // namespace
+
+LineTable::LineTable(const ElfFile& elf) {
+  const Elf64_Shdr* const section = elf.find_section(".debug_line");
+  if (section == nullptr) {
+    return;
+  }
+  const uint8_t* const begin = elf.section_data(*section);
+  const uint8_t* const end = begin + section->sh_size;
+  DwarfReader reader{begin, end};
+  while (not reader.at_end()) {
+    bool is_64bit = false;
+    const uint8_t* const unit_begin = reader.position();
+    const uint64_t length = reader.read_unit_length(is_64bit);
+    if (reader.overflow() or length > reader.remaining()) {
+      break;
+    }
+    const uint8_t* const unit_end = reader.position() + length;
+    read_unit(unit_begin, unit_end, elf);
+    reader.skip(length);
+  }
+
+  // Sort by address, placing the end of a sequence before a sequence starting
+  // at the same address.
+  std::stable_sort(rows_.begin(), rows_.end(),
+                   [](const LineRow& a, const LineRow& b) {
+                     return a.address < b.address or
+                            (a.address == b.address and a.end_sequence and
+                             not b.end_sequence);
+                   });
+}
+
+const LineRow* LineTable::find(const uint64_t address) const noexcept {
+  auto it = std::upper_bound(
+      rows_.begin(), rows_.end(), address,
+      [](const uint64_t a, const LineRow& row) { return a < row.address; });
+  if (it == rows_.begin()) {
+    return nullptr;
+  }
+  --it;
+  return it->end_sequence ? nullptr : &*it;
+}
+
+std::pair<uint64_t, uint64_t> LineTable::line_range(
+    const uint64_t address) const noexcept {
+  const LineRow* const row = find(address);
+  if (row == nullptr) {
+    return {0, 0};
+  }
+  auto index = static_cast<std::size_t>(row - rows_.data());
+  std::size_t first = index;
+  while (first > 0 and not rows_[first - 1].end_sequence and
+         rows_[first - 1].line == row->line and
+         rows_[first - 1].file == row->file) {
+    --first;
+  }
+  std::size_t last = index + 1;
+  while (last < rows_.size() and not rows_[last].end_sequence and
+         rows_[last].line == row->line and rows_[last].file == row->file) {
+    ++last;
+  }
+  const uint64_t end =
+      last < rows_.size() ? rows_[last].address : rows_.back().address;
+  return {rows_[first].address, end};
+}
+
+bool LineTable::is_statement_start(const uint64_t address) const noexcept {
+  auto it = std::lower_bound(
+      rows_.begin(), rows_.end(), address,
+      [](const LineRow& row, const uint64_t a) { return row.address < a; });
+  for (; it != rows_.end() and it->address == address; ++it) {
+    if (it->is_stmt and not it->end_sequence) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LineTable::read_unit(const uint8_t* const begin, const uint8_t* const end,
+                          const ElfFile& elf) {
+  DwarfReader reader{begin, end};
+  bool is_64bit = false;
+  reader.read_unit_length(is_64bit);
+  const auto version = reader.read<uint16_t>();
+  if (version < 2 or version > 5) {
+    return;
+  }
+  if (version >= 5) {
+    // address_size and segment_selector_size
+    reader.skip(2);
+  }
+  const uint64_t header_length = reader.read_offset(is_64bit);
+  const uint8_t* const program_begin = reader.position() + header_length;
+  const auto minimum_instruction_length = reader.read<uint8_t>();
+  if (version >= 4) {
+    // maximum_operations_per_instruction, only relevant for VLIW
+    reader.skip(1);
+  }
+  const bool default_is_stmt = reader.read<uint8_t>() != 0;
+  const auto line_base = reader.read<int8_t>();
+  const auto line_range = reader.read<uint8_t>();
+  const auto opcode_base = reader.read<uint8_t>();
+  std::vector<uint8_t> standard_opcode_lengths(opcode_base, 0);
+  for (std::size_t i = 1; i < opcode_base; ++i) {
+    standard_opcode_lengths[i] = reader.read<uint8_t>();
+  }
+  if (reader.overflow() or line_range == 0 or program_begin > end) {
+    return;
+  }
+
+  // File indices of this unit are mapped to indices into files_.
+  std::vector<uint32_t> file_indices{};
+  std::vector<std::string> directories{};
+  if (version >= 5) {
+    for (int table = 0; table < 2; ++table) {
+      const auto format_count = reader.read<uint8_t>();
+      std::vector<std::pair<uint64_t, uint64_t>> formats{};
+      for (std::size_t i = 0; i < format_count; ++i) {
+        const uint64_t content_type = reader.read_uleb128();
+        formats.emplace_back(content_type, reader.read_uleb128());
+      }
+      const uint64_t count = reader.read_uleb128();
+      for (uint64_t i = 0; i < count and not reader.overflow(); ++i) {
+        const char* path = "";
+        uint64_t directory = 0;
+        for (const auto& format : formats) {
+          const char* string = "";
+          uint64_t value = 0;
+          read_form(reader, format.second, is_64bit, elf, string, value);
+          if (format.first == DW_LNCT_path) {
+            path = string;
+          } else if (format.first == DW_LNCT_directory_index) {
+            directory = value;
+          }
+        }
+        if (table == 0) {
+          directories.emplace_back(path);
+        } else {
+          file_indices.push_back(static_cast<uint32_t>(files_.size()));
+          files_.push_back(join_path(
+              directory < directories.size() ? directories[directory] : "",
+              path));
+        }
+      }
+    }
+  } else {
+    // The compilation directory is implicitly entry 0.
+    directories.emplace_back("");
+    while (true) {
+      const char* const directory = reader.read_string();
+      if (*directory == '\0' or reader.overflow()) {
+        break;
+      }
+      directories.emplace_back(directory);
+    }
+    // File indices start at 1 before DWARF 5.
+    file_indices.push_back(static_cast<uint32_t>(files_.size()));
+    files_.emplace_back("");
+    while (true) {
+      const char* const file = reader.read_string();
+      if (*file == '\0' or reader.overflow()) {
+        break;
+      }
+      const uint64_t directory = reader.read_uleb128();
+      reader.read_uleb128();  // modification time
+      reader.read_uleb128();  // file length
+      file_indices.push_back(static_cast<uint32_t>(files_.size()));
+      files_.push_back(join_path(
+          directory < directories.size() ? directories[directory] : "", file));
+    }
+  }
+  if (file_indices.empty()) {
+    file_indices.push_back(static_cast<uint32_t>(files_.size()));
+    files_.emplace_back("");
+  }
+
+  // Run the line number program.
+  DwarfReader program{program_begin, end};
+  LineRow state{};
+  const auto reset = [&state, default_is_stmt]() {
+    state = LineRow{0, 1, 1, default_is_stmt, false};
+  };
+  const auto emit_row = [this, &state, &file_indices]() {
+    LineRow row = state;
+    row.file = file_indices[state.file < file_indices.size() ? state.file : 0];
+    rows_.push_back(row);
+  };
+  reset();
+  while (not program.at_end() and not program.overflow()) {
+    const auto opcode = program.read<uint8_t>();
+    if (opcode >= opcode_base) {
+      const unsigned adjusted = opcode - opcode_base;
+      state.address += (adjusted / line_range) * minimum_instruction_length;
+      state.line = static_cast<uint32_t>(
+          static_cast<int64_t>(state.line) + line_base +
+          static_cast<int64_t>(adjusted % line_range));
+      emit_row();
+      continue;
+    }
+    switch (opcode) {
+      case 0: {
+        const uint64_t length = program.read_uleb128();
+        const uint8_t* const next = program.position() + length;
+        const auto extended = program.read<uint8_t>();
+        if (extended == DW_LNE_end_sequence) {
+          state.end_sequence = true;
+          emit_row();
+          reset();
+        } else if (extended == DW_LNE_set_address) {
+          state.address = program.read<uint64_t>();
+        }
+        // define_file, set_discriminator and vendor extensions are skipped
+        if (length > 0) {
+          program.skip(static_cast<std::size_t>(next - program.position()));
+        }
+        break;
+      }
+      case DW_LNS_copy:
+        emit_row();
+        break;
+      case DW_LNS_advance_pc:
+        state.address += program.read_uleb128() * minimum_instruction_length;
+        break;
+      case DW_LNS_advance_line:
+        state.line = static_cast<uint32_t>(static_cast<int64_t>(state.line) +
+                                           program.read_sleb128());
+        break;
+      case DW_LNS_set_file:
+        state.file = static_cast<uint32_t>(program.read_uleb128());
+        break;
+      case DW_LNS_negate_stmt:
+        state.is_stmt = not state.is_stmt;
+        break;
+      case DW_LNS_const_add_pc:
+        state.address +=
+            ((255 - opcode_base) / line_range) * minimum_instruction_length;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        state.address += program.read<uint16_t>();
+        break;
+      default:
+        // Skip the ULEB128 operands of other standard opcodes.
+        for (std::size_t i = 0; i < standard_opcode_lengths[opcode]; ++i) {
+          program.read_uleb128();
+        }
+    }
+  }
+}
+}  // namespace nebugger
@@ -0,0 +1,62 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+class ElfFile;
+
+/// A row of the DWARF line number matrix.
+struct LineRow {
+  // Address relative to the load address
+  uint64_t address;
+  // Index into `LineTable::file_name`
+  uint32_t file;
+  uint32_t line;
+  bool is_stmt;
+  // Marks the first address after a contiguous sequence of instructions
+  bool end_sequence;
+};
+
+/// The line number information of all compilation units of an ELF file,
+/// decoded from `.debug_line` into a single table sorted by address.
+class LineTable {
+ public:
+  LineTable() = default;
+  explicit LineTable(const ElfFile& elf);
+
+  bool empty() const noexcept { return rows_.empty(); }
+
+  /// The row describing `address`, or `nullptr` if the address is not
+  /// covered by the line table.
+  const LineRow* find(uint64_t address) const noexcept;
+
+  /// The range [first, second) of addresses around `address` that belong to
+  /// the same source line without interruption. Returns an empty range if the
+  /// address is not covered.
+  std::pair<uint64_t, uint64_t> line_range(uint64_t address) const noexcept;
+
+  /// True if a new statement starts exactly at `address`.
+  bool is_statement_start(uint64_t address) const noexcept;
+
+  const std::string& file_name(const LineRow& row) const noexcept {
+    return files_[row.file];
+  }
+
+ private:
+  void read_unit(const uint8_t* begin, const uint8_t* end,
+                 const ElfFile& elf);
+
+  std::vector<LineRow> rows_{};
+  std::vector<std::string> files_{};
+};
+}  // namespace nebugger
@@ -0,0 +1,109 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "MachineInterface.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+
+namespace nebugger {
+namespace {
+void append_escaped(std::string& buffer, const std::string_view text) {
+  constexpr char hex_digits[] = "0123456789abcdef";
+  for (const char c : text) {
+    if (c == '"' or c == '\\') {
+      buffer += '\\';
+      buffer += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      buffer += "\\u00";
+      buffer += hex_digits[(c >> 4) & 0xf];
+      buffer += hex_digits[c & 0xf];
+    } else {
+      buffer += c;
+    }
+  }
+}
+
+template <typename T>
+void append_number(std::string& buffer, const T value, const int base) {
+  char digits[24];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), value,
+                                    base);
+  buffer.append(digits, result.ptr);
+}
+}  // namespace
+
+MiRecord& MiRecord::begin(const std::string_view type) {
+  buffer_.clear();
+  buffer_ += "{\"type\":\"";
+  append_escaped(buffer_, type);
+  buffer_ += '"';
+  return *this;
+}
+
+MiRecord& MiRecord::string(const std::string_view key,
+                           const std::string_view value) {
+  this->key(key);
+  buffer_ += '"';
+  append_escaped(buffer_, value);
+  buffer_ += '"';
+  return *this;
+}
+
+MiRecord& MiRecord::integer(const std::string_view key, const int64_t value) {
+  this->key(key);
+  append_number(buffer_, value, 10);
+  return *this;
+}
+
+MiRecord& MiRecord::address(const std::string_view key, const uint64_t value) {
+  this->key(key);
+  buffer_ += "\"0x";
+  append_number(buffer_, value, 16);
+  buffer_ += '"';
+  return *this;
+}
+
+MiRecord& MiRecord::boolean(const std::string_view key, const bool value) {
+  this->key(key);
+  buffer_ += value ? "true" : "false";
+  return *this;
+}
+
+const std::string& MiRecord::finish() {
+  buffer_ += "}\n";
+  return buffer_;
+}
+
+void MiRecord::key(const std::string_view key) {
+  buffer_ += ",\"";
+  append_escaped(buffer_, key);
+  buffer_ += "\":";
+}
+
+void MiStream::emit(MiRecord& record) const {
+  const std::string& line = record.finish();
+  if (fd_ == -1) {
+    return;
+  }
+  const char* data = line.data();
+  std::size_t remaining = line.size();
+  while (remaining > 0) {
+    const ssize_t written = ::write(fd_, data, remaining);
+    if (written == -1 and errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      // The frontend went away, there is nobody left to report this to.
+      return;
+    }
+    data += written;
+    remaining -= static_cast<std::size_t>(written);
+  }
+}
+}  // namespace nebugger
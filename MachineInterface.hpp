@@ -0,0 +1,68 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace nebugger {
+/// One record of the machine interface: a flat JSON object with a `type`
+/// member, built into a buffer that is reused from record to record.
+///
+/// \code
+/// record.begin("stopped").string("reason", "breakpoint-hit")
+///     .address("address", pc);
+/// \endcode
+class MiRecord {
+ public:
+  MiRecord() { buffer_.reserve(256); }
+
+  /// Discard the previous record and start a new one of type `type`.
+  MiRecord& begin(std::string_view type);
+
+  MiRecord& string(std::string_view key, std::string_view value);
+  MiRecord& integer(std::string_view key, int64_t value);
+  /// Add `value` as a hexadecimal string, since JSON numbers cannot hold
+  /// every 64-bit address exactly.
+  MiRecord& address(std::string_view key, uint64_t value);
+  MiRecord& boolean(std::string_view key, bool value);
+
+  /// Close the object and return the line, including its newline.
+  const std::string& finish();
+
+ private:
+  void key(std::string_view key);
+
+  std::string buffer_{};
+};
+
+/// Writes machine interface records as JSON lines to a file descriptor, one
+/// `write` per record so that a reader never sees partial records and the
+/// records of several threads are not interleaved.
+class MiStream {
+ public:
+  /// A disabled stream, records are built but not written.
+  MiStream() = default;
+  /// Write records to `fd`, which is not closed by the stream.
+  explicit MiStream(int fd) : fd_(fd) {}
+
+  bool enabled() const noexcept { return fd_ != -1; }
+
+  /// Start the record shared by the debugger thread.
+  MiRecord& record(const std::string_view type) { return record_.begin(type); }
+
+  /// Finish `record` and write it. May be called from any thread as long as
+  /// each thread uses its own record.
+  void emit(MiRecord& record) const;
+
+ private:
+  int fd_{-1};
+  MiRecord record_{};
+};
+}  // namespace nebugger
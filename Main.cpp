@@ -5,19 +5,63 @@
  * http://boost.org/LICENSE_1_0.txt)
  */
 
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
 #include <linenoise.h>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
+#include "CommandLine.hpp"
+#include "CoreFile.hpp"
+#include "Coverage.hpp"
 #include "Debugger.hpp"
+#include "GdbServer.hpp"
+#include "HeapTracker.hpp"
+#include "ProcessGroup.hpp"
+#include "Stats.hpp"
 
-int execute_debugee(const std::string& program_name) {
+namespace {
+const char* const usage =
+    "usage: ndbg [OPTIONS] PROGRAM [ARGS...]\n"
+    "options:\n"
+    "  --coverage              run PROGRAM to completion recording basic block\n"
+    "                          coverage instead of debugging it\n"
+    "  --coverage-output FILE  where to write the coverage report (default\n"
+    "                          ndbg-coverage.txt)\n"
+    "  --core FILE             inspect the ELF core file FILE of PROGRAM\n"
+    "                          instead of running it\n"
+    "  --gdbserver ADDRESS     serve PROGRAM to a GDB remote protocol client\n"
+    "                          on ADDRESS, [HOST]:PORT or unix:PATH\n"
+    "  --heap-profile          run PROGRAM to completion tracking its heap\n"
+    "                          allocations, reporting leaks and the top\n"
+    "                          allocation sites\n"
+    "  --heap-output FILE      where to write the heap report (default\n"
+    "                          ndbg-heap.txt)\n"
+    "  --processes N           debug N processes running PROGRAM at once,\n"
+    "                          commands apply to all of them unless prefixed\n"
+    "                          with @RANKS, e.g. @0-3,7 continue\n"
+    "  --stats                 print latency statistics of the debugger to\n"
+    "                          stderr on exit\n"
+    "  --mi-fd FD              also write machine interface records (JSON\n"
+    "                          lines) for results, stops and tracepoint hits\n"
+    "                          to the open file descriptor FD\n"
+    "  -x FILE                 run the commands in FILE (- for stdin) instead\n"
+    "                          of prompting, commands are also read from\n"
+    "                          stdin when it is not a terminal. Exits with 1\n"
+    "                          if a command fails and otherwise with the exit\n"
+    "                          code of PROGRAM, or 0 if it did not exit\n";
+}  // namespace
+
+int execute_debugee(const std::string& program_name, char* const* argv) {
   // Use ptrace with PTRACE_TRACEME to set the parent process (debugger) to be
   // allowed to trace.
   if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1) {
@@ -26,10 +70,9 @@ int execute_debugee(const std::string& program_name) {
         << errno << '\n';
     return -1;
   }
-  // Launch the program we were passed as a first argument on the forked
-  // process. nullptr is used to terminate the list of arguments passed to the
-  // child process.
-  if (execl(program_name.c_str(), program_name.c_str(), nullptr) == -1) {
+  // Launch the program we were passed on the forked process. `argv` holds the
+  // program name followed by its arguments and is terminated by nullptr.
+  if (execv(program_name.c_str(), argv) == -1) {
     std::cerr << "Failed launching the program '" << program_name
               << "' in the subprocess with errno: " << errno << '\n';
     return -1;
@@ -38,23 +81,148 @@ int execute_debugee(const std::string& program_name) {
 }
 
 int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    std::cerr << "Program name not specified.\n";
+  bool coverage = false;
+  std::string coverage_output{"ndbg-coverage.txt"};
+  bool heap_profile = false;
+  std::string heap_output{"ndbg-heap.txt"};
+  std::string core_name{};
+  std::string script_name{};
+  int mi_fd = -1;
+  std::string server_address{};
+  bool dump_stats = false;
+  std::size_t processes = 1;
+  int arg = 1;
+  for (; arg < argc and argv[arg][0] == '-'; ++arg) {
+    const std::string option{argv[arg]};
+    if (option == "--coverage") {
+      coverage = true;
+    } else if (option == "--coverage-output" and arg + 1 < argc) {
+      coverage_output = argv[++arg];
+    } else if (option == "--core" and arg + 1 < argc) {
+      core_name = argv[++arg];
+    } else if (option == "--gdbserver" and arg + 1 < argc) {
+      server_address = argv[++arg];
+    } else if (option == "--heap-profile") {
+      heap_profile = true;
+    } else if (option == "--heap-output" and arg + 1 < argc) {
+      heap_output = argv[++arg];
+    } else if (option == "--processes" and arg + 1 < argc) {
+      const std::string_view count{argv[++arg]};
+      if (not nebugger::parse_integer(count, processes) or processes == 0) {
+        std::cerr << "Invalid number of processes '" << count << "'\n";
+        return -1;
+      }
+    } else if (option == "--stats") {
+      dump_stats = true;
+    } else if (option == "--mi-fd" and arg + 1 < argc) {
+      mi_fd = std::atoi(argv[++arg]);
+      if (mi_fd < 0 or fcntl(mi_fd, F_GETFD) == -1) {
+        std::cerr << "Invalid machine interface file descriptor '"
+                  << argv[arg] << "'\n";
+        return -1;
+      }
+    } else if (option == "-x" and arg + 1 < argc) {
+      script_name = argv[++arg];
+    } else {
+      std::cerr << "Unknown option '" << option << "'.\n" << usage;
+      return -1;
+    }
+  }
+  if (arg >= argc) {
+    std::cerr << "Program name not specified.\n" << usage;
     return -1;
   }
 
-  auto program_name = argv[1];
+  auto program_name = argv[arg];
+  if (script_name.empty() and isatty(STDIN_FILENO) == 0) {
+    script_name = "-";
+  }
+  std::ifstream script_file{};
+  if (not script_name.empty() and script_name != "-") {
+    script_file.open(script_name);
+    if (not script_file) {
+      std::cerr << "Failed to open the script '" << script_name << "'\n";
+      return -1;
+    }
+  }
+  if (not script_name.empty()) {
+    // Nobody is watching the output as it happens, so let the streams buffer
+    // it instead of flushing on every line.
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+  }
+
+  if (not core_name.empty()) {
+    auto core = std::make_unique<nebugger::CoreFile>(core_name);
+    if (not core->is_valid()) {
+      return -1;
+    }
+    if (dump_stats) {
+      std::atexit([]() { nebugger::print_stats(std::cerr); });
+    }
+    nebugger::Debugger dbg{program_name, std::move(core), mi_fd};
+    if (script_name.empty()) {
+      dbg.run();
+      return 0;
+    }
+    return script_name == "-" ? dbg.run_script(std::cin, "<stdin>")
+                              : dbg.run_script(script_file, script_name);
+  }
+
+  if (processes > 1) {
+    if (dump_stats) {
+      std::atexit([]() { nebugger::print_stats(std::cerr); });
+    }
+    nebugger::ProcessGroup group{
+        std::vector<std::string>(argv + arg, argv + argc), processes};
+    if (script_name.empty()) {
+      group.run();
+      return 0;
+    }
+    return script_name == "-" ? group.run_script(std::cin, "<stdin>")
+                              : group.run_script(script_file, script_name);
+  }
 
   // fork() returns 0 in the child process and the PID of the child process on
   // the parent process.
   pid_t pid = fork();
+  if (pid >= 1 and dump_stats) {
+    std::atexit([]() { nebugger::print_stats(std::cerr); });
+  }
   if (pid == 0) {
     // Debuggee process
-    const auto result = execute_debugee(program_name);
+    const auto result = execute_debugee(program_name, argv + arg);
     return result;
+  } else if (pid >= 1 and coverage) {
+    nebugger::CoverageRecorder recorder{program_name, pid};
+    const int exit_status = recorder.run();
+    std::ofstream report{coverage_output};
+    recorder.write_report(report);
+    if (not report) {
+      std::cerr << "Failed to write the coverage report to '"
+                << coverage_output << "'\n";
+    }
+    return exit_status;
+  } else if (pid >= 1 and heap_profile) {
+    nebugger::HeapTracker tracker{program_name, pid};
+    const int exit_status = tracker.run();
+    std::ofstream report{heap_output};
+    tracker.write_report(report);
+    if (not report) {
+      std::cerr << "Failed to write the heap report to '" << heap_output
+                << "'\n";
+    }
+    return exit_status;
+  } else if (pid >= 1 and not server_address.empty()) {
+    nebugger::GdbServer server{pid};
+    return server.run(server_address);
+  } else if (pid >= 1 and not script_name.empty()) {
+    nebugger::Debugger dbg{program_name, pid, mi_fd};
+    return script_name == "-" ? dbg.run_script(std::cin, "<stdin>")
+                              : dbg.run_script(script_file, script_name);
   } else if (pid >= 1) {
     // Debugger process
-    nebugger::Debugger dbg{program_name, pid};
+    nebugger::Debugger dbg{program_name, pid, mi_fd};
     dbg.run();
   } else {
     std::cerr << "Failed to fork process for debugger.\n";
@@ -0,0 +1,127 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Memory.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace nebugger {
+InferiorMemory::~InferiorMemory() {
+  if (mem_fd_ != -1) {
+    close(mem_fd_);
+  }
+}
+
+bool InferiorMemory::read(const std::intptr_t address, void* const buffer,
+                          const std::size_t size, const Backend backend) {
+  auto* const out = static_cast<uint8_t*>(buffer);
+  switch (backend) {
+    case Backend::Ptrace: {
+      for (std::size_t offset = 0; offset < size; offset += sizeof(long)) {
+        errno = 0;
+        const long word = ptrace(PTRACE_PEEKDATA, pid_,
+                                 address + static_cast<std::intptr_t>(offset),
+                                 nullptr);
+        if (word == -1 and errno != 0) {
+          return false;
+        }
+        std::memcpy(out + offset, &word,
+                    std::min(sizeof(long), size - offset));
+      }
+      return true;
+    }
+    case Backend::ProcessVm: {
+      std::size_t done = 0;
+      while (done < size) {
+        iovec local{out + done, size - done};
+        iovec remote{reinterpret_cast<void*>(address + done), size - done};
+        const ssize_t result = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+        if (result <= 0) {
+          break;
+        }
+        done += static_cast<std::size_t>(result);
+      }
+      if (done == size) {
+        return true;
+      }
+      // Partial reads happen at pages without read permission, which
+      // /proc/PID/mem can still access.
+      return read(address + static_cast<std::intptr_t>(done), out + done,
+                  size - done, Backend::ProcMem);
+    }
+    case Backend::ProcMem: {
+      if (not open_proc_mem()) {
+        return false;
+      }
+      std::size_t done = 0;
+      while (done < size) {
+        const ssize_t result =
+            pread(mem_fd_, out + done, size - done,
+                  static_cast<off_t>(address + static_cast<off_t>(done)));
+        if (result <= 0) {
+          return false;
+        }
+        done += static_cast<std::size_t>(result);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool InferiorMemory::write(const std::intptr_t address,
+                           const void* const buffer, const std::size_t size) {
+  if (not open_proc_mem()) {
+    return false;
+  }
+  const auto* const in = static_cast<const uint8_t*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t result =
+        pwrite(mem_fd_, in + done, size - done,
+               static_cast<off_t>(address + static_cast<off_t>(done)));
+    if (result <= 0) {
+      return false;
+    }
+    done += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+bool InferiorMemory::read_as_inferior(const std::intptr_t address,
+                                      void* const buffer,
+                                      const std::size_t size) {
+  iovec local{buffer, size};
+  iovec remote{reinterpret_cast<void*>(address), size};
+  return process_vm_readv(pid_, &local, 1, &remote, 1, 0) ==
+         static_cast<ssize_t>(size);
+}
+
+bool InferiorMemory::write_as_inferior(const std::intptr_t address,
+                                       const void* const buffer,
+                                       const std::size_t size) {
+  iovec local{const_cast<void*>(buffer), size};
+  iovec remote{reinterpret_cast<void*>(address), size};
+  return process_vm_writev(pid_, &local, 1, &remote, 1, 0) ==
+         static_cast<ssize_t>(size);
+}
+
+bool InferiorMemory::open_proc_mem() {
+  if (mem_fd_ == -1) {
+    const std::string path = "/proc/" + std::to_string(pid_) + "/mem";
+    mem_fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  }
+  return mem_fd_ != -1;
+}
+}  // namespace nebugger
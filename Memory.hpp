@@ -0,0 +1,61 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace nebugger {
+/// Bulk access to the memory of the inferior.
+///
+/// Reading and writing one word at a time with `PTRACE_PEEKDATA` and
+/// `PTRACE_POKEDATA` costs a system call per eight bytes. This class instead
+/// moves whole blocks with a single system call. Writes go through
+/// `/proc/PID/mem`, which, like ptrace, can write to read-only text pages.
+class InferiorMemory {
+ public:
+  /// The mechanism used to read memory.
+  enum class Backend {
+    // PTRACE_PEEKDATA, one system call per word
+    Ptrace,
+    // process_vm_readv, fails on pages without read permission
+    ProcessVm,
+    // pread on /proc/PID/mem
+    ProcMem
+  };
+
+  explicit InferiorMemory(pid_t pid) : pid_(pid) {}
+  InferiorMemory(const InferiorMemory&) = delete;
+  InferiorMemory& operator=(const InferiorMemory&) = delete;
+  ~InferiorMemory();
+
+  /// Read `size` bytes at `address` into `buffer`. If `backend` is
+  /// `ProcessVm` and the read fails, it is retried through `/proc/PID/mem`.
+  bool read(std::intptr_t address, void* buffer, std::size_t size,
+            Backend backend = Backend::ProcessVm);
+
+  /// Write `size` bytes from `buffer` to `address`.
+  bool write(std::intptr_t address, const void* buffer, std::size_t size);
+
+  /// Access memory with the permissions of the inferior itself, failing on
+  /// pages it could not read or write, where `read` and `write` force the
+  /// access. Used to execute instructions on behalf of the inferior.
+  bool read_as_inferior(std::intptr_t address, void* buffer,
+                        std::size_t size);
+  bool write_as_inferior(std::intptr_t address, const void* buffer,
+                         std::size_t size);
+
+ private:
+  bool open_proc_mem();
+
+  pid_t pid_;
+  // File descriptor of /proc/PID/mem, opened on first use
+  int mem_fd_{-1};
+};
+}  // namespace nebugger
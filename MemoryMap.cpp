@@ -0,0 +1,148 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "MemoryMap.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+namespace nebugger {
+std::vector<MemoryRegion> read_memory_map(const pid_t pid) {
+  std::vector<MemoryRegion> regions{};
+  const std::string maps_path = "/proc/" + std::to_string(pid) + "/maps";
+  FILE* const maps = std::fopen(maps_path.c_str(), "r");
+  if (maps == nullptr) {
+    std::cerr << "Failed to open '" << maps_path << "'\n";
+    return regions;
+  }
+  char line[PATH_MAX + 128];
+  while (std::fgets(line, sizeof(line), maps) != nullptr) {
+    unsigned long start = 0;
+    unsigned long end = 0;
+    unsigned long offset = 0;
+    char permissions[5] = {};
+    int path_position = 0;
+    if (std::sscanf(line, "%lx-%lx %4s %lx %*s %*s %n", &start, &end,
+                    permissions, &offset, &path_position) < 4) {
+      continue;
+    }
+    std::string path{line + path_position};
+    if (not path.empty() and path.back() == '\n') {
+      path.pop_back();
+    }
+    regions.push_back(MemoryRegion{
+        static_cast<std::intptr_t>(start), static_cast<std::intptr_t>(end),
+        permissions[0] == 'r', permissions[1] == 'w', permissions[2] == 'x',
+        permissions[3] == 's', offset, std::move(path)});
+  }
+  std::fclose(maps);
+  return regions;
+}
+
+std::intptr_t find_load_address(const pid_t pid, const std::string& path) {
+  char resolved[PATH_MAX];
+  const std::string canonical_path =
+      realpath(path.c_str(), resolved) == nullptr ? path : resolved;
+  for (const auto& region : read_memory_map(pid)) {
+    if (region.offset == 0 and region.path == canonical_path) {
+      return region.start;
+    }
+  }
+  return 0;
+}
+
+std::string_view memory_kind_name(const MemoryKind kind) {
+  switch (kind) {
+    case MemoryKind::Unmapped:
+      return "unmapped";
+    case MemoryKind::Text:
+      return "text";
+    case MemoryKind::Data:
+      return "data";
+    case MemoryKind::Heap:
+      return "heap";
+    case MemoryKind::Stack:
+      return "stack";
+    case MemoryKind::Anonymous:
+      return "anonymous";
+  }
+  return "unknown";
+}
+
+const MemoryRegion* MemoryMapIndex::find(const std::intptr_t address) {
+  const std::vector<MemoryRegion>& map = regions();
+  // The last region starting at or before the address
+  const auto after = std::upper_bound(
+      map.begin(), map.end(), address,
+      [](const std::intptr_t value, const MemoryRegion& region) {
+        return value < region.start;
+      });
+  if (after == map.begin() or std::prev(after)->end <= address) {
+    return nullptr;
+  }
+  return &*std::prev(after);
+}
+
+bool MemoryMapIndex::contains(const std::intptr_t address,
+                              const std::size_t size) {
+  const std::intptr_t end = address + static_cast<std::intptr_t>(size);
+  if (end < address) {
+    return false;
+  }
+  const MemoryRegion* region = find(address);
+  if (region == nullptr) {
+    return false;
+  }
+  for (; region->end < end; ++region) {
+    if (region + 1 == regions_.data() + regions_.size() or
+        region[1].start != region->end) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MemoryKind MemoryMapIndex::classify(const std::intptr_t address) {
+  const MemoryRegion* const region = find(address);
+  if (region == nullptr) {
+    return MemoryKind::Unmapped;
+  }
+  if (region->path == "[heap]") {
+    return MemoryKind::Heap;
+  }
+  if (region->path.compare(0, 6, "[stack") == 0) {
+    return MemoryKind::Stack;
+  }
+  if (region->executable) {
+    return MemoryKind::Text;
+  }
+  if (region->path.empty() or region->path.front() == '[') {
+    return MemoryKind::Anonymous;
+  }
+  return MemoryKind::Data;
+}
+
+const std::vector<MemoryRegion>& MemoryMapIndex::regions() {
+  if (stale_) {
+    regions_ = read_memory_map(pid_);
+    // The legacy vsyscall page is at the top of the address space, whose
+    // addresses are negative as std::intptr_t and would break the order.
+    regions_.erase(std::remove_if(regions_.begin(), regions_.end(),
+                                  [](const MemoryRegion& region) {
+                                    return region.start < 0;
+                                  }),
+                   regions_.end());
+    stale_ = false;
+  }
+  return regions_;
+}
+}  // namespace nebugger
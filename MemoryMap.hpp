@@ -0,0 +1,79 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace nebugger {
+/// A single line of `/proc/PID/maps`.
+struct MemoryRegion {
+  std::intptr_t start;
+  // One past the last address of the region
+  std::intptr_t end;
+  bool readable;
+  bool writable;
+  bool executable;
+  bool shared;
+  uint64_t offset;
+  std::string path;
+};
+
+/// Parse `/proc/PID/maps` of the process `pid`. The regions are sorted by
+/// address.
+std::vector<MemoryRegion> read_memory_map(const pid_t pid);
+
+/// The address at which the file `path` is loaded in the process `pid`, i.e.
+/// the start of its mapping with file offset zero. Returns 0 if the file is not
+/// mapped.
+std::intptr_t find_load_address(const pid_t pid, const std::string& path);
+
+/// What an address of a process points into.
+enum class MemoryKind { Unmapped, Text, Data, Heap, Stack, Anonymous };
+
+/// Name of `kind`, e.g. "heap".
+std::string_view memory_kind_name(MemoryKind kind);
+
+/// The mappings of a process, for checking and classifying addresses without
+/// a system call per address.
+///
+/// Mappings never overlap, so the regions sorted by address form an interval
+/// index: a binary search over their starts finds the one holding an address
+/// in O(log n). `/proc/PID/maps` is only read again on the first lookup after
+/// `invalidate`, which must be called whenever the process may have mapped,
+/// unmapped or protected memory, i.e. after it ran.
+class MemoryMapIndex {
+ public:
+  explicit MemoryMapIndex(const pid_t pid) : pid_(pid) {}
+
+  /// The mapping holding `address`, nullptr if it is not mapped.
+  const MemoryRegion* find(std::intptr_t address);
+
+  /// Whether all `size` bytes at `address` are mapped, possibly by adjacent
+  /// mappings.
+  bool contains(std::intptr_t address, std::size_t size);
+
+  /// What `address` points into.
+  MemoryKind classify(std::intptr_t address);
+
+  /// Read the map again on the next lookup.
+  void invalidate() noexcept { stale_ = true; }
+
+  /// The mappings sorted by address.
+  const std::vector<MemoryRegion>& regions();
+
+ private:
+  pid_t pid_;
+  std::vector<MemoryRegion> regions_{};
+  bool stale_{true};
+};
+}  // namespace nebugger
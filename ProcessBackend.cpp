@@ -0,0 +1,25 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "ProcessBackend.hpp"
+
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+#include "Registers.hpp"
+
+namespace nebugger {
+bool LiveProcess::read_memory(const std::intptr_t address, void* const buffer,
+                              const std::size_t size) {
+  return memory_.read(address, buffer, size);
+}
+
+user_regs_struct LiveProcess::registers() { return get_registers(pid_); }
+
+std::intptr_t LiveProcess::load_address(const std::string& path) {
+  return find_load_address(pid_, path);
+}
+}  // namespace nebugger
@@ -0,0 +1,65 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <sys/user.h>
+
+namespace nebugger {
+class InferiorMemory;
+
+/// The target whose memory and registers the debugger inspects, either a
+/// live process or a core file.
+///
+/// Only inspection goes through the backend. Running, stepping and modifying
+/// the target need a live process and are done with ptrace directly.
+class ProcessBackend {
+ public:
+  ProcessBackend() = default;
+  ProcessBackend(const ProcessBackend&) = delete;
+  ProcessBackend& operator=(const ProcessBackend&) = delete;
+  virtual ~ProcessBackend() = default;
+
+  /// False for core files, which can only be inspected.
+  virtual bool is_live() const noexcept = 0;
+
+  virtual pid_t pid() const noexcept = 0;
+
+  /// Read `size` bytes at `address` into `buffer`, returns false if any of
+  /// them cannot be read.
+  virtual bool read_memory(std::intptr_t address, void* buffer,
+                           std::size_t size) = 0;
+
+  /// The general purpose registers of the (stopped) thread.
+  virtual user_regs_struct registers() = 0;
+
+  /// The address the file at `path` is mapped at, 0 if it is not mapped.
+  virtual std::intptr_t load_address(const std::string& path) = 0;
+};
+
+/// A process being traced by the debugger.
+class LiveProcess final : public ProcessBackend {
+ public:
+  LiveProcess(const pid_t pid, InferiorMemory& memory)
+      : pid_(pid), memory_(memory) {}
+
+  bool is_live() const noexcept override { return true; }
+  pid_t pid() const noexcept override { return pid_; }
+  bool read_memory(std::intptr_t address, void* buffer,
+                   std::size_t size) override;
+  user_regs_struct registers() override;
+  std::intptr_t load_address(const std::string& path) override;
+
+ private:
+  pid_t pid_;
+  InferiorMemory& memory_;
+};
+}  // namespace nebugger
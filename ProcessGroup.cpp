@@ -0,0 +1,329 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "ProcessGroup.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sys/personality.h>
+#include <sys/ptrace.h>
+#include <unistd.h>
+#include <utility>
+
+#include "CommandLine.hpp"
+#include "Linenoise/linenoise.h"
+
+namespace nebugger {
+namespace {
+// Parse a rank list like `0-3,7` into `ranks`.
+bool parse_ranks(std::string_view list, const std::size_t size,
+                 std::vector<std::size_t>& ranks) {
+  while (not list.empty()) {
+    const auto comma = list.find(',');
+    const std::string_view range = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view{}
+                                           : list.substr(comma + 1);
+    const auto dash = range.find('-');
+    std::size_t first = 0;
+    std::size_t last = 0;
+    if (not parse_integer(range.substr(0, dash), first) or
+        (dash != std::string_view::npos and
+         not parse_integer(range.substr(dash + 1), last))) {
+      return false;
+    }
+    last = dash == std::string_view::npos ? first : last;
+    if (first > last or last >= size) {
+      return false;
+    }
+    for (std::size_t rank = first; rank <= last; ++rank) {
+      ranks.push_back(rank);
+    }
+  }
+  std::sort(ranks.begin(), ranks.end());
+  ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+  return not ranks.empty();
+}
+
+// Write sorted `ranks` as a rank list like `0-3,7`.
+void print_ranks(std::ostream& os, const std::vector<std::size_t>& ranks) {
+  for (std::size_t i = 0; i < ranks.size();) {
+    std::size_t j = i;
+    while (j + 1 < ranks.size() and ranks[j + 1] == ranks[j] + 1) {
+      ++j;
+    }
+    os << (i == 0 ? "" : ",") << ranks[i];
+    if (j > i) {
+      os << '-' << ranks[j];
+    }
+    i = j + 1;
+  }
+}
+
+const char* const group_help =
+    "status (where every process is stopped)\n"
+    "@RANKS COMMAND (run COMMAND only for RANKS, e.g. @0-3,7)\n";
+}  // namespace
+
+ProcessGroup::ProcessGroup(std::vector<std::string> arguments,
+                           const std::size_t size)
+    : arguments_(std::move(arguments)),
+      program_(std::make_shared<const ProgramIndex>(arguments_[0])) {
+  for (std::size_t rank = 0; rank < size; ++rank) {
+    members_.push_back(std::make_unique<Member>());
+    members_.back()->rank = rank;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  busy_ = size;
+  for (auto& member : members_) {
+    member->thread = std::thread([this, &member]() { worker(*member); });
+  }
+  wait_for_workers(lock);
+}
+
+ProcessGroup::~ProcessGroup() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_posted_.notify_all();
+  for (auto& member : members_) {
+    member->thread.join();
+  }
+}
+
+pid_t ProcessGroup::launch(const std::size_t rank) {
+  // Only async-signal-safe functions may be called in the child of a
+  // multithreaded process, so everything it needs is prepared here.
+  std::vector<char*> argv{};
+  for (std::string& argument : arguments_) {
+    argv.push_back(argument.data());
+  }
+  argv.push_back(nullptr);
+  std::string rank_variable = "NEBUGGER_RANK=" + std::to_string(rank);
+  std::string size_variable =
+      "NEBUGGER_SIZE=" + std::to_string(members_.size());
+  std::vector<char*> environment{};
+  for (char** variable = environ; *variable != nullptr; ++variable) {
+    if (std::strncmp(*variable, "NEBUGGER_RANK=", 14) != 0 and
+        std::strncmp(*variable, "NEBUGGER_SIZE=", 14) != 0) {
+      environment.push_back(*variable);
+    }
+  }
+  environment.push_back(rank_variable.data());
+  environment.push_back(size_variable.data());
+  environment.push_back(nullptr);
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    personality(ADDR_NO_RANDOMIZE);
+    if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1) {
+      _exit(126);
+    }
+    execve(argv[0], argv.data(), environment.data());
+    _exit(127);
+  }
+  if (pid == -1) {
+    std::cerr << "Failed to fork process for rank " << rank
+              << " with errno: " << errno << '\n';
+  }
+  return pid;
+}
+
+void ProcessGroup::worker(Member& member) {
+  // This thread starts the process and therefore is the only one that may
+  // trace it.
+  const pid_t pid = launch(member.rank);
+  if (pid > 0) {
+    member.debugger =
+        std::make_unique<Debugger>(program_, pid, member.output);
+    member.debugger->wait_for_start();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  member.result = pid > 0;
+  while (true) {
+    --busy_;
+    task_done_.notify_all();
+    task_posted_.wait(lock,
+                      [this, &member]() { return stopping_ or member.task; });
+    if (not member.task) {
+      break;
+    }
+    const Task task = std::move(member.task);
+    member.task = nullptr;
+    lock.unlock();
+    bool result = false;
+    if (member.debugger != nullptr) {
+      try {
+        result = task(*member.debugger, member.output);
+      } catch (const std::exception& e) {
+        member.output << e.what() << '\n';
+      }
+    }
+    lock.lock();
+    member.result = result;
+  }
+  lock.unlock();
+  if (member.debugger != nullptr) {
+    member.debugger->kill_inferior();
+  }
+}
+
+void ProcessGroup::wait_for_workers(std::unique_lock<std::mutex>& lock) {
+  task_done_.wait(lock, [this]() { return busy_ == 0; });
+}
+
+bool ProcessGroup::run_on(const std::vector<std::size_t>& ranks,
+                          const Task& task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const std::size_t rank : ranks) {
+    Member& member = *members_[rank];
+    member.output.str({});
+    member.task = task;
+  }
+  busy_ = ranks.size();
+  task_posted_.notify_all();
+  wait_for_workers(lock);
+  return std::all_of(ranks.begin(), ranks.end(), [this](const std::size_t r) {
+    return members_[r]->result;
+  });
+}
+
+void ProcessGroup::print_condensed(const std::vector<std::size_t>& ranks) {
+  // Distinct outputs in the order of the first rank producing them
+  std::vector<std::pair<std::string, std::vector<std::size_t>>> outputs{};
+  for (const std::size_t rank : ranks) {
+    std::string output = members_[rank]->output.str();
+    if (output.empty()) {
+      continue;
+    }
+    const auto same = std::find_if(
+        outputs.begin(), outputs.end(),
+        [&output](const auto& entry) { return entry.first == output; });
+    if (same != outputs.end()) {
+      same->second.push_back(rank);
+    } else {
+      outputs.emplace_back(std::move(output), std::vector<std::size_t>{rank});
+    }
+  }
+  for (const auto& [output, output_ranks] : outputs) {
+    std::cout << '[';
+    print_ranks(std::cout, output_ranks);
+    const bool one_line = output.find('\n') == output.size() - 1;
+    std::cout << (one_line ? "] " : "]\n") << output;
+    if (output.back() != '\n') {
+      std::cout << '\n';
+    }
+  }
+}
+
+bool ProcessGroup::handle_line(const std::string_view line) {
+  const CommandArgs args{line};
+  if (args.empty()) {
+    return true;
+  }
+  std::vector<std::size_t> ranks{};
+  std::string_view command = line;
+  if (args[0][0] == '@') {
+    if (not parse_ranks(args[0].substr(1), members_.size(), ranks)) {
+      std::cerr << "Invalid ranks '" << args[0].substr(1) << "', expected "
+                << "e.g. @0-3,7 with ranks below " << members_.size()
+                << ".\n";
+      return false;
+    }
+    command = args.rest(1);
+    if (command.empty()) {
+      std::cerr << "Missing command after '" << args[0] << "'.\n";
+      return false;
+    }
+  } else {
+    for (std::size_t rank = 0; rank < members_.size(); ++rank) {
+      ranks.push_back(rank);
+    }
+  }
+
+  const CommandArgs command_args{command};
+  bool succeeded = false;
+  if (command_args[0] == "status") {
+    succeeded = run_on(ranks, [](Debugger& debugger, std::ostream& output) {
+      debugger.print_state(output);
+      return true;
+    });
+  } else {
+    // Exited processes cannot carry out any command.
+    ranks.erase(std::remove_if(ranks.begin(), ranks.end(),
+                               [this](const std::size_t rank) {
+                                 const Debugger* const debugger =
+                                     members_[rank]->debugger.get();
+                                 return debugger == nullptr or
+                                        debugger->exit_code() != -1;
+                               }),
+                ranks.end());
+    if (ranks.empty()) {
+      std::cerr << "None of the processes is alive.\n";
+      return false;
+    }
+    if (command_args[0] == "help") {
+      std::cout << group_help;
+    }
+    const std::string command_line{command};
+    succeeded = run_on(
+        ranks, [&command_line](Debugger& debugger, std::ostream& /*output*/) {
+          return debugger.handle_command(command_line);
+        });
+  }
+  print_condensed(ranks);
+  std::cout.flush();
+  return succeeded;
+}
+
+void ProcessGroup::run() {
+  std::vector<std::size_t> all(members_.size());
+  for (std::size_t rank = 0; rank < all.size(); ++rank) {
+    all[rank] = rank;
+  }
+  print_condensed(all);
+  char* line = nullptr;
+  while ((line = linenoise("dbg> ")) != nullptr) {
+    handle_line(line);
+    linenoiseHistoryAdd(line);
+    linenoiseFree(line);
+  }
+}
+
+int ProcessGroup::run_script(std::istream& script, const std::string& name) {
+  std::vector<std::size_t> all(members_.size());
+  for (std::size_t rank = 0; rank < all.size(); ++rank) {
+    all[rank] = rank;
+  }
+  print_condensed(all);
+  std::string line{};
+  size_t line_number = 0;
+  while (std::getline(script, line)) {
+    ++line_number;
+    if (not line.empty() and line.back() == '\r') {
+      line.pop_back();
+    }
+    const auto first = line.find_first_not_of(" \t");
+    if (first == std::string::npos or line[first] == '#') {
+      continue;
+    }
+    if (not handle_line(line)) {
+      std::cerr << name << ':' << line_number << ": command failed: " << line
+                << '\n';
+      return 1;
+    }
+  }
+  int status = 0;
+  for (const auto& member : members_) {
+    if (member->debugger != nullptr) {
+      status = std::max(status, member->debugger->exit_code());
+    }
+  }
+  return status;
+}
+}  // namespace nebugger
@@ -0,0 +1,93 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#include "Debugger.hpp"
+
+namespace nebugger {
+/// Debugs several processes running the same program, e.g. the ranks of an
+/// MPI job, from one debugger.
+///
+/// Every process has its own `Debugger` and a worker thread that started it
+/// and is therefore its tracer, since the kernel only accepts ptrace requests
+/// from the tracing thread. Commands are broadcast to all processes, or to
+/// the ones selected with an `@RANKS` prefix, and carried out on the workers
+/// in parallel. This also lets processes that wait on each other run at the
+/// same time. The outputs are then printed condensed, once for each set of
+/// processes that produced the same output. The symbols and line table of
+/// the program are loaded once and shared by all processes, and address
+/// space randomization is disabled so that their addresses agree.
+///
+/// Each process gets its rank and the number of processes in the
+/// `NEBUGGER_RANK` and `NEBUGGER_SIZE` environment variables.
+class ProcessGroup {
+ public:
+  /// `arguments` holds the program name followed by its arguments.
+  ProcessGroup(std::vector<std::string> arguments, std::size_t size);
+  ProcessGroup(const ProcessGroup&) = delete;
+  ProcessGroup& operator=(const ProcessGroup&) = delete;
+  /// Kills the processes that are still alive.
+  ~ProcessGroup();
+
+  /// Run the debugger waiting on user input.
+  void run();
+
+  /// Run the commands read from `script`, see `Debugger::run_script`.
+  ///
+  /// Returns 1 if a command failed for any process, otherwise the largest
+  /// exit code of the processes that exited or 0.
+  int run_script(std::istream& script, const std::string& name);
+
+ private:
+  using Task =
+      std::function<bool(Debugger& debugger, std::ostream& output)>;
+
+  struct Member {
+    std::size_t rank{0};
+    std::thread thread{};
+    std::unique_ptr<Debugger> debugger{};
+    // Output of the current task, only touched by the worker while it runs
+    std::ostringstream output{};
+    // Guarded by ProcessGroup::mutex_
+    Task task{};
+    bool result{false};
+  };
+
+  void worker(Member& member);
+  pid_t launch(std::size_t rank);
+  // Wait until all workers finished their tasks
+  void wait_for_workers(std::unique_lock<std::mutex>& lock);
+  bool run_on(const std::vector<std::size_t>& ranks, const Task& task);
+  bool handle_line(std::string_view line);
+  void print_condensed(const std::vector<std::size_t>& ranks);
+
+  std::vector<std::string> arguments_;
+  std::shared_ptr<const ProgramIndex> program_;
+  std::vector<std::unique_ptr<Member>> members_{};
+  std::mutex mutex_{};
+  std::condition_variable task_posted_{};
+  std::condition_variable task_done_{};
+  // Number of workers still busy, guarded by mutex_
+  std::size_t busy_{0};
+  bool stopping_{false};
+};
+}  // namespace nebugger
@@ -14,11 +14,13 @@
 #include <sys/types.h>
 #include <sys/user.h>
 
+#include "Stats.hpp"
+
 namespace nebugger {
 namespace {
-template <class T>
-decltype(auto) map_register_to_sys(user_regs_struct& regs_struct,
-                                   const Register reg, const T invokable) {
+template <class RegsStruct, class T>
+decltype(auto) map_register_to_sys(RegsStruct& regs_struct, const Register reg,
+                                   const T invokable) {
   switch (reg) {
     case Register::rax:
       return invokable(regs_struct.rax);
@@ -94,13 +96,14 @@ std::string get_register_name(const Register reg) {
       ->name;
 }
 
-Register get_register_from_name(const std::string& name) {
+Register get_register_from_name(const std::string_view name) {
   const auto it =
       std::find_if(register_descriptors.begin(), register_descriptors.end(),
                    [&name](const auto& t) { return t.name == name; });
   if (it == register_descriptors.end()) {
     throw std::out_of_range(
-        "Unknown register during retrieval of register from name " + name);
+        "Unknown register during retrieval of register from name " +
+        std::string{name});
   }
   return it->reg;
 }
@@ -126,28 +129,58 @@ Register get_register_from_dwarf_register(const unsigned dwarf_reg) {
 
 uint64_t get_register_value(const pid_t pid, const Register reg) {
   user_regs_struct regs;
-  if (ptrace(PTRACE_GETREGS, pid, nullptr, &regs) == -1) {
+  if (timed_ptrace(Probe::PtraceGetRegs, PTRACE_GETREGS, pid, nullptr,
+                   &regs) == -1) {
     std::cerr << "Failed reading the registers while trying to read: " << reg
               << "\n";
     abort();
   }
-  return map_register_to_sys(regs, reg,
-                             [](const auto t) -> uint64_t { return t; });
+  return get_register_value(regs, reg);
 }
 
 void set_register_value(const pid_t pid, const Register reg,
                         const uint64_t value) {
   user_regs_struct regs;
-  if (ptrace(PTRACE_GETREGS, pid, nullptr, &regs) == -1) {
+  if (timed_ptrace(Probe::PtraceGetRegs, PTRACE_GETREGS, pid, nullptr,
+                   &regs) == -1) {
     std::cerr << "Failed reading the registers while trying to set: " << reg
               << "\n";
     abort();
   }
-  map_register_to_sys(regs, reg, [value](auto& t) { t = value; });
-  if (ptrace(PTRACE_SETREGS, pid, nullptr, &regs) == -1) {
+  set_register_value(regs, reg, value);
+  if (timed_ptrace(Probe::PtraceSetRegs, PTRACE_SETREGS, pid, nullptr,
+                   &regs) == -1) {
     std::cerr << "Failed writing the registers while trying to set: " << reg
               << "\n";
     abort();
   }
 }
+
+user_regs_struct get_registers(const pid_t pid) {
+  user_regs_struct regs;
+  if (timed_ptrace(Probe::PtraceGetRegs, PTRACE_GETREGS, pid, nullptr,
+                   &regs) == -1) {
+    std::cerr << "Failed reading the registers of process " << pid << "\n";
+    abort();
+  }
+  return regs;
+}
+
+void set_registers(const pid_t pid, const user_regs_struct& regs) {
+  if (timed_ptrace(Probe::PtraceSetRegs, PTRACE_SETREGS, pid, nullptr,
+                   &regs) == -1) {
+    std::cerr << "Failed writing the registers of process " << pid << "\n";
+    abort();
+  }
+}
+
+uint64_t get_register_value(const user_regs_struct& regs, const Register reg) {
+  return map_register_to_sys(regs, reg,
+                             [](const auto t) -> uint64_t { return t; });
+}
+
+void set_register_value(user_regs_struct& regs, const Register reg,
+                        const uint64_t value) {
+  map_register_to_sys(regs, reg, [value](auto& t) { t = value; });
+}
 }  // namespace nebugger
@@ -11,6 +11,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/user.h>
 
 namespace nebugger {
 /// A list of all the registers we support reading from and writing to.
@@ -93,7 +96,7 @@ std::ostream& operator<<(std::ostream& os, const Register reg);
 std::string get_register_name(const Register reg);
 
 /// Given the name of a Register
-Register get_register_from_name(const std::string& name);
+Register get_register_from_name(std::string_view name);
 
 int get_dwarf_register(const Register t);
 
@@ -103,4 +106,20 @@ uint64_t get_register_value(const pid_t pid, const Register reg);
 
 void set_register_value(const pid_t pid, const Register reg,
                         const uint64_t value);
+
+/// Read all general purpose registers of the process with a single ptrace
+/// call. Prefer this over repeated calls to `get_register_value` when several
+/// registers are needed.
+user_regs_struct get_registers(const pid_t pid);
+
+/// Write all general purpose registers of the process with a single ptrace
+/// call.
+void set_registers(const pid_t pid, const user_regs_struct& regs);
+
+/// Get the value of `reg` from an already retrieved register set.
+uint64_t get_register_value(const user_regs_struct& regs, const Register reg);
+
+/// Set the value of `reg` in an already retrieved register set.
+void set_register_value(user_regs_struct& regs, const Register reg,
+                        const uint64_t value);
 }  // namespace nebugger
@@ -0,0 +1,177 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "RemoteAllocator.hpp"
+
+#include <iostream>
+#include <sys/mman.h>
+
+#include "Syscall.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint64_t page_size = 4096;
+
+uint64_t round_up(const uint64_t value, const uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+}  // namespace
+
+std::intptr_t RemoteAllocator::allocate(const uint64_t size, const Kind kind) {
+  if (size == 0) {
+    return 0;
+  }
+  std::size_t size_class = 0;
+  while (size_class < number_of_size_classes and
+         (uint64_t{1} << (size_class + min_class_shift)) < size) {
+    ++size_class;
+  }
+
+  if (size_class == number_of_size_classes) {
+    const uint64_t mapped_size = round_up(size, page_size);
+    const std::intptr_t address = map(mapped_size, kind);
+    if (address != 0) {
+      allocations_.insert(
+          {address, Allocation{mapped_size, kind, number_of_size_classes}});
+    }
+    return address;
+  }
+
+  const uint64_t chunk_size = uint64_t{1} << (size_class + min_class_shift);
+  Pool& pool = pools_[static_cast<std::size_t>(kind)][size_class];
+  std::intptr_t address = 0;
+  if (not pool.free_chunks.empty()) {
+    address = pool.free_chunks.back();
+    pool.free_chunks.pop_back();
+  } else {
+    if (pool.arena_next + static_cast<std::intptr_t>(chunk_size) >
+        pool.arena_end) {
+      const std::intptr_t arena = map(arena_size, kind);
+      if (arena == 0) {
+        return 0;
+      }
+      pool.arena_next = arena;
+      pool.arena_end = arena + static_cast<std::intptr_t>(arena_size);
+    }
+    address = pool.arena_next;
+    pool.arena_next += static_cast<std::intptr_t>(chunk_size);
+  }
+  allocations_.insert({address, Allocation{chunk_size, kind, size_class}});
+  return address;
+}
+
+std::intptr_t RemoteAllocator::allocate_near(const uint64_t size,
+                                            const std::intptr_t target) {
+  const uint64_t chunk_size = round_up(size, 16);
+  if (chunk_size == 0 or chunk_size > arena_size) {
+    return 0;
+  }
+  // Keep some distance from the limit so every byte of the chunk is
+  // reachable.
+  const auto is_near = [target](const std::intptr_t address) {
+    const std::intptr_t distance =
+        address > target ? address - target : target - address;
+    return distance < (std::intptr_t{1} << 31) -
+                          2 * static_cast<std::intptr_t>(arena_size);
+  };
+
+  for (Pool& arena : near_arenas_) {
+    if (is_near(arena.arena_next) and
+        arena.arena_next + static_cast<std::intptr_t>(chunk_size) <=
+            arena.arena_end) {
+      const std::intptr_t address = arena.arena_next;
+      arena.arena_next += static_cast<std::intptr_t>(chunk_size);
+      allocations_.insert(
+          {address, Allocation{chunk_size, Kind::Code, near_size_class}});
+      return address;
+    }
+  }
+
+  // mmap only treats the address as a hint, so try a few candidates on either
+  // side of the target until one ends up close enough.
+  const std::intptr_t base = target & ~((std::intptr_t{1} << 20) - 1);
+  for (std::intptr_t step = 1; step <= 16; ++step) {
+    for (const std::intptr_t direction : {1, -1}) {
+      const std::intptr_t hint =
+          base + direction * step * (std::intptr_t{1} << 26);
+      if (hint <= 0) {
+        continue;
+      }
+      const std::intptr_t arena = map(arena_size, Kind::Code, hint);
+      if (arena == 0) {
+        continue;
+      }
+      if (not is_near(arena)) {
+        ++injections_;
+        inject_munmap(pid_, arena, arena_size);
+        mappings_.pop_back();
+        continue;
+      }
+      near_arenas_.push_back(
+          Pool{{}, arena, arena + static_cast<std::intptr_t>(arena_size)});
+      return allocate_near(size, target);
+    }
+  }
+  std::cerr << "Failed to map code memory near 0x" << std::hex << target
+            << std::dec << '\n';
+  return 0;
+}
+
+void RemoteAllocator::deallocate(const std::intptr_t address) {
+  const auto it = allocations_.find(address);
+  if (it == allocations_.end()) {
+    std::cerr << "Attempting to free unknown remote address 0x" << std::hex
+              << address << std::dec << '\n';
+    return;
+  }
+  const Allocation allocation = it->second;
+  allocations_.erase(it);
+  if (allocation.size_class == number_of_size_classes) {
+    ++injections_;
+    inject_munmap(pid_, address, allocation.size);
+    for (auto mapping = mappings_.begin(); mapping != mappings_.end();
+         ++mapping) {
+      if (mapping->first == address) {
+        mappings_.erase(mapping);
+        break;
+      }
+    }
+    return;
+  }
+  if (allocation.size_class == near_size_class) {
+    // Near arenas are bump allocated only.
+    return;
+  }
+  pools_[static_cast<std::size_t>(allocation.kind)][allocation.size_class]
+      .free_chunks.push_back(address);
+}
+
+void RemoteAllocator::release() {
+  for (const auto& mapping : mappings_) {
+    ++injections_;
+    inject_munmap(pid_, mapping.first, mapping.second);
+  }
+  mappings_.clear();
+  allocations_.clear();
+  pools_ = {};
+  near_arenas_.clear();
+}
+
+std::intptr_t RemoteAllocator::map(const uint64_t size, const Kind kind,
+                                   const std::intptr_t hint) {
+  ++injections_;
+  const std::intptr_t address = inject_mmap(
+      pid_, size,
+      kind == Kind::Code ? PROT_READ | PROT_WRITE | PROT_EXEC
+                         : PROT_READ | PROT_WRITE,
+      hint);
+  if (address != 0) {
+    mappings_.emplace_back(address, size);
+  }
+  return address;
+}
+}  // namespace nebugger
@@ -0,0 +1,97 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+/// Allocates memory inside the stopped inferior.
+///
+/// Memory is obtained by injecting `mmap`/`munmap` system calls (see
+/// `inject_syscall`). Small requests are rounded up to a power-of-two size
+/// class and carved out of large arenas, so only the first allocation of a
+/// class, and every time an arena is exhausted, pays for a syscall injection.
+/// Freed chunks go onto a per-class free list kept in the debugger and are
+/// reused without touching the inferior. Requests larger than the largest
+/// size class are mapped directly.
+///
+/// Both data (read/write) and code (read/write/execute) memory is handed out
+/// from separate pools.
+class RemoteAllocator {
+ public:
+  enum class Kind : std::size_t { Data = 0, Code = 1 };
+
+  explicit RemoteAllocator(pid_t pid) : pid_(pid) {}
+  RemoteAllocator(const RemoteAllocator&) = delete;
+  RemoteAllocator& operator=(const RemoteAllocator&) = delete;
+  RemoteAllocator(RemoteAllocator&&) = default;
+  RemoteAllocator& operator=(RemoteAllocator&&) = default;
+  ~RemoteAllocator() = default;
+
+  /// Allocate at least `size` bytes, aligned to 16 bytes (to the page size
+  /// for direct mappings). Returns 0 on failure.
+  std::intptr_t allocate(uint64_t size, Kind kind = Kind::Data);
+
+  /// Allocate `size` bytes of code memory within a `rel32` displacement of
+  /// `target`, e.g. for trampolines reached by a patched `jmp`. Returns 0 if
+  /// no such memory could be mapped. Memory from near arenas is not reused
+  /// after being deallocated.
+  std::intptr_t allocate_near(uint64_t size, std::intptr_t target);
+
+  /// Return memory obtained from `allocate` to the allocator.
+  void deallocate(std::intptr_t address);
+
+  /// Unmap all memory in the inferior. Must only be called while the inferior
+  /// is stopped and none of the memory is in use any more.
+  void release();
+
+  /// Number of system calls injected so far, useful for checking the pooling.
+  std::size_t number_of_injections() const noexcept { return injections_; }
+
+ private:
+  static constexpr std::size_t number_of_size_classes = 13;
+  // Smallest size class is 2^min_class_shift bytes
+  static constexpr std::size_t min_class_shift = 4;
+  // Size of an arena that chunks are carved from
+  static constexpr uint64_t arena_size = 1 << 18;
+
+  struct Pool {
+    std::vector<std::intptr_t> free_chunks{};
+    // Next uncarved address in the current arena and the end of that arena
+    std::intptr_t arena_next{0};
+    std::intptr_t arena_end{0};
+  };
+
+  struct Allocation {
+    uint64_t size;
+    Kind kind;
+    // Size class index, number_of_size_classes for direct mappings and
+    // near_size_class for memory from near arenas
+    std::size_t size_class;
+  };
+
+  static constexpr std::size_t near_size_class = number_of_size_classes + 1;
+
+  std::intptr_t map(uint64_t size, Kind kind, std::intptr_t hint = 0);
+
+  pid_t pid_;
+  std::array<std::array<Pool, number_of_size_classes>, 2> pools_{};
+  // Code arenas placed close to specific addresses
+  std::vector<Pool> near_arenas_{};
+  std::unordered_map<std::intptr_t, Allocation> allocations_{};
+  // All arenas and direct mappings as (address, size)
+  std::vector<std::pair<std::intptr_t, uint64_t>> mappings_{};
+  std::size_t injections_{0};
+};
+}  // namespace nebugger
@@ -0,0 +1,371 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Search.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <immintrin.h>
+#include <sys/uio.h>
+#include <thread>
+#include <utility>
+
+#include "CommandLine.hpp"
+
+namespace nebugger {
+namespace {
+// Bytes of start positions per chunk, a chunk reads the pattern length minus
+// one more to find matches that cross into the next chunk
+constexpr std::size_t chunk_size = 8 << 20;
+constexpr std::size_t chunks_per_thread = 4;
+constexpr unsigned max_threads = 8;
+constexpr std::size_t page_size = 4096;
+
+// Parse `text` into `bytes`, see `parse_search_pattern`. A `width` other
+// than zero is the number of bytes of a `0xVALUE`.
+bool parse_bytes(std::string_view text, std::size_t width,
+                 std::vector<uint8_t>& bytes) {
+  bytes.clear();
+  if (text.size() > 2 and text[0] == '0' and
+      (text[1] == 'x' or text[1] == 'X')) {
+    uint64_t value = 0;
+    const std::size_t digits = text.size() - 2;
+    if (digits > 16 or not parse_integer(text, value)) {
+      return false;
+    }
+    if (width == 0) {
+      width = digits <= 2 ? 1 : digits <= 4 ? 2 : digits <= 8 ? 4 : 8;
+    }
+    if (width < 8 and value >> (8 * width) != 0) {
+      return false;
+    }
+    for (std::size_t i = 0; i < width; ++i) {
+      bytes.push_back(static_cast<uint8_t>(i < 8 ? value >> (8 * i) : 0));
+    }
+    return true;
+  }
+  if (text.empty() or text.size() % 2 != 0) {
+    return false;
+  }
+  for (std::size_t i = 0; i < text.size(); i += 2) {
+    uint8_t byte = 0;
+    const auto result =
+        std::from_chars(text.data() + i, text.data() + i + 2, byte, 16);
+    if (result.ec != std::errc{} or result.ptr != text.data() + i + 2) {
+      return false;
+    }
+    bytes.push_back(byte);
+  }
+  return true;
+}
+
+// Finds the pattern in a buffer. Candidates are the positions at which the
+// two anchor bytes match, which are checked against the whole pattern.
+class Matcher {
+ public:
+  explicit Matcher(const SearchPattern& pattern) : pattern_(pattern) {
+    // Zeros and 0xff fill most of memory, so other values rule out more
+    // positions.
+    const auto score = [&pattern](const std::size_t i) {
+      const uint8_t byte = pattern.bytes[i];
+      return __builtin_popcount(pattern.mask[i]) +
+             (byte != 0x00 and byte != 0xff ? 8 : 0);
+    };
+    for (std::size_t i = 1; i < pattern.bytes.size(); ++i) {
+      if (score(i) > score(first_)) {
+        first_ = i;
+      }
+    }
+    last_ = first_ == 0 and pattern.bytes.size() > 1 ? 1 : 0;
+    for (std::size_t i = 0; i < pattern.bytes.size(); ++i) {
+      if (i != first_ and score(i) > score(last_)) {
+        last_ = i;
+      }
+    }
+  }
+
+  std::size_t size() const noexcept { return pattern_.bytes.size(); }
+
+  // Append the matches starting at the first `positions` bytes of `data`,
+  // which was read from `address`. The pattern must fit at each of them.
+  void scan(const uint8_t* const data, const std::size_t positions,
+            const std::intptr_t address,
+            std::vector<std::intptr_t>& matches) const {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    std::size_t position =
+        avx2 ? scan_avx2(data, 0, positions, address, matches) : 0;
+    position = scan_sse2(data, position, positions, address, matches);
+    for (; position < positions; ++position) {
+      check(data, position, address, matches);
+    }
+  }
+
+ private:
+  void check(const uint8_t* const data, const std::size_t position,
+             const std::intptr_t address,
+             std::vector<std::intptr_t>& matches) const {
+    const uint8_t* const candidate = data + position;
+    for (std::size_t i = 0; i < pattern_.bytes.size(); ++i) {
+      if ((candidate[i] & pattern_.mask[i]) != pattern_.bytes[i]) {
+        return;
+      }
+    }
+    matches.push_back(address + static_cast<std::intptr_t>(position));
+  }
+
+  // The kernels scan from `position` on and return where they stopped, less
+  // than one vector of positions before `positions`.
+
+  __attribute__((target("avx2"))) std::size_t scan_avx2(
+      const uint8_t* const data, std::size_t position,
+      const std::size_t positions, const std::intptr_t address,
+      std::vector<std::intptr_t>& matches) const {
+    const __m256i first_byte =
+        _mm256_set1_epi8(static_cast<char>(pattern_.bytes[first_]));
+    const __m256i first_mask =
+        _mm256_set1_epi8(static_cast<char>(pattern_.mask[first_]));
+    const __m256i last_byte =
+        _mm256_set1_epi8(static_cast<char>(pattern_.bytes[last_]));
+    const __m256i last_mask =
+        _mm256_set1_epi8(static_cast<char>(pattern_.mask[last_]));
+    for (; position + 32 <= positions; position += 32) {
+      const __m256i first = _mm256_and_si256(
+          _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(data + position + first_)),
+          first_mask);
+      const __m256i last = _mm256_and_si256(
+          _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(data + position + last_)),
+          last_mask);
+      auto candidates = static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_and_si256(_mm256_cmpeq_epi8(first, first_byte),
+                           _mm256_cmpeq_epi8(last, last_byte))));
+      for (; candidates != 0; candidates &= candidates - 1) {
+        check(data, position + static_cast<std::size_t>(
+                                   __builtin_ctz(candidates)),
+              address, matches);
+      }
+    }
+    return position;
+  }
+
+  std::size_t scan_sse2(const uint8_t* const data, std::size_t position,
+                        const std::size_t positions,
+                        const std::intptr_t address,
+                        std::vector<std::intptr_t>& matches) const {
+    const __m128i first_byte =
+        _mm_set1_epi8(static_cast<char>(pattern_.bytes[first_]));
+    const __m128i first_mask =
+        _mm_set1_epi8(static_cast<char>(pattern_.mask[first_]));
+    const __m128i last_byte =
+        _mm_set1_epi8(static_cast<char>(pattern_.bytes[last_]));
+    const __m128i last_mask =
+        _mm_set1_epi8(static_cast<char>(pattern_.mask[last_]));
+    for (; position + 16 <= positions; position += 16) {
+      const __m128i first = _mm_and_si128(
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(data + position + first_)),
+          first_mask);
+      const __m128i last = _mm_and_si128(
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(data + position + last_)),
+          last_mask);
+      auto candidates = static_cast<uint32_t>(
+          _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, first_byte),
+                                          _mm_cmpeq_epi8(last, last_byte))));
+      for (; candidates != 0; candidates &= candidates - 1) {
+        check(data, position + static_cast<std::size_t>(
+                                   __builtin_ctz(candidates)),
+              address, matches);
+      }
+    }
+    return position;
+  }
+
+  const SearchPattern& pattern_;
+  // The bytes of the pattern compared for all positions
+  std::size_t first_{0};
+  std::size_t last_{0};
+};
+
+// Read `size` bytes at `address` of the process `pid`, from any thread.
+bool read_chunk(const pid_t pid, const std::intptr_t address, uint8_t* buffer,
+                const std::size_t size) {
+  std::size_t done = 0;
+  while (done < size) {
+    iovec local{buffer + done, size - done};
+    iovec remote{reinterpret_cast<void*>(address +
+                                         static_cast<std::intptr_t>(done)),
+                 size - done};
+    const ssize_t result = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (result <= 0) {
+      return false;
+    }
+    done += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+// Read what can be read of `size` bytes at `address` a page at a time, for
+// when `read_chunk` fails on some of them. Appends the [begin, end) offsets
+// of the runs of bytes read to `runs`.
+void read_pages(const pid_t pid, const std::intptr_t address,
+                uint8_t* const buffer, const std::size_t size,
+                std::vector<std::pair<std::size_t, std::size_t>>& runs) {
+  std::size_t offset = 0;
+  while (offset < size) {
+    const auto in_page = static_cast<std::size_t>(
+        (address + static_cast<std::intptr_t>(offset)) &
+        static_cast<std::intptr_t>(page_size - 1));
+    const std::size_t end = std::min(size, offset + page_size - in_page);
+    if (read_chunk(pid, address + static_cast<std::intptr_t>(offset),
+                   buffer + offset, end - offset)) {
+      if (not runs.empty() and runs.back().second == offset) {
+        runs.back().second = end;
+      } else {
+        runs.emplace_back(offset, end);
+      }
+    }
+    offset = end;
+  }
+}
+}  // namespace
+
+bool parse_search_pattern(const std::string_view pattern,
+                          const std::string_view mask,
+                          SearchPattern& result) {
+  if (not parse_bytes(pattern, 0, result.bytes)) {
+    return false;
+  }
+  if (mask.empty()) {
+    result.mask.assign(result.bytes.size(), 0xff);
+  } else if (not parse_bytes(mask, result.bytes.size(), result.mask) or
+             result.mask.size() != result.bytes.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < result.bytes.size(); ++i) {
+    result.bytes[i] &= result.mask[i];
+  }
+  return true;
+}
+
+struct MemorySearch::Chunk {
+  std::intptr_t start;
+  // Number of start positions, and of bytes to read
+  std::size_t positions;
+  std::size_t size;
+  std::size_t region;
+  // Number of start positions in readable memory
+  std::size_t scanned;
+  std::vector<std::intptr_t> matches;
+};
+
+MemorySearch::MemorySearch(const pid_t pid, SearchPattern pattern)
+    : pid_(pid), pattern_(std::move(pattern)), regions_(read_memory_map(pid)) {
+  // The vDSO data and the legacy vsyscall page cannot be read by other
+  // processes.
+  regions_.erase(std::remove_if(regions_.begin(), regions_.end(),
+                                [](const MemoryRegion& region) {
+                                  return not region.readable or
+                                         region.path == "[vvar]" or
+                                         region.path == "[vsyscall]";
+                                }),
+                 regions_.end());
+  next_address_ = regions_.empty() ? 0 : regions_.front().start;
+}
+
+bool MemorySearch::next(SearchMatch& match) {
+  while (next_match_ == matches_.size()) {
+    matches_.clear();
+    next_match_ = 0;
+    if (not scan_batch()) {
+      return false;
+    }
+  }
+  match = matches_[next_match_++];
+  return true;
+}
+
+bool MemorySearch::scan_batch() {
+  const std::size_t threads = std::clamp(std::thread::hardware_concurrency(),
+                                         1u, max_threads);
+  const Matcher matcher{pattern_};
+  std::vector<Chunk> chunks{};
+  while (chunks.size() < threads * chunks_per_thread and
+         next_region_ < regions_.size()) {
+    const MemoryRegion& region = regions_[next_region_];
+    const auto left = static_cast<std::size_t>(region.end - next_address_);
+    if (left < matcher.size()) {
+      if (++next_region_ < regions_.size()) {
+        next_address_ = regions_[next_region_].start;
+      }
+      continue;
+    }
+    const std::size_t positions =
+        std::min(chunk_size, left - matcher.size() + 1);
+    chunks.push_back({next_address_, positions,
+                      positions + matcher.size() - 1, next_region_, 0, {}});
+    next_address_ += static_cast<std::intptr_t>(positions);
+  }
+  if (chunks.empty()) {
+    return false;
+  }
+
+  const std::size_t workers = std::min(threads, chunks.size());
+  while (buffers_.size() < workers) {
+    buffers_.emplace_back(new uint8_t[chunk_size + matcher.size() - 1]);
+  }
+  std::atomic<std::size_t> next_chunk{0};
+  const auto work = [this, &chunks, &next_chunk,
+                     &matcher](uint8_t* const buffer) {
+    std::vector<std::pair<std::size_t, std::size_t>> runs{};
+    for (std::size_t i = next_chunk++; i < chunks.size(); i = next_chunk++) {
+      Chunk& chunk = chunks[i];
+      runs.clear();
+      if (read_chunk(pid_, chunk.start, buffer, chunk.size)) {
+        runs.emplace_back(0, chunk.size);
+      } else {
+        // Some pages cannot be read, e.g. of a file mapped past its end,
+        // the others are still searched.
+        read_pages(pid_, chunk.start, buffer, chunk.size, runs);
+      }
+      for (const auto& [begin, end] : runs) {
+        if (begin >= chunk.positions) {
+          break;
+        }
+        if (end - begin < matcher.size()) {
+          continue;
+        }
+        const std::size_t positions =
+            std::min(end - matcher.size() + 1, chunk.positions) - begin;
+        matcher.scan(buffer + begin, positions,
+                     chunk.start + static_cast<std::intptr_t>(begin),
+                     chunk.matches);
+        chunk.scanned += positions;
+      }
+    }
+  };
+  std::vector<std::thread> helpers{};
+  for (std::size_t i = 1; i < workers; ++i) {
+    helpers.emplace_back(work, buffers_[i].get());
+  }
+  work(buffers_[0].get());
+  for (std::thread& helper : helpers) {
+    helper.join();
+  }
+
+  for (const Chunk& chunk : chunks) {
+    bytes_scanned_ += chunk.scanned;
+    bytes_unreadable_ += chunk.positions - chunk.scanned;
+    for (const std::intptr_t address : chunk.matches) {
+      matches_.push_back({address, chunk.region});
+    }
+  }
+  return true;
+}
+}  // namespace nebugger
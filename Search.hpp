@@ -0,0 +1,92 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+#include "MemoryMap.hpp"
+
+namespace nebugger {
+/// Bytes to search for, of which only the bits set in `mask` must match.
+struct SearchPattern {
+  std::vector<uint8_t> bytes{};
+  std::vector<uint8_t> mask{};
+};
+
+/// Parse the PATTERN and optional MASK of the `find` command into `result`.
+///
+/// A pattern `0xVALUE` is the integer VALUE as stored in memory, i.e. little
+/// endian in 1, 2, 4 or 8 bytes depending on the number of digits, so a
+/// pointer is written with all 16 digits. Otherwise it is a string of
+/// hexadecimal bytes in memory order, e.g. `7f454c46`. A mask is written the
+/// same way and covers the whole pattern.
+bool parse_search_pattern(std::string_view pattern, std::string_view mask,
+                          SearchPattern& result);
+
+/// A match of a `MemorySearch`.
+struct SearchMatch {
+  std::intptr_t address;
+  // Index of the mapping in `MemorySearch::regions`
+  std::size_t region;
+};
+
+/// Search for a pattern in all readable mappings of the process.
+///
+/// The matches are produced lazily: each call to `next` that runs out of
+/// matches scans the next batch of memory, so stopping after the first few
+/// matches does not pay for scanning the whole address space. A batch is
+/// split into large chunks that worker threads read with `process_vm_readv`
+/// and scan by comparing the two most selective pattern bytes at 32 (AVX2)
+/// or 16 (SSE2) positions at once, verifying only the candidates. The scan
+/// keeps up with the copy, so the search is bound by memory bandwidth.
+///
+/// The process must stay stopped while it is searched.
+class MemorySearch {
+ public:
+  MemorySearch(pid_t pid, SearchPattern pattern);
+  MemorySearch(const MemorySearch&) = delete;
+  MemorySearch& operator=(const MemorySearch&) = delete;
+
+  /// Set `match` to the next match in address order. Returns false once
+  /// all memory has been scanned.
+  bool next(SearchMatch& match);
+
+  /// The mappings that are searched, sorted by address.
+  const std::vector<MemoryRegion>& regions() const noexcept {
+    return regions_;
+  }
+
+  /// Bytes scanned so far, and bytes that could not be read.
+  uint64_t bytes_scanned() const noexcept { return bytes_scanned_; }
+  uint64_t bytes_unreadable() const noexcept { return bytes_unreadable_; }
+
+ private:
+  struct Chunk;
+  // Scan the next batch of chunks into `matches_`. Returns false if there
+  // is nothing left to scan.
+  bool scan_batch();
+
+  pid_t pid_;
+  SearchPattern pattern_;
+  std::vector<MemoryRegion> regions_;
+  // Where the next batch starts
+  std::size_t next_region_{0};
+  std::intptr_t next_address_{0};
+  std::vector<SearchMatch> matches_{};
+  std::size_t next_match_{0};
+  // One read buffer per worker thread, allocated on first use
+  std::vector<std::unique_ptr<uint8_t[]>> buffers_{};
+  uint64_t bytes_scanned_{0};
+  uint64_t bytes_unreadable_{0};
+};
+}  // namespace nebugger
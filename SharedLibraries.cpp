@@ -0,0 +1,222 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "SharedLibraries.hpp"
+
+#include <algorithm>
+#include <elf.h>
+#include <fstream>
+#include <iostream>
+#include <link.h>
+#include <unistd.h>
+#include <utility>
+
+#include "Memory.hpp"
+
+namespace nebugger {
+namespace {
+// The leading fields of the loader's `struct r_debug` and `struct link_map`
+// in the inferior, read with a single access each.
+struct DebugState {
+  int32_t version;
+  uint64_t map;
+  uint64_t breakpoint;
+  int32_t state;
+  uint64_t loader_base;
+};
+
+struct LinkMapEntry {
+  uint64_t load_address;
+  uint64_t name;
+  uint64_t dynamic;
+  uint64_t next;
+  uint64_t previous;
+};
+
+// The load address of the dynamic loader from the auxiliary vector.
+std::intptr_t find_loader_base(const pid_t pid) {
+  std::ifstream file{"/proc/" + std::to_string(pid) + "/auxv",
+                     std::ios::binary};
+  uint64_t entry[2] = {0, 0};
+  while (file.read(reinterpret_cast<char*>(entry), sizeof(entry)) and
+         entry[0] != AT_NULL) {
+    if (entry[0] == AT_BASE) {
+      return static_cast<std::intptr_t>(entry[1]);
+    }
+  }
+  return 0;
+}
+
+// Read a NUL terminated string in blocks that do not cross pages, since the
+// page after the string need not be mapped.
+bool read_string(InferiorMemory& memory, std::intptr_t address,
+                 std::string& result) {
+  constexpr std::intptr_t page_size = 4096;
+  constexpr std::size_t max_length = 4096;
+  result.clear();
+  char block[256];
+  while (result.size() < max_length) {
+    const auto size = static_cast<std::size_t>(
+        std::min<std::intptr_t>(sizeof(block),
+                                page_size - address % page_size));
+    if (not memory.read(address, block, size)) {
+      return false;
+    }
+    const auto end = std::find(block, block + size, '\0');
+    result.append(block, end);
+    if (end != block + size) {
+      return true;
+    }
+    address += static_cast<std::intptr_t>(size);
+  }
+  return false;
+}
+}  // namespace
+
+std::intptr_t SharedLibrary::find_symbol(const std::string& name) const {
+  const Symbol* const symbol =
+      elf == nullptr ? nullptr : elf->find_symbol(name);
+  return symbol == nullptr
+             ? 0
+             : load_address + static_cast<std::intptr_t>(symbol->address);
+}
+
+std::intptr_t SharedLibraries::find_loader(const ElfFile& executable) {
+  const Elf64_Shdr* const interpreter = executable.find_section(".interp");
+  const std::intptr_t base = find_loader_base(pid_);
+  if (interpreter == nullptr or base == 0) {
+    return 0;
+  }
+  const std::string path{
+      reinterpret_cast<const char*>(executable.section_data(*interpreter))};
+  const std::shared_ptr<const ElfFile> loader = load(path);
+  const Symbol* const r_debug =
+      loader == nullptr ? nullptr : loader->find_symbol("_r_debug");
+  const Symbol* const debug_state =
+      loader == nullptr ? nullptr : loader->find_symbol("_dl_debug_state");
+  if (r_debug == nullptr or debug_state == nullptr) {
+    std::cerr << "Shared libraries are not tracked, the dynamic loader '"
+              << path << "' does not define _r_debug and _dl_debug_state\n";
+    return 0;
+  }
+  r_debug_ = base + static_cast<std::intptr_t>(r_debug->address);
+  breakpoint_ = base + static_cast<std::intptr_t>(debug_state->address);
+  return breakpoint_;
+}
+
+bool SharedLibraries::update(std::vector<SharedLibrary>& added) {
+  if (r_debug_ == 0) {
+    return true;
+  }
+  DebugState debug{};
+  if (not memory_.read(r_debug_, &debug, sizeof(debug))) {
+    std::cerr << "Failed to read the state of the dynamic loader of process "
+              << pid_ << '\n';
+    return false;
+  }
+  if (debug.state == r_debug::RT_DELETE) {
+    removed_ = true;
+  }
+  if (debug.state != r_debug::RT_CONSISTENT) {
+    // Called again once the change is complete
+    return true;
+  }
+
+  auto entry = static_cast<std::intptr_t>(debug.map);
+  std::vector<SharedLibrary> previous{};
+  if (tail_ == 0 or removed_) {
+    previous.swap(libraries_);
+  } else {
+    LinkMapEntry tail{};
+    if (not memory_.read(tail_, &tail, sizeof(tail))) {
+      return false;
+    }
+    entry = static_cast<std::intptr_t>(tail.next);
+  }
+  removed_ = false;
+  while (entry != 0) {
+    LinkMapEntry link{};
+    if (not memory_.read(entry, &link, sizeof(link))) {
+      std::cerr << "Failed to read the link map of process " << pid_ << '\n';
+      return false;
+    }
+    tail_ = entry;
+    const auto load_address = static_cast<std::intptr_t>(link.load_address);
+    const auto known = std::find_if(
+        previous.begin(), previous.end(),
+        [entry, load_address](const SharedLibrary& library) {
+          return library.entry == entry and
+                 library.load_address == load_address;
+        });
+    if (known != previous.end()) {
+      libraries_.push_back(std::move(*known));
+    } else {
+      SharedLibrary library{};
+      if (read_library(entry, static_cast<std::intptr_t>(link.name),
+                       load_address, library)) {
+        libraries_.push_back(library);
+        added.push_back(std::move(library));
+      }
+    }
+    entry = static_cast<std::intptr_t>(link.next);
+  }
+  return true;
+}
+
+std::intptr_t SharedLibraries::find_symbol(const std::string& name) const {
+  for (const SharedLibrary& library : libraries_) {
+    const std::intptr_t address = library.find_symbol(name);
+    if (address != 0) {
+      return address;
+    }
+  }
+  return 0;
+}
+
+const SharedLibrary* SharedLibraries::find_library_containing(
+    const std::intptr_t address) const noexcept {
+  const auto library = std::find_if(
+      libraries_.begin(), libraries_.end(),
+      [address](const SharedLibrary& candidate) {
+        return address >= candidate.start and address < candidate.end;
+      });
+  return library == libraries_.end() ? nullptr : &*library;
+}
+
+bool SharedLibraries::read_library(const std::intptr_t entry,
+                                   const std::intptr_t name,
+                                   const std::intptr_t load_address,
+                                   SharedLibrary& library) {
+  // The executable has an empty name and the vDSO is not backed by a file.
+  if (name == 0 or not read_string(memory_, name, library.path) or
+      library.path.empty() or access(library.path.c_str(), R_OK) != 0) {
+    return false;
+  }
+  library.elf = load(library.path);
+  if (library.elf == nullptr) {
+    return false;
+  }
+  const auto range = library.elf->address_range();
+  library.load_address = load_address;
+  library.start = load_address + static_cast<std::intptr_t>(range.first);
+  library.end = load_address + static_cast<std::intptr_t>(range.second);
+  library.entry = entry;
+  return true;
+}
+
+std::shared_ptr<const ElfFile> SharedLibraries::load(const std::string& path) {
+  auto& elf = cache_[path];
+  if (elf == nullptr) {
+    auto file = std::make_shared<const ElfFile>(path);
+    if (not file->is_valid()) {
+      return nullptr;
+    }
+    elf = std::move(file);
+  }
+  return elf;
+}
+}  // namespace nebugger
@@ -0,0 +1,101 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Elf.hpp"
+
+namespace nebugger {
+class InferiorMemory;
+
+/// A shared object in the link map of the dynamic loader.
+struct SharedLibrary {
+  /// Address of the symbol `name` in memory, 0 if the library does not
+  /// define it.
+  std::intptr_t find_symbol(const std::string& name) const;
+
+  std::string path{};
+  // Offset of the addresses in memory from those in the file
+  std::intptr_t load_address{0};
+  // Addresses [start, end) in memory covered by the library
+  std::intptr_t start{0};
+  std::intptr_t end{0};
+  // Address of the loader's `link_map` entry for the library
+  std::intptr_t entry{0};
+  std::shared_ptr<const ElfFile> elf{};
+};
+
+/// Symbol indexes of shared objects by path, built once for each file.
+using ElfCache =
+    std::unordered_map<std::string, std::shared_ptr<const ElfFile>>;
+
+/// Follows the shared objects the dynamic loader maps into a process.
+///
+/// The loader keeps its objects in the `link_map` list of its `r_debug`
+/// structure and calls `_dl_debug_state` before and after changing the list.
+/// A breakpoint there lets `update` read the changes. Objects are only ever
+/// appended to the list, so after a load only the entries past the last one
+/// read are visited and only their symbols are loaded. The whole list is
+/// walked again after an unload, without loading any symbols again.
+class SharedLibraries {
+ public:
+  SharedLibraries(pid_t pid, InferiorMemory& memory, ElfCache& cache)
+      : pid_(pid), memory_(memory), cache_(cache) {}
+
+  /// Find the dynamic loader of the stopped process running `executable`.
+  /// Returns the address of the breakpoint after which `update` must be
+  /// called, or 0 if the program is statically linked or its loader
+  /// unknown.
+  std::intptr_t find_loader(const ElfFile& executable);
+
+  /// The breakpoint address found by `find_loader`, 0 if libraries are not
+  /// tracked.
+  std::intptr_t loader_breakpoint() const noexcept { return breakpoint_; }
+
+  /// Read the changes to the link map, appending the libraries loaded since
+  /// the last call to `added`.
+  bool update(std::vector<SharedLibrary>& added);
+
+  /// The loaded libraries in the order of the link map.
+  const std::vector<SharedLibrary>& libraries() const noexcept {
+    return libraries_;
+  }
+
+  /// Address of the symbol `name` in the first library defining it, 0 if
+  /// none does.
+  std::intptr_t find_symbol(const std::string& name) const;
+
+  /// The library covering `address`, `nullptr` if there is none.
+  const SharedLibrary* find_library_containing(
+      std::intptr_t address) const noexcept;
+
+ private:
+  // Read the entry of the link map at `entry`, returns false if it is not a
+  // library backed by a file.
+  bool read_library(std::intptr_t entry, std::intptr_t name,
+                    std::intptr_t load_address, SharedLibrary& library);
+  std::shared_ptr<const ElfFile> load(const std::string& path);
+
+  pid_t pid_;
+  InferiorMemory& memory_;
+  ElfCache& cache_;
+  std::intptr_t r_debug_{0};
+  std::intptr_t breakpoint_{0};
+  // Last entry of the link map read, 0 to walk it from the start
+  std::intptr_t tail_{0};
+  // Whether objects were removed since the last update
+  bool removed_{false};
+  std::vector<SharedLibrary> libraries_{};
+};
+}  // namespace nebugger
@@ -0,0 +1,338 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+
+namespace nebugger {
+namespace {
+constexpr std::intptr_t page_size = 4096;
+// Size of the reads of a diff
+constexpr std::size_t chunk_size = 8 << 20;
+constexpr uint64_t pagemap_soft_dirty = uint64_t{1} << 55;
+
+// Turns the masks of differing bytes of consecutive blocks into ranges.
+class RangeBuilder {
+ public:
+  RangeBuilder(const std::intptr_t address, const std::size_t mapping,
+               std::vector<ChangedRange>& ranges)
+      : address_(address), mapping_(mapping), ranges_(ranges) {}
+
+  // Bit i of `differ` is set if byte `offset + i` differs, for the `width`
+  // bytes from `offset`.
+  void add(const std::size_t offset, const uint64_t differ,
+           const unsigned width) {
+    const uint64_t all =
+        width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    unsigned i = 0;
+    while (i < width) {
+      const uint64_t rest = ((open_ ? ~differ : differ) & all) >> i;
+      if (rest == 0) {
+        return;
+      }
+      i += static_cast<unsigned>(__builtin_ctzll(rest));
+      if (open_) {
+        close(offset + i);
+      } else {
+        open_ = true;
+        start_ = offset + i;
+      }
+    }
+  }
+
+  // The block starting at `offset` is equal.
+  void equal(const std::size_t offset) {
+    if (open_) {
+      close(offset);
+    }
+  }
+
+ private:
+  void close(const std::size_t end) {
+    open_ = false;
+    const std::intptr_t start = address_ + static_cast<std::intptr_t>(start_);
+    if (not ranges_.empty() and ranges_.back().end == start and
+        ranges_.back().mapping == mapping_) {
+      ranges_.back().end = address_ + static_cast<std::intptr_t>(end);
+    } else {
+      ranges_.push_back(
+          {start, address_ + static_cast<std::intptr_t>(end), mapping_});
+    }
+  }
+
+  std::intptr_t address_;
+  std::size_t mapping_;
+  std::vector<ChangedRange>& ranges_;
+  bool open_{false};
+  std::size_t start_{0};
+};
+
+// The kernels compare from `offset` on and return where they stopped, less
+// than a block before `size`.
+
+__attribute__((target("avx2"))) std::size_t diff_avx2(
+    const uint8_t* const a, const uint8_t* const b, std::size_t offset,
+    const std::size_t size, RangeBuilder& builder) {
+  for (; offset + 128 <= size; offset += 128) {
+    const auto* const x = reinterpret_cast<const __m256i*>(a + offset);
+    const auto* const y = reinterpret_cast<const __m256i*>(b + offset);
+    __m256i differ = _mm256_setzero_si256();
+    for (std::size_t i = 0; i < 4; ++i) {
+      differ = _mm256_or_si256(
+          differ, _mm256_xor_si256(_mm256_loadu_si256(x + i),
+                                   _mm256_loadu_si256(y + i)));
+    }
+    if (_mm256_testz_si256(differ, differ) != 0) {
+      builder.equal(offset);
+      continue;
+    }
+    for (std::size_t i = 0; i < 4; i += 2) {
+      const auto low = static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256(x + i),
+                            _mm256_loadu_si256(y + i))));
+      const auto high = static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256(x + i + 1),
+                            _mm256_loadu_si256(y + i + 1))));
+      builder.add(offset + 32 * i, ~(uint64_t{high} << 32 | low), 64);
+    }
+  }
+  return offset;
+}
+
+std::size_t diff_sse2(const uint8_t* const a, const uint8_t* const b,
+                      std::size_t offset, const std::size_t size,
+                      RangeBuilder& builder) {
+  for (; offset + 64 <= size; offset += 64) {
+    __m128i equal[4];
+    for (std::size_t i = 0; i < 4; ++i) {
+      equal[i] = _mm_cmpeq_epi8(
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(a + offset + 16 * i)),
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(b + offset + 16 * i)));
+    }
+    const __m128i all = _mm_and_si128(_mm_and_si128(equal[0], equal[1]),
+                                      _mm_and_si128(equal[2], equal[3]));
+    if (_mm_movemask_epi8(all) == 0xffff) {
+      builder.equal(offset);
+      continue;
+    }
+    uint64_t mask = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+      mask |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(equal[i]))}
+              << (16 * i);
+    }
+    builder.add(offset, ~mask, 64);
+  }
+  return offset;
+}
+
+void diff_scalar(const uint8_t* const a, const uint8_t* const b,
+                 std::size_t offset, const std::size_t size,
+                 RangeBuilder& builder) {
+  for (; offset < size; offset += 64) {
+    const auto width = static_cast<unsigned>(std::min<std::size_t>(
+        64, size - offset));
+    uint64_t differ = 0;
+    for (unsigned i = 0; i < width; ++i) {
+      differ |= uint64_t{a[offset + i] != b[offset + i]} << i;
+    }
+    builder.add(offset, differ, width);
+  }
+}
+
+std::string pagemap_path(const pid_t pid) {
+  return "/proc/" + std::to_string(pid) + "/pagemap";
+}
+}  // namespace
+
+void find_changed_ranges(const uint8_t* const a, const uint8_t* const b,
+                         const std::size_t size, const std::intptr_t address,
+                         const std::size_t mapping,
+                         std::vector<ChangedRange>& ranges) {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  RangeBuilder builder{address, mapping, ranges};
+  std::size_t offset = avx2 ? diff_avx2(a, b, 0, size, builder) : 0;
+  offset = diff_sse2(a, b, offset, size, builder);
+  diff_scalar(a, b, offset, size, builder);
+  builder.equal(size);
+}
+
+MemorySnapshot::~MemorySnapshot() { release(); }
+
+bool MemorySnapshot::save(const std::string_view filter,
+                          SnapshotSummary& summary) {
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  release();
+  for (const MemoryRegion& region : read_memory_map(pid_)) {
+    if (region.readable and region.writable and not region.shared and
+        region.path.find(filter) != std::string::npos) {
+      mappings_.push_back({region.start, region.end, region.path, nullptr});
+      arena_size_ += static_cast<std::size_t>(region.end - region.start);
+    }
+  }
+  if (mappings_.empty()) {
+    std::cerr << "No writable mappings to save\n";
+    return false;
+  }
+  void* const arena =
+      mmap(nullptr, arena_size_, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (arena == MAP_FAILED) {
+    std::cerr << "Failed to allocate " << arena_size_ / 1024
+              << " KiB for the snapshot\n";
+    arena_size_ = 0;
+    mappings_.clear();
+    return false;
+  }
+  arena_ = static_cast<uint8_t*>(arena);
+  uint8_t* copy = arena_;
+  for (Mapping& mapping : mappings_) {
+    const auto size = static_cast<std::size_t>(mapping.end - mapping.start);
+    if (not memory_.read(mapping.start, copy, size)) {
+      std::cerr << "Failed to read the mapping at 0x" << std::hex
+                << mapping.start << std::dec << '\n';
+      release();
+      return false;
+    }
+    mapping.copy = copy;
+    copy += size;
+  }
+  // Once cleared the bits no longer tell whether the kernel tracks them, so
+  // a later snapshot keeps what the first one found.
+  soft_dirty_ = soft_dirty_ or has_soft_dirty_pages();
+  if (soft_dirty_) {
+    const std::string path = "/proc/" + std::to_string(pid_) + "/clear_refs";
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    soft_dirty_ = fd != -1 and ::write(fd, "4", 1) == 1;
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+  summary.mappings = mappings_.size();
+  summary.bytes = arena_size_;
+  summary.soft_dirty = soft_dirty_;
+  summary.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return true;
+}
+
+bool MemorySnapshot::diff(std::vector<ChangedRange>& ranges,
+                          SnapshotSummary& summary) {
+  if (empty()) {
+    std::cerr << "No snapshot saved\n";
+    return false;
+  }
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  const int pagemap =
+      soft_dirty_ ? open(pagemap_path(pid_).c_str(), O_RDONLY | O_CLOEXEC)
+                  : -1;
+  std::vector<uint8_t> buffer(chunk_size);
+  std::vector<std::pair<std::intptr_t, std::intptr_t>> runs{};
+  for (std::size_t i = 0; i < mappings_.size(); ++i) {
+    const Mapping& mapping = mappings_[i];
+    runs.clear();
+    written_pages(mapping, pagemap, runs);
+    for (const auto& [first, last] : runs) {
+      for (std::intptr_t address = first; address < last;
+           address += static_cast<std::intptr_t>(chunk_size)) {
+        const auto size = std::min(chunk_size,
+                                   static_cast<std::size_t>(last - address));
+        if (not memory_.read(address, buffer.data(), size)) {
+          summary.bytes_unreadable += size;
+          continue;
+        }
+        find_changed_ranges(mapping.copy + (address - mapping.start),
+                            buffer.data(), size, address, i, ranges);
+        summary.bytes_compared += size;
+      }
+    }
+  }
+  if (pagemap != -1) {
+    close(pagemap);
+  }
+  summary.mappings = mappings_.size();
+  summary.bytes = arena_size_;
+  summary.soft_dirty = soft_dirty_;
+  summary.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return true;
+}
+
+void MemorySnapshot::release() {
+  if (arena_ != nullptr) {
+    munmap(arena_, arena_size_);
+    arena_ = nullptr;
+  }
+  arena_size_ = 0;
+  mappings_.clear();
+}
+
+void MemorySnapshot::written_pages(
+    const Mapping& mapping, const int pagemap,
+    std::vector<std::pair<std::intptr_t, std::intptr_t>>& runs) const {
+  const auto pages =
+      static_cast<std::size_t>((mapping.end - mapping.start) / page_size);
+  std::vector<uint64_t> entries(pages);
+  const auto bytes = static_cast<ssize_t>(pages * sizeof(uint64_t));
+  if (pagemap == -1 or
+      pread(pagemap, entries.data(), static_cast<std::size_t>(bytes),
+            static_cast<off_t>(mapping.start / page_size *
+                               static_cast<std::intptr_t>(
+                                   sizeof(uint64_t)))) != bytes) {
+    runs.emplace_back(mapping.start, mapping.end);
+    return;
+  }
+  for (std::size_t page = 0; page < pages; ++page) {
+    if ((entries[page] & pagemap_soft_dirty) == 0) {
+      continue;
+    }
+    const std::intptr_t address =
+        mapping.start + static_cast<std::intptr_t>(page) * page_size;
+    if (not runs.empty() and runs.back().second == address) {
+      runs.back().second += page_size;
+    } else {
+      runs.emplace_back(address, address + page_size);
+    }
+  }
+}
+
+bool MemorySnapshot::has_soft_dirty_pages() const {
+  const int pagemap = open(pagemap_path(pid_).c_str(), O_RDONLY | O_CLOEXEC);
+  if (pagemap == -1) {
+    return false;
+  }
+  bool found = false;
+  for (const Mapping& mapping : mappings_) {
+    uint64_t entry = 0;
+    if (pread(pagemap, &entry, sizeof(entry),
+              static_cast<off_t>(mapping.start / page_size *
+                                 static_cast<std::intptr_t>(
+                                     sizeof(uint64_t)))) ==
+            static_cast<ssize_t>(sizeof(entry)) and
+        (entry & pagemap_soft_dirty) != 0) {
+      found = true;
+      break;
+    }
+  }
+  close(pagemap);
+  return found;
+}
+}  // namespace nebugger
@@ -0,0 +1,111 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace nebugger {
+class InferiorMemory;
+
+/// Bytes [start, end) that differ between a snapshot and the memory now.
+struct ChangedRange {
+  std::intptr_t start;
+  std::intptr_t end;
+  // Index of the saved mapping holding the bytes
+  std::size_t mapping;
+};
+
+/// Append the ranges of bytes in which the `size` bytes at `a` and `b`
+/// differ to `ranges`, as addresses starting at `address`. A range that
+/// continues the last one of `ranges` extends it. Uses AVX2 if the CPU has
+/// it and SSE2 otherwise.
+void find_changed_ranges(const uint8_t* a, const uint8_t* b, std::size_t size,
+                         std::intptr_t address, std::size_t mapping,
+                         std::vector<ChangedRange>& ranges);
+
+/// What `MemorySnapshot::save` and `MemorySnapshot::diff` did.
+struct SnapshotSummary {
+  std::size_t mappings{0};
+  // Bytes in the snapshot, and bytes read and compared by a diff
+  uint64_t bytes{0};
+  uint64_t bytes_compared{0};
+  // Bytes of saved mappings that can no longer be read
+  uint64_t bytes_unreadable{0};
+  // Whether pages untouched since the save are skipped
+  bool soft_dirty{false};
+  double seconds{0.0};
+};
+
+/// A copy of the writable memory of the inferior, to find what a stretch of
+/// execution, e.g. a function call, changed.
+///
+/// The private writable mappings are copied with one bulk read each into a
+/// single arena mapped for the snapshot. A diff reads the memory again in
+/// large chunks and compares it with vectorized kernels that skip equal
+/// blocks quickly and emit the ranges of changed bytes.
+///
+/// If the kernel tracks soft-dirty bits, they are cleared when saving and a
+/// diff only reads the pages `/proc/PID/pagemap` marks as written since, so
+/// its cost is proportional to the memory touched, not to the memory saved.
+class MemorySnapshot {
+ public:
+  MemorySnapshot(pid_t pid, InferiorMemory& memory)
+      : pid_(pid), memory_(memory) {}
+  MemorySnapshot(const MemorySnapshot&) = delete;
+  MemorySnapshot& operator=(const MemorySnapshot&) = delete;
+  ~MemorySnapshot();
+
+  /// Replace the snapshot by a copy of the private writable mappings whose
+  /// path contains `filter`, all of them if it is empty.
+  bool save(std::string_view filter, SnapshotSummary& summary);
+
+  /// Whether a snapshot was saved.
+  bool empty() const noexcept { return mappings_.empty(); }
+
+  /// Find the ranges of bytes that changed since the snapshot was saved.
+  bool diff(std::vector<ChangedRange>& ranges, SnapshotSummary& summary);
+
+  /// Path, or name such as `[heap]`, of the saved mapping `mapping`.
+  const std::string& mapping_name(const std::size_t mapping) const {
+    return mappings_[mapping].path;
+  }
+
+ private:
+  struct Mapping {
+    std::intptr_t start;
+    std::intptr_t end;
+    std::string path;
+    // The copy in the arena
+    uint8_t* copy;
+  };
+
+  void release();
+  // Append the runs [first, last) of pages of `mapping` written since the
+  // save according to the open `/proc/PID/pagemap`, all of them if
+  // soft-dirty bits are not tracked.
+  void written_pages(
+      const Mapping& mapping, int pagemap,
+      std::vector<std::pair<std::intptr_t, std::intptr_t>>& runs) const;
+  // Whether soft-dirty bits are set for the saved mappings, which they are
+  // after their creation if the kernel tracks them
+  bool has_soft_dirty_pages() const;
+
+  pid_t pid_;
+  InferiorMemory& memory_;
+  std::vector<Mapping> mappings_{};
+  uint8_t* arena_{nullptr};
+  std::size_t arena_size_{0};
+  bool soft_dirty_{false};
+};
+}  // namespace nebugger
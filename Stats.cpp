@@ -0,0 +1,119 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Stats.hpp"
+
+#include <deque>
+#include <iomanip>
+#include <mutex>
+
+namespace nebugger {
+namespace {
+using Histograms = std::array<LatencyHistogram, number_of_probes>;
+
+// The histograms of every thread that recorded a latency. They are never
+// freed so that they outlive their threads, and a deque does not move them
+// when growing.
+std::mutex all_histograms_mutex{};
+std::deque<Histograms> all_histograms{};
+thread_local Histograms* thread_histograms = nullptr;
+
+const char* const probe_names[number_of_probes] = {
+    "command",     "wait",        "ptrace-cont",    "ptrace-step",
+    "ptrace-peek", "ptrace-poke", "ptrace-getregs", "ptrace-setregs",
+    "emulate"};
+
+// Print `nanoseconds` in microseconds with a fixed width.
+void print_microseconds(std::ostream& os, const double nanoseconds) {
+  os << std::setw(12) << std::fixed << std::setprecision(2)
+     << nanoseconds / 1000.0;
+}
+}  // namespace
+
+uint64_t LatencyHistogram::quantile(const double fraction) const noexcept {
+  const auto target = static_cast<uint64_t>(fraction * count());
+  const uint64_t max_seen = max();
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < number_of_buckets; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen > target) {
+      const uint64_t upper = i == 0 ? 0 : (uint64_t{1} << i) - 1;
+      return upper < max_seen ? upper : max_seen;
+    }
+  }
+  return max_seen;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) noexcept {
+  for (std::size_t i = 0; i < number_of_buckets; ++i) {
+    buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  }
+  count_.fetch_add(other.count(), std::memory_order_relaxed);
+  total_.fetch_add(other.total(), std::memory_order_relaxed);
+  raise_max(other.max());
+}
+
+void LatencyHistogram::reset() noexcept {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  total_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram& histogram(const Probe probe) {
+  if (thread_histograms == nullptr) {
+    const std::lock_guard<std::mutex> lock(all_histograms_mutex);
+    thread_histograms = &all_histograms.emplace_back();
+  }
+  return (*thread_histograms)[static_cast<std::size_t>(probe)];
+}
+
+void reset_stats() {
+  const std::lock_guard<std::mutex> lock(all_histograms_mutex);
+  for (Histograms& thread : all_histograms) {
+    for (LatencyHistogram& histogram : thread) {
+      histogram.reset();
+    }
+  }
+}
+
+void print_stats(std::ostream& os) {
+  Histograms histograms{};
+  {
+    const std::lock_guard<std::mutex> lock(all_histograms_mutex);
+    for (const Histograms& thread : all_histograms) {
+      for (std::size_t i = 0; i < number_of_probes; ++i) {
+        histograms[i].merge(thread[i]);
+      }
+    }
+  }
+  const auto flags = os.flags();
+  os << std::left << std::setw(16) << "probe" << std::right << std::setw(12)
+     << "count" << std::setw(12) << "total ms" << std::setw(12) << "mean us"
+     << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+     << std::setw(12) << "max us" << '\n';
+  for (std::size_t i = 0; i < number_of_probes; ++i) {
+    const LatencyHistogram& h = histograms[i];
+    if (h.count() == 0) {
+      continue;
+    }
+    os << std::left << std::setw(16) << probe_names[i] << std::right
+       << std::setw(12) << h.count() << std::setw(12) << std::fixed
+       << std::setprecision(2) << h.total() / 1.0e6;
+    print_microseconds(os, static_cast<double>(h.total()) /
+                               static_cast<double>(h.count()));
+    print_microseconds(os, static_cast<double>(h.quantile(0.5)));
+    print_microseconds(os, static_cast<double>(h.quantile(0.99)));
+    print_microseconds(os, static_cast<double>(h.max()));
+    os << '\n';
+  }
+  os.flags(flags);
+}
+}  // namespace nebugger
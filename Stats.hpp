@@ -0,0 +1,133 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <time.h>
+
+namespace nebugger {
+/// The operations whose latency is measured.
+enum class Probe : std::size_t {
+  Command,
+  WaitForSignal,
+  PtraceCont,
+  PtraceStep,
+  PtracePeek,
+  PtracePoke,
+  PtraceGetRegs,
+  PtraceSetRegs,
+  Emulate
+};
+
+constexpr std::size_t number_of_probes = 9;
+
+/// Latency histogram with power-of-two buckets: bucket `i` counts durations
+/// in [2^(i-1), 2^i) nanoseconds, and bucket 0 zero durations.
+///
+/// The counters are relaxed atomics, so a histogram can be read, merged or
+/// cleared by one thread while another records into it. The counters are
+/// not updated together, a reader may see a duration counted but not yet
+/// added to the total.
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t number_of_buckets = 48;
+
+  void record(const uint64_t nanoseconds) noexcept {
+    const std::size_t bucket =
+        nanoseconds == 0
+            ? 0
+            : static_cast<std::size_t>(64 - __builtin_clzll(nanoseconds));
+    buckets_[bucket < number_of_buckets ? bucket : number_of_buckets - 1]
+        .fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    raise_max(nanoseconds);
+  }
+
+  uint64_t count() const noexcept {
+    return count_.load(std::memory_order_relaxed);
+  }
+  uint64_t total() const noexcept {
+    return total_.load(std::memory_order_relaxed);
+  }
+  uint64_t max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+  /// Upper bound of the bucket holding the `fraction` quantile, e.g. 0.99.
+  uint64_t quantile(double fraction) const noexcept;
+
+  /// Add the durations recorded in `other`.
+  void merge(const LatencyHistogram& other) noexcept;
+
+  /// Forget all recorded durations.
+  void reset() noexcept;
+
+ private:
+  void raise_max(uint64_t nanoseconds) noexcept {
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (nanoseconds > max and
+           not max_.compare_exchange_weak(max, nanoseconds,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+
+  std::array<std::atomic<uint64_t>, number_of_buckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+/// The calling thread's histogram of `probe`. Every thread that controls an
+/// inferior records into its own set of histograms, so recording threads do
+/// not contend for the counters.
+LatencyHistogram& histogram(Probe probe);
+
+/// Clear the histograms of all threads. Durations being recorded while the
+/// histograms are cleared may be partly kept.
+void reset_stats();
+
+/// Print a table of the count, total, mean, median, 99th percentile and
+/// maximum latency of every probe that was hit, merged over all threads.
+void print_stats(std::ostream& os);
+
+/// Records the time from its construction to its destruction in the
+/// histogram of a probe.
+class LatencyTimer {
+ public:
+  explicit LatencyTimer(const Probe probe) noexcept
+      : probe_(probe), start_(now()) {}
+  LatencyTimer(const LatencyTimer&) = delete;
+  LatencyTimer& operator=(const LatencyTimer&) = delete;
+  ~LatencyTimer() { histogram(probe_).record(now() - start_); }
+
+ private:
+  // CLOCK_MONOTONIC is served by the vDSO without entering the kernel.
+  static uint64_t now() noexcept {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 +
+           static_cast<uint64_t>(time.tv_nsec);
+  }
+
+  Probe probe_;
+  uint64_t start_;
+};
+
+/// `ptrace` with its latency recorded in the histogram of `probe`.
+template <typename Address, typename Data>
+long timed_ptrace(const Probe probe, const __ptrace_request request,
+                  const pid_t pid, const Address address, const Data data) {
+  const LatencyTimer timer{probe};
+  return ptrace(request, pid, address, data);
+}
+}  // namespace nebugger
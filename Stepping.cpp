@@ -0,0 +1,575 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Stepping.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#include "Elf.hpp"
+#include "Emulator.hpp"
+#include "Fork.hpp"
+#include "InstructionCache.hpp"
+#include "LineTable.hpp"
+#include "Memory.hpp"
+#include "Registers.hpp"
+#include "Stats.hpp"
+
+namespace nebugger {
+namespace {
+// The wait status of a process stopped by SIGTRAP, used before the first stop
+constexpr int trap_status = (SIGTRAP << 8) | 0x7f;
+
+bool stopped_by_trap(const int wait_status) {
+  return WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGTRAP and
+         ptrace_event(wait_status) == 0;
+}
+}  // namespace
+
+StepResult Stepper::step_line(const ElfFile& elf, const LineTable& lines,
+                              const std::intptr_t load_address,
+                              const bool into, const StepEngine engine) {
+  stops_ = 0;
+  watch_hit_ = false;
+  // After hitting a breakpoint rip points one past it, move it back so the
+  // original instruction is executed.
+  user_regs_struct regs = get_registers(pid_);
+  if (at_breakpoint_) {
+    regs.rip -= 1;
+    set_registers(pid_, regs);
+    at_breakpoint_ = false;
+  }
+  if (lines.find(regs.rip - static_cast<uint64_t>(load_address)) == nullptr) {
+    StepResult result{};
+    result.status = StepResult::Status::NoLineInfo;
+    return result;
+  }
+  return engine == StepEngine::SingleStep
+             ? step_line_single(lines, load_address, into)
+             : step_line_range(elf, lines, load_address, into);
+}
+
+StepResult Stepper::step_instruction() {
+  stops_ = 0;
+  watch_hit_ = false;
+  user_regs_struct regs = get_registers(pid_);
+  if (at_breakpoint_) {
+    regs.rip -= 1;
+    set_registers(pid_, regs);
+    at_breakpoint_ = false;
+  }
+  int wait_status = trap_status;
+  if (not single_step(wait_status)) {
+    return finish(StepResult::Status::Signal, wait_status);
+  }
+  return finish(StepResult::Status::Done, wait_status);
+}
+
+StepResult Stepper::step_line_single(const LineTable& lines,
+                                     const std::intptr_t load_address,
+                                     const bool into) {
+  const LineRow* row = lines.find(get_register_value(pid_, Register::rip) -
+                                  static_cast<uint64_t>(load_address));
+  uint32_t line = row->line;
+  uint32_t file = row->file;
+  int wait_status = trap_status;
+  while (true) {
+    user_regs_struct regs = get_registers(pid_);
+    const Instruction* const decoded =
+        instructions_.find(static_cast<std::intptr_t>(regs.rip));
+    if (decoded == nullptr) {
+      return finish(StepResult::Status::Signal, wait_status);
+    }
+    const Instruction insn = *decoded;
+    const bool is_call = insn.valid and (insn.flow == FlowKind::Call or
+                                         insn.flow == FlowKind::IndirectCall);
+    if (not single_step(wait_status)) {
+      return finish(StepResult::Status::Signal, wait_status);
+    }
+    if (is_call) {
+      const uint64_t callee = get_register_value(pid_, Register::rip);
+      if (into and lines.find(callee - static_cast<uint64_t>(load_address)) !=
+                       nullptr) {
+        return finish(StepResult::Status::Done, wait_status);
+      }
+      if (not run_until_return(insn.address + insn.length, regs.rsp,
+                               wait_status)) {
+        return finish(StepResult::Status::Breakpoint, wait_status);
+      }
+    }
+
+    const uint64_t pc = get_register_value(pid_, Register::rip);
+    if (is_user_breakpoint(static_cast<std::intptr_t>(pc))) {
+      // Report it as if the breakpoint had been hit.
+      set_register_value(pid_, Register::rip, pc + 1);
+      return finish(StepResult::Status::Breakpoint, wait_status);
+    }
+    row = lines.find(pc - static_cast<uint64_t>(load_address));
+    if (row == nullptr or (insn.valid and insn.flow == FlowKind::Return)) {
+      return finish(StepResult::Status::Done, wait_status);
+    }
+    if (row->line != line or row->file != file) {
+      if (lines.is_statement_start(pc - static_cast<uint64_t>(load_address))) {
+        return finish(StepResult::Status::Done, wait_status);
+      }
+      // We landed in the middle of another line, finish that one.
+      line = row->line;
+      file = row->file;
+    }
+  }
+}
+
+StepResult Stepper::step_line_range(const ElfFile& elf,
+                                    const LineTable& lines,
+                                    const std::intptr_t load_address,
+                                    const bool into) {
+  const auto load = static_cast<uint64_t>(load_address);
+  const LineRow* row =
+      lines.find(get_register_value(pid_, Register::rip) - load);
+  uint32_t line = row->line;
+  uint32_t file = row->file;
+  RangePlan plan{};
+  int wait_status = trap_status;
+  bool returned = false;
+  while (true) {
+    const user_regs_struct regs = get_registers(pid_);
+    const auto pc = static_cast<std::intptr_t>(regs.rip);
+
+    if (pc < plan.start or pc >= plan.end) {
+      row = lines.find(regs.rip - load);
+      if (row == nullptr or returned) {
+        return finish(StepResult::Status::Done, wait_status);
+      }
+      if (row->line != line or row->file != file) {
+        if (lines.is_statement_start(regs.rip - load)) {
+          return finish(StepResult::Status::Done, wait_status);
+        }
+        line = row->line;
+        file = row->file;
+      }
+      const auto range = lines.line_range(regs.rip - load);
+      const Symbol* const function =
+          elf.find_function_containing(regs.rip - load);
+      plan = plan_range(
+          static_cast<std::intptr_t>(range.first + load),
+          static_cast<std::intptr_t>(range.second + load),
+          function == nullptr
+              ? std::pair<std::intptr_t, std::intptr_t>{0, 0}
+              : std::pair<std::intptr_t, std::intptr_t>{
+                    static_cast<std::intptr_t>(function->address + load),
+                    static_cast<std::intptr_t>(function->address +
+                                               function->size + load)},
+          into);
+      plan.frame_rsp = regs.rsp;
+    }
+
+    if (not plan.decoded) {
+      // Run to the next taken branch, or the end of the line.
+      set_temporary_breakpoints({plan.end});
+      // EIO means the kernel lacks block stepping; any other failure leaves
+      // the process where it was.
+      if (not resume(PTRACE_SINGLEBLOCK, wait_status) and
+          (errno != EIO or not resume(PTRACE_SINGLESTEP, wait_status))) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      if (not stopped_by_trap(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      user_regs_struct stop_regs = get_registers(pid_);
+      const auto address = static_cast<std::intptr_t>(stop_regs.rip) - 1;
+      if (temporary_breakpoints_.count(address) > 0) {
+        stop_regs.rip -= 1;
+        set_registers(pid_, stop_regs);
+      } else if (is_user_breakpoint(address)) {
+        return finish(StepResult::Status::Breakpoint, wait_status);
+      }
+      continue;
+    }
+
+    const auto call = std::find_if(
+        plan.calls.begin(), plan.calls.end(),
+        [pc](const auto& site) { return site.first == pc; });
+    if (call != plan.calls.end()) {
+      if (not single_step(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      const uint64_t callee = get_register_value(pid_, Register::rip);
+      if (into and lines.find(callee - load) != nullptr) {
+        return finish(StepResult::Status::Done, wait_status);
+      }
+      if (not run_until_return(pc + call->second, regs.rsp, wait_status)) {
+        return finish(StepResult::Status::Breakpoint, wait_status);
+      }
+      continue;
+    }
+    if (std::find(plan.single_step_sites.begin(), plan.single_step_sites.end(),
+                  pc) != plan.single_step_sites.end()) {
+      const Instruction* const insn = instructions_.find(pc);
+      returned = insn != nullptr and insn->flow == FlowKind::Return;
+      if (not single_step(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      const uint64_t new_pc = get_register_value(pid_, Register::rip);
+      if (is_user_breakpoint(static_cast<std::intptr_t>(new_pc))) {
+        set_register_value(pid_, Register::rip, new_pc + 1);
+        return finish(StepResult::Status::Breakpoint, wait_status);
+      }
+      continue;
+    }
+
+    if (is_user_breakpoint(pc)) {
+      // Execute the instruction under the breakpoint we start on.
+      if (not single_step(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      continue;
+    }
+
+    // Run until the next way out of the straight-line code.
+    std::vector<std::intptr_t> stops = plan.exits;
+    for (const auto& site : plan.calls) {
+      stops.push_back(site.first);
+    }
+    stops.insert(stops.end(), plan.single_step_sites.begin(),
+                 plan.single_step_sites.end());
+    set_temporary_breakpoints(stops);
+    std::intptr_t address = 0;
+    while (true) {
+      if (not resume(PTRACE_CONT, wait_status) or
+          not stopped_by_trap(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+      user_regs_struct stop_regs = get_registers(pid_);
+      address = static_cast<std::intptr_t>(stop_regs.rip) - 1;
+      if (temporary_breakpoints_.count(address) == 0) {
+        break;
+      }
+      stop_regs.rip -= 1;
+      set_registers(pid_, stop_regs);
+      if (not in_deeper_frame(plan, stop_regs.rsp)) {
+        break;
+      }
+      // Another invocation of the line, e.g. from a callback of a function
+      // it calls, carries on past the breakpoint.
+      if (not single_step(wait_status)) {
+        return finish(StepResult::Status::Signal, wait_status);
+      }
+    }
+    if (temporary_breakpoints_.count(address) > 0) {
+      // An exit of the range in the frame stepping it
+    } else if (is_user_breakpoint(address)) {
+      return finish(StepResult::Status::Breakpoint, wait_status);
+    } else {
+      // An int3 of the program itself
+      return finish(StepResult::Status::Signal, wait_status);
+    }
+  }
+}
+
+bool Stepper::run_until_return(const std::intptr_t return_address,
+                               const uint64_t call_rsp, int& wait_status) {
+  auto inserted = temporary_breakpoints_.find(return_address);
+  if (inserted == temporary_breakpoints_.end() and
+      not is_user_breakpoint(return_address)) {
+    Breakpoint bp{pid_, return_address};
+    temporary_breakpoints_.insert({return_address, std::move(bp.enable())});
+  }
+  while (true) {
+    if (not resume(PTRACE_CONT, wait_status) or
+        not stopped_by_trap(wait_status)) {
+      return false;
+    }
+    user_regs_struct regs = get_registers(pid_);
+    const auto address = static_cast<std::intptr_t>(regs.rip) - 1;
+    const bool is_temporary = temporary_breakpoints_.count(address) > 0;
+    if (not is_temporary and
+        not(address == return_address and is_user_breakpoint(address))) {
+      // A user breakpoint in the callee, or an int3 of the program
+      return false;
+    }
+    if (regs.rsp >= call_rsp and address == return_address) {
+      regs.rip -= 1;
+      set_registers(pid_, regs);
+      return true;
+    }
+    if (not is_temporary) {
+      // The user breakpoint at the return address was hit by a recursive
+      // invocation, which should stop like any other user breakpoint.
+      return false;
+    }
+    // A temporary breakpoint hit by a deeper frame, e.g. recursion
+    regs.rip -= 1;
+    set_registers(pid_, regs);
+    if (not single_step(wait_status)) {
+      return false;
+    }
+  }
+}
+
+bool Stepper::resume(const int request, int& wait_status) {
+  const int resume_request =
+      request == PTRACE_CONT and syscalls_wanted_ and syscalls_wanted_()
+          ? PTRACE_SYSCALL
+          : request;
+  if (timed_ptrace(request == PTRACE_CONT ? Probe::PtraceCont
+                                          : Probe::PtraceStep,
+                   static_cast<__ptrace_request>(resume_request), pid_,
+                   nullptr, nullptr) == -1) {
+    return false;
+  }
+  while (true) {
+    ++stops_;
+    {
+      const LatencyTimer timer{Probe::WaitForSignal};
+      if (waitpid(pid_, &wait_status, 0) != pid_) {
+        return false;
+      }
+    }
+    const int event = WIFSTOPPED(wait_status) ? ptrace_event(wait_status) : 0;
+    if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == syscall_trap) {
+      if (syscall_handler_) {
+        syscall_handler_();
+      }
+    } else if (event == 0 and WIFSTOPPED(wait_status) and
+               WSTOPSIG(wait_status) == SIGSEGV and fault_handler_) {
+      const StepResult::Status status = fault_handler_(wait_status);
+      if (status == StepResult::Status::Watch) {
+        watch_hit_ = true;
+      }
+      if (status != StepResult::Status::Done) {
+        return true;
+      }
+      // The faulting instruction was executed, which completes a single-step.
+      if (request == PTRACE_SINGLESTEP) {
+        wait_status = trap_status;
+        return true;
+      }
+    } else if (event == 0) {
+      if (internal_breakpoint_ == 0 or not stopped_by_trap(wait_status) or
+          get_register_value(pid_, Register::rip) - 1 !=
+              static_cast<uint64_t>(internal_breakpoint_)) {
+        return WIFSTOPPED(wait_status);
+      }
+      set_register_value(pid_, Register::rip,
+                         static_cast<uint64_t>(internal_breakpoint_));
+      // The loader reported a change of its libraries, which the handler
+      // called by single_step took care of.
+      if (not single_step(wait_status) or request == PTRACE_SINGLESTEP) {
+        return WIFSTOPPED(wait_status);
+      }
+    } else {
+      if (event == PTRACE_EVENT_EXEC) {
+        temporary_breakpoints_.clear();
+      }
+      if (not event_handler_ or not event_handler_(wait_status)) {
+        return true;
+      }
+    }
+    // The stop is of no concern to the step, carry on as requested.
+    if (timed_ptrace(request == PTRACE_CONT ? Probe::PtraceCont
+                                            : Probe::PtraceStep,
+                     static_cast<__ptrace_request>(resume_request), pid_,
+                     nullptr, nullptr) == -1) {
+      return false;
+    }
+  }
+}
+
+bool Stepper::single_step(int& wait_status) {
+  user_regs_struct regs = get_registers(pid_);
+  const auto pc = static_cast<std::intptr_t>(regs.rip);
+  if (pc == internal_breakpoint_ and internal_handler_) {
+    internal_handler_();
+  }
+  if (const Instruction* const insn = instructions_.find(pc)) {
+    const LatencyTimer timer{Probe::Emulate};
+    if (emulate_instruction(*insn, instructions_.bytes(*insn), regs,
+                            memory_)) {
+      set_registers(pid_, regs);
+      wait_status = trap_status;
+      return true;
+    }
+  }
+  Breakpoint* hidden[2] = {nullptr, nullptr};
+  const auto user = breakpoints_.find(pc);
+  if (user != breakpoints_.end() and user->second.is_enabled()) {
+    hidden[0] = &user->second;
+  }
+  const auto temporary = temporary_breakpoints_.find(pc);
+  if (temporary != temporary_breakpoints_.end() and
+      temporary->second.is_enabled()) {
+    hidden[1] = &temporary->second;
+  }
+  for (Breakpoint* bp : hidden) {
+    if (bp != nullptr) {
+      bp->disable();
+    }
+  }
+  const bool alive = resume(PTRACE_SINGLESTEP, wait_status);
+  if (alive) {
+    for (Breakpoint* bp : hidden) {
+      if (bp != nullptr) {
+        bp->enable();
+      }
+    }
+  }
+  return alive and stopped_by_trap(wait_status);
+}
+
+Stepper::RangePlan Stepper::plan_range(
+    const std::intptr_t start, const std::intptr_t end,
+    const std::pair<std::intptr_t, std::intptr_t> function, const bool into) {
+  RangePlan plan{};
+  plan.start = start;
+  plan.end = end;
+  plan.exits.push_back(end);
+  if (end <= start or end - start > 1 << 16) {
+    return plan;
+  }
+  std::intptr_t address = start;
+  while (address < end) {
+    const Instruction* const decoded = instructions_.find(address);
+    if (decoded == nullptr) {
+      return plan;
+    }
+    const Instruction& insn = *decoded;
+    if (not insn.valid) {
+      return plan;
+    }
+    if (insn.flow == FlowKind::Call or insn.flow == FlowKind::IndirectCall) {
+      plan.return_addresses.push_back(address + insn.length);
+    }
+    switch (insn.flow) {
+      case FlowKind::Call:
+        // When stepping over, a direct call to another function returns into
+        // the line without any help.
+        if (into or function.first == function.second or
+            (insn.branch_target() >= function.first and
+             insn.branch_target() < function.second)) {
+          plan.calls.emplace_back(address, insn.length);
+        }
+        break;
+      case FlowKind::IndirectCall:
+        plan.calls.emplace_back(address, insn.length);
+        break;
+      case FlowKind::Jump:
+      case FlowKind::ConditionalJump:
+        if (insn.branch_target() < start or insn.branch_target() >= end) {
+          plan.exits.push_back(insn.branch_target());
+        }
+        break;
+      case FlowKind::Return:
+      case FlowKind::IndirectJump:
+        plan.single_step_sites.push_back(address);
+        break;
+      default:
+        break;
+    }
+    address += insn.length;
+  }
+  std::sort(plan.exits.begin(), plan.exits.end());
+  plan.exits.erase(std::unique(plan.exits.begin(), plan.exits.end()),
+                   plan.exits.end());
+  plan.decoded = true;
+  return plan;
+}
+
+bool Stepper::in_deeper_frame(const RangePlan& plan, const uint64_t rsp) {
+  if (rsp >= plan.frame_rsp or plan.return_addresses.empty()) {
+    return false;
+  }
+  // The line itself may push below the stack pointer it started with, so
+  // look for a return address into it between the two stack pointers. The
+  // calls of the line are made within a few pages of where it started.
+  constexpr uint64_t window = 64 * 1024;
+  const uint64_t low =
+      plan.frame_rsp - rsp > window ? plan.frame_rsp - window : rsp;
+  std::vector<uint64_t> slots((plan.frame_rsp - low) / sizeof(uint64_t));
+  if (not memory_.read(static_cast<std::intptr_t>(low), slots.data(),
+                       slots.size() * sizeof(uint64_t))) {
+    return false;
+  }
+  return std::any_of(slots.begin(), slots.end(), [&plan](const uint64_t slot) {
+    return std::find(plan.return_addresses.begin(),
+                     plan.return_addresses.end(),
+                     static_cast<std::intptr_t>(slot)) !=
+           plan.return_addresses.end();
+  });
+}
+
+void Stepper::set_temporary_breakpoints(
+    const std::vector<std::intptr_t>& addresses) {
+  // Only touch the breakpoints that change, consecutive plans of the same
+  // line share all of them.
+  for (auto it = temporary_breakpoints_.begin();
+       it != temporary_breakpoints_.end();) {
+    if (std::find(addresses.begin(), addresses.end(), it->first) ==
+        addresses.end()) {
+      it->second.disable();
+      it = temporary_breakpoints_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (const std::intptr_t address : addresses) {
+    if (temporary_breakpoints_.count(address) == 0 and
+        not is_user_breakpoint(address)) {
+      Breakpoint bp{pid_, address};
+      temporary_breakpoints_.insert({address, std::move(bp.enable())});
+    }
+  }
+}
+
+void Stepper::clear_temporary_breakpoints() {
+  for (auto& bp : temporary_breakpoints_) {
+    bp.second.disable();
+  }
+  temporary_breakpoints_.clear();
+}
+
+bool Stepper::is_user_breakpoint(const std::intptr_t address) const {
+  const auto it = breakpoints_.find(address);
+  return address != internal_breakpoint_ and it != breakpoints_.end() and
+         it->second.is_enabled();
+}
+
+StepResult Stepper::finish(const StepResult::Status status,
+                           const int wait_status) {
+  StepResult result{};
+  result.stops = stops_;
+  if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+    temporary_breakpoints_.clear();
+    at_breakpoint_ = false;
+    result.status = StepResult::Status::Exited;
+    result.code = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status)
+                                         : 128 + WTERMSIG(wait_status);
+    return result;
+  }
+  clear_temporary_breakpoints();
+  result.status = status;
+  // Steps ending at a user breakpoint leave rip one past it, as if it had
+  // been hit.
+  at_breakpoint_ = status == StepResult::Status::Breakpoint and
+                   WIFSTOPPED(wait_status) and
+                   is_user_breakpoint(static_cast<std::intptr_t>(
+                       get_register_value(pid_, Register::rip) - 1));
+  if (watch_hit_) {
+    result.status = StepResult::Status::Watch;
+  } else if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) != SIGTRAP) {
+    result.status = StepResult::Status::Signal;
+  } else if (WIFSTOPPED(wait_status) and ptrace_event(wait_status) != 0) {
+    result.status = StepResult::Status::Event;
+  }
+  result.code = WIFSTOPPED(wait_status) ? WSTOPSIG(wait_status) : 0;
+  return result;
+}
+}  // namespace nebugger
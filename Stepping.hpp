@@ -0,0 +1,208 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Breakpoint.hpp"
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+class ElfFile;
+class InferiorMemory;
+class InstructionCache;
+class LineTable;
+
+/// How source lines are stepped.
+enum class StepEngine {
+  // One PTRACE_SINGLESTEP per instruction, stepping over calls with a
+  // breakpoint at the return address
+  SingleStep,
+  // Temporary breakpoints at the exits of the line, see `Stepper`
+  Range
+};
+
+/// Why a step ended.
+struct StepResult {
+  // Event: the step was ended by a fork or exec, see `set_event_handler`
+  // Watch: the step was ended by a change of watched memory, see
+  // `set_fault_handler`
+  enum class Status {
+    Done,
+    Breakpoint,
+    Signal,
+    Exited,
+    NoLineInfo,
+    Event,
+    Watch
+  };
+  Status status{Status::Done};
+  // Number of times the inferior stopped during the step
+  std::size_t stops{0};
+  // Signal that stopped, or exit code of, the inferior
+  int code{0};
+};
+
+/// Source-level stepping.
+///
+/// The range engine decodes the instructions of the current line once and
+/// plants temporary breakpoints at every way out of it: the line-table
+/// boundary at its end, targets of branches leaving the line, and the line's
+/// returns and indirect jumps (which are then single-stepped). Direct calls to
+/// other functions need no breakpoint at all since they return into the line.
+/// Indirect and recursive calls get a temporary breakpoint that is turned into
+/// a breakpoint on the return address, with a frame check on `rsp` ignoring
+/// hits from the deeper invocations; the exits of the line are checked the
+/// same way. Loops within a line run without stopping, so stepping over a
+/// line takes a handful of stops regardless of how many instructions
+/// execute. Lines that cannot be decoded are advanced with
+/// `PTRACE_SINGLEBLOCK`, which traps on taken branches only.
+///
+/// User breakpoints hit during a step end it with rip one past the
+/// breakpoint, the same as after `continue`.
+///
+/// Instructions are decoded through the `InstructionCache`, which sees
+/// through the temporary breakpoints, so each line is read and decoded once
+/// however often it is stepped.
+class Stepper {
+ public:
+  Stepper(pid_t pid, InstructionCache& instructions, InferiorMemory& memory,
+          std::unordered_map<std::intptr_t, Breakpoint>& breakpoints)
+      : pid_(pid),
+        instructions_(instructions),
+        memory_(memory),
+        breakpoints_(breakpoints) {}
+
+  /// Step to the start of the next source line. If `into` is true calls to
+  /// functions with line information are entered. `load_address` is added
+  /// to the addresses of `lines` and `elf`.
+  StepResult step_line(const ElfFile& elf, const LineTable& lines,
+                       std::intptr_t load_address, bool into,
+                       StepEngine engine);
+
+  /// Execute a single instruction.
+  StepResult step_instruction();
+
+  /// Call `handler` when a ptrace event such as a fork stops the process
+  /// during a step. The step carries on if it returns true and otherwise
+  /// ends with `StepResult::Status::Event`. Temporary breakpoints are
+  /// forgotten on an exec, which replaces the code they were inserted into.
+  void set_event_handler(std::function<bool(int wait_status)> handler) {
+    event_handler_ = std::move(handler);
+  }
+
+  /// Call `handler` when the process stops with a SIGSEGV during a step,
+  /// which may be a write into memory watched by `RegionWatchpoints`. It
+  /// returns `Done` if it executed the faulting instruction and the step
+  /// carries on, `Watch` if it executed it and the step ends there, and
+  /// `Signal` for a real fault.
+  void set_fault_handler(
+      std::function<StepResult::Status(int wait_status)> handler) {
+    fault_handler_ = std::move(handler);
+  }
+
+  /// Resume the process with PTRACE_SYSCALL instead of PTRACE_CONT while
+  /// `wanted` returns true and call `handler` at its system call stops. Used
+  /// by `RegionWatchpoints` to let the kernel write into watched pages.
+  void set_syscall_handler(std::function<bool()> wanted,
+                           std::function<void()> handler) {
+    syscalls_wanted_ = std::move(wanted);
+    syscall_handler_ = std::move(handler);
+  }
+
+  /// Call `handler` whenever the instruction at `address` is executed during a
+  /// step, instead of ending the step at the breakpoint placed there. Used
+  /// for the breakpoint of the dynamic loader, see `SharedLibraries`.
+  void set_internal_breakpoint(const std::intptr_t address,
+                               std::function<void()> handler) {
+    internal_breakpoint_ = address;
+    internal_handler_ = std::move(handler);
+  }
+
+  /// Whether the process is stopped at a user breakpoint it trapped on, with
+  /// rip one past the int3. Steps rewind rip only then, the debugger sets it
+  /// after the other ways of resuming the process.
+  bool at_breakpoint() const noexcept { return at_breakpoint_; }
+  void set_at_breakpoint(const bool at_breakpoint) noexcept {
+    at_breakpoint_ = at_breakpoint;
+  }
+
+  /// The breakpoints inserted for the step in progress.
+  const std::unordered_map<std::intptr_t, Breakpoint>& temporary_breakpoints()
+      const noexcept {
+    return temporary_breakpoints_;
+  }
+
+ private:
+  struct RangePlan {
+    std::intptr_t start{0};
+    std::intptr_t end{0};
+    bool decoded{false};
+    // Addresses and lengths of the calls to trap, and addresses of returns
+    // and indirect jumps, inside the range
+    std::vector<std::pair<std::intptr_t, uint8_t>> calls{};
+    std::vector<std::intptr_t> single_step_sites{};
+    // Breakpoint addresses at the exits of the range
+    std::vector<std::intptr_t> exits{};
+    // Return addresses of all calls in the range, which mark the frames of
+    // the functions they call on the stack
+    std::vector<std::intptr_t> return_addresses{};
+    // Stack pointer of the frame stepping the range
+    uint64_t frame_rsp{0};
+  };
+
+  // Resume with `request` and wait for the next stop. Returns false if the
+  // process is gone.
+  bool resume(int request, int& wait_status);
+  // Single-step the instruction at the program counter, hiding a user or
+  // temporary breakpoint located there. Instructions `emulate_instruction`
+  // knows are executed without resuming the process.
+  bool single_step(int& wait_status);
+  // Plan the range [start, end) of the function [function_start,
+  // function_end), which may be empty if unknown.
+  RangePlan plan_range(std::intptr_t start, std::intptr_t end,
+                       std::pair<std::intptr_t, std::intptr_t> function,
+                       bool into);
+  // Whether a stop with stack pointer `rsp` is in a deeper invocation than
+  // the one stepping `plan`, i.e. under a call made from the range.
+  bool in_deeper_frame(const RangePlan& plan, uint64_t rsp);
+  void set_temporary_breakpoints(const std::vector<std::intptr_t>& addresses);
+  void clear_temporary_breakpoints();
+  bool is_user_breakpoint(std::intptr_t address) const;
+  StepResult finish(StepResult::Status status, int wait_status);
+  StepResult step_line_single(const LineTable& lines,
+                              std::intptr_t load_address, bool into);
+  StepResult step_line_range(const ElfFile& elf, const LineTable& lines,
+                             std::intptr_t load_address, bool into);
+  // Run until the call made at `call_rsp` returns to `return_address`.
+  bool run_until_return(std::intptr_t return_address, uint64_t call_rsp,
+                        int& wait_status);
+
+  pid_t pid_;
+  InstructionCache& instructions_;
+  InferiorMemory& memory_;
+  std::unordered_map<std::intptr_t, Breakpoint>& breakpoints_;
+  std::unordered_map<std::intptr_t, Breakpoint> temporary_breakpoints_{};
+  std::function<bool(int wait_status)> event_handler_{};
+  std::function<StepResult::Status(int wait_status)> fault_handler_{};
+  std::function<bool()> syscalls_wanted_{};
+  std::function<void()> syscall_handler_{};
+  // Whether the fault handler ended the step in progress
+  bool watch_hit_{false};
+  std::intptr_t internal_breakpoint_{0};
+  std::function<void()> internal_handler_{};
+  std::size_t stops_{0};
+  bool at_breakpoint_{false};
+};
+}  // namespace nebugger
@@ -0,0 +1,104 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Syscall.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#include "Registers.hpp"
+
+namespace nebugger {
+int64_t inject_syscall(const pid_t pid, const int64_t number,
+                       const std::array<uint64_t, 6>& args) {
+  const user_regs_struct saved_regs = get_registers(pid);
+
+  errno = 0;
+  const long saved_text =
+      ptrace(PTRACE_PEEKTEXT, pid, saved_regs.rip, nullptr);
+  if (saved_text == -1 and errno != 0) {
+    std::cerr << "Failed to read text at 0x" << std::hex << saved_regs.rip
+              << std::dec << " while injecting system call " << number << '\n';
+    return -EFAULT;
+  }
+  // The syscall instruction is 0x0f 0x05, which is 0x050f in little endian.
+  const uint64_t syscall_text =
+      (static_cast<uint64_t>(saved_text) & ~0xffffULL) | 0x050f;
+  if (ptrace(PTRACE_POKETEXT, pid, saved_regs.rip, syscall_text) == -1) {
+    std::cerr << "Failed to patch in syscall instruction at 0x" << std::hex
+              << saved_regs.rip << std::dec << '\n';
+    return -EFAULT;
+  }
+
+  user_regs_struct regs = saved_regs;
+  regs.rax = static_cast<uint64_t>(number);
+  regs.rdi = args[0];
+  regs.rsi = args[1];
+  regs.rdx = args[2];
+  regs.r10 = args[3];
+  regs.r8 = args[4];
+  regs.r9 = args[5];
+  // Prevent the kernel from treating the injected instruction as a restart
+  // of an interrupted system call.
+  regs.orig_rax = static_cast<uint64_t>(-1);
+  set_registers(pid, regs);
+
+  int64_t result = -EINTR;
+  int wait_status = 0;
+  if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) == -1 or
+      waitpid(pid, &wait_status, 0) != pid) {
+    std::cerr << "Failed to single step over injected system call " << number
+              << '\n';
+  } else if (not WIFSTOPPED(wait_status) or
+             WSTOPSIG(wait_status) != SIGTRAP) {
+    std::cerr << "Process stopped with unexpected status " << wait_status
+              << " during injected system call " << number << '\n';
+  } else {
+    result = static_cast<int64_t>(get_registers(pid).rax);
+  }
+
+  if (ptrace(PTRACE_POKETEXT, pid, saved_regs.rip, saved_text) == -1) {
+    std::cerr << "Failed to restore text at 0x" << std::hex << saved_regs.rip
+              << std::dec << " after injected system call\n";
+  }
+  set_registers(pid, saved_regs);
+  return result;
+}
+
+std::intptr_t inject_mmap(const pid_t pid, const uint64_t size, const int prot,
+                          const std::intptr_t hint) {
+  const int64_t result = inject_syscall(
+      pid, SYS_mmap,
+      {{static_cast<uint64_t>(hint), size, static_cast<uint64_t>(prot),
+        MAP_PRIVATE | MAP_ANONYMOUS, static_cast<uint64_t>(-1), 0}});
+  // mmap returns a negative errno in [-4095, -1] on failure.
+  if (result < 0 and result > -4096) {
+    std::cerr << "Injected mmap of " << size
+              << " bytes failed with errno: " << -result << '\n';
+    return 0;
+  }
+  return static_cast<std::intptr_t>(result);
+}
+
+bool inject_munmap(const pid_t pid, const std::intptr_t address,
+                   const uint64_t size) {
+  const int64_t result = inject_syscall(
+      pid, SYS_munmap, {{static_cast<uint64_t>(address), size, 0, 0, 0, 0}});
+  if (result != 0) {
+    std::cerr << "Injected munmap of 0x" << std::hex << address << std::dec
+              << " failed with errno: " << -result << '\n';
+    return false;
+  }
+  return true;
+}
+}  // namespace nebugger
@@ -0,0 +1,35 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace nebugger {
+/// Execute the system call `number` with the arguments `args` inside the
+/// stopped process `pid`.
+///
+/// A `syscall` instruction is temporarily patched in at the current program
+/// counter and executed with `PTRACE_SINGLESTEP`. The registers and the
+/// overwritten text are restored afterwards, so the process can be continued
+/// as if nothing happened. Returns the raw value of `rax` after the system
+/// call, i.e. a negative errno on failure.
+int64_t inject_syscall(const pid_t pid, const int64_t number,
+                       const std::array<uint64_t, 6>& args);
+
+/// Map `size` bytes of anonymous memory with protection `prot` into the
+/// process `pid`. Returns 0 on failure. If `hint` is non-zero it is passed to
+/// `mmap` as the preferred address.
+std::intptr_t inject_mmap(const pid_t pid, const uint64_t size, const int prot,
+                          const std::intptr_t hint = 0);
+
+/// Unmap memory previously mapped with `inject_mmap`.
+bool inject_munmap(const pid_t pid, const std::intptr_t address,
+                   const uint64_t size);
+}  // namespace nebugger
@@ -0,0 +1,615 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Tracepoint.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+#include "InstructionCache.hpp"
+#include "Memory.hpp"
+#include "RemoteAllocator.hpp"
+#include "Syscall.hpp"
+#include "X86Decoder.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint64_t ring_capacity = 1 << 14;
+constexpr std::size_t ring_header_size = 64;
+constexpr std::size_t ring_size =
+    ring_header_size + ring_capacity * sizeof(TraceRecord);
+constexpr std::size_t history_capacity = 1 << 16;
+// Size of the patched jmp rel32
+constexpr std::size_t jump_size = 5;
+// Offsets of the fields in a TraceRecord
+constexpr int32_t registers_offset = 40;
+constexpr int32_t memory_offset = 168;
+
+// Names of the general purpose registers in hardware encoding order.
+const char* const hardware_register_names[16] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15"};
+
+int hardware_index(const Register reg) {
+  const std::string name = get_register_name(reg);
+  for (int i = 0; i < 16; ++i) {
+    if (name == hardware_register_names[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+struct CodeBuffer {
+  std::vector<uint8_t> bytes{};
+
+  void emit(std::initializer_list<uint8_t> values) {
+    bytes.insert(bytes.end(), values);
+  }
+  void emit32(const uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+  void emit64(const uint64_t value) {
+    emit32(static_cast<uint32_t>(value));
+    emit32(static_cast<uint32_t>(value >> 32));
+  }
+  // mov [rdx + offset], reg
+  void store_to_record(const int reg, const int32_t offset) {
+    emit({static_cast<uint8_t>(0x48 | (reg >= 8 ? 0x4 : 0)), 0x89,
+          static_cast<uint8_t>(0x82 | ((reg & 0x7) << 3))});
+    emit32(static_cast<uint32_t>(offset));
+  }
+  // mov rax, [rsp + offset]
+  void load_rax_from_stack(const int32_t offset) {
+    emit({0x48, 0x8b, 0x84, 0x24});
+    emit32(static_cast<uint32_t>(offset));
+  }
+};
+
+bool fits_in_int32(const int64_t value) {
+  return value >= INT32_MIN and value <= INT32_MAX;
+}
+
+// Copy `insn` from `original` to the end of `code`, which will be located at
+// `code_address`, fixing up anything relative to the program counter.
+bool relocate(const Instruction& insn, const uint8_t* const original,
+              CodeBuffer& code, const std::intptr_t code_address) {
+  const std::intptr_t new_address =
+      code_address + static_cast<std::intptr_t>(code.bytes.size());
+  if (insn.relative_branch) {
+    const std::intptr_t target = insn.branch_target();
+    if (insn.immediate_size == 4) {
+      const std::size_t start = code.bytes.size();
+      code.bytes.insert(code.bytes.end(), original,
+                        original + insn.immediate_offset);
+      const int64_t displacement =
+          target - (new_address + static_cast<std::intptr_t>(insn.length));
+      if (not fits_in_int32(displacement)) {
+        return false;
+      }
+      code.emit32(static_cast<uint32_t>(displacement));
+      return code.bytes.size() - start == insn.length;
+    }
+    // Short branches are rewritten to their rel32 forms.
+    if (insn.opcode_map == 0 and insn.opcode == 0xeb) {
+      code.emit({0xe9});
+      const int64_t displacement = target - (new_address + 5);
+      if (not fits_in_int32(displacement)) {
+        return false;
+      }
+      code.emit32(static_cast<uint32_t>(displacement));
+      return true;
+    }
+    if (insn.opcode_map == 0 and insn.opcode >= 0x70 and insn.opcode <= 0x7f) {
+      code.emit({0x0f, static_cast<uint8_t>(0x80 + (insn.opcode - 0x70))});
+      const int64_t displacement = target - (new_address + 6);
+      if (not fits_in_int32(displacement)) {
+        return false;
+      }
+      code.emit32(static_cast<uint32_t>(displacement));
+      return true;
+    }
+    // loop and jrcxz have no rel32 form
+    return false;
+  }
+  const std::size_t start = code.bytes.size();
+  code.bytes.insert(code.bytes.end(), original, original + insn.length);
+  if (insn.rip_relative) {
+    const int64_t displacement =
+        static_cast<int64_t>(insn.displacement) +
+        (insn.address - new_address);
+    if (not fits_in_int32(displacement)) {
+      return false;
+    }
+    const auto value = static_cast<int32_t>(displacement);
+    std::memcpy(code.bytes.data() + start + insn.displacement_offset, &value,
+                sizeof(value));
+  }
+  return true;
+}
+}  // namespace
+
+FastTracepoints::~FastTracepoints() {
+  if (drain_thread_.joinable()) {
+    stop_draining_ = true;
+    drain_thread_.join();
+  }
+  if (ring_ != nullptr) {
+    munmap(ring_, ring_size);
+  }
+}
+
+int FastTracepoints::insert(const std::intptr_t address,
+                            const MemoryCollection& collection) {
+  if (collection.length > sizeof(TraceRecord::memory)) {
+    std::cerr << "At most " << sizeof(TraceRecord::memory)
+              << " bytes of memory can be collected per hit\n";
+    return -1;
+  }
+  if (collection.length > 0 and hardware_index(collection.base) == -1) {
+    std::cerr << "Memory can only be collected relative to a general purpose "
+                 "register\n";
+    return -1;
+  }
+  for (const auto& tracepoint : tracepoints_) {
+    if (tracepoint.enabled and
+        address < tracepoint.address +
+                      static_cast<std::intptr_t>(
+                          tracepoint.original_bytes.size()) and
+        tracepoint.address < address + static_cast<std::intptr_t>(jump_size)) {
+      std::cerr << "Tracepoint at 0x" << std::hex << address << std::dec
+                << " overlaps tracepoint " << tracepoint.id << '\n';
+      return -1;
+    }
+  }
+
+  // Decode whole instructions until there is room for the jmp.
+  std::vector<uint8_t> original_bytes{};
+  std::size_t patch_size = 0;
+  while (patch_size < jump_size) {
+    const Instruction* const decoded = instructions_.find(
+        address + static_cast<std::intptr_t>(patch_size));
+    if (decoded == nullptr) {
+      std::cerr << "Failed to read text at 0x" << std::hex << address
+                << std::dec << '\n';
+      return -1;
+    }
+    const Instruction& insn = *decoded;
+    if (not insn.valid or insn.flow == FlowKind::Trap) {
+      std::cerr << "Cannot relocate the instruction at 0x" << std::hex
+                << insn.address << std::dec << '\n';
+      return -1;
+    }
+    patch_size += insn.length;
+    // The cache holds the bytes under our breakpoints, not the int3s.
+    const uint8_t* const bytes = instructions_.bytes(insn);
+    original_bytes.insert(original_bytes.end(), bytes, bytes + insn.length);
+    const bool ends_flow = insn.flow == FlowKind::Jump or
+                           insn.flow == FlowKind::IndirectJump or
+                           insn.flow == FlowKind::Return;
+    if (ends_flow and patch_size < jump_size) {
+      // The instruction following is most likely a branch target.
+      std::cerr << "Not enough room for a jump at 0x" << std::hex << address
+                << std::dec << " before the end of the basic block\n";
+      return -1;
+    }
+  }
+
+  const std::intptr_t rip = static_cast<std::intptr_t>(
+      get_register_value(pid_, Register::rip));
+  if (rip > address and rip < address + static_cast<std::intptr_t>(patch_size)) {
+    std::cerr << "The program counter is inside the instructions to patch\n";
+    return -1;
+  }
+  if (ring_ == nullptr and not setup_ring()) {
+    return -1;
+  }
+
+  Tracepoint tracepoint{static_cast<int>(tracepoints_.size()) + 1,
+                        address,
+                        std::move(original_bytes),
+                        0,
+                        collection,
+                        true};
+  // Generous upper bound of the trampoline size
+  const uint64_t trampoline_capacity = 512 + 2 * patch_size;
+  tracepoint.trampoline = allocator_.allocate_near(trampoline_capacity, address);
+  if (tracepoint.trampoline == 0) {
+    return -1;
+  }
+  bool success = false;
+  const std::vector<uint8_t> code =
+      build_trampoline(tracepoint, tracepoint.trampoline, success);
+  if (not success or code.size() > trampoline_capacity) {
+    std::cerr << "Failed to relocate the instructions at 0x" << std::hex
+              << address << std::dec << " into the trampoline\n";
+    allocator_.deallocate(tracepoint.trampoline);
+    return -1;
+  }
+  if (not memory_.write(tracepoint.trampoline, code.data(), code.size())) {
+    std::cerr << "Failed to write the trampoline\n";
+    allocator_.deallocate(tracepoint.trampoline);
+    return -1;
+  }
+
+  // jmp rel32 to the trampoline, the remaining bytes are filled with int3 so
+  // stray jumps into the patched instructions trap.
+  std::vector<uint8_t> patch(patch_size, 0xcc);
+  patch[0] = 0xe9;
+  const auto displacement = static_cast<int32_t>(
+      tracepoint.trampoline - (address + static_cast<std::intptr_t>(jump_size)));
+  std::memcpy(patch.data() + 1, &displacement, sizeof(displacement));
+  if (not memory_.write(address, patch.data(), patch.size())) {
+    std::cerr << "Failed to patch the jump at 0x" << std::hex << address
+              << std::dec << '\n';
+    // Undo a partial patch before the trampoline it jumps to goes away.
+    memory_.write(address, tracepoint.original_bytes.data(),
+                  tracepoint.original_bytes.size());
+    allocator_.deallocate(tracepoint.trampoline);
+    return -1;
+  }
+  instructions_.invalidate(address, patch.size());
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hit_counts_.resize(static_cast<std::size_t>(tracepoint.id) + 1, 0);
+  }
+  tracepoints_.push_back(std::move(tracepoint));
+  return tracepoints_.back().id;
+}
+
+bool FastTracepoints::remove(const int id) {
+  if (id < 1 or static_cast<std::size_t>(id) > tracepoints_.size() or
+      not tracepoints_[static_cast<std::size_t>(id) - 1].enabled) {
+    std::cerr << "No tracepoint with id " << id << '\n';
+    return false;
+  }
+  Tracepoint& tracepoint = tracepoints_[static_cast<std::size_t>(id) - 1];
+  if (not memory_.write(tracepoint.address, tracepoint.original_bytes.data(),
+                        tracepoint.original_bytes.size())) {
+    std::cerr << "Failed to restore the instructions at 0x" << std::hex
+              << tracepoint.address << std::dec << '\n';
+    return false;
+  }
+  instructions_.invalidate(tracepoint.address,
+                           tracepoint.original_bytes.size());
+  tracepoint.enabled = false;
+  return true;
+}
+
+std::vector<std::pair<std::intptr_t, std::intptr_t>>
+FastTracepoints::patched_ranges() const {
+  std::vector<std::pair<std::intptr_t, std::intptr_t>> ranges{};
+  for (const auto& tracepoint : tracepoints_) {
+    if (tracepoint.enabled) {
+      ranges.emplace_back(
+          tracepoint.address,
+          tracepoint.address +
+              static_cast<std::intptr_t>(tracepoint.original_bytes.size()));
+    }
+  }
+  return ranges;
+}
+
+std::vector<std::pair<std::intptr_t, std::vector<uint8_t>>>
+FastTracepoints::original_code() const {
+  std::vector<std::pair<std::intptr_t, std::vector<uint8_t>>> code{};
+  for (const auto& tracepoint : tracepoints_) {
+    if (tracepoint.enabled) {
+      code.emplace_back(tracepoint.address, tracepoint.original_bytes);
+    }
+  }
+  return code;
+}
+
+void FastTracepoints::print_list(std::ostream& os) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& tracepoint : tracepoints_) {
+    os << tracepoint.id << ": 0x" << std::hex << tracepoint.address
+       << std::dec << (tracepoint.enabled ? "" : " (deleted)") << ", "
+       << hit_counts_[static_cast<std::size_t>(tracepoint.id)] << " hits\n";
+  }
+  os << total_records_ << " records drained, " << lost_records_ << " lost\n";
+}
+
+void FastTracepoints::print_records(std::ostream& os, std::size_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  count = std::min(count, history_.size());
+  for (std::size_t i = 0; i < count; ++i) {
+    const TraceRecord& record =
+        history_[(history_next_ + history_.size() - count + i) %
+                 history_.size()];
+    os << '#' << record.tracepoint_id << " rip 0x" << std::hex << record.rip
+       << " tsc " << std::dec << record.timestamp << std::hex;
+    for (int reg = 0; reg < 16; ++reg) {
+      os << ' ' << hardware_register_names[reg] << " 0x"
+         << record.registers[reg];
+    }
+    const auto& collection =
+        tracepoints_[record.tracepoint_id - 1].collection;
+    if (collection.length > 0) {
+      os << " memory";
+      for (uint32_t byte = 0; byte < collection.length; ++byte) {
+        os << ' ' << std::setw(2) << std::setfill('0')
+           << static_cast<unsigned>(record.memory[byte]);
+      }
+    }
+    os << std::dec << '\n';
+  }
+}
+
+bool FastTracepoints::setup_ring() {
+  // The ring lives in a shared memory file that both processes map. The file
+  // is unlinked again once the inferior has mapped it.
+  static int counter = 0;
+  const std::string path = "/dev/shm/nebugger-" + std::to_string(getpid()) +
+                           "-" + std::to_string(counter++);
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0600);
+  if (fd == -1) {
+    std::cerr << "Failed to create the trace buffer '" << path << "'\n";
+    return false;
+  }
+  if (ftruncate(fd, ring_size) == -1) {
+    std::cerr << "Failed to size the trace buffer '" << path << "'\n";
+    close(fd);
+    unlink(path.c_str());
+    return false;
+  }
+  void* const local =
+      mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (local == MAP_FAILED) {
+    std::cerr << "Failed to map the trace buffer '" << path << "'\n";
+    unlink(path.c_str());
+    return false;
+  }
+
+  const std::intptr_t remote_path = allocator_.allocate(path.size() + 1);
+  bool success = remote_path != 0 and
+                 memory_.write(remote_path, path.c_str(), path.size() + 1);
+  int64_t remote_fd = -1;
+  if (success) {
+    remote_fd = inject_syscall(
+        pid_, SYS_openat,
+        {{static_cast<uint64_t>(AT_FDCWD), static_cast<uint64_t>(remote_path),
+          O_RDWR | O_CLOEXEC, 0, 0, 0}});
+    success = remote_fd >= 0;
+  }
+  if (success) {
+    const int64_t mapped = inject_syscall(
+        pid_, SYS_mmap,
+        {{0, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+          static_cast<uint64_t>(remote_fd), 0}});
+    inject_syscall(pid_, SYS_close,
+                   {{static_cast<uint64_t>(remote_fd), 0, 0, 0, 0, 0}});
+    success = not(mapped < 0 and mapped > -4096);
+    remote_ring_ = static_cast<std::intptr_t>(mapped);
+  }
+  if (remote_path != 0) {
+    allocator_.deallocate(remote_path);
+  }
+  unlink(path.c_str());
+  if (not success) {
+    std::cerr << "Failed to map the trace buffer into the inferior\n";
+    munmap(local, ring_size);
+    return false;
+  }
+
+  ring_ = static_cast<uint8_t*>(local);
+  history_.reserve(history_capacity);
+  drain_thread_ = std::thread([this]() { drain_loop(); });
+  return true;
+}
+
+void FastTracepoints::set_record_callback(
+    std::function<void(const TraceRecord& record)> callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  record_callback_ = std::move(callback);
+}
+
+void FastTracepoints::drain() {
+  auto* const head = reinterpret_cast<uint64_t*>(ring_);
+  auto* const records =
+      reinterpret_cast<TraceRecord*>(ring_ + ring_header_size);
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (true) {
+    const uint64_t current_head = __atomic_load_n(head, __ATOMIC_ACQUIRE);
+    if (current_head == tail_) {
+      return;
+    }
+    if (current_head - tail_ > ring_capacity) {
+      // The inferior lapped us, skip over the overwritten records.
+      lost_records_ += current_head - ring_capacity - tail_;
+      tail_ = current_head - ring_capacity;
+    }
+    TraceRecord& slot = records[tail_ & (ring_capacity - 1)];
+    const uint64_t sequence =
+        __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+    if (sequence < tail_ + 1) {
+      // Still being written
+      return;
+    }
+    if (sequence == tail_ + 1) {
+      TraceRecord record;
+      std::memcpy(&record, &slot, sizeof(record));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      // Check the writer did not start overwriting the slot during the copy.
+      if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == sequence and
+          record.tracepoint_id < hit_counts_.size()) {
+        ++hit_counts_[record.tracepoint_id];
+        ++total_records_;
+        if (history_.size() < history_capacity) {
+          history_.push_back(record);
+        } else {
+          history_[history_next_] = record;
+        }
+        history_next_ = (history_next_ + 1) % history_capacity;
+        if (record_callback_) {
+          record_callback_(record);
+        }
+      } else {
+        ++lost_records_;
+      }
+    } else {
+      ++lost_records_;
+    }
+    ++tail_;
+  }
+}
+
+void FastTracepoints::drain_loop() {
+  while (not stop_draining_) {
+    const uint64_t tail_before = tail_;
+    drain();
+    if (tail_ == tail_before) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+std::vector<uint8_t> FastTracepoints::build_trampoline(
+    const Tracepoint& tracepoint, const std::intptr_t trampoline_address,
+    bool& success) const {
+  CodeBuffer code{};
+  // Step over the red zone and save what we clobber.
+  code.emit({0x48, 0x8d, 0x64, 0x24, 0x80});  // lea rsp, [rsp - 128]
+  code.emit({0x9c});                          // pushfq
+  code.emit({0x50, 0x51, 0x52});              // push rax; push rcx; push rdx
+  code.emit({0x41, 0x53});                    // push r11
+  code.emit({0x0f, 0x31});                    // rdtsc
+  code.emit({0x48, 0xc1, 0xe2, 0x20});        // shl rdx, 32
+  code.emit({0x48, 0x09, 0xd0});              // or rax, rdx
+  code.emit({0x50});                          // push rax
+  // Stack: timestamp, r11, rdx, rcx, rax, rflags
+  constexpr int32_t saved_size = 48;
+
+  // Reserve a slot: r11 = index, rdx = record
+  code.emit({0x48, 0xb9});  // mov rcx, ring
+  code.emit64(static_cast<uint64_t>(remote_ring_));
+  code.emit({0xb8, 0x01, 0x00, 0x00, 0x00});  // mov eax, 1
+  code.emit({0xf0, 0x48, 0x0f, 0xc1, 0x01});  // lock xadd [rcx], rax
+  code.emit({0x49, 0x89, 0xc3});              // mov r11, rax
+  code.emit({0x48, 0x89, 0xc2});              // mov rdx, rax
+  code.emit({0x48, 0x81, 0xe2});              // and rdx, mask
+  code.emit32(static_cast<uint32_t>(ring_capacity - 1));
+  code.emit({0x48, 0xc1, 0xe2, 0x08});  // shl rdx, 8
+  code.emit({0x48, 0x8d, 0x54, 0x11,
+             static_cast<uint8_t>(ring_header_size)});  // lea rdx, [rcx+rdx+64]
+
+  // Mark the record as being written and fill it.
+  code.emit({0x48, 0xc7, 0x02, 0x00, 0x00, 0x00, 0x00});  // mov qword [rdx], 0
+  code.emit({0x48, 0xc7, 0x42, 0x08});  // mov qword [rdx + 8], id
+  code.emit32(static_cast<uint32_t>(tracepoint.id));
+  code.load_rax_from_stack(0);
+  code.store_to_record(0, 16);
+  code.emit({0x48, 0xb8});  // mov rax, address
+  code.emit64(static_cast<uint64_t>(tracepoint.address));
+  code.store_to_record(0, 24);
+  code.load_rax_from_stack(40);
+  code.store_to_record(0, 32);
+  for (int reg = 0; reg < 16; ++reg) {
+    const int32_t offset = registers_offset + 8 * reg;
+    switch (reg) {
+      case 0:
+        code.load_rax_from_stack(32);
+        code.store_to_record(0, offset);
+        break;
+      case 1:
+        code.load_rax_from_stack(24);
+        code.store_to_record(0, offset);
+        break;
+      case 2:
+        code.load_rax_from_stack(16);
+        code.store_to_record(0, offset);
+        break;
+      case 4:
+        code.emit({0x48, 0x8d, 0x84, 0x24});  // lea rax, [rsp + ...]
+        code.emit32(static_cast<uint32_t>(saved_size + 128));
+        code.store_to_record(0, offset);
+        break;
+      case 11:
+        code.load_rax_from_stack(8);
+        code.store_to_record(0, offset);
+        break;
+      default:
+        code.store_to_record(reg, offset);
+    }
+  }
+
+  // Copy the requested memory, using the register values from the record.
+  const MemoryCollection& collection = tracepoint.collection;
+  if (collection.length > 0) {
+    code.emit({0x48, 0x8b, 0x82});  // mov rax, [rdx + register]
+    code.emit32(static_cast<uint32_t>(
+        registers_offset + 8 * hardware_index(collection.base)));
+    // Whole words first, then the bytes left, so that nothing past the
+    // requested memory is read.
+    uint32_t i = 0;
+    for (; i + 8 <= collection.length; i += 8) {
+      code.emit({0x48, 0x8b, 0x88});  // mov rcx, [rax + offset + i]
+      code.emit32(static_cast<uint32_t>(collection.offset +
+                                        static_cast<int32_t>(i)));
+      code.store_to_record(1, memory_offset + static_cast<int32_t>(i));
+    }
+    for (; i < collection.length; ++i) {
+      code.emit({0x8a, 0x88});  // mov cl, [rax + offset + i]
+      code.emit32(static_cast<uint32_t>(collection.offset +
+                                        static_cast<int32_t>(i)));
+      code.emit({0x88, 0x8a});  // mov [rdx + memory + i], cl
+      code.emit32(
+          static_cast<uint32_t>(memory_offset + static_cast<int32_t>(i)));
+    }
+  }
+
+  // Publish the record and restore the registers.
+  code.emit({0x49, 0xff, 0xc3});              // inc r11
+  code.emit({0x4c, 0x89, 0x1a});              // mov [rdx], r11
+  code.emit({0x48, 0x8d, 0x64, 0x24, 0x08});  // lea rsp, [rsp + 8]
+  code.emit({0x41, 0x5b});                    // pop r11
+  code.emit({0x5a, 0x59, 0x58});              // pop rdx; pop rcx; pop rax
+  code.emit({0x9d});                          // popfq
+  code.emit({0x48, 0x8d, 0xa4, 0x24});        // lea rsp, [rsp + 128]
+  code.emit32(128);
+
+  // Run the displaced instructions and jump back.
+  success = true;
+  std::size_t offset = 0;
+  while (offset < tracepoint.original_bytes.size()) {
+    const Instruction insn = decode_instruction(
+        tracepoint.original_bytes.data() + offset,
+        tracepoint.original_bytes.size() - offset,
+        tracepoint.address + static_cast<std::intptr_t>(offset));
+    if (not insn.valid or
+        not relocate(insn, tracepoint.original_bytes.data() + offset, code,
+                     trampoline_address)) {
+      success = false;
+      return code.bytes;
+    }
+    offset += insn.length;
+  }
+  const std::intptr_t jump_address =
+      trampoline_address + static_cast<std::intptr_t>(code.bytes.size());
+  const int64_t displacement =
+      tracepoint.address + static_cast<std::intptr_t>(offset) -
+      (jump_address + static_cast<std::intptr_t>(jump_size));
+  success = fits_in_int32(displacement);
+  code.emit({0xe9});
+  code.emit32(static_cast<uint32_t>(displacement));
+  return code.bytes;
+}
+}  // namespace nebugger
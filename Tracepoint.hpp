@@ -0,0 +1,149 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <sys/types.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Registers.hpp"
+
+namespace nebugger {
+class InferiorMemory;
+class InstructionCache;
+class RemoteAllocator;
+
+/// A single event written by a fast tracepoint into the shared ring buffer.
+struct TraceRecord {
+  // Ring index + 1 once the record is complete, 0 while it is being written
+  uint64_t sequence;
+  uint64_t tracepoint_id;
+  // Value of the time stamp counter at the hit
+  uint64_t timestamp;
+  uint64_t rip;
+  uint64_t rflags;
+  // General purpose registers in hardware encoding order, i.e. rax, rcx,
+  // rdx, rbx, rsp, rbp, rsi, rdi, r8, ..., r15
+  uint64_t registers[16];
+  uint8_t memory[64];
+  uint8_t padding[24];
+};
+static_assert(sizeof(TraceRecord) == 256,
+              "The trampoline code assumes 256 byte trace records");
+
+/// Memory to copy into each record when a fast tracepoint is hit: `length`
+/// bytes (at most 64) starting at the value of `base` plus `offset`. The
+/// trampoline reads the memory without checking it is mapped, if it is not
+/// the inferior crashes with a SIGSEGV.
+struct MemoryCollection {
+  Register base{Register::rsp};
+  int32_t offset{0};
+  uint32_t length{0};
+};
+
+/// Tracepoints that do not stop the inferior.
+///
+/// The instructions at the trace site are replaced by a 5-byte `jmp` to a
+/// trampoline placed within reach of the site. The trampoline saves the
+/// registers, reserves a slot in a ring buffer that lives in shared memory
+/// between the debugger and the inferior, writes the registers and the
+/// requested memory, runs the relocated original instructions and jumps back.
+/// A hit therefore costs a few dozen instructions in the inferior and nothing
+/// in the debugger.
+///
+/// A background thread in the debugger drains the ring into a bounded history
+/// and per-tracepoint hit counts. If the inferior outruns the drain thread the
+/// oldest records are overwritten and counted as lost.
+///
+/// Branches from elsewhere into the middle of the patched instructions cannot
+/// be detected and will misbehave, as with any jump-patching tracer.
+class FastTracepoints {
+ public:
+  FastTracepoints(pid_t pid, RemoteAllocator& allocator,
+                  InferiorMemory& memory, InstructionCache& instructions)
+      : pid_(pid),
+        allocator_(allocator),
+        memory_(memory),
+        instructions_(instructions) {}
+  FastTracepoints(const FastTracepoints&) = delete;
+  FastTracepoints& operator=(const FastTracepoints&) = delete;
+  ~FastTracepoints();
+
+  /// Install a tracepoint at `address`. Returns the id of the tracepoint or
+  /// -1 on failure. The inferior must be stopped and its program counter must
+  /// not point into the middle of the patched instructions.
+  int insert(std::intptr_t address, const MemoryCollection& collection);
+
+  /// Restore the original instructions of the tracepoint `id`. The
+  /// trampoline stays mapped since a thread may still be executing it.
+  bool remove(int id);
+
+  /// The range of bytes [first, second) patched by the tracepoints.
+  std::vector<std::pair<std::intptr_t, std::intptr_t>> patched_ranges() const;
+
+  /// The address and the original instructions of every patched site.
+  std::vector<std::pair<std::intptr_t, std::vector<uint8_t>>> original_code()
+      const;
+
+  void print_list(std::ostream& os);
+  /// Print the last `count` drained records.
+  void print_records(std::ostream& os, std::size_t count);
+
+  /// Call `callback` on the drain thread for every record drained from now
+  /// on, e.g. to stream the hits to a frontend.
+  void set_record_callback(
+      std::function<void(const TraceRecord& record)> callback);
+
+ private:
+  struct Tracepoint {
+    int id;
+    std::intptr_t address;
+    std::vector<uint8_t> original_bytes;
+    std::intptr_t trampoline;
+    MemoryCollection collection;
+    bool enabled;
+  };
+
+  bool setup_ring();
+  void drain();
+  void drain_loop();
+  std::vector<uint8_t> build_trampoline(const Tracepoint& tracepoint,
+                                        std::intptr_t trampoline_address,
+                                        bool& success) const;
+
+  pid_t pid_;
+  RemoteAllocator& allocator_;
+  InferiorMemory& memory_;
+  InstructionCache& instructions_;
+  std::vector<Tracepoint> tracepoints_{};
+
+  // The ring buffer as mapped into the debugger and the inferior
+  uint8_t* ring_{nullptr};
+  std::intptr_t remote_ring_{0};
+  // Next ring index to be read by the drain thread
+  uint64_t tail_{0};
+
+  std::thread drain_thread_{};
+  std::atomic<bool> stop_draining_{false};
+  // Guards everything below, which is written by the drain thread
+  std::mutex mutex_{};
+  std::vector<TraceRecord> history_{};
+  std::size_t history_next_{0};
+  uint64_t total_records_{0};
+  uint64_t lost_records_{0};
+  std::vector<uint64_t> hit_counts_{};
+  std::function<void(const TraceRecord& record)> record_callback_{};
+};
+}  // namespace nebugger
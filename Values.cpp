@@ -0,0 +1,1547 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Values.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+#include "CallFrame.hpp"
+#include "CommandLine.hpp"
+#include "DebugInfo.hpp"
+#include "DwarfReader.hpp"
+#include "ProcessBackend.hpp"
+
+namespace nebugger {
+namespace {
+constexpr uint64_t DW_TAG_unspecified_parameters = 0x18;
+
+// Operations of DWARF expressions, those taking a register number or a
+// literal in the opcode are ranges starting at the given value
+enum : uint8_t {
+  DW_OP_addr = 0x03,
+  DW_OP_deref = 0x06,
+  DW_OP_const1u = 0x08,
+  DW_OP_const1s = 0x09,
+  DW_OP_const2u = 0x0a,
+  DW_OP_const2s = 0x0b,
+  DW_OP_const4u = 0x0c,
+  DW_OP_const4s = 0x0d,
+  DW_OP_const8u = 0x0e,
+  DW_OP_const8s = 0x0f,
+  DW_OP_constu = 0x10,
+  DW_OP_consts = 0x11,
+  DW_OP_dup = 0x12,
+  DW_OP_drop = 0x13,
+  DW_OP_over = 0x14,
+  DW_OP_swap = 0x16,
+  DW_OP_and = 0x1a,
+  DW_OP_minus = 0x1c,
+  DW_OP_mul = 0x1e,
+  DW_OP_neg = 0x1f,
+  DW_OP_or = 0x21,
+  DW_OP_plus = 0x22,
+  DW_OP_plus_uconst = 0x23,
+  DW_OP_lit0 = 0x30,
+  DW_OP_reg0 = 0x50,
+  DW_OP_breg0 = 0x70,
+  DW_OP_regx = 0x90,
+  DW_OP_fbreg = 0x91,
+  DW_OP_bregx = 0x92,
+  DW_OP_piece = 0x93,
+  DW_OP_nop = 0x96,
+  DW_OP_form_tls_address = 0x9b,
+  DW_OP_call_frame_cfa = 0x9c,
+  DW_OP_implicit_value = 0x9e,
+  DW_OP_stack_value = 0x9f,
+  DW_OP_addrx = 0xa1,
+  DW_OP_entry_value = 0xa3,
+  DW_OP_GNU_push_tls_address = 0xe0,
+  DW_OP_GNU_entry_value = 0xf3,
+  DW_OP_GNU_parameter_ref = 0xfa,
+  DW_OP_GNU_addr_index = 0xfb
+};
+
+// Runs of at least this many equal elements are printed once
+constexpr uint64_t repeat_threshold = 10;
+
+bool is_qualifier(const uint64_t tag) {
+  return tag == DW_TAG_typedef or tag == DW_TAG_const_type or
+         tag == DW_TAG_volatile_type or tag == DW_TAG_restrict_type or
+         tag == DW_TAG_atomic_type;
+}
+
+uint64_t load_unsigned(const uint8_t* const data, const std::size_t size) {
+  uint64_t value = 0;
+  std::memcpy(&value, data, std::min<std::size_t>(size, sizeof(value)));
+  return value;
+}
+
+int64_t sign_extend(const uint64_t value, const unsigned bits) {
+  if (bits == 0 or bits >= 64) {
+    return static_cast<int64_t>(value);
+  }
+  const uint64_t sign = uint64_t{1} << (bits - 1);
+  return static_cast<int64_t>(((value & ((sign << 1) - 1)) ^ sign) - sign);
+}
+
+bool is_signed(const TypeLayouts& types, const uint32_t type) {
+  const TypeDescriptor& descriptor = types[type];
+  return descriptor.kind == TypeKind::Signed or
+         descriptor.kind == TypeKind::Char or
+         (descriptor.kind == TypeKind::Enum and
+          descriptor.target != TypeLayouts::none and
+          types[descriptor.target].kind == TypeKind::Signed);
+}
+
+// Copy the `bit_size` bits starting `shift` bits into `data` to `field`,
+// extended to the 16 bytes of the largest integers
+void extract_bit_field(const uint8_t* const data, const uint64_t shift,
+                       const uint32_t bit_size, const bool is_signed,
+                       uint8_t (&field)[16]) {
+  uint8_t bytes[16]{};
+  std::memcpy(bytes, data,
+              std::min<std::size_t>((shift + bit_size + 7) / 8, 16));
+  uint64_t low = 0;
+  std::memcpy(&low, bytes, sizeof(low));
+  uint64_t bits = low >> shift;
+  if (shift != 0) {
+    bits |= uint64_t{bytes[8]} << (64 - shift);
+  }
+  if (bit_size < 64) {
+    bits &= (uint64_t{1} << bit_size) - 1;
+  }
+  const bool negative = is_signed and bit_size > 0 and
+                        ((bits >> std::min(bit_size - 1, 63u)) & 1) != 0;
+  if (negative and bit_size < 64) {
+    bits |= ~uint64_t{0} << bit_size;
+  }
+  std::memset(field, negative ? 0xff : 0, sizeof(field));
+  std::memcpy(field, &bits, sizeof(bits));
+}
+
+void write_char(std::ostream& os, const unsigned char c, const char quote) {
+  switch (c) {
+    case '\a':
+      os << "\\a";
+      return;
+    case '\b':
+      os << "\\b";
+      return;
+    case '\f':
+      os << "\\f";
+      return;
+    case '\n':
+      os << "\\n";
+      return;
+    case '\r':
+      os << "\\r";
+      return;
+    case '\t':
+      os << "\\t";
+      return;
+    case '\v':
+      os << "\\v";
+      return;
+    case '\\':
+      os << "\\\\";
+      return;
+    default:
+      break;
+  }
+  if (c == quote) {
+    os << '\\' << quote;
+  } else if (c >= 0x20 and c < 0x7f) {
+    os << c;
+  } else {
+    os << '\\' << std::oct << std::setw(3) << std::setfill('0')
+       << static_cast<unsigned>(c) << std::dec << std::setfill(' ');
+  }
+}
+
+// Write the shortest decimal representation that reads back as `value`
+template <typename T>
+void write_float(std::ostream& os, const T value) {
+  if (not std::isfinite(value)) {
+    os << (std::isnan(value) ? "nan" : (value < 0 ? "-inf" : "inf"));
+    return;
+  }
+  std::ostringstream text{};
+  for (int precision = 1; precision < std::numeric_limits<T>::max_digits10;
+       ++precision) {
+    text.str({});
+    text << std::setprecision(precision) << value;
+    if (static_cast<T>(std::strtold(text.str().c_str(), nullptr)) == value) {
+      os << text.str();
+      return;
+    }
+  }
+  os << std::setprecision(std::numeric_limits<T>::max_digits10) << value
+     << std::setprecision(6);
+}
+
+std::string_view trim_front(std::string_view text) {
+  while (not text.empty() and std::isspace(static_cast<unsigned char>(
+                                  text.front())) != 0) {
+    text.remove_prefix(1);
+  }
+  return text;
+}
+
+// Remove and return the identifier at the start of `text`, with `::`
+// separating namespaces
+std::string_view take_identifier(std::string_view& text) {
+  std::size_t length = 0;
+  while (length < text.size() and
+         (std::isalnum(static_cast<unsigned char>(text[length])) != 0 or
+          text[length] == '_' or text[length] == ':')) {
+    ++length;
+  }
+  const std::string_view identifier = text.substr(0, length);
+  text.remove_prefix(length);
+  return identifier;
+}
+}  // namespace
+
+uint32_t TypeLayouts::add(TypeDescriptor type) {
+  const auto index = static_cast<uint32_t>(types_.size());
+  types_.push_back(std::move(type));
+  return index;
+}
+
+uint32_t TypeLayouts::compile(const uint64_t entry) {
+  const auto known = by_entry_.find(entry);
+  if (known != by_entry_.end()) {
+    return known->second;
+  }
+  DebugInfoEntry die{};
+  if (entry == 0 or not debug_info_.read_entry(entry, die)) {
+    TypeDescriptor type{};
+    type.kind = entry == 0 ? TypeKind::Void : TypeKind::Unknown;
+    type.name = entry == 0 ? "void" : "<unknown type>";
+    const uint32_t index = add(std::move(type));
+    by_entry_.emplace(entry, index);
+    return index;
+  }
+  if (is_qualifier(die.tag)) {
+    const uint32_t index = die.type != entry ? compile(die.type) : 0;
+    by_entry_.emplace(entry, index);
+    return index;
+  }
+  if (die.tag == DW_TAG_structure_type or die.tag == DW_TAG_class_type or
+      die.tag == DW_TAG_union_type) {
+    return compile_struct(die);
+  }
+  if (die.tag == DW_TAG_array_type) {
+    return compile_array(die);
+  }
+
+  TypeDescriptor type{};
+  type.size = die.byte_size > 0 ? static_cast<uint64_t>(die.byte_size) : 0;
+  type.name = type_name(entry);
+  switch (die.tag) {
+    case DW_TAG_base_type:
+      switch (die.encoding) {
+        case DW_ATE_boolean:
+          type.kind = TypeKind::Bool;
+          break;
+        case DW_ATE_float:
+          type.kind = TypeKind::Float;
+          break;
+        case DW_ATE_signed:
+          type.kind = TypeKind::Signed;
+          break;
+        case DW_ATE_signed_char:
+          type.kind = type.size == 1 ? TypeKind::Char : TypeKind::Signed;
+          break;
+        case DW_ATE_unsigned:
+        case DW_ATE_UTF:
+          type.kind = TypeKind::Unsigned;
+          break;
+        case DW_ATE_unsigned_char:
+          type.kind =
+              type.size == 1 ? TypeKind::UnsignedChar : TypeKind::Unsigned;
+          break;
+        default:
+          type.kind = TypeKind::Unknown;
+      }
+      break;
+    case DW_TAG_pointer_type:
+    case DW_TAG_unspecified_type:
+      type.kind = TypeKind::Pointer;
+      type.size = 8;
+      type.target_entry = die.type;
+      type.text = is_character(die.type);
+      break;
+    case DW_TAG_reference_type:
+    case DW_TAG_rvalue_reference_type:
+      type.kind = TypeKind::Reference;
+      type.size = 8;
+      type.target_entry = die.type;
+      break;
+    case DW_TAG_ptr_to_member_type:
+      type.kind = TypeKind::Unsigned;
+      type.size = type.size == 0 ? 8 : type.size;
+      break;
+    case DW_TAG_subroutine_type:
+      type.kind = TypeKind::Function;
+      break;
+    case DW_TAG_enumeration_type: {
+      type.kind = TypeKind::Enum;
+      type.target = die.type != 0 ? compile(die.type) : TypeLayouts::none;
+      std::vector<EnumeratorDescriptor> enumerators{};
+      DebugInfoEntry child{};
+      for (uint64_t offset = die.has_children ? die.next : 0;
+           offset != 0 and debug_info_.read_entry(offset, child) and
+           child.tag != 0;
+           offset = debug_info_.next_sibling(child)) {
+        if (child.tag == DW_TAG_enumerator and child.name != nullptr) {
+          enumerators.push_back(
+              {child.name, static_cast<int64_t>(child.const_value)});
+        }
+      }
+      type.first = static_cast<uint32_t>(enumerators_.size());
+      type.count = enumerators.size();
+      enumerators_.insert(enumerators_.end(), enumerators.begin(),
+                          enumerators.end());
+      break;
+    }
+    default:
+      type.kind = TypeKind::Unknown;
+  }
+  const uint32_t index = add(std::move(type));
+  by_entry_.emplace(entry, index);
+  return index;
+}
+
+uint32_t TypeLayouts::compile_struct(const DebugInfoEntry& entry) {
+  if (entry.declaration) {
+    // The definition may be in another compilation unit.
+    const uint64_t definition =
+        entry.name != nullptr ? debug_info_.find_type(entry.name) : 0;
+    if (definition != 0 and definition != entry.offset) {
+      const uint32_t index = compile(definition);
+      by_entry_.emplace(entry.offset, index);
+      return index;
+    }
+  }
+  TypeDescriptor type{};
+  type.kind = entry.declaration ? TypeKind::Unknown : TypeKind::Struct;
+  type.size = entry.byte_size > 0 ? static_cast<uint64_t>(entry.byte_size) : 0;
+  type.name = entry.name != nullptr ? entry.name : "<anonymous>";
+  // Registered before the members are compiled, which may refer back to it
+  const uint32_t index = add(std::move(type));
+  by_entry_.emplace(entry.offset, index);
+  if (entry.declaration) {
+    return index;
+  }
+
+  std::vector<MemberDescriptor> members{};
+  DebugInfoEntry child{};
+  for (uint64_t offset = entry.has_children ? entry.next : 0;
+       offset != 0 and debug_info_.read_entry(offset, child) and
+       child.tag != 0;
+       offset = debug_info_.next_sibling(child)) {
+    // Static members are declarations, defined outside of the object.
+    if ((child.tag != DW_TAG_member and child.tag != DW_TAG_inheritance) or
+        child.declaration) {
+      continue;
+    }
+    const uint32_t member_type = compile(child.type);
+    const uint64_t location =
+        child.member_location > 0 ? static_cast<uint64_t>(child.member_location)
+                                  : 0;
+    MemberDescriptor member{child.name, member_type, 8 * location, 0,
+                            child.tag == DW_TAG_inheritance};
+    if (child.bit_size > 0) {
+      member.bit_size = static_cast<uint32_t>(child.bit_size);
+      if (child.data_bit_offset >= 0) {
+        member.bit_position = static_cast<uint64_t>(child.data_bit_offset);
+      } else if (child.bit_offset >= 0) {
+        // DWARF 2 and 3 count from the most significant bit of the storage
+        // unit
+        const uint64_t storage =
+            child.byte_size > 0 ? static_cast<uint64_t>(child.byte_size)
+                                : types_[member_type].size;
+        member.bit_position = 8 * location + 8 * storage -
+                              static_cast<uint64_t>(child.bit_offset) -
+                              member.bit_size;
+      }
+    }
+    members.push_back(member);
+  }
+  types_[index].first = static_cast<uint32_t>(members_.size());
+  types_[index].count = members.size();
+  members_.insert(members_.end(), members.begin(), members.end());
+
+  // The libstdc++ containers are recognized by name and the members that
+  // hold their elements.
+  const std::string_view name = types_[index].name;
+  uint64_t data = 0;
+  uint64_t end = 0;
+  uint32_t data_member = 0;
+  uint32_t end_member = 0;
+  if (name.substr(0, 7) == "vector<" and name.substr(0, 11) != "vector<bool" and
+      find_member(index, "_M_start", data, data_member) and
+      find_member(index, "_M_finish", end, end_member) and
+      types_[members_[data_member].type].kind == TypeKind::Pointer) {
+    types_[index].kind = TypeKind::Vector;
+  } else if (name.substr(0, 13) == "basic_string<" and
+             find_member(index, "_M_p", data, data_member) and
+             find_member(index, "_M_string_length", end, end_member) and
+             types_[members_[data_member].type].kind == TypeKind::Pointer) {
+    types_[index].kind = TypeKind::String;
+    types_[index].text = types_[members_[data_member].type].text;
+  } else {
+    return index;
+  }
+  types_[index].data_offset = static_cast<uint32_t>(data / 8);
+  types_[index].end_offset = static_cast<uint32_t>(end / 8);
+  types_[index].target_entry = types_[members_[data_member].type].target_entry;
+  return index;
+}
+
+uint32_t TypeLayouts::compile_array(const DebugInfoEntry& entry) {
+  const uint32_t element = compile(entry.type);
+  std::vector<uint64_t> counts{};
+  DebugInfoEntry child{};
+  for (uint64_t offset = entry.has_children ? entry.next : 0;
+       offset != 0 and debug_info_.read_entry(offset, child) and
+       child.tag != 0;
+       offset = debug_info_.next_sibling(child)) {
+    if (child.tag != DW_TAG_subrange_type) {
+      continue;
+    }
+    // Arrays of unknown size, e.g. flexible array members, have no elements
+    if (child.count >= 0) {
+      counts.push_back(static_cast<uint64_t>(child.count));
+    } else if (child.upper_bound >= child.lower_bound) {
+      counts.push_back(
+          static_cast<uint64_t>(child.upper_bound - child.lower_bound + 1));
+    } else {
+      counts.push_back(0);
+    }
+  }
+  if (counts.empty()) {
+    counts.push_back(0);
+  }
+  // Multidimensional arrays are arrays of arrays.
+  uint32_t index = element;
+  std::string suffix{};
+  for (std::size_t i = counts.size(); i-- > 0;) {
+    suffix = "[" + std::to_string(counts[i]) + "]" + suffix;
+    TypeDescriptor array{};
+    array.kind = TypeKind::Array;
+    array.target = index;
+    array.count = counts[i];
+    array.size = counts[i] * types_[index].size;
+    array.text = types_[index].kind == TypeKind::Char or
+                 types_[index].kind == TypeKind::UnsignedChar;
+    array.name = types_[element].name + " " + suffix;
+    index = add(std::move(array));
+  }
+  by_entry_.emplace(entry.offset, index);
+  return index;
+}
+
+uint32_t TypeLayouts::target(const uint32_t type) {
+  if (types_[type].target == none) {
+    const uint32_t target = compile(types_[type].target_entry);
+    types_[type].target = target;
+  }
+  return types_[type].target;
+}
+
+uint32_t TypeLayouts::pointer_to(const uint32_t type) {
+  const auto known = pointers_.find(type);
+  if (known != pointers_.end()) {
+    return known->second;
+  }
+  TypeDescriptor pointer{};
+  pointer.kind = TypeKind::Pointer;
+  pointer.size = 8;
+  pointer.target = type;
+  pointer.text = types_[type].kind == TypeKind::Char or
+                 types_[type].kind == TypeKind::UnsignedChar;
+  pointer.name = types_[type].name + " *";
+  const uint32_t index = add(std::move(pointer));
+  pointers_.emplace(type, index);
+  return index;
+}
+
+bool TypeLayouts::find_member(const uint32_t type, const std::string_view name,
+                              uint64_t& bit_position, uint32_t& member) const {
+  const TypeDescriptor& descriptor = types_[type];
+  if (descriptor.kind != TypeKind::Struct and
+      descriptor.kind != TypeKind::Vector and
+      descriptor.kind != TypeKind::String) {
+    return false;
+  }
+  for (uint32_t i = descriptor.first; i < descriptor.first + descriptor.count;
+       ++i) {
+    if (members_[i].name != nullptr and name == members_[i].name) {
+      bit_position = members_[i].bit_position;
+      member = i;
+      return true;
+    }
+  }
+  // Members of bases and of anonymous structures and unions, and for the
+  // containers those of the members holding the elements
+  for (uint32_t i = descriptor.first; i < descriptor.first + descriptor.count;
+       ++i) {
+    if (members_[i].type != type and
+        find_member(members_[i].type, name, bit_position, member)) {
+      bit_position += members_[i].bit_position;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TypeLayouts::is_character(uint64_t entry) const {
+  DebugInfoEntry die{};
+  for (int depth = 0; depth < 8 and debug_info_.read_entry(entry, die);
+       ++depth) {
+    if (not is_qualifier(die.tag)) {
+      return die.tag == DW_TAG_base_type and die.byte_size == 1 and
+             (die.encoding == DW_ATE_signed_char or
+              die.encoding == DW_ATE_unsigned_char);
+    }
+    entry = die.type;
+  }
+  return false;
+}
+
+std::string TypeLayouts::type_name(const uint64_t entry,
+                                   const int depth) const {
+  DebugInfoEntry die{};
+  if (entry == 0) {
+    return "void";
+  }
+  if (depth > 16 or not debug_info_.read_entry(entry, die)) {
+    return "?";
+  }
+  const auto parameters = [this, &die, depth]() {
+    std::string list{};
+    DebugInfoEntry child{};
+    for (uint64_t offset = die.has_children ? die.next : 0;
+         offset != 0 and debug_info_.read_entry(offset, child) and
+         child.tag != 0;
+         offset = debug_info_.next_sibling(child)) {
+      if (child.tag == DW_TAG_formal_parameter) {
+        list += (list.empty() ? "" : ", ") + type_name(child.type, depth + 1);
+      } else if (child.tag == DW_TAG_unspecified_parameters) {
+        list += list.empty() ? "..." : ", ...";
+      }
+    }
+    return "(" + (list.empty() ? std::string{"void"} : list) + ")";
+  };
+  switch (die.tag) {
+    case DW_TAG_const_type:
+      return "const " + type_name(die.type, depth + 1);
+    case DW_TAG_volatile_type:
+      return "volatile " + type_name(die.type, depth + 1);
+    case DW_TAG_pointer_type: {
+      DebugInfoEntry target{};
+      if (debug_info_.read_entry(die.type, target) and
+          target.tag == DW_TAG_subroutine_type) {
+        die = target;
+        return type_name(target.type, depth + 1) + " (*)" + parameters();
+      }
+      return type_name(die.type, depth + 1) + " *";
+    }
+    case DW_TAG_reference_type:
+      return type_name(die.type, depth + 1) + " &";
+    case DW_TAG_rvalue_reference_type:
+      return type_name(die.type, depth + 1) + " &&";
+    case DW_TAG_ptr_to_member_type:
+      return type_name(die.type, depth + 1) + " ::*";
+    case DW_TAG_subroutine_type:
+      return type_name(die.type, depth + 1) + " " + parameters();
+    case DW_TAG_array_type:
+      return type_name(die.type, depth + 1) + " []";
+    default:
+      return die.name != nullptr ? die.name : "<anonymous>";
+  }
+}
+
+struct ValuePrinter::Value {
+  uint32_t type{0};
+  // Where the value is stored, otherwise its bytes are held here
+  bool in_memory{false};
+  std::intptr_t address{0};
+  std::vector<uint8_t> bytes{};
+  bool optimized_out{false};
+};
+
+bool ValuePrinter::print(const std::string_view expression,
+                         const user_regs_struct& registers,
+                         ProcessBackend& process,
+                         const std::intptr_t load_address, std::ostream& os) {
+  if (debug_info_.empty()) {
+    std::cerr << "The program has no debugging information\n";
+    return false;
+  }
+  process_ = &process;
+  registers_ = registers;
+  load_address_ = static_cast<uint64_t>(load_address);
+  function_ = debug_info_.find_function(registers.rip - load_address_);
+
+  Value value{};
+  std::string_view rest = expression;
+  if (not parse_unary(rest, value)) {
+    return false;
+  }
+  rest = trim_front(rest);
+  if (not rest.empty()) {
+    std::cerr << "Unexpected '" << rest << "' in the expression\n";
+    return false;
+  }
+  if (value.optimized_out) {
+    os << "<optimized out>\n";
+    return true;
+  }
+
+  // Gather everything the value is formatted from at once.
+  const uint64_t size = extent(value.type);
+  std::vector<uint8_t> buffer{};
+  if (value.in_memory) {
+    buffer.resize(size);
+    if (not read(value.address, buffer.data(), buffer.size())) {
+      std::cerr << "Cannot access memory at address 0x" << std::hex
+                << value.address << std::dec << '\n';
+      return false;
+    }
+  } else {
+    buffer = std::move(value.bytes);
+    buffer.resize(std::max<uint64_t>(buffer.size(), size));
+  }
+  format(value.type, buffer.data(), os);
+  os << '\n';
+  return true;
+}
+
+bool ValuePrinter::parse_unary(std::string_view& expression, Value& value) {
+  expression = trim_front(expression);
+  if (not expression.empty() and expression.front() == '*') {
+    expression.remove_prefix(1);
+    return parse_unary(expression, value) and dereference(value);
+  }
+  if (not expression.empty() and expression.front() == '&') {
+    expression.remove_prefix(1);
+    if (not parse_unary(expression, value)) {
+      return false;
+    }
+    if (not value.in_memory) {
+      std::cerr << "Cannot take the address of a value not in memory\n";
+      return false;
+    }
+    value.type = types_.pointer_to(value.type);
+    value.in_memory = false;
+    value.bytes.resize(sizeof(value.address));
+    std::memcpy(value.bytes.data(), &value.address, sizeof(value.address));
+    return true;
+  }
+  return parse_postfix(expression, value);
+}
+
+bool ValuePrinter::parse_postfix(std::string_view& expression, Value& value) {
+  expression = trim_front(expression);
+  if (not expression.empty() and expression.front() == '(') {
+    expression.remove_prefix(1);
+    if (not parse_unary(expression, value)) {
+      return false;
+    }
+    expression = trim_front(expression);
+    if (expression.empty() or expression.front() != ')') {
+      std::cerr << "Expected ')' in the expression\n";
+      return false;
+    }
+    expression.remove_prefix(1);
+  } else {
+    const std::string_view name = take_identifier(expression);
+    if (name.empty()) {
+      std::cerr << "Expected a variable at '" << expression << "'\n";
+      return false;
+    }
+    if (not find_variable(name, value)) {
+      std::cerr << "No symbol '" << name << "' in the current context\n";
+      return false;
+    }
+  }
+
+  while (true) {
+    expression = trim_front(expression);
+    if (expression.empty()) {
+      return true;
+    }
+    const bool arrow = expression.substr(0, 2) == "->";
+    if (arrow or expression.front() == '.') {
+      expression.remove_prefix(arrow ? 2 : 1);
+      expression = trim_front(expression);
+      const std::string_view name = take_identifier(expression);
+      if (name.empty()) {
+        std::cerr << "Expected a member name at '" << expression << "'\n";
+        return false;
+      }
+      if ((arrow and not dereference(value)) or not member(value, name)) {
+        return false;
+      }
+    } else if (expression.front() == '[') {
+      const std::size_t close = expression.find(']');
+      uint64_t element = 0;
+      if (close == std::string_view::npos or
+          not parse_integer(
+              std::string_view{expression.substr(1, close - 1)}, element)) {
+        std::cerr << "Expected an integer index at '" << expression << "'\n";
+        return false;
+      }
+      expression.remove_prefix(close + 1);
+      if (not index(value, element)) {
+        return false;
+      }
+    } else {
+      return true;
+    }
+  }
+}
+
+bool ValuePrinter::find_variable(const std::string_view name, Value& value) {
+  const uint64_t pc = registers_.rip - load_address_;
+  uint64_t offset =
+      function_ != 0 ? debug_info_.find_local(function_, pc, name) : 0;
+  if (offset == 0) {
+    offset = debug_info_.find_global(name);
+  }
+  DebugInfoEntry variable{};
+  if (offset == 0 or not debug_info_.read_entry(offset, variable)) {
+    return false;
+  }
+  debug_info_.inherit_from_origin(variable);
+  value = Value{};
+  value.type = types_.compile(variable.type);
+  if (variable.has_const_value) {
+    if (variable.const_block != nullptr) {
+      value.bytes.assign(variable.const_block,
+                         variable.const_block + variable.const_size);
+    } else {
+      value.bytes.resize(sizeof(variable.const_value));
+      std::memcpy(value.bytes.data(), &variable.const_value,
+                  sizeof(variable.const_value));
+    }
+    return true;
+  }
+  const uint8_t* expression = nullptr;
+  std::size_t size = 0;
+  if (not debug_info_.find_expression(variable, variable.location, pc,
+                                      expression, size) or
+      size == 0) {
+    value.optimized_out = true;
+    return true;
+  }
+  if (not evaluate_location(variable, expression, size, value)) {
+    std::cerr << "Cannot compute the location of '" << name << "'\n";
+    // The error has been reported, do not report an unknown symbol.
+    value.optimized_out = true;
+  }
+  return true;
+}
+
+bool ValuePrinter::evaluate_location(const DebugInfoEntry& variable,
+                                     const uint8_t* const expression,
+                                     const std::size_t size, Value& value) {
+  DwarfReader reader{expression, expression + size};
+  std::vector<uint64_t> stack{};
+  // The kind of location described by the operations since the last piece
+  bool in_register = false;
+  uint64_t register_number = 0;
+  bool is_stack_value = false;
+  const uint8_t* implicit = nullptr;
+  std::size_t implicit_size = 0;
+  std::vector<uint8_t> pieces{};
+  bool has_pieces = false;
+
+  const auto pop = [&stack]() {
+    if (stack.empty()) {
+      return uint64_t{0};
+    }
+    const uint64_t top = stack.back();
+    stack.pop_back();
+    return top;
+  };
+  const auto push_register = [this, &stack](const uint64_t number,
+                                            const int64_t offset) {
+    uint64_t content = 0;
+    if (not register_value(number, content)) {
+      return false;
+    }
+    stack.push_back(content + static_cast<uint64_t>(offset));
+    return true;
+  };
+  // Write the current location to `bytes`, returns false if it is unknown
+  const auto location_bytes = [&](const std::size_t count,
+                                  std::vector<uint8_t>& bytes) {
+    bytes.assign(count, 0);
+    uint64_t word = 0;
+    if (implicit != nullptr) {
+      std::memcpy(bytes.data(), implicit, std::min(count, implicit_size));
+    } else if (in_register) {
+      if (not register_value(register_number, word)) {
+        return false;
+      }
+      std::memcpy(bytes.data(), &word, std::min(count, sizeof(word)));
+    } else if (is_stack_value and not stack.empty()) {
+      word = stack.back();
+      std::memcpy(bytes.data(), &word, std::min(count, sizeof(word)));
+    } else if (not stack.empty()) {
+      return read(static_cast<std::intptr_t>(stack.back()), bytes.data(),
+                  count);
+    } else {
+      return false;
+    }
+    return true;
+  };
+
+  while (not reader.at_end() and not reader.overflow()) {
+    const auto op = reader.read<uint8_t>();
+    if (op >= DW_OP_lit0 and op < DW_OP_lit0 + 32) {
+      stack.push_back(op - DW_OP_lit0);
+      continue;
+    }
+    if (op >= DW_OP_reg0 and op < DW_OP_reg0 + 32) {
+      in_register = true;
+      register_number = op - DW_OP_reg0;
+      continue;
+    }
+    if (op >= DW_OP_breg0 and op < DW_OP_breg0 + 32) {
+      if (not push_register(op - DW_OP_breg0, reader.read_sleb128())) {
+        value.optimized_out = true;
+        return true;
+      }
+      continue;
+    }
+    switch (op) {
+      case DW_OP_addr:
+        stack.push_back(reader.read<uint64_t>() + load_address_);
+        break;
+      case DW_OP_addrx:
+      case DW_OP_GNU_addr_index:
+        stack.push_back(
+            debug_info_.indexed_address(variable, reader.read_uleb128()) +
+            load_address_);
+        break;
+      case DW_OP_const1u:
+        stack.push_back(reader.read<uint8_t>());
+        break;
+      case DW_OP_const1s:
+        stack.push_back(static_cast<uint64_t>(int64_t{reader.read<int8_t>()}));
+        break;
+      case DW_OP_const2u:
+        stack.push_back(reader.read<uint16_t>());
+        break;
+      case DW_OP_const2s:
+        stack.push_back(
+            static_cast<uint64_t>(int64_t{reader.read<int16_t>()}));
+        break;
+      case DW_OP_const4u:
+        stack.push_back(reader.read<uint32_t>());
+        break;
+      case DW_OP_const4s:
+        stack.push_back(
+            static_cast<uint64_t>(int64_t{reader.read<int32_t>()}));
+        break;
+      case DW_OP_const8u:
+      case DW_OP_const8s:
+        stack.push_back(reader.read<uint64_t>());
+        break;
+      case DW_OP_constu:
+        stack.push_back(reader.read_uleb128());
+        break;
+      case DW_OP_consts:
+        stack.push_back(static_cast<uint64_t>(reader.read_sleb128()));
+        break;
+      case DW_OP_dup:
+        stack.push_back(stack.empty() ? 0 : stack.back());
+        break;
+      case DW_OP_drop:
+        pop();
+        break;
+      case DW_OP_over:
+        stack.push_back(stack.size() < 2 ? 0 : stack[stack.size() - 2]);
+        break;
+      case DW_OP_swap:
+        if (stack.size() >= 2) {
+          std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+        }
+        break;
+      case DW_OP_and: {
+        const uint64_t b = pop();
+        stack.push_back(pop() & b);
+        break;
+      }
+      case DW_OP_or: {
+        const uint64_t b = pop();
+        stack.push_back(pop() | b);
+        break;
+      }
+      case DW_OP_plus: {
+        const uint64_t b = pop();
+        stack.push_back(pop() + b);
+        break;
+      }
+      case DW_OP_minus: {
+        const uint64_t b = pop();
+        stack.push_back(pop() - b);
+        break;
+      }
+      case DW_OP_mul: {
+        const uint64_t b = pop();
+        stack.push_back(pop() * b);
+        break;
+      }
+      case DW_OP_neg:
+        stack.push_back(~pop() + 1);
+        break;
+      case DW_OP_plus_uconst:
+        stack.push_back(pop() + reader.read_uleb128());
+        break;
+      case DW_OP_deref: {
+        uint64_t word = 0;
+        if (not read(static_cast<std::intptr_t>(pop()), &word, sizeof(word))) {
+          value.optimized_out = true;
+          return true;
+        }
+        stack.push_back(word);
+        break;
+      }
+      case DW_OP_regx:
+        in_register = true;
+        register_number = reader.read_uleb128();
+        break;
+      case DW_OP_bregx: {
+        const uint64_t number = reader.read_uleb128();
+        if (not push_register(number, reader.read_sleb128())) {
+          value.optimized_out = true;
+          return true;
+        }
+        break;
+      }
+      case DW_OP_fbreg: {
+        uint64_t base = 0;
+        if (not frame_base(base)) {
+          return false;
+        }
+        stack.push_back(base + static_cast<uint64_t>(reader.read_sleb128()));
+        break;
+      }
+      case DW_OP_call_frame_cfa: {
+        CfaRule rule{};
+        if (not call_frames_.find_cfa_rule(registers_.rip - load_address_,
+                                           rule) or
+            not push_register(rule.register_number, rule.offset)) {
+          return false;
+        }
+        break;
+      }
+      case DW_OP_stack_value:
+        is_stack_value = true;
+        break;
+      case DW_OP_implicit_value:
+        implicit_size = reader.read_uleb128();
+        implicit = reader.position();
+        reader.skip(implicit_size);
+        break;
+      case DW_OP_piece: {
+        // Parts of the value in different places, parts that are not
+        // described are left zero
+        std::vector<uint8_t> bytes{};
+        const uint64_t piece_size = reader.read_uleb128();
+        location_bytes(piece_size, bytes);
+        pieces.insert(pieces.end(), bytes.begin(), bytes.end());
+        has_pieces = true;
+        stack.clear();
+        in_register = false;
+        is_stack_value = false;
+        implicit = nullptr;
+        break;
+      }
+      case DW_OP_nop:
+        break;
+      case DW_OP_entry_value:
+      case DW_OP_GNU_entry_value:
+      case DW_OP_GNU_parameter_ref:
+        // Values the function was entered with, which are lost
+        value.optimized_out = true;
+        return true;
+      case DW_OP_form_tls_address:
+      case DW_OP_GNU_push_tls_address:
+        std::cerr << "Thread local variables are not supported\n";
+        return false;
+      default:
+        std::cerr << "Unsupported DWARF expression operation 0x" << std::hex
+                  << static_cast<unsigned>(op) << std::dec << '\n';
+        return false;
+    }
+  }
+  if (reader.overflow()) {
+    return false;
+  }
+
+  if (has_pieces) {
+    value.bytes = std::move(pieces);
+  } else if (implicit != nullptr or in_register or is_stack_value) {
+    if (not location_bytes(8, value.bytes)) {
+      value.optimized_out = true;
+    }
+    if (implicit != nullptr) {
+      value.bytes.assign(implicit, implicit + implicit_size);
+    }
+  } else if (not stack.empty()) {
+    value.in_memory = true;
+    value.address = static_cast<std::intptr_t>(stack.back());
+  } else {
+    value.optimized_out = true;
+  }
+  return true;
+}
+
+bool ValuePrinter::frame_base(uint64_t& base) {
+  DebugInfoEntry function{};
+  const uint8_t* expression = nullptr;
+  std::size_t size = 0;
+  if (function_ == 0 or not debug_info_.read_entry(function_, function) or
+      not debug_info_.find_expression(function, function.frame_base,
+                                      registers_.rip - load_address_,
+                                      expression, size)) {
+    return false;
+  }
+  // A register location means the frame base is the register's contents.
+  Value value{};
+  if (not evaluate_location(function, expression, size, value) or
+      value.optimized_out) {
+    return false;
+  }
+  if (value.in_memory) {
+    base = static_cast<uint64_t>(value.address);
+  } else {
+    base = load_unsigned(value.bytes.data(), value.bytes.size());
+  }
+  return true;
+}
+
+bool ValuePrinter::register_value(const uint64_t number,
+                                  uint64_t& value) const {
+  // The DWARF numbering of the general purpose registers of x86-64
+  static constexpr unsigned long long user_regs_struct::*registers[] = {
+      &user_regs_struct::rax, &user_regs_struct::rdx, &user_regs_struct::rcx,
+      &user_regs_struct::rbx, &user_regs_struct::rsi, &user_regs_struct::rdi,
+      &user_regs_struct::rbp, &user_regs_struct::rsp, &user_regs_struct::r8,
+      &user_regs_struct::r9,  &user_regs_struct::r10, &user_regs_struct::r11,
+      &user_regs_struct::r12, &user_regs_struct::r13, &user_regs_struct::r14,
+      &user_regs_struct::r15, &user_regs_struct::rip};
+  if (number >= std::size(registers)) {
+    return false;
+  }
+  value = registers_.*registers[number];
+  return true;
+}
+
+bool ValuePrinter::dereference(Value& value) {
+  if (value.optimized_out) {
+    std::cerr << "Cannot dereference a value that is optimized out\n";
+    return false;
+  }
+  const TypeKind kind = types_[value.type].kind;
+  if (kind == TypeKind::Array) {
+    value.type = types_[value.type].target;
+    return true;
+  }
+  if (kind != TypeKind::Pointer and kind != TypeKind::Reference) {
+    std::cerr << "Cannot dereference a value of type "
+              << types_[value.type].name << '\n';
+    return false;
+  }
+  uint64_t pointer = 0;
+  if (not load(value, 0, &pointer, sizeof(pointer))) {
+    return false;
+  }
+  const uint32_t target = types_.target(value.type);
+  const TypeKind target_kind = types_[target].kind;
+  if (target_kind == TypeKind::Void or target_kind == TypeKind::Function or
+      (target_kind == TypeKind::Unknown and types_[target].size == 0)) {
+    std::cerr << "Cannot dereference a pointer to " << types_[target].name
+              << '\n';
+    return false;
+  }
+  value = Value{};
+  value.type = target;
+  value.in_memory = true;
+  value.address = static_cast<std::intptr_t>(pointer);
+  return true;
+}
+
+bool ValuePrinter::member(Value& value, const std::string_view name) {
+  if (types_[value.type].kind == TypeKind::Reference and
+      not dereference(value)) {
+    return false;
+  }
+  uint64_t bit_position = 0;
+  uint32_t index = 0;
+  if (value.optimized_out or
+      not types_.find_member(value.type, name, bit_position, index)) {
+    std::cerr << "There is no member named '" << name << "' in "
+              << types_[value.type].name << '\n';
+    return false;
+  }
+  const MemberDescriptor member = types_.member(index);
+  const uint64_t size = types_[member.type].size;
+  if (member.bit_size == 0) {
+    value.type = member.type;
+    if (value.in_memory) {
+      value.address += static_cast<std::intptr_t>(bit_position / 8);
+    } else {
+      std::vector<uint8_t> bytes(size, 0);
+      const uint64_t offset = bit_position / 8;
+      if (offset < value.bytes.size()) {
+        std::copy_n(value.bytes.begin() + static_cast<std::ptrdiff_t>(offset),
+                    std::min<uint64_t>(size, value.bytes.size() - offset),
+                    bytes.begin());
+      }
+      value.bytes = std::move(bytes);
+    }
+    return true;
+  }
+  // Bit fields are extracted into a value of their own.
+  uint8_t bytes[16]{};
+  if (not load(value, bit_position / 8, bytes,
+               (bit_position % 8 + member.bit_size + 7) / 8)) {
+    return false;
+  }
+  uint8_t field[16]{};
+  extract_bit_field(bytes, bit_position % 8, member.bit_size,
+                    is_signed(types_, member.type), field);
+  value.type = member.type;
+  value.in_memory = false;
+  value.bytes.assign(field, field + sizeof(field));
+  value.bytes.resize(std::max<uint64_t>(size, sizeof(field)));
+  return true;
+}
+
+bool ValuePrinter::index(Value& value, const uint64_t element) {
+  if (types_[value.type].kind == TypeKind::Reference and
+      not dereference(value)) {
+    return false;
+  }
+  const TypeDescriptor& type = types_[value.type];
+  if (value.optimized_out) {
+    std::cerr << "Cannot index a value that is optimized out\n";
+    return false;
+  }
+  if (type.kind == TypeKind::Array) {
+    if (type.count != 0 and element >= type.count) {
+      std::cerr << "Index " << element << " is out of bounds of "
+                << type.name << '\n';
+      return false;
+    }
+    const uint32_t target = type.target;
+    const uint64_t size = types_[target].size;
+    value.type = target;
+    if (value.in_memory) {
+      value.address += static_cast<std::intptr_t>(element * size);
+    } else {
+      if ((element + 1) * size > value.bytes.size()) {
+        std::cerr << "Index " << element << " is out of bounds\n";
+        return false;
+      }
+      value.bytes = std::vector<uint8_t>(
+          value.bytes.begin() + static_cast<std::ptrdiff_t>(element * size),
+          value.bytes.begin() +
+              static_cast<std::ptrdiff_t>((element + 1) * size));
+    }
+    return true;
+  }
+  if (type.kind == TypeKind::Pointer) {
+    if (not dereference(value)) {
+      return false;
+    }
+    value.address += static_cast<std::intptr_t>(
+        element * types_[value.type].size);
+    return true;
+  }
+  if (type.kind == TypeKind::Vector or type.kind == TypeKind::String) {
+    const uint32_t data_offset = type.data_offset;
+    const uint32_t end_offset = type.end_offset;
+    const bool is_string = type.kind == TypeKind::String;
+    const uint32_t target = types_.target(value.type);
+    const uint64_t size = types_[target].size;
+    uint64_t data = 0;
+    uint64_t end = 0;
+    if (size == 0 or not load(value, data_offset, &data, sizeof(data)) or
+        not load(value, end_offset, &end, sizeof(end))) {
+      return false;
+    }
+    const uint64_t length = is_string ? end : (end - data) / size;
+    if (element >= length) {
+      std::cerr << "Index " << element << " is out of bounds of length "
+                << length << '\n';
+      return false;
+    }
+    value = Value{};
+    value.type = target;
+    value.in_memory = true;
+    value.address = static_cast<std::intptr_t>(data + element * size);
+    return true;
+  }
+  std::cerr << "Cannot index a value of type " << type.name << '\n';
+  return false;
+}
+
+bool ValuePrinter::read(const std::intptr_t address, void* const buffer,
+                        const std::size_t size) {
+  return size == 0 or process_->read_memory(address, buffer, size);
+}
+
+bool ValuePrinter::load(const Value& value, const uint64_t offset,
+                        void* const buffer, const std::size_t size) {
+  if (value.in_memory) {
+    if (not read(value.address + static_cast<std::intptr_t>(offset), buffer,
+                 size)) {
+      std::cerr << "Cannot access memory at address 0x" << std::hex
+                << value.address + static_cast<std::intptr_t>(offset)
+                << std::dec << '\n';
+      return false;
+    }
+    return true;
+  }
+  std::memset(buffer, 0, size);
+  if (offset < value.bytes.size()) {
+    std::memcpy(buffer, value.bytes.data() + offset,
+                std::min<uint64_t>(size, value.bytes.size() - offset));
+  }
+  return true;
+}
+
+uint64_t ValuePrinter::extent(const uint32_t type) const {
+  const TypeDescriptor& descriptor = types_[type];
+  if (descriptor.kind == TypeKind::Array and
+      descriptor.count > element_limit_) {
+    return element_limit_ * types_[descriptor.target].size;
+  }
+  return descriptor.size;
+}
+
+void ValuePrinter::format(const uint32_t type, const uint8_t* const data,
+                          std::ostream& os) {
+  switch (types_[type].kind) {
+    case TypeKind::Void:
+      os << "void";
+      return;
+    case TypeKind::Signed:
+    case TypeKind::Unsigned:
+    case TypeKind::Char:
+    case TypeKind::UnsignedChar:
+    case TypeKind::Bool:
+    case TypeKind::Enum:
+      format_integer(types_[type], data, os);
+      return;
+    case TypeKind::Float: {
+      const uint64_t size = types_[type].size;
+      if (size == sizeof(float)) {
+        float value = 0.0f;
+        std::memcpy(&value, data, sizeof(value));
+        write_float(os, value);
+      } else if (size == sizeof(double)) {
+        double value = 0.0;
+        std::memcpy(&value, data, sizeof(value));
+        write_float(os, value);
+      } else {
+        // The 80-bit x87 format, padded to 16 bytes
+        long double value = 0.0L;
+        std::memcpy(&value, data, std::min<uint64_t>(size, 10));
+        write_float(os, value);
+      }
+      return;
+    }
+    case TypeKind::Pointer: {
+      const uint64_t pointer = load_unsigned(data, 8);
+      if (types_[type].text and pointer != 0) {
+        os << "0x" << std::hex << pointer << std::dec << ' ';
+        format_string(static_cast<std::intptr_t>(pointer),
+                      ~uint64_t{0}, os);
+      } else {
+        os << '(' << types_[type].name << ") 0x" << std::hex << pointer
+           << std::dec;
+      }
+      return;
+    }
+    case TypeKind::Reference: {
+      const uint64_t pointer = load_unsigned(data, 8);
+      const uint32_t target = types_.target(type);
+      os << '(' << types_[type].name << ") @0x" << std::hex << pointer
+         << std::dec << ": ";
+      std::vector<uint8_t> buffer(extent(target));
+      if (not read(static_cast<std::intptr_t>(pointer), buffer.data(),
+                   buffer.size())) {
+        os << "<error: Cannot access memory at address 0x" << std::hex
+           << pointer << std::dec << '>';
+        return;
+      }
+      format(target, buffer.data(), os);
+      return;
+    }
+    case TypeKind::Struct:
+      format_struct(type, data, os);
+      return;
+    case TypeKind::Array: {
+      const uint32_t element = types_[type].target;
+      const uint64_t count = types_[type].count;
+      const uint64_t shown = std::min<uint64_t>(count, element_limit_);
+      if (types_[type].text) {
+        const auto* const null = static_cast<const uint8_t*>(
+            std::memchr(data, 0, static_cast<std::size_t>(shown)));
+        const uint8_t* const end = null != nullptr ? null : data + shown;
+        os << '"';
+        for (const uint8_t* c = data; c != end; ++c) {
+          write_char(os, *c, '"');
+        }
+        os << '"' << (null == nullptr and shown < count ? "..." : "");
+        return;
+      }
+      format_elements(element, data, shown, shown < count, os);
+      return;
+    }
+    case TypeKind::Vector: {
+      const uint64_t begin = load_unsigned(data + types_[type].data_offset, 8);
+      const uint64_t end = load_unsigned(data + types_[type].end_offset, 8);
+      const uint32_t element = types_.target(type);
+      const uint64_t size = types_[element].size;
+      if (size == 0 or end < begin) {
+        format_struct(type, data, os);
+        return;
+      }
+      const uint64_t length = (end - begin) / size;
+      const uint64_t shown = std::min<uint64_t>(length, element_limit_);
+      os << "std::vector of length " << length << " = ";
+      std::vector<uint8_t> buffer(shown * size);
+      if (not read(static_cast<std::intptr_t>(begin), buffer.data(),
+                   buffer.size())) {
+        os << "<error: Cannot access memory at address 0x" << std::hex
+           << begin << std::dec << '>';
+        return;
+      }
+      format_elements(element, buffer.data(), shown, shown < length, os);
+      return;
+    }
+    case TypeKind::String: {
+      const uint64_t pointer =
+          load_unsigned(data + types_[type].data_offset, 8);
+      const uint64_t length = load_unsigned(data + types_[type].end_offset, 8);
+      if (types_[type].text) {
+        format_string(static_cast<std::intptr_t>(pointer), length, os);
+      } else {
+        // Wide strings are printed as their characters.
+        const uint32_t element = types_.target(type);
+        const uint64_t shown = std::min<uint64_t>(length, element_limit_);
+        std::vector<uint8_t> buffer(shown * types_[element].size);
+        if (not read(static_cast<std::intptr_t>(pointer), buffer.data(),
+                     buffer.size())) {
+          os << "<error: Cannot access memory at address 0x" << std::hex
+             << pointer << std::dec << '>';
+          return;
+        }
+        format_elements(element, buffer.data(), shown, shown < length, os);
+      }
+      return;
+    }
+    case TypeKind::Function:
+      os << '{' << types_[type].name << '}';
+      return;
+    case TypeKind::Unknown:
+      os << "<incomplete type " << types_[type].name << '>';
+      return;
+  }
+}
+
+void ValuePrinter::format_integer(const TypeDescriptor& type,
+                                  const uint8_t* const data,
+                                  std::ostream& os) const {
+  const auto size = static_cast<std::size_t>(type.size);
+  if (size == 16 and type.kind != TypeKind::Enum) {
+    // 128-bit integers, divided by 10 in 32-bit limbs for each digit
+    uint32_t limbs[4]{};
+    std::memcpy(limbs, data, sizeof(limbs));
+    const bool negative =
+        type.kind == TypeKind::Signed and (data[15] & 0x80) != 0;
+    if (negative) {
+      uint64_t carry = 1;
+      for (uint32_t& limb : limbs) {
+        carry += uint32_t{~limb};
+        limb = static_cast<uint32_t>(carry);
+        carry >>= 32;
+      }
+    }
+    std::string digits{};
+    do {
+      uint64_t remainder = 0;
+      for (std::size_t i = 4; i-- > 0;) {
+        const uint64_t current = (remainder << 32) | limbs[i];
+        limbs[i] = static_cast<uint32_t>(current / 10);
+        remainder = current % 10;
+      }
+      digits.insert(digits.begin(), static_cast<char>('0' + remainder));
+    } while ((limbs[0] | limbs[1] | limbs[2] | limbs[3]) != 0);
+    os << (negative ? "-" : "") << digits;
+    return;
+  }
+  const uint64_t raw = load_unsigned(data, size);
+  const auto bits = static_cast<unsigned>(8 * std::min<std::size_t>(size, 8));
+  switch (type.kind) {
+    case TypeKind::Bool:
+      if (raw <= 1) {
+        os << (raw == 1 ? "true" : "false");
+      } else {
+        os << raw;
+      }
+      return;
+    case TypeKind::Char:
+    case TypeKind::UnsignedChar:
+      if (type.kind == TypeKind::Char) {
+        os << sign_extend(raw, bits);
+      } else {
+        os << raw;
+      }
+      os << " '";
+      write_char(os, static_cast<unsigned char>(raw), '\'');
+      os << '\'';
+      return;
+    case TypeKind::Signed:
+      os << sign_extend(raw, bits);
+      return;
+    case TypeKind::Enum: {
+      const bool is_signed =
+          type.target != TypeLayouts::none and
+          types_[type.target].kind == TypeKind::Signed;
+      const int64_t value =
+          is_signed ? sign_extend(raw, bits) : static_cast<int64_t>(raw);
+      for (uint32_t i = type.first; i < type.first + type.count; ++i) {
+        const EnumeratorDescriptor& enumerator = types_.enumerator(i);
+        if (enumerator.value == value or
+            static_cast<uint64_t>(enumerator.value) == raw) {
+          os << enumerator.name;
+          return;
+        }
+      }
+      if (is_signed) {
+        os << value;
+      } else {
+        os << raw;
+      }
+      return;
+    }
+    default:
+      os << raw;
+  }
+}
+
+void ValuePrinter::format_struct(const uint32_t type, const uint8_t* const data,
+                                 std::ostream& os) {
+  const uint32_t first = types_[type].first;
+  const uint64_t count = types_[type].count;
+  os << '{';
+  for (uint32_t i = first; i < first + count; ++i) {
+    // Copied, formatting may compile types and grow the member array
+    const MemberDescriptor member = types_.member(i);
+    os << (i == first ? "" : ", ");
+    if (member.is_base) {
+      os << '<' << types_[member.type].name << "> = ";
+    } else if (member.name != nullptr) {
+      os << member.name << " = ";
+    }
+    if (member.bit_size == 0) {
+      format(member.type, data + member.bit_position / 8, os);
+      continue;
+    }
+    uint8_t field[16]{};
+    extract_bit_field(data + member.bit_position / 8, member.bit_position % 8,
+                      member.bit_size, is_signed(types_, member.type), field);
+    format(member.type, field, os);
+  }
+  os << '}';
+}
+
+void ValuePrinter::format_elements(const uint32_t element,
+                                   const uint8_t* const data,
+                                   const uint64_t count, const bool truncated,
+                                   std::ostream& os) {
+  const uint64_t size = types_[element].size;
+  os << '{';
+  for (uint64_t i = 0; i < count;) {
+    uint64_t run = 1;
+    while (size > 0 and i + run < count and
+           std::memcmp(data + i * size, data + (i + run) * size, size) == 0) {
+      ++run;
+    }
+    if (run < repeat_threshold) {
+      run = 1;
+    }
+    os << (i == 0 ? "" : ", ");
+    format(element, data + i * size, os);
+    if (run > 1) {
+      os << " <repeats " << run << " times>";
+    }
+    i += run;
+  }
+  os << (truncated ? "..." : "") << '}';
+}
+
+void ValuePrinter::format_string(const std::intptr_t address,
+                                 const uint64_t length, std::ostream& os) {
+  // Strings of unknown length end at a null character. They are read a page
+  // at a time, so a string ending just before an unmapped page is read.
+  constexpr std::size_t page_size = 4096;
+  const uint64_t limit = std::min<uint64_t>(length, element_limit_);
+  std::vector<uint8_t> text{};
+  bool terminated = false;
+  while (text.size() < limit and not terminated) {
+    const std::intptr_t position =
+        address + static_cast<std::intptr_t>(text.size());
+    const std::size_t chunk = std::min<uint64_t>(
+        limit - text.size(),
+        length == ~uint64_t{0}
+            ? page_size - static_cast<std::size_t>(position) % page_size
+            : limit);
+    const std::size_t start = text.size();
+    text.resize(start + chunk);
+    if (not read(position, text.data() + start, chunk)) {
+      os << "<error: Cannot access memory at address 0x" << std::hex
+         << position << std::dec << '>';
+      return;
+    }
+    if (length == ~uint64_t{0}) {
+      const auto* const end = static_cast<const uint8_t*>(
+          std::memchr(text.data() + start, 0, chunk));
+      if (end != nullptr) {
+        text.resize(static_cast<std::size_t>(end - text.data()));
+        terminated = true;
+      }
+    }
+  }
+  os << '"';
+  for (const uint8_t c : text) {
+    write_char(os, c, '"');
+  }
+  os << '"' << (not terminated and text.size() < length ? "..." : "");
+}
+}  // namespace nebugger
@@ -0,0 +1,225 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/user.h>
+#include <unordered_map>
+#include <vector>
+
+namespace nebugger {
+class CallFrameInfo;
+class DebugInfo;
+struct DebugInfoEntry;
+class ProcessBackend;
+
+/// What a `TypeDescriptor` describes.
+enum class TypeKind : uint8_t {
+  Void,
+  Signed,
+  Unsigned,
+  Char,
+  UnsignedChar,
+  Bool,
+  Float,
+  Enum,
+  Pointer,
+  Reference,
+  Struct,
+  Array,
+  Function,
+  // A libstdc++ `std::vector`, printed as its elements
+  Vector,
+  // A libstdc++ `std::basic_string`, printed as its characters
+  String,
+  // Types only declared, or of kinds that cannot be printed
+  Unknown
+};
+
+/// The layout of a type, compiled from its entries in `.debug_info`.
+///
+/// Typedefs and qualifiers compile to the type they qualify, so a value is
+/// formatted by following descriptors only.
+struct TypeDescriptor {
+  TypeKind kind{TypeKind::Unknown};
+  uint64_t size{0};
+  // The pointee, element or enumeration's underlying type. Pointees are
+  // compiled from `target_entry` when first needed, see
+  // `TypeLayouts::target`.
+  uint32_t target{~uint32_t{0}};
+  uint64_t target_entry{0};
+  // Members or enumerators [first, first + count), or the number of elements
+  // of an array
+  uint32_t first{0};
+  uint64_t count{0};
+  // Offsets of the pointers to the first and past the last element of a
+  // `Vector`, or of the character pointer and the length of a `String`
+  uint32_t data_offset{0};
+  uint32_t end_offset{0};
+  // Pointers to and arrays of characters are printed as strings
+  bool text{false};
+  std::string name{};
+};
+
+/// A data member or base class of a structure, class or union.
+struct MemberDescriptor {
+  // nullptr for anonymous members
+  const char* name;
+  uint32_t type;
+  uint64_t bit_position;
+  // 0 unless the member is a bit field
+  uint32_t bit_size;
+  bool is_base;
+};
+
+struct EnumeratorDescriptor {
+  const char* name;
+  int64_t value;
+};
+
+/// Type layouts compiled once into flat arrays of descriptors.
+///
+/// Member offsets, sizes and bit fields are decoded from `.debug_info` the
+/// first time a type is used and looked up by index afterwards, so printing
+/// the thousandth element of an array does not touch the DWARF again.
+/// Descriptors are only ever appended, so indices stay valid, but references
+/// into the arrays do not survive a call that compiles a type.
+class TypeLayouts {
+ public:
+  static constexpr uint32_t none = ~uint32_t{0};
+
+  explicit TypeLayouts(const DebugInfo& debug_info)
+      : debug_info_(debug_info) {}
+
+  /// The descriptor of the type whose entry is at `entry`, 0 for void.
+  uint32_t compile(uint64_t entry);
+
+  /// The pointee of a pointer or reference, or the element of a `Vector`.
+  uint32_t target(uint32_t type);
+
+  /// A pointer to `type`, for taking addresses.
+  uint32_t pointer_to(uint32_t type);
+
+  const TypeDescriptor& operator[](const uint32_t type) const {
+    return types_[type];
+  }
+  const MemberDescriptor& member(const uint32_t index) const {
+    return members_[index];
+  }
+  const EnumeratorDescriptor& enumerator(const uint32_t index) const {
+    return enumerators_[index];
+  }
+
+  /// Find the data member `name` of the structure `type`, of its bases or
+  /// of its anonymous members. Sets `member` to its index and
+  /// `bit_position` to its position in `type`.
+  bool find_member(uint32_t type, std::string_view name,
+                   uint64_t& bit_position, uint32_t& member) const;
+
+  /// Number of compiled descriptors.
+  std::size_t size() const noexcept { return types_.size(); }
+
+ private:
+  uint32_t add(TypeDescriptor type);
+  uint32_t compile_struct(const DebugInfoEntry& entry);
+  uint32_t compile_array(const DebugInfoEntry& entry);
+  // Whether the entry names a character type, seeing through qualifiers
+  bool is_character(uint64_t entry) const;
+  std::string type_name(uint64_t entry, int depth = 0) const;
+
+  const DebugInfo& debug_info_;
+  std::vector<TypeDescriptor> types_{};
+  std::vector<MemberDescriptor> members_{};
+  std::vector<EnumeratorDescriptor> enumerators_{};
+  std::unordered_map<uint64_t, uint32_t> by_entry_{};
+  std::unordered_map<uint32_t, uint32_t> pointers_{};
+};
+
+/// Evaluates expressions on the variables of a stopped program and prints
+/// their values according to their DWARF types.
+///
+/// Expressions are variable names, qualified with their namespaces for
+/// globals, followed by `.member`, `->member` and `[index]`, and prefixed by
+/// `*` and `&`. Locals and parameters are those of the innermost frame.
+///
+/// All the memory a value needs is gathered with one read before it is
+/// formatted, only the contents of strings, `std::vector`s and references
+/// take another read each. Arrays and containers are printed up to
+/// `element_limit` elements, runs of equal elements are collapsed, so
+/// printing a large container stays interactive.
+class ValuePrinter {
+ public:
+  static constexpr std::size_t default_element_limit = 200;
+
+  ValuePrinter(const DebugInfo& debug_info, const CallFrameInfo& call_frames)
+      : debug_info_(debug_info),
+        call_frames_(call_frames),
+        types_(debug_info) {}
+
+  /// Write the value of `expression` in the program stopped with `registers`
+  /// to `os`. The executable is loaded at `load_address`. Errors are written
+  /// to stderr.
+  bool print(std::string_view expression, const user_regs_struct& registers,
+             ProcessBackend& process, std::intptr_t load_address,
+             std::ostream& os);
+
+  void set_element_limit(const std::size_t limit) noexcept {
+    element_limit_ = limit;
+  }
+
+  const TypeLayouts& layouts() const noexcept { return types_; }
+
+ private:
+  struct Value;
+
+  bool parse_unary(std::string_view& expression, Value& value);
+  bool parse_postfix(std::string_view& expression, Value& value);
+  bool find_variable(std::string_view name, Value& value);
+  bool evaluate_location(const DebugInfoEntry& variable,
+                         const uint8_t* expression, std::size_t size,
+                         Value& value);
+  bool frame_base(uint64_t& base);
+  bool register_value(uint64_t number, uint64_t& value) const;
+  bool dereference(Value& value);
+  bool member(Value& value, std::string_view name);
+  bool index(Value& value, uint64_t element);
+  bool read(std::intptr_t address, void* buffer, std::size_t size);
+  // Copy `size` bytes at `offset` into `value`, from memory or its bytes
+  bool load(const Value& value, uint64_t offset, void* buffer,
+            std::size_t size);
+
+  // Write the value of `type` stored at `data`
+  void format(uint32_t type, const uint8_t* data, std::ostream& os);
+  void format_integer(const TypeDescriptor& type, const uint8_t* data,
+                      std::ostream& os) const;
+  void format_struct(uint32_t type, const uint8_t* data, std::ostream& os);
+  // Write `count` elements of `element` stored at `data`, collapsing runs
+  void format_elements(uint32_t element, const uint8_t* data,
+                       uint64_t count, bool truncated, std::ostream& os);
+  void format_string(std::intptr_t address, uint64_t length,
+                     std::ostream& os);
+  // Bytes of `type` that are formatted, less than its size for arrays
+  // longer than the element limit
+  uint64_t extent(uint32_t type) const;
+
+  const DebugInfo& debug_info_;
+  const CallFrameInfo& call_frames_;
+  TypeLayouts types_;
+  std::size_t element_limit_{default_element_limit};
+
+  // State of the current `print`
+  ProcessBackend* process_{nullptr};
+  user_regs_struct registers_{};
+  uint64_t load_address_{0};
+  uint64_t function_{0};
+};
+}  // namespace nebugger
@@ -0,0 +1,329 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "Watchpoint.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <utility>
+
+#include "Emulator.hpp"
+#include "InstructionCache.hpp"
+#include "Memory.hpp"
+#include "MemoryMap.hpp"
+#include "Registers.hpp"
+#include "Stats.hpp"
+#include "Syscall.hpp"
+
+namespace nebugger {
+namespace {
+constexpr std::intptr_t page_size = 4096;
+// Most bytes one instruction writes: a zmm register. String instructions
+// with a rep prefix trap after each iteration when single-stepped.
+constexpr std::intptr_t max_write_size = 64;
+
+std::intptr_t page_of(const std::intptr_t address) {
+  return address & ~(page_size - 1);
+}
+}  // namespace
+
+std::size_t RegionWatchpoints::add(const std::intptr_t address,
+                                   const std::size_t length) {
+  if (length == 0) {
+    std::cerr << "Cannot watch an empty region\n";
+    return 0;
+  }
+  const std::intptr_t end = address + static_cast<std::intptr_t>(length);
+  const std::vector<MemoryRegion> map = read_memory_map(pid_);
+  std::vector<std::intptr_t> pages{};
+  std::vector<std::pair<std::intptr_t, int>> added{};
+  for (std::intptr_t page = page_of(address); page < end; page += page_size) {
+    pages.push_back(page);
+    if (pages_.count(page) > 0) {
+      continue;
+    }
+    const auto region = std::find_if(
+        map.begin(), map.end(), [page](const MemoryRegion& candidate) {
+          return page >= candidate.start and page < candidate.end;
+        });
+    if (region == map.end() or not region->writable) {
+      std::cerr << "Address 0x" << std::hex << std::max(page, address)
+                << std::dec << " is not in writable memory\n";
+      return 0;
+    }
+    added.emplace_back(page, (region->readable ? PROT_READ : 0) | PROT_WRITE |
+                                 (region->executable ? PROT_EXEC : 0));
+  }
+  pages_.insert(added.begin(), added.end());
+  if (not protect(pages, true)) {
+    std::cerr << "Failed to protect the pages of the region\n";
+    std::vector<std::intptr_t> restore{};
+    for (const auto& page : added) {
+      restore.push_back(page.first);
+    }
+    protect(restore, false);
+    for (const auto& page : added) {
+      pages_.erase(page.first);
+    }
+    return 0;
+  }
+  regions_.push_back({next_id_, address, end, 0});
+  return next_id_++;
+}
+
+bool RegionWatchpoints::remove(const std::size_t id) {
+  const auto region =
+      std::find_if(regions_.begin(), regions_.end(),
+                   [id](const WatchRegion& watch) { return watch.id == id; });
+  if (region == regions_.end()) {
+    std::cerr << "No watch region with id " << id << '\n';
+    return false;
+  }
+  const std::intptr_t start = page_of(region->start);
+  const std::intptr_t end = region->end;
+  regions_.erase(region);
+  std::vector<std::intptr_t> released{};
+  for (std::intptr_t page = start; page < end; page += page_size) {
+    const bool watched = std::any_of(
+        regions_.begin(), regions_.end(), [page](const WatchRegion& watch) {
+          return watch.start < page + page_size and watch.end > page;
+        });
+    if (not watched) {
+      released.push_back(page);
+    }
+  }
+  const bool success = protect(released, false);
+  for (const std::intptr_t page : released) {
+    pages_.erase(page);
+  }
+  return success;
+}
+
+std::vector<ProtectedPages> RegionWatchpoints::protected_pages() const {
+  std::vector<ProtectedPages> result{};
+  for (const auto& [page, protection] : pages_) {
+    if (not result.empty() and
+        result.back().start + static_cast<std::intptr_t>(
+                                  result.back().length) == page and
+        result.back().protection == protection) {
+      result.back().length += page_size;
+    } else {
+      result.push_back({page, page_size, protection});
+    }
+  }
+  return result;
+}
+
+bool RegionWatchpoints::handle_syscall() {
+  __ptrace_syscall_info info{};
+  if (ptrace(PTRACE_GET_SYSCALL_INFO, pid_, sizeof(info), &info) <= 0) {
+    return false;
+  }
+  if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+    std::array<uint64_t, 6> args{};
+    std::copy_n(info.entry.args, args.size(), args.begin());
+    if (lifted_ or not may_write_pages(info.entry.nr, args)) {
+      return true;
+    }
+    // The protection can only be changed once the process is out of the
+    // kernel, so the call is skipped and made again.
+    skipped_call_ = get_registers(pid_);
+    user_regs_struct regs = skipped_call_;
+    regs.orig_rax = ~0ULL;
+    set_registers(pid_, regs);
+    skipped_ = true;
+    return true;
+  }
+  if (info.op != PTRACE_SYSCALL_INFO_EXIT) {
+    return true;
+  }
+  if (skipped_) {
+    skipped_ = false;
+    lifted_ = protect_all(false);
+    // Back at the syscall instruction, `int 0x80` and `sysenter` are as long
+    user_regs_struct regs = skipped_call_;
+    regs.rax = skipped_call_.orig_rax;
+    regs.rip -= 2;
+    set_registers(pid_, regs);
+    return lifted_;
+  }
+  if (lifted_) {
+    // An interrupted call leaves a signal to deliver, which would stop the
+    // injected mprotect. The protection is put back at the exit of the call
+    // made next, the restarted one or that returning from the handler.
+    const int64_t result = info.exit.rval;
+    if (result == -EINTR or (result <= -512 and result >= -516)) {
+      return true;
+    }
+    lifted_ = false;
+    return protect_all(true);
+  }
+  return true;
+}
+
+WatchFault RegionWatchpoints::handle_fault(WatchHit& hit) {
+  siginfo_t info{};
+  if (ptrace(PTRACE_GETSIGINFO, pid_, nullptr, &info) == -1 or
+      info.si_signo != SIGSEGV or info.si_code != SEGV_ACCERR) {
+    return WatchFault::NotWatched;
+  }
+  const auto address = reinterpret_cast<std::intptr_t>(info.si_addr);
+  const std::intptr_t start = page_of(address);
+  if (pages_.count(start) == 0) {
+    return WatchFault::NotWatched;
+  }
+  // A write may reach into the next page.
+  std::intptr_t end = start + page_size;
+  if (pages_.count(end) > 0) {
+    end += page_size;
+  }
+  // The fault address is where the write starts, or the start of the page if
+  // it began in an unprotected, and therefore unwatched, page before.
+  const auto size =
+      static_cast<std::size_t>(std::min(address + max_write_size, end) -
+                               address);
+  std::array<uint8_t, max_write_size> before{};
+  std::array<uint8_t, max_write_size> after{};
+  hit.pc = static_cast<std::intptr_t>(get_registers(pid_).rip);
+  if (not memory_.read(address, before.data(), size) or
+      not execute_write(start, end) or
+      not memory_.read(address, after.data(), size)) {
+    return WatchFault::Failed;
+  }
+  const std::intptr_t written_end = address + static_cast<std::intptr_t>(size);
+  for (WatchRegion& region : regions_) {
+    if (region.end <= address or region.start >= written_end) {
+      continue;
+    }
+    const auto first =
+        static_cast<std::size_t>(std::max(region.start, address) - address);
+    const auto last =
+        static_cast<std::size_t>(std::min(region.end, written_end) - address);
+    std::size_t changed = last;
+    for (std::size_t i = first; i < last; ++i) {
+      if (before[i] == after[i]) {
+        continue;
+      }
+      if (changed == last) {
+        changed = i;
+      }
+      hit.length = i + 1 - changed;
+    }
+    if (changed == last) {
+      continue;
+    }
+    ++region.hits;
+    hit.id = region.id;
+    hit.address = address + static_cast<std::intptr_t>(changed);
+    std::copy_n(before.begin() + changed, hit.length, hit.old_bytes.begin());
+    std::copy_n(after.begin() + changed, hit.length, hit.new_bytes.begin());
+    return WatchFault::Hit;
+  }
+  return WatchFault::Resume;
+}
+
+bool RegionWatchpoints::protect(const std::vector<std::intptr_t>& pages,
+                                const bool watch) {
+  bool success = true;
+  std::size_t run = 0;
+  for (std::size_t i = 1; i <= pages.size(); ++i) {
+    // Consecutive pages with the same protection take one call.
+    if (i < pages.size() and pages[i] == pages[i - 1] + page_size and
+        pages_.at(pages[i]) == pages_.at(pages[run])) {
+      continue;
+    }
+    int protection = pages_.at(pages[run]);
+    if (watch) {
+      protection &= ~PROT_WRITE;
+    }
+    success = inject_syscall(pid_, SYS_mprotect,
+                             {{static_cast<uint64_t>(pages[run]),
+                               static_cast<uint64_t>(pages[i - 1] + page_size -
+                                                     pages[run]),
+                               static_cast<uint64_t>(protection), 0, 0,
+                               0}}) == 0 and
+              success;
+    run = i;
+  }
+  return success;
+}
+
+bool RegionWatchpoints::may_write_pages(
+    const uint64_t number, const std::array<uint64_t, 6>& args) const {
+  switch (number) {
+    // Calls writing into buffers listed in memory
+    case SYS_readv:
+    case SYS_preadv:
+    case SYS_preadv2:
+    case SYS_recvmsg:
+    case SYS_recvmmsg:
+    case SYS_process_vm_readv:
+      return true;
+    default:
+      break;
+  }
+  constexpr uint64_t max_size = uint64_t{1} << 30;
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    const auto start = static_cast<std::intptr_t>(args[i]);
+    const uint64_t size =
+        i + 1 < args.size() and args[i + 1] != 0 and args[i + 1] < max_size
+            ? args[i + 1]
+            : 1;
+    const auto page = pages_.lower_bound(page_of(start));
+    if (start > 0 and page != pages_.end() and
+        page->first < start + static_cast<std::intptr_t>(size)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RegionWatchpoints::protect_all(const bool watch) {
+  std::vector<std::intptr_t> pages{};
+  for (const auto& page : pages_) {
+    pages.push_back(page.first);
+  }
+  return protect(pages, watch);
+}
+
+bool RegionWatchpoints::execute_write(const std::intptr_t start,
+                                      const std::intptr_t end) {
+  user_regs_struct regs = get_registers(pid_);
+  if (const Instruction* const insn =
+          instructions_.find(static_cast<std::intptr_t>(regs.rip))) {
+    const LatencyTimer timer{Probe::Emulate};
+    if (emulate_instruction(*insn, instructions_.bytes(*insn), regs, memory_,
+                            {start, end})) {
+      set_registers(pid_, regs);
+      return true;
+    }
+  }
+  std::vector<std::intptr_t> pages{};
+  for (std::intptr_t page = start; page < end; page += page_size) {
+    pages.push_back(page);
+  }
+  if (not protect(pages, false)) {
+    return false;
+  }
+  int wait_status = 0;
+  const bool stepped =
+      timed_ptrace(Probe::PtraceStep, PTRACE_SINGLESTEP, pid_, nullptr,
+                   nullptr) != -1 and
+      waitpid(pid_, &wait_status, 0) == pid_ and WIFSTOPPED(wait_status) and
+      WSTOPSIG(wait_status) == SIGTRAP;
+  const bool protected_again = protect(pages, true);
+  return stepped and protected_again;
+}
+}  // namespace nebugger
@@ -0,0 +1,140 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <vector>
+
+#include "Fork.hpp"
+
+namespace nebugger {
+class InferiorMemory;
+class InstructionCache;
+
+/// A range of memory whose changes stop the process.
+struct WatchRegion {
+  std::size_t id;
+  std::intptr_t start;
+  // One past the last watched byte
+  std::intptr_t end;
+  // Number of writes that changed the watched bytes
+  std::size_t hits;
+};
+
+/// The change of a watched region by one instruction.
+struct WatchHit {
+  std::size_t id{0};
+  // Address of the instruction that wrote
+  std::intptr_t pc{0};
+  // The changed bytes [address, address + length) of the region, from the
+  // first to the last one that differs
+  std::intptr_t address{0};
+  std::size_t length{0};
+  std::array<uint8_t, 64> old_bytes{};
+  std::array<uint8_t, 64> new_bytes{};
+};
+
+/// What `RegionWatchpoints::handle_fault` made of a SIGSEGV.
+enum class WatchFault {
+  // Not caused by a watch region, a real fault of the process
+  NotWatched,
+  // A write that changed no watched byte, the process can go on
+  Resume,
+  // A watched region was changed, see `WatchHit`
+  Hit,
+  // The write could not be carried out
+  Failed
+};
+
+/// Watchpoints on memory regions of any size.
+///
+/// Hardware debug registers watch at most four aligned 8 byte locations. To
+/// watch whole buffers the pages holding them are made read-only with an
+/// `mprotect` injected into the process, so a write into them stops it with a
+/// SIGSEGV while all other code runs at full speed. The debugger then carries
+/// out the faulting write itself, with `emulate_instruction` if possible and
+/// otherwise by single-stepping it with the protection lifted, and compares
+/// the watched bytes it may have touched.
+///
+/// The kernel cannot write into the protected pages either, a `read` into a
+/// watched buffer would fail with EFAULT. So while regions are watched the
+/// process is resumed with PTRACE_SYSCALL, and a system call whose arguments
+/// may point into the protected pages is skipped at its entry and run again
+/// with the protection lifted, see `handle_syscall`. Writes made by system
+/// calls are not reported, neither are writes by other processes into
+/// shared memory. Single-stepping a `syscall` instruction that writes into
+/// the pages still fails.
+class RegionWatchpoints {
+ public:
+  RegionWatchpoints(pid_t pid, InferiorMemory& memory,
+                    InstructionCache& instructions)
+      : pid_(pid), memory_(memory), instructions_(instructions) {}
+
+  /// Watch the `length` bytes at `address`, which must be writable. Returns
+  /// the id of the region, 0 on failure.
+  std::size_t add(std::intptr_t address, std::size_t length);
+
+  /// Stop watching the region `id`, giving its pages their protection back.
+  bool remove(std::size_t id);
+
+  /// The watched regions, in the order they were added.
+  const std::vector<WatchRegion>& regions() const noexcept {
+    return regions_;
+  }
+
+  /// The pages protected for the regions, for removing them from a forked
+  /// child.
+  std::vector<ProtectedPages> protected_pages() const;
+
+  /// Whether the process needs to be resumed with PTRACE_SYSCALL.
+  bool watching() const noexcept { return not pages_.empty(); }
+
+  /// Handle a stop at the entry or exit of a system call. Returns false if
+  /// the protection could not be lifted or put back.
+  bool handle_syscall();
+
+  /// Handle the SIGSEGV the process is stopped with. Unless it is
+  /// `NotWatched` the faulting instruction has been executed afterwards and
+  /// the process can be resumed without the signal.
+  WatchFault handle_fault(WatchHit& hit);
+
+  /// Lift the protection of all watched pages, or put it back if `watch` is
+  /// true.
+  bool protect_all(bool watch);
+
+ private:
+  // Give the sorted `pages`, which are in `pages_`, their original
+  // protection, without PROT_WRITE if `watch` is true.
+  bool protect(const std::vector<std::intptr_t>& pages, bool watch);
+  // Execute the instruction at the program counter, which faulted writing
+  // into the protected pages [start, end).
+  bool execute_write(std::intptr_t start, std::intptr_t end);
+  // Whether the system call `number` may write into the protected pages. An
+  // argument pointing into memory is taken to be followed by the size of it.
+  bool may_write_pages(uint64_t number,
+                       const std::array<uint64_t, 6>& args) const;
+
+  pid_t pid_;
+  InferiorMemory& memory_;
+  InstructionCache& instructions_;
+  std::vector<WatchRegion> regions_{};
+  // Original protection of the protected pages
+  std::map<std::intptr_t, int> pages_{};
+  std::size_t next_id_{1};
+  // The registers at the entry of the system call that was skipped
+  user_regs_struct skipped_call_{};
+  bool skipped_{false};
+  // The skipped call runs with the protection lifted
+  bool lifted_{false};
+};
+}  // namespace nebugger
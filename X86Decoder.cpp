@@ -0,0 +1,477 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#include "X86Decoder.hpp"
+
+#include <cstring>
+
+namespace nebugger {
+namespace {
+// Kinds of immediates following the opcode (and ModRM/SIB/displacement).
+enum class Immediate : uint8_t {
+  None,
+  Byte,
+  Word,
+  // 16 or 32 bits depending on the operand size prefix
+  WordOrDword,
+  // enter: 16 bit followed by 8 bit
+  WordAndByte,
+  // mov r64, imm64 with REX.W, otherwise WordOrDword
+  Full,
+  // Memory offset of mov al/eax, moffs: 64 or 32 bits depending on the
+  // address size prefix
+  MemoryOffset,
+  // Relative branch displacements
+  Relative8,
+  Relative32
+};
+
+// Whether a one-byte opcode is followed by a ModRM byte.
+bool one_byte_has_modrm(const uint8_t opcode) noexcept {
+  if (opcode < 0x40) {
+    return (opcode & 0x7) < 4;
+  }
+  switch (opcode) {
+    case 0x63:
+    case 0x69:
+    case 0x6b:
+    case 0xc0:
+    case 0xc1:
+    case 0xc6:
+    case 0xc7:
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+    case 0xf6:
+    case 0xf7:
+    case 0xfe:
+    case 0xff:
+      return true;
+    default:
+      return (opcode >= 0x80 and opcode <= 0x8f) or
+             (opcode >= 0xd8 and opcode <= 0xdf);
+  }
+}
+
+Immediate one_byte_immediate(const uint8_t opcode,
+                             const uint8_t modrm_reg) noexcept {
+  if (opcode < 0x40) {
+    switch (opcode & 0x7) {
+      case 4:
+        return Immediate::Byte;
+      case 5:
+        return Immediate::WordOrDword;
+      default:
+        return Immediate::None;
+    }
+  }
+  if (opcode >= 0x70 and opcode <= 0x7f) {
+    return Immediate::Relative8;
+  }
+  if (opcode >= 0xb0 and opcode <= 0xb7) {
+    return Immediate::Byte;
+  }
+  if (opcode >= 0xb8 and opcode <= 0xbf) {
+    return Immediate::Full;
+  }
+  if (opcode >= 0xa0 and opcode <= 0xa3) {
+    return Immediate::MemoryOffset;
+  }
+  switch (opcode) {
+    case 0x68:
+    case 0x69:
+    case 0x81:
+    case 0xa9:
+    case 0xc7:
+      return Immediate::WordOrDword;
+    case 0x6a:
+    case 0x6b:
+    case 0x80:
+    case 0x83:
+    case 0xa8:
+    case 0xc0:
+    case 0xc1:
+    case 0xc6:
+    case 0xcd:
+    case 0xe4:
+    case 0xe5:
+    case 0xe6:
+    case 0xe7:
+      return Immediate::Byte;
+    case 0xc2:
+    case 0xca:
+      return Immediate::Word;
+    case 0xc8:
+      return Immediate::WordAndByte;
+    case 0xe0:
+    case 0xe1:
+    case 0xe2:
+    case 0xe3:
+    case 0xeb:
+      return Immediate::Relative8;
+    case 0xe8:
+    case 0xe9:
+      return Immediate::Relative32;
+    case 0xf6:
+      return modrm_reg < 2 ? Immediate::Byte : Immediate::None;
+    case 0xf7:
+      return modrm_reg < 2 ? Immediate::WordOrDword : Immediate::None;
+    default:
+      return Immediate::None;
+  }
+}
+
+bool one_byte_is_invalid(const uint8_t opcode) noexcept {
+  switch (opcode) {
+    case 0x06:
+    case 0x07:
+    case 0x0e:
+    case 0x16:
+    case 0x17:
+    case 0x1e:
+    case 0x1f:
+    case 0x27:
+    case 0x2f:
+    case 0x37:
+    case 0x3f:
+    case 0x60:
+    case 0x61:
+    case 0x82:
+    case 0x9a:
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xea:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool two_byte_has_modrm(const uint8_t opcode) noexcept {
+  if ((opcode >= 0x30 and opcode <= 0x37) or
+      (opcode >= 0x80 and opcode <= 0x8f) or
+      (opcode >= 0xc8 and opcode <= 0xcf)) {
+    return false;
+  }
+  switch (opcode) {
+    case 0x05:
+    case 0x06:
+    case 0x07:
+    case 0x08:
+    case 0x09:
+    case 0x0b:
+    case 0x0e:
+    case 0x77:
+    case 0xa0:
+    case 0xa1:
+    case 0xa2:
+    case 0xa8:
+    case 0xa9:
+    case 0xaa:
+      return false;
+    default:
+      return true;
+  }
+}
+
+Immediate two_byte_immediate(const uint8_t opcode) noexcept {
+  if (opcode >= 0x80 and opcode <= 0x8f) {
+    return Immediate::Relative32;
+  }
+  switch (opcode) {
+    case 0x0f:
+    case 0x70:
+    case 0x71:
+    case 0x72:
+    case 0x73:
+    case 0xa4:
+    case 0xac:
+    case 0xba:
+    case 0xc2:
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+      return Immediate::Byte;
+    default:
+      return Immediate::None;
+  }
+}
+
+FlowKind one_byte_flow(const uint8_t opcode, const uint8_t modrm_reg) noexcept {
+  if ((opcode >= 0x70 and opcode <= 0x7f) or
+      (opcode >= 0xe0 and opcode <= 0xe3)) {
+    return FlowKind::ConditionalJump;
+  }
+  switch (opcode) {
+    case 0xe8:
+      return FlowKind::Call;
+    case 0xe9:
+    case 0xeb:
+      return FlowKind::Jump;
+    case 0xc2:
+    case 0xc3:
+    case 0xca:
+    case 0xcb:
+    case 0xcf:
+      return FlowKind::Return;
+    case 0xcc:
+    case 0xcd:
+    case 0xf1:
+    case 0xf4:
+      return FlowKind::Trap;
+    case 0xff:
+      if (modrm_reg == 2 or modrm_reg == 3) {
+        return FlowKind::IndirectCall;
+      }
+      if (modrm_reg == 4 or modrm_reg == 5) {
+        return FlowKind::IndirectJump;
+      }
+      return FlowKind::Sequential;
+    default:
+      return FlowKind::Sequential;
+  }
+}
+
+FlowKind two_byte_flow(const uint8_t opcode) noexcept {
+  if (opcode >= 0x80 and opcode <= 0x8f) {
+    return FlowKind::ConditionalJump;
+  }
+  switch (opcode) {
+    case 0x05:
+    case 0x34:
+      return FlowKind::Syscall;
+    case 0x07:
+    case 0x35:
+      return FlowKind::Return;
+    case 0x0b:
+      return FlowKind::Trap;
+    default:
+      return FlowKind::Sequential;
+  }
+}
+
+int64_t read_signed(const uint8_t* bytes, const std::size_t size) noexcept {
+  switch (size) {
+    case 1:
+      return static_cast<int8_t>(bytes[0]);
+    case 2: {
+      int16_t value;
+      std::memcpy(&value, bytes, sizeof(value));
+      return value;
+    }
+    case 4: {
+      int32_t value;
+      std::memcpy(&value, bytes, sizeof(value));
+      return value;
+    }
+    case 8: {
+      int64_t value;
+      std::memcpy(&value, bytes, sizeof(value));
+      return value;
+    }
+    default:
+      return 0;
+  }
+}
+}  // namespace
+
+Instruction decode_instruction(const uint8_t* const bytes,
+                               const std::size_t size,
+                               const std::intptr_t address) {
+  Instruction insn{};
+  insn.address = address;
+  // x86 instructions are at most 15 bytes long
+  const std::size_t limit = size < 15 ? size : 15;
+  std::size_t pos = 0;
+
+  // Legacy prefixes
+  for (; pos < limit; ++pos) {
+    const uint8_t byte = bytes[pos];
+    if (byte == 0x66) {
+      insn.operand_size_prefix = true;
+    } else if (byte == 0x67) {
+      insn.address_size_prefix = true;
+    } else if (byte == 0xf3) {
+      insn.rep_prefix = true;
+    } else if (byte == 0xf2) {
+      insn.repne_prefix = true;
+    } else if (byte == 0xf0) {
+      insn.lock_prefix = true;
+    } else if (byte != 0x2e and byte != 0x36 and byte != 0x3e and
+               byte != 0x26 and byte != 0x64 and byte != 0x65) {
+      break;
+    }
+  }
+  // REX has to directly precede the opcode
+  if (pos < limit and (bytes[pos] & 0xf0) == 0x40) {
+    insn.rex = bytes[pos++];
+  }
+  if (pos >= limit) {
+    return insn;
+  }
+
+  Immediate immediate = Immediate::None;
+  bool has_modrm = false;
+  const uint8_t first = bytes[pos];
+  if (first == 0xc4 or first == 0xc5 or first == 0x62) {
+    // VEX (C4/C5) and EVEX (62) encoded instructions. In 64-bit mode these
+    // bytes cannot start a legacy instruction.
+    insn.vex = true;
+    const std::size_t prefix_size = first == 0xc5 ? 2 : (first == 0xc4 ? 3 : 4);
+    if (pos + prefix_size >= limit) {
+      return insn;
+    }
+    if (first == 0xc5) {
+      insn.opcode_map = 1;
+      // Inverted R bit and W=0
+      insn.rex = static_cast<uint8_t>(0x40 | ((~bytes[pos + 1] >> 5) & 0x4));
+    } else {
+      insn.opcode_map =
+          static_cast<uint8_t>(bytes[pos + 1] & (first == 0xc4 ? 0x1f : 0x7));
+      insn.rex = static_cast<uint8_t>(0x40 | ((~bytes[pos + 1] >> 5) & 0x7) |
+                                      ((bytes[pos + 2] >> 4) & 0x8));
+    }
+    pos += prefix_size;
+    insn.opcode_offset = static_cast<uint8_t>(pos);
+    insn.opcode = bytes[pos++];
+    // vzeroupper/vzeroall are the only VEX instructions without ModRM
+    has_modrm = not(insn.opcode_map == 1 and insn.opcode == 0x77);
+    if (insn.opcode_map == 3 or
+        (insn.opcode_map == 1 and
+         ((insn.opcode >= 0x70 and insn.opcode <= 0x73) or
+          insn.opcode == 0xc2 or
+          (insn.opcode >= 0xc4 and insn.opcode <= 0xc6)))) {
+      immediate = Immediate::Byte;
+    }
+  } else if (first == 0x0f) {
+    if (pos + 1 >= limit) {
+      return insn;
+    }
+    const uint8_t second = bytes[pos + 1];
+    if (second == 0x38 or second == 0x3a) {
+      if (pos + 2 >= limit) {
+        return insn;
+      }
+      insn.opcode_map = second == 0x38 ? 2 : 3;
+      insn.opcode_offset = static_cast<uint8_t>(pos + 2);
+      insn.opcode = bytes[pos + 2];
+      pos += 3;
+      has_modrm = true;
+      immediate = second == 0x3a ? Immediate::Byte : Immediate::None;
+    } else {
+      insn.opcode_map = 1;
+      insn.opcode_offset = static_cast<uint8_t>(pos + 1);
+      insn.opcode = second;
+      pos += 2;
+      has_modrm = two_byte_has_modrm(second);
+      immediate = two_byte_immediate(second);
+      insn.flow = two_byte_flow(second);
+    }
+  } else {
+    if (one_byte_is_invalid(first)) {
+      return insn;
+    }
+    insn.opcode_offset = static_cast<uint8_t>(pos);
+    insn.opcode = first;
+    ++pos;
+    has_modrm = one_byte_has_modrm(first);
+  }
+
+  if (has_modrm) {
+    if (pos >= limit) {
+      return insn;
+    }
+    insn.has_modrm = true;
+    insn.modrm = bytes[pos++];
+    const uint8_t mod = insn.modrm_mod();
+    const uint8_t rm = insn.modrm_rm();
+    if (mod != 3) {
+      if (rm == 4) {
+        if (pos >= limit) {
+          return insn;
+        }
+        insn.has_sib = true;
+        insn.sib = bytes[pos++];
+        if (mod == 0 and (insn.sib & 0x7) == 5) {
+          insn.displacement_size = 4;
+        }
+      } else if (mod == 0 and rm == 5) {
+        insn.rip_relative = true;
+        insn.displacement_size = 4;
+      }
+      if (mod == 1) {
+        insn.displacement_size = 1;
+      } else if (mod == 2) {
+        insn.displacement_size = 4;
+      }
+    }
+    if (insn.displacement_size != 0) {
+      if (pos + insn.displacement_size > limit) {
+        return insn;
+      }
+      insn.displacement_offset = static_cast<uint8_t>(pos);
+      insn.displacement =
+          static_cast<int32_t>(read_signed(bytes + pos, insn.displacement_size));
+      pos += insn.displacement_size;
+    }
+  }
+
+  if (not insn.vex and insn.opcode_map == 0) {
+    immediate = one_byte_immediate(insn.opcode, insn.modrm_reg());
+    insn.flow = one_byte_flow(insn.opcode, insn.modrm_reg());
+  }
+
+  std::size_t immediate_size = 0;
+  switch (immediate) {
+    case Immediate::None:
+      break;
+    case Immediate::Byte:
+      immediate_size = 1;
+      break;
+    case Immediate::Word:
+      immediate_size = 2;
+      break;
+    case Immediate::WordOrDword:
+      immediate_size = insn.operand_size_prefix ? 2 : 4;
+      break;
+    case Immediate::WordAndByte:
+      immediate_size = 3;
+      break;
+    case Immediate::Full:
+      immediate_size = insn.rex_w() ? 8 : (insn.operand_size_prefix ? 2 : 4);
+      break;
+    case Immediate::MemoryOffset:
+      immediate_size = insn.address_size_prefix ? 4 : 8;
+      break;
+    case Immediate::Relative8:
+      immediate_size = 1;
+      insn.relative_branch = true;
+      break;
+    case Immediate::Relative32:
+      immediate_size = 4;
+      insn.relative_branch = true;
+      break;
+  }
+  if (immediate_size != 0) {
+    if (pos + immediate_size > limit) {
+      return insn;
+    }
+    insn.immediate_offset = static_cast<uint8_t>(pos);
+    insn.immediate_size = static_cast<uint8_t>(immediate_size);
+    insn.immediate = immediate == Immediate::WordAndByte
+                         ? read_signed(bytes + pos, 2)
+                         : read_signed(bytes + pos, immediate_size);
+    pos += immediate_size;
+  }
+
+  insn.length = static_cast<uint8_t>(pos);
+  insn.valid = true;
+  return insn;
+}
+}  // namespace nebugger
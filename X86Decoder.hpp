@@ -0,0 +1,95 @@
+/*!
+ * @copyright Nils Deppe 2018
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE.md or copy at
+ * http://boost.org/LICENSE_1_0.txt)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nebugger {
+/// How an instruction affects control flow.
+enum class FlowKind : uint8_t {
+  Sequential,
+  Jump,
+  ConditionalJump,
+  Call,
+  Return,
+  IndirectJump,
+  IndirectCall,
+  // int3, int N, ud2, hlt, ...
+  Trap,
+  Syscall
+};
+
+/// The structure of a single decoded x86-64 instruction.
+///
+/// Offsets are relative to the first byte of the instruction. A size of zero
+/// means the instruction has no such component.
+struct Instruction {
+  std::intptr_t address{0};
+  uint8_t length{0};
+  bool valid{false};
+
+  // Legacy prefixes that change how the instruction is decoded
+  bool operand_size_prefix{false};
+  bool address_size_prefix{false};
+  bool rep_prefix{false};
+  bool repne_prefix{false};
+  bool lock_prefix{false};
+  // The REX prefix, 0 if there is none
+  uint8_t rex{0};
+  // 0 for the one-byte map, 1 for 0F, 2 for 0F 38 and 3 for 0F 3A
+  uint8_t opcode_map{0};
+  uint8_t opcode{0};
+  uint8_t opcode_offset{0};
+  // Set for instructions encoded with a VEX or EVEX prefix
+  bool vex{false};
+
+  bool has_modrm{false};
+  uint8_t modrm{0};
+  bool has_sib{false};
+  uint8_t sib{0};
+  bool rip_relative{false};
+
+  uint8_t displacement_offset{0};
+  uint8_t displacement_size{0};
+  int32_t displacement{0};
+
+  uint8_t immediate_offset{0};
+  uint8_t immediate_size{0};
+  // Sign-extended immediate, for relative branches this is the displacement
+  // of the branch target
+  int64_t immediate{0};
+
+  FlowKind flow{FlowKind::Sequential};
+  // True if the immediate is a branch displacement relative to the next
+  // instruction
+  bool relative_branch{false};
+
+  bool rex_w() const noexcept { return (rex & 0x8) != 0; }
+  uint8_t modrm_mod() const noexcept { return modrm >> 6; }
+  uint8_t modrm_reg() const noexcept { return (modrm >> 3) & 0x7; }
+  uint8_t modrm_rm() const noexcept { return modrm & 0x7; }
+
+  /// Target of a relative branch.
+  std::intptr_t branch_target() const noexcept {
+    return address + length + static_cast<std::intptr_t>(immediate);
+  }
+
+  /// Whether the instruction behaves identically at any address, i.e. can
+  /// be copied elsewhere without fixups.
+  bool is_position_independent() const noexcept {
+    return not rip_relative and not relative_branch;
+  }
+};
+
+/// Decode the instruction in `bytes`, which is located at `address` in the
+/// inferior. At most `size` bytes are looked at. The returned instruction is
+/// not `valid` if the bytes do not form a complete instruction.
+Instruction decode_instruction(const uint8_t* bytes, std::size_t size,
+                               std::intptr_t address);
+}  // namespace nebugger